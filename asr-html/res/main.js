@@ -34,7 +34,8 @@ var recIndex = 0;
 function sendBlob(blob) {
     var request = new XMLHttpRequest();
 
-    request.open("POST", URL);
+    // Audio is recorded at the native sample rate of the context
+    request.open("POST", URL + "?rate=" + audioContext.sampleRate);
 
     updateStatus("Sending data to " + URL)
     request.onreadystatechange=function() {
@@ -67,7 +68,8 @@ function gotBuffers( buffers ) {
 
     // the ONLY time gotBuffers is called is right after a new recording is completed - 
     // so here's where we should set up the download.
-    audioRecorder.exportMonoWAV( sendBlob );
+    // mono export is raw PCM rather than WAV, so it is not sent as audio/wav
+    audioRecorder.exportMonoWAV( sendBlob, "application/octet-stream" );
     //apiaiSend();
 }
 
@@ -60,47 +60,19 @@ function exportWAV(type){
   var bufferL = mergeBuffers(recBuffersL, recLength);
   var bufferR = mergeBuffers(recBuffersR, recLength);
   var interleaved = interleave(bufferL, bufferR);
-  var downsampledBuffer = downsampleBuffer(interleaved, 16000);
-  var dataview = encodeWAV(downsampledBuffer);
+  var dataview = encodeWAV(interleaved);
   var audioBlob = new Blob([dataview], { type: type });
 
   this.postMessage(audioBlob);
 }
 
-function downsampleBuffer(buffer, rate) {
-    var sampleRate = 44100;
-    if (rate == sampleRate) {
-        return buffer;
-    }
-    if (rate > sampleRate) {
-        throw "downsampling rate show be smaller than original sample rate";
-    }
-    var sampleRateRatio = sampleRate / rate;
-    var newLength = Math.round(buffer.length / sampleRateRatio);
-    var result = new Float32Array(newLength);
-    var offsetResult = 0;
-    var offsetBuffer = 0;
-    while (offsetResult < result.length) {
-        var nextOffsetBuffer = Math.round((offsetResult + 1) * sampleRateRatio);
-        var accum = 0, count = 0;
-        for (var i = offsetBuffer; i < nextOffsetBuffer && i < buffer.length; i++) {
-            accum += buffer[i];
-            count++;
-        }
-        result[offsetResult] = accum / count;
-        offsetResult++;
-        offsetBuffer = nextOffsetBuffer;
-    }
-    return result;
-}
-
 function exportMonoWAV(type){
   var bufferL = mergeBuffers(recBuffersL, recLength);
   //var dataview = encodeWAV(bufferL, true);
-  var d = downsampleBuffer(bufferL, 16000);
-  var buffer = new ArrayBuffer(d.length * 2);
+  // Raw PCM is sent at the native sample rate, the server resamples it
+  var buffer = new ArrayBuffer(bufferL.length * 2);
   var view = new DataView(buffer);
-  floatTo16BitPCM(view, 0, d);
+  floatTo16BitPCM(view, 0, bufferL);
   var audioBlob = new Blob([view], { type: type });
   this.postMessage(audioBlob);
 }
@@ -0,0 +1,71 @@
+#!/bin/bash
+# best-path-bench.sh
+
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+# WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# MERCHANTABLITY OR NON-INFRINGEMENT.
+# See the Apache 2 License for the specific language governing permissions and
+# limitations under the License.
+# Compares lattice search against best path only search (--fcgi-bestpath).
+# Starts the decoder twice in the current (model) directory and runs
+# fcgi-load-client against each with single result requests. Reports peak
+# resident memory growth over loaded models per concurrent stream, decoder
+# CPU time per request and the load client summary (real-time factor etc.).
+#
+# Usage: best-path-bench.sh <audio-dir> [decoder options...]
+
+if [ $# -lt 1 ]; then
+	echo "Usage: $0 <audio-dir> [decoder options...]" >&2
+	exit 1
+fi
+
+AUDIO_DIR=$1
+shift
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+DECODER=${DECODER:-$BENCH_DIR/../fcgi-nnet3-decoder}
+PORT=${PORT:-8123}
+CONCURRENCY=${CONCURRENCY:-8}
+REQUESTS=${REQUESTS:-64}
+CLK_TCK=$(getconf CLK_TCK)
+
+# User and system CPU time of the process in clock ticks
+cpu_ticks() {
+	awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+run_search() {
+	name=$1
+	shift
+	"$DECODER" --fcgi-socket=:$PORT "$@" 2>/dev/null &
+	pid=$!
+	# Wait for models to be loaded
+	while ! (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null; do
+		if ! kill -0 $pid 2>/dev/null; then
+			echo "Decoder failed to start" >&2
+			exit 1
+		fi
+		sleep 1
+	done
+	loaded_kb=$(awk '/^VmRSS/ { print $2 }' /proc/$pid/status)
+	start_ticks=$(cpu_ticks $pid)
+
+	summary=$("$BENCH_DIR/fcgi-load-client" --server=:$PORT --concurrency=$CONCURRENCY --requests=$REQUESTS \
+		--realtime=false --nbest=1 "$AUDIO_DIR")
+	peak_kb=$(awk '/^VmHWM/ { print $2 }' /proc/$pid/status)
+	cpu_ms=$(( ($(cpu_ticks $pid) - start_ticks) * 1000 / CLK_TCK / REQUESTS ))
+	echo "$name: stream_rss_kb=$(( (peak_kb - loaded_kb) / CONCURRENCY )) cpu_ms_per_request=$cpu_ms $summary"
+
+	kill $pid
+	wait $pid 2>/dev/null
+}
+
+run_search lattice --fcgi-bestpath=false "$@"
+run_search bestpath --fcgi-bestpath=true "$@"
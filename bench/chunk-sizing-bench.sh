@@ -0,0 +1,65 @@
+#!/bin/bash
+# chunk-sizing-bench.sh
+
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+# WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# MERCHANTABLITY OR NON-INFRINGEMENT.
+# See the Apache 2 License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares fixed and adaptive chunk sizing on live and upload traffic.
+# Starts the decoder twice in the current (model) directory, with chunk
+# length fixed and with default adaptive limits, and runs fcgi-load-client
+# against each: live streams at real-time pace with intermediate results,
+# and whole-file uploads sent as fast as possible.
+#
+# Usage: chunk-sizing-bench.sh <audio-dir> [decoder options...]
+
+if [ $# -lt 1 ]; then
+	echo "Usage: $0 <audio-dir> [decoder options...]" >&2
+	exit 1
+fi
+
+AUDIO_DIR=$1
+shift
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+DECODER=${DECODER:-$BENCH_DIR/../fcgi-nnet3-decoder}
+PORT=${PORT:-8123}
+CONCURRENCY=${CONCURRENCY:-8}
+REQUESTS=${REQUESTS:-64}
+
+run_shapes() {
+	name=$1
+	shift
+	"$DECODER" --fcgi-socket=:$PORT "$@" 2>/dev/null &
+	pid=$!
+	# Wait for models to be loaded
+	while ! (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null; do
+		if ! kill -0 $pid 2>/dev/null; then
+			echo "Decoder failed to start" >&2
+			exit 1
+		fi
+		sleep 1
+	done
+
+	printf '%s live: ' "$name"
+	"$BENCH_DIR/fcgi-load-client" --server=:$PORT --concurrency=$CONCURRENCY --requests=$REQUESTS \
+		--realtime=true --intermediate=300 "$AUDIO_DIR"
+	printf '%s upload: ' "$name"
+	"$BENCH_DIR/fcgi-load-client" --server=:$PORT --concurrency=$CONCURRENCY --requests=$REQUESTS \
+		--realtime=false --chunk-ms=1000 "$AUDIO_DIR"
+
+	kill $pid
+	wait $pid 2>/dev/null
+}
+
+run_shapes fixed --min-chunk-length=0 --max-chunk-length=0 "$@"
+run_shapes adaptive "$@"
@@ -0,0 +1,428 @@
+// fcgi-load-client.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FcgiProtocol.h"
+#include "Timing.h"
+#include "util/parse-options.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace apiai;
+
+const int REQUEST_ID = 1;
+const size_t BYTES_PER_MILLISECOND = 16000 * 2 / 1000;
+const int RESPONSE_TIMEOUT_MS = 60000;
+
+struct AudioFile {
+	std::string name;
+	std::string data;
+};
+
+/** Timings of single request, in milliseconds */
+struct RequestStats {
+	RequestStats() : ok(false), audio_ms(0), total_ms(0), first_partial_ms(-1), final_ms(-1) {};
+
+	bool ok;
+	milliseconds_t audio_ms;
+	/** From connection start to the end of response */
+	milliseconds_t total_ms;
+	/** From connection start to the first intermediate result, -1 if none */
+	milliseconds_t first_partial_ms;
+	/** From the last audio byte sent to the end of response */
+	milliseconds_t final_ms;
+};
+
+struct LoadOptions {
+	std::string server;
+	std::string query_string;
+	kaldi::int32 concurrency;
+	kaldi::int32 requests;
+	kaldi::int32 chunk_ms;
+	bool realtime;
+};
+
+/**
+ * Shared state of client threads
+ */
+struct LoadState {
+	const LoadOptions *options;
+	const std::vector<AudioFile> *files;
+
+	pthread_mutex_t mutex;
+	kaldi::int32 next_request;
+	std::vector<RequestStats> stats;
+};
+
+static bool ReadFiles(const std::string &dir, std::vector<AudioFile> *files) {
+	DIR *d = opendir(dir.c_str());
+	if (d == NULL) {
+		KALDI_WARN << "Failed to open directory " << dir << ": " << strerror(errno);
+		return false;
+	}
+	std::vector<std::string> names;
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		if (entry->d_name[0] != '.') {
+			names.push_back(entry->d_name);
+		}
+	}
+	closedir(d);
+	std::sort(names.begin(), names.end());
+
+	for (size_t i = 0; i < names.size(); i++) {
+		std::ifstream in((dir + "/" + names[i]).c_str(), std::ios::binary);
+		if (!in) {
+			continue;
+		}
+		AudioFile file;
+		file.name = names[i];
+		std::ostringstream data;
+		data << in.rdbuf();
+		file.data = data.str();
+		if (file.data.size() >= 2) {
+			files->push_back(file);
+		}
+	}
+	return files->size() > 0;
+}
+
+/**
+ * Connect to server given as [host]:port or unix socket path,
+ * same as --fcgi-socket option of the decoder
+ */
+static int Connect(const std::string &server) {
+	size_t colon = server.rfind(':');
+	if (colon == std::string::npos) {
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, server.c_str(), sizeof(address.sun_path) - 1);
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+			close(fd);
+			fd = -1;
+		}
+		return fd;
+	}
+
+	std::string host = colon > 0 ? server.substr(0, colon) : "127.0.0.1";
+	std::string port = server.substr(colon + 1);
+	struct addrinfo hints, *addresses;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+		return -1;
+	}
+	int fd = -1;
+	for (struct addrinfo *a = addresses; a != NULL && fd < 0; a = a->ai_next) {
+		fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(addresses);
+	return fd;
+}
+
+static bool WriteAll(int fd, const std::string &data) {
+	size_t pos = 0;
+	while (pos < data.size()) {
+		ssize_t count = write(fd, data.data() + pos, data.size() - pos);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			return false;
+		}
+		pos += count;
+	}
+	return true;
+}
+
+/**
+ * Send single recognition request, audio sent in chunk_ms pieces
+ * either paced in real time or as fast as possible
+ */
+static RequestStats RunRequest(const LoadOptions &options, const AudioFile &file) {
+	RequestStats stats;
+	stats.audio_ms = file.data.size() / BYTES_PER_MILLISECOND;
+
+	milliseconds_t start = getMilliseconds();
+	int fd = Connect(options.server);
+	if (fd < 0) {
+		KALDI_WARN << "Failed to connect to " << options.server << ": " << strerror(errno);
+		return stats;
+	}
+
+	std::string records, params;
+	std::ostringstream content_length;
+	content_length << file.data.size();
+	FcgiProtocol::AppendParam(&params, "REQUEST_METHOD", "POST");
+	FcgiProtocol::AppendParam(&params, "QUERY_STRING", options.query_string);
+	FcgiProtocol::AppendParam(&params, "CONTENT_TYPE", "application/octet-stream");
+	FcgiProtocol::AppendParam(&params, "CONTENT_LENGTH", content_length.str());
+	FcgiProtocol::AppendBeginRequest(&records, REQUEST_ID, FcgiProtocol::RESPONDER, 0);
+	FcgiProtocol::AppendRecord(&records, FcgiProtocol::PARAMS, REQUEST_ID, params.data(), params.size());
+	FcgiProtocol::AppendRecord(&records, FcgiProtocol::PARAMS, REQUEST_ID, NULL, 0);
+
+	const size_t chunk_size = std::max<size_t>(2, options.chunk_ms * BYTES_PER_MILLISECOND);
+	size_t sent = 0;
+	bool input_done = false;
+	bool response_done = false;
+	milliseconds_t input_done_time = 0;
+	std::string received, output;
+	char buffer[16 * 1024];
+
+	while (!response_done) {
+		milliseconds_t now = getMilliseconds();
+		int poll_timeout = RESPONSE_TIMEOUT_MS;
+		if (!input_done) {
+			milliseconds_t send_time = options.realtime ? start + milliseconds_t(sent / BYTES_PER_MILLISECOND) : now;
+			if (now >= send_time) {
+				size_t length = std::min(chunk_size, file.data.size() - sent);
+				FcgiProtocol::AppendRecord(&records, FcgiProtocol::STDIN, REQUEST_ID, file.data.data() + sent, length);
+				sent += length;
+				if (sent == file.data.size()) {
+					FcgiProtocol::AppendRecord(&records, FcgiProtocol::STDIN, REQUEST_ID, NULL, 0);
+					input_done = true;
+				}
+				if (!WriteAll(fd, records)) {
+					break;
+				}
+				records.clear();
+				if (input_done) {
+					input_done_time = getMilliseconds();
+				} else {
+					poll_timeout = 0;
+				}
+			} else {
+				poll_timeout = send_time - now;
+			}
+		}
+
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int ready = poll(&pfd, 1, poll_timeout);
+		if (ready < 0 && errno != EINTR) {
+			break;
+		}
+		if (ready <= 0) {
+			if (input_done && ready == 0) {
+				KALDI_WARN << "Response timeout for " << file.name;
+				break;
+			}
+			continue;
+		}
+
+		ssize_t count = read(fd, buffer, sizeof(buffer));
+		if (count <= 0) {
+			break;
+		}
+		received.append(buffer, count);
+
+		size_t pos = 0;
+		while (received.size() - pos >= FcgiProtocol::HEADER_LENGTH) {
+			FcgiProtocol::Header header;
+			FcgiProtocol::ParseHeader(received.data() + pos, &header);
+			if (received.size() - pos < header.RecordLength()) {
+				break;
+			}
+			if (header.type == FcgiProtocol::STDOUT) {
+				output.append(received.data() + pos + FcgiProtocol::HEADER_LENGTH, header.content_length);
+				if (stats.first_partial_ms < 0 && output.find("\"status\":\"intermediate\"") != std::string::npos) {
+					stats.first_partial_ms = getMillisecondsSince(start);
+				}
+			} else if (header.type == FcgiProtocol::END_REQUEST) {
+				response_done = true;
+			}
+			pos += header.RecordLength();
+		}
+		received.erase(0, pos);
+	}
+	close(fd);
+
+	if (response_done && input_done) {
+		stats.total_ms = getMillisecondsSince(start);
+		stats.final_ms = getMilliseconds() - input_done_time;
+		stats.ok = output.find("\"status\":\"ok\"") != std::string::npos;
+	}
+	if (!stats.ok) {
+		KALDI_WARN << "Request failed for " << file.name;
+	}
+	return stats;
+}
+
+static void *RunClientThread(void *arg) {
+	LoadState *state = static_cast<LoadState*>(arg);
+	while (true) {
+		pthread_mutex_lock(&state->mutex);
+		kaldi::int32 index = state->next_request++;
+		pthread_mutex_unlock(&state->mutex);
+		if (index >= state->options->requests) {
+			break;
+		}
+
+		const AudioFile &file = state->files->at(index % state->files->size());
+		RequestStats stats = RunRequest(*(state->options), file);
+
+		pthread_mutex_lock(&state->mutex);
+		state->stats.push_back(stats);
+		pthread_mutex_unlock(&state->mutex);
+	}
+	return NULL;
+}
+
+/** Nearest-rank percentile of sorted values */
+static milliseconds_t Percentile(const std::vector<milliseconds_t> &sorted, double p) {
+	size_t rank = size_t(p / 100.0 * sorted.size() + 0.999999);
+	return sorted[std::max<size_t>(1, std::min(rank, sorted.size())) - 1];
+}
+
+static void WriteLatency(std::ostream &out, const std::string &name, std::vector<milliseconds_t> values) {
+	std::sort(values.begin(), values.end());
+	out << "\"" << name << "\":{\"count\":" << values.size();
+	if (values.size() > 0) {
+		out << ",\"p50\":" << Percentile(values, 50)
+			<< ",\"p95\":" << Percentile(values, 95)
+			<< ",\"p99\":" << Percentile(values, 99)
+			<< ",\"max\":" << values.back();
+	}
+	out << "}";
+}
+
+int main(int argc, char *argv[]) {
+	const char *usage = "Replays raw 16 KHz 16 bit mono PCM files against FastCGI decoder "
+			"and prints JSON summary of throughput and latencies.\n"
+			"Usage: fcgi-load-client [options] <audio-dir>\n"
+			"e.g.: fcgi-load-client --server=:8000 --concurrency=8 --realtime=true --intermediate=500 audio/\n";
+	kaldi::ParseOptions po(usage);
+
+	LoadOptions options;
+	options.server = ":8000";
+	options.concurrency = 1;
+	options.requests = 0;
+	options.chunk_ms = 100;
+	options.realtime = false;
+	kaldi::int32 intermediate = 0;
+	kaldi::int32 nbest = 0;
+	std::string multipart;
+	po.Register("server", &options.server, "Decoder FastCGI socket: [host]:port or unix socket path");
+	po.Register("concurrency", &options.concurrency, "Number of simultaneous requests");
+	po.Register("requests", &options.requests, "Total number of requests, files are replayed round-robin. "
+			"Every file sent once if non-positive");
+	po.Register("chunk-ms", &options.chunk_ms, "Audio sent in chunks of given length in milliseconds");
+	po.Register("realtime", &options.realtime, "Send audio at real-time pace instead of as fast as possible");
+	po.Register("intermediate", &intermediate, "Value of \"intermediate\" request parameter, not sent if non-positive");
+	po.Register("nbest", &nbest, "Value of \"nbest\" request parameter, not sent if non-positive");
+	po.Register("multipart", &multipart, "Value of \"multipart\" request parameter, not sent if empty");
+	po.Read(argc, argv);
+
+	if (po.NumArgs() != 1) {
+		po.PrintUsage();
+		return 1;
+	}
+
+	std::vector<AudioFile> files;
+	if (!ReadFiles(po.GetArg(1), &files)) {
+		KALDI_WARN << "No audio files found in " << po.GetArg(1);
+		return 1;
+	}
+
+	std::ostringstream query;
+	if (intermediate > 0) {
+		query << "&intermediate=" << intermediate;
+	}
+	if (nbest > 0) {
+		query << "&nbest=" << nbest;
+	}
+	if (multipart.size() > 0) {
+		query << "&multipart=" << multipart;
+	}
+	options.query_string = query.str().size() > 0 ? query.str().substr(1) : "";
+	if (options.requests <= 0) {
+		options.requests = files.size();
+	}
+	options.concurrency = std::max(1, options.concurrency);
+
+	LoadState state;
+	state.options = &options;
+	state.files = &files;
+	state.next_request = 0;
+	pthread_mutex_init(&state.mutex, NULL);
+
+	milliseconds_t start = getMilliseconds();
+	std::vector<pthread_t> threads(options.concurrency);
+	for (size_t i = 0; i < threads.size(); i++) {
+		pthread_create(&threads[i], NULL, RunClientThread, &state);
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		pthread_join(threads[i], NULL);
+	}
+	milliseconds_t wall_ms = std::max<milliseconds_t>(1, getMillisecondsSince(start));
+	pthread_mutex_destroy(&state.mutex);
+
+	size_t errors = 0;
+	milliseconds_t audio_ms = 0, processing_ms = 0;
+	std::vector<milliseconds_t> first_partial, final;
+	for (size_t i = 0; i < state.stats.size(); i++) {
+		const RequestStats &stats = state.stats[i];
+		if (!stats.ok) {
+			errors++;
+			continue;
+		}
+		audio_ms += stats.audio_ms;
+		processing_ms += stats.total_ms;
+		if (stats.first_partial_ms >= 0) {
+			first_partial.push_back(stats.first_partial_ms);
+		}
+		final.push_back(stats.final_ms);
+	}
+
+	std::cout << "{\"requests\":" << state.stats.size()
+			<< ",\"errors\":" << errors
+			<< ",\"concurrency\":" << options.concurrency
+			<< ",\"realtime\":" << (options.realtime ? "true" : "false")
+			<< ",\"query_string\":\"" << options.query_string << "\""
+			<< ",\"wall_seconds\":" << wall_ms / 1000.0
+			<< ",\"audio_seconds\":" << audio_ms / 1000.0
+			<< ",\"requests_per_second\":" << (state.stats.size() - errors) * 1000.0 / wall_ms
+			<< ",\"audio_seconds_per_second\":" << double(audio_ms) / wall_ms
+			<< ",\"real_time_factor\":" << (audio_ms > 0 ? double(processing_ms) / audio_ms : 0)
+			<< ",";
+	WriteLatency(std::cout, "first_partial_ms", first_partial);
+	std::cout << ",";
+	WriteLatency(std::cout, "final_ms", final);
+	std::cout << "}" << std::endl;
+
+	return errors > 0 ? 2 : 0;
+}
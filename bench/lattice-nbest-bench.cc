@@ -0,0 +1,118 @@
+// lattice-nbest-bench.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LatticeNbest.h"
+#include "Timing.h"
+#include "lat/lattice-functions.h"
+#include "util/parse-options.h"
+#include "base/kaldi-math.h"
+#include <vector>
+
+using namespace apiai;
+
+/**
+ * Word lattice resembling decoder output: states are word boundaries,
+ * every state has several alternative words ending at the next few states
+ */
+static void GenerateLattice(kaldi::int32 words, kaldi::int32 alternatives, kaldi::CompactLattice *clat) {
+	clat->DeleteStates();
+	for (kaldi::int32 s = 0; s <= words; s++) {
+		clat->AddState();
+	}
+	clat->SetStart(0);
+	clat->SetFinal(words, kaldi::CompactLatticeWeight::One());
+	for (kaldi::int32 s = 0; s < words; s++) {
+		for (kaldi::int32 a = 0; a < alternatives; a++) {
+			kaldi::int32 next = std::min(words, s + 1 + kaldi::Rand() % 3);
+			std::vector<kaldi::int32> alignment(10 + kaldi::Rand() % 30, 1 + kaldi::Rand() % 3000);
+			kaldi::CompactLatticeWeight weight(kaldi::LatticeWeight(kaldi::RandUniform() * 10,
+					kaldi::RandUniform() * 100), alignment);
+			kaldi::int32 word = 1 + kaldi::Rand() % 50000;
+			clat->AddArc(s, kaldi::CompactLatticeArc(word, word, weight, next));
+		}
+	}
+}
+
+/** N-best extraction as it was done before: conversion to lattice and n-shortest paths */
+static double LegacyNbest(const kaldi::CompactLattice &clat, kaldi::int32 count) {
+	kaldi::Lattice lat, nbest_lat;
+	fst::ConvertLattice(clat, &lat);
+	fst::ShortestPath(lat, &nbest_lat, count);
+	std::vector<kaldi::Lattice> nbest_lats;
+	fst::ConvertNbestToVector(nbest_lat, &nbest_lats);
+
+	double checksum = 0;
+	for (size_t k = 0; k < nbest_lats.size(); k++) {
+		std::vector<kaldi::int32> alignment, words;
+		kaldi::LatticeWeight weight;
+		fst::GetLinearSymbolSequence(nbest_lats[k], &alignment, &words, &weight);
+		checksum += weight.Value1() + weight.Value2();
+	}
+	return checksum;
+}
+
+static double LazyNbest(kaldi::CompactLattice *clat, kaldi::int32 count) {
+	LatticeNbest nbest(clat);
+	LatticeNbest::Path path;
+	double checksum = 0;
+	for (kaldi::int32 k = 0; k < count && nbest.Next(&path); k++) {
+		checksum += path.weight.Value1() + path.weight.Value2();
+	}
+	return checksum;
+}
+
+static void Report(const std::string &name, kaldi::int32 count, nanoseconds_t elapsed_ns, kaldi::int32 iterations,
+		double checksum) {
+	std::cout << name << " nbest=" << count << ": " << (elapsed_ns / 1e6 / iterations) << " ms"
+			<< " (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	const char *usage = "Measures n-best extraction latency on generated lattices.\n"
+			"Usage: lattice-nbest-bench [options]\n";
+	kaldi::ParseOptions po(usage);
+
+	kaldi::int32 words = 200;
+	kaldi::int32 alternatives = 20;
+	kaldi::int32 iterations = 20;
+	po.Register("words", &words, "Number of word boundary states in generated lattice");
+	po.Register("alternatives", &alternatives, "Number of word arcs leaving every state");
+	po.Register("iterations", &iterations, "Number of extractions per measurement");
+	po.Read(argc, argv);
+
+	kaldi::CompactLattice clat;
+	GenerateLattice(words, alternatives, &clat);
+
+	const kaldi::int32 counts[] = { 1, 5, 10 };
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		kaldi::int32 count = counts[i];
+
+		double checksum = 0;
+		nanoseconds_t start = getMonotonicNanoseconds();
+		for (kaldi::int32 it = 0; it < iterations; it++) {
+			checksum += LegacyNbest(clat, count);
+		}
+		Report("shortest path", count, getMonotonicNanoseconds() - start, iterations, checksum);
+
+		checksum = 0;
+		start = getMonotonicNanoseconds();
+		for (kaldi::int32 it = 0; it < iterations; it++) {
+			checksum += LazyNbest(&clat, count);
+		}
+		Report("lazy a-star", count, getMonotonicNanoseconds() - start, iterations, checksum);
+	}
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+#!/bin/bash
+# lookahead-graph-bench.sh
+
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+# WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+# MERCHANTABLITY OR NON-INFRINGEMENT.
+# See the Apache 2 License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares memory and speed of static HCLG against HCL and G composed on the fly.
+# Starts the decoder in the current (model) directory with each graph, runs
+# fcgi-load-client against it and reports peak resident memory of the decoder
+# process, its resident memory after the load (idle sessions pooled with their
+# arc caches) together with the load client summary (real-time factor etc.).
+#
+# Usage: lookahead-graph-bench.sh <audio-dir> <HCLG.fst> <HCLr.fst> <Gr.fst> [decoder options...]
+
+if [ $# -lt 4 ]; then
+	echo "Usage: $0 <audio-dir> <HCLG.fst> <HCLr.fst> <Gr.fst> [decoder options...]" >&2
+	exit 1
+fi
+
+AUDIO_DIR=$1
+HCLG=$2
+HCL=$3
+G=$4
+shift 4
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+DECODER=${DECODER:-$BENCH_DIR/../fcgi-nnet3-decoder}
+PORT=${PORT:-8123}
+CONCURRENCY=${CONCURRENCY:-8}
+REQUESTS=${REQUESTS:-64}
+
+run_graph() {
+	name=$1
+	shift
+	"$DECODER" --fcgi-socket=:$PORT "$@" 2>/dev/null &
+	pid=$!
+	# Wait for models to be loaded
+	while ! (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null; do
+		if ! kill -0 $pid 2>/dev/null; then
+			echo "Decoder failed to start" >&2
+			exit 1
+		fi
+		sleep 1
+	done
+	loaded_kb=$(awk '/^VmRSS/ { print $2 }' /proc/$pid/status)
+
+	summary=$("$BENCH_DIR/fcgi-load-client" --server=:$PORT --concurrency=$CONCURRENCY --requests=$REQUESTS \
+		--realtime=false "$AUDIO_DIR")
+	peak_kb=$(awk '/^VmHWM/ { print $2 }' /proc/$pid/status)
+	warm_kb=$(awk '/^VmRSS/ { print $2 }' /proc/$pid/status)
+	echo "$name: loaded_rss_mb=$((loaded_kb / 1024)) peak_rss_mb=$((peak_kb / 1024))" \
+		"warm_pool_rss_mb=$((warm_kb / 1024)) $summary"
+
+	kill $pid
+	wait $pid 2>/dev/null
+}
+
+run_graph static --fst-in="$HCLG" "$@"
+run_graph lookahead --hcl-in="$HCL" --g-in="$G" "$@"
@@ -0,0 +1,274 @@
+// nnet-batch-bench.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Nnet3BatchScheduler.h"
+#include "Nnet3BatchedDecodable.h"
+#include "Timing.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/decodable-online-looped.h"
+#include "nnet3/nnet-utils.h"
+#include "util/common-utils.h"
+#include <sys/resource.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+
+using namespace apiai;
+
+/** Features of utterance getting ready at real time pace, like ones of audio being uploaded */
+class PacedFeatures : public kaldi::OnlineFeatureInterface {
+public:
+	PacedFeatures(const kaldi::Matrix<kaldi::BaseFloat> &features, kaldi::int32 frame_shift_ms, bool realtime)
+		: features_(features), frame_shift_ms_(frame_shift_ms), realtime_(realtime),
+		  start_time_(getMilliseconds()) {}
+
+	virtual kaldi::int32 Dim() const { return features_.NumCols(); }
+	virtual kaldi::int32 NumFramesReady() const {
+		if (!realtime_) {
+			return features_.NumRows();
+		}
+		return std::min<kaldi::int32>(features_.NumRows(), getMillisecondsSince(start_time_) / frame_shift_ms_);
+	}
+	virtual bool IsLastFrame(kaldi::int32 frame) const {
+		return frame == features_.NumRows() - 1 && NumFramesReady() == features_.NumRows();
+	}
+	virtual kaldi::BaseFloat FrameShiftInSeconds() const { return frame_shift_ms_ / 1000.0; }
+	virtual void GetFrame(kaldi::int32 frame, kaldi::VectorBase<kaldi::BaseFloat> *feat) {
+		feat->CopyFromVec(features_.Row(frame));
+	}
+	/** Time the given frame got ready at */
+	milliseconds_t FrameTime(kaldi::int32 frame) const {
+		return realtime_ ? start_time_ + (frame + 1) * frame_shift_ms_ : start_time_;
+	}
+private:
+	const kaldi::Matrix<kaldi::BaseFloat> &features_;
+	kaldi::int32 frame_shift_ms_;
+	bool realtime_;
+	milliseconds_t start_time_;
+};
+
+/** Zero iVectors for nnets which take them, ready together with the input features */
+class ZeroIvectors : public kaldi::OnlineFeatureInterface {
+public:
+	ZeroIvectors(const PacedFeatures &input, kaldi::int32 dim) : input_(input), dim_(dim) {}
+
+	virtual kaldi::int32 Dim() const { return dim_; }
+	virtual kaldi::int32 NumFramesReady() const { return input_.NumFramesReady(); }
+	virtual bool IsLastFrame(kaldi::int32 frame) const { return input_.IsLastFrame(frame); }
+	virtual kaldi::BaseFloat FrameShiftInSeconds() const { return input_.FrameShiftInSeconds(); }
+	virtual void GetFrame(kaldi::int32 frame, kaldi::VectorBase<kaldi::BaseFloat> *feat) { feat->SetZero(); }
+private:
+	const PacedFeatures &input_;
+	kaldi::int32 dim_;
+};
+
+struct BenchConfig {
+	const std::vector<kaldi::Matrix<kaldi::BaseFloat> > *utterances;
+	const kaldi::TransitionModel *trans_model;
+	const kaldi::nnet3::DecodableNnetSimpleLoopedInfo *looped_info;
+	Nnet3BatchScheduler *scheduler;
+	kaldi::int32 ivector_dim;
+	kaldi::int32 utterances_per_stream;
+	kaldi::int32 frame_shift_ms;
+	kaldi::int32 poll_ms;
+	bool realtime;
+};
+
+struct StreamResult {
+	unsigned int seed;
+	kaldi::int64 frames;
+	/** Delays of output frames after their input frames got ready, in milliseconds */
+	std::vector<milliseconds_t> latencies;
+};
+
+struct StreamArgs {
+	const BenchConfig *config;
+	StreamResult *result;
+};
+
+static void *RunStream(void *data) {
+	const BenchConfig &config = *(((StreamArgs*)data)->config);
+	StreamResult &result = *(((StreamArgs*)data)->result);
+	const std::vector<kaldi::Matrix<kaldi::BaseFloat> > &utterances = *(config.utterances);
+
+	// Streams start at random times, so that their chunks are not aligned
+	if (config.realtime) {
+		usleep((rand_r(&result.seed) % 1000) * 1000);
+	}
+	size_t utterance = rand_r(&result.seed) % utterances.size();
+	for (kaldi::int32 u = 0; u < config.utterances_per_stream; u++, utterance = (utterance + 1) % utterances.size()) {
+		PacedFeatures input(utterances[utterance], config.frame_shift_ms, config.realtime);
+		ZeroIvectors ivectors(input, config.ivector_dim);
+		kaldi::OnlineFeatureInterface *ivector_features = config.ivector_dim > 0 ? &ivectors : NULL;
+
+		std::auto_ptr<kaldi::DecodableInterface> decodable;
+		kaldi::int32 subsampling;
+		if (config.scheduler != NULL) {
+			decodable.reset(new Nnet3BatchedDecodable(*(config.trans_model), *(config.scheduler),
+					&input, ivector_features));
+			subsampling = config.scheduler->FrameSubsamplingFactor();
+		} else {
+			decodable.reset(new kaldi::nnet3::DecodableAmNnetLoopedOnline(*(config.trans_model),
+					*(config.looped_info), &input, ivector_features));
+			subsampling = config.looped_info->opts.frame_subsampling_factor;
+		}
+
+		// Reads outputs the way decoder does, polling for frames ready
+		kaldi::int32 frame = 0;
+		while (!decodable->IsLastFrame(frame - 1)) {
+			kaldi::int32 frames_ready = decodable->NumFramesReady();
+			if (frame == frames_ready) {
+				usleep(config.poll_ms * 1000);
+				continue;
+			}
+			for (; frame < frames_ready; frame++) {
+				decodable->LogLikelihood(frame, 1);
+				kaldi::int32 input_frame = std::min(utterances[utterance].NumRows() - 1, (frame + 1) * subsampling - 1);
+				result.latencies.push_back(getMilliseconds() - input.FrameTime(input_frame));
+			}
+		}
+		result.frames += frame;
+	}
+	return NULL;
+}
+
+static double CpuSeconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/** Runs all streams concurrently and prints CPU time, throughput and latency */
+static void RunBench(const std::string &name, const BenchConfig &config, kaldi::int32 streams) {
+	std::vector<StreamResult> results(streams);
+	std::vector<StreamArgs> args(streams);
+	std::vector<pthread_t> threads(streams);
+
+	double cpu_start = CpuSeconds();
+	milliseconds_t start = getMilliseconds();
+	for (kaldi::int32 i = 0; i < streams; i++) {
+		results[i].seed = i + 1;
+		results[i].frames = 0;
+		args[i].config = &config;
+		args[i].result = &results[i];
+		if (pthread_create(&threads[i], NULL, RunStream, &args[i]) != 0) {
+			KALDI_ERR << "Failed to start stream thread";
+		}
+	}
+	for (kaldi::int32 i = 0; i < streams; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	double cpu = CpuSeconds() - cpu_start;
+	double wall = getMillisecondsSince(start) / 1000.0;
+
+	kaldi::int64 frames = 0;
+	std::vector<milliseconds_t> latencies;
+	for (kaldi::int32 i = 0; i < streams; i++) {
+		frames += results[i].frames;
+		latencies.insert(latencies.end(), results[i].latencies.begin(), results[i].latencies.end());
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout << name << ": " << frames << " output frames in " << wall << " s, CPU " << cpu << " s, "
+			<< (frames / cpu) << " frames per CPU second, " << (frames / wall) << " frames per second";
+	if (config.realtime && !latencies.empty()) {
+		std::cout << ", latency p50 " << latencies[latencies.size() / 2] << " ms, p95 "
+				<< latencies[latencies.size() * 95 / 100] << " ms";
+	}
+	std::cout << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	const char *usage = "Compares batched nnet computation with unbatched looped one for many concurrent streams:\n"
+			"every stream computes utterances of given features, fed at real time pace from random start time.\n"
+			"Reports CPU time, throughput and delay of outputs after their input.\n"
+			"Usage: nnet-batch-bench [options] <model-in> <features-rspecifier>\n"
+			"e.g.: nnet-batch-bench --streams=50 --frames-per-chunk=18 final.mdl scp:feats.scp\n";
+	kaldi::ParseOptions po(usage);
+
+	kaldi::nnet3::NnetSimpleLoopedComputationOptions opts;
+	kaldi::int32 streams = 50;
+	kaldi::int32 utterances_per_stream = 2;
+	kaldi::int32 batch_size = 32;
+	kaldi::int32 batch_wait_ms = 5;
+	kaldi::int32 batch_threads = 1;
+	kaldi::int32 frame_shift_ms = 10;
+	kaldi::int32 poll_ms = 10;
+	bool realtime = true;
+	opts.Register(&po);
+	po.Register("streams", &streams, "Number of concurrent streams");
+	po.Register("utterances-per-stream", &utterances_per_stream, "Number of utterances every stream computes one by one");
+	po.Register("nnet-batch-size", &batch_size, "Max number of chunks computed at once");
+	po.Register("nnet-batch-wait-ms", &batch_wait_ms, "Max time in milliseconds a chunk waits for the batch");
+	po.Register("nnet-batch-threads", &batch_threads, "Number of threads computing batches");
+	po.Register("frame-shift-ms", &frame_shift_ms, "Frame shift of features");
+	po.Register("poll-ms", &poll_ms, "Time in milliseconds stream waits for more features");
+	po.Register("realtime", &realtime, "Feed features at real time pace, otherwise all at once "
+			"to measure throughput only");
+	po.Read(argc, argv);
+
+	if (po.NumArgs() != 2 || streams < 1) {
+		po.PrintUsage();
+		return 1;
+	}
+
+	// Looped computation modifies nnet to take iVectors periodically, so both modes have own copy
+	kaldi::TransitionModel trans_model;
+	kaldi::nnet3::AmNnetSimple looped_nnet;
+	{
+		bool binary;
+		kaldi::Input ki(po.GetArg(1), &binary);
+		trans_model.Read(ki.Stream(), binary);
+		looped_nnet.Read(ki.Stream(), binary);
+	}
+	kaldi::nnet3::SetBatchnormTestMode(true, &(looped_nnet.GetNnet()));
+	kaldi::nnet3::SetDropoutTestMode(true, &(looped_nnet.GetNnet()));
+	kaldi::nnet3::CollapseModel(kaldi::nnet3::CollapseModelConfig(), &(looped_nnet.GetNnet()));
+	kaldi::nnet3::AmNnetSimple batched_nnet(looped_nnet);
+
+	std::vector<kaldi::Matrix<kaldi::BaseFloat> > utterances;
+	kaldi::SequentialBaseFloatMatrixReader feature_reader(po.GetArg(2));
+	for (; !feature_reader.Done(); feature_reader.Next()) {
+		utterances.push_back(feature_reader.Value());
+	}
+	if (utterances.empty()) {
+		KALDI_WARN << "No features read";
+		return 1;
+	}
+
+	BenchConfig config;
+	config.utterances = &utterances;
+	config.trans_model = &trans_model;
+	config.ivector_dim = std::max(0, batched_nnet.GetNnet().InputDim("ivector"));
+	config.utterances_per_stream = utterances_per_stream;
+	config.frame_shift_ms = frame_shift_ms;
+	config.poll_ms = poll_ms;
+	config.realtime = realtime;
+
+	kaldi::nnet3::DecodableNnetSimpleLoopedInfo looped_info(opts, &looped_nnet);
+	config.looped_info = &looped_info;
+	config.scheduler = NULL;
+	RunBench("unbatched", config, streams);
+
+	Nnet3BatchScheduler scheduler(batched_nnet, opts, batch_size, batch_wait_ms, batch_threads);
+	scheduler.Precompile("");
+	config.looped_info = NULL;
+	config.scheduler = &scheduler;
+	RunBench("batched", config, streams);
+	return 0;
+}
@@ -0,0 +1,138 @@
+// nnet-int8-bench.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "QuantizedAffineComponent.h"
+#include "Timing.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-utils.h"
+#include "util/common-utils.h"
+#include <math.h>
+
+using namespace apiai;
+
+/** Output of nnet for all frames of utterance */
+static void ComputeOutput(const kaldi::nnet3::NnetSimpleComputationOptions &opts, const kaldi::nnet3::Nnet &nnet,
+		kaldi::nnet3::CachingOptimizingCompiler *compiler, const kaldi::Matrix<kaldi::BaseFloat> &features,
+		const kaldi::Matrix<kaldi::BaseFloat> *ivectors, kaldi::int32 ivector_period,
+		kaldi::Matrix<kaldi::BaseFloat> *output) {
+	kaldi::Vector<kaldi::BaseFloat> priors;
+	kaldi::nnet3::DecodableNnetSimple decodable(opts, nnet, priors, features, compiler,
+			NULL, ivectors, ivector_period);
+	output->Resize(decodable.NumFrames(), decodable.OutputDim());
+	for (kaldi::int32 t = 0; t < decodable.NumFrames(); t++) {
+		kaldi::SubVector<kaldi::BaseFloat> row(*output, t);
+		decodable.GetOutputForFrame(t, &row);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *usage = "Compares int8 quantized nnet with floating point one on given features:\n"
+			"reports computation speedup, divergence of outputs and agreement of best output per frame.\n"
+			"Usage: nnet-int8-bench [options] <model-in> <features-rspecifier>\n"
+			"e.g.: nnet-int8-bench --online-ivectors=scp:ivector_online.scp final.mdl scp:feats.scp\n";
+	kaldi::ParseOptions po(usage);
+
+	kaldi::nnet3::NnetSimpleComputationOptions opts;
+	std::string ivector_rspecifier;
+	kaldi::int32 ivector_period = 10;
+	kaldi::int32 min_dim = 128;
+	opts.Register(&po);
+	po.Register("online-ivectors", &ivector_rspecifier, "Rspecifier of online iVectors, if nnet uses them");
+	po.Register("online-ivector-period", &ivector_period, "Number of frames between online iVectors");
+	po.Register("nnet-int8-min-dim", &min_dim, "Layers with smaller input dimension are kept in floating point");
+	po.Read(argc, argv);
+
+	if (po.NumArgs() != 2) {
+		po.PrintUsage();
+		return 1;
+	}
+
+	kaldi::TransitionModel trans_model;
+	kaldi::nnet3::AmNnetSimple am_nnet;
+	{
+		bool binary;
+		kaldi::Input ki(po.GetArg(1), &binary);
+		trans_model.Read(ki.Stream(), binary);
+		am_nnet.Read(ki.Stream(), binary);
+	}
+	kaldi::nnet3::Nnet &float_nnet = am_nnet.GetNnet();
+	kaldi::nnet3::SetBatchnormTestMode(true, &float_nnet);
+	kaldi::nnet3::SetDropoutTestMode(true, &float_nnet);
+	kaldi::nnet3::CollapseModel(kaldi::nnet3::CollapseModelConfig(), &float_nnet);
+
+	kaldi::nnet3::Nnet int8_nnet(float_nnet);
+	QuantizeNnet(min_dim, &int8_nnet);
+
+	kaldi::nnet3::CachingOptimizingCompiler float_compiler(float_nnet, opts.optimize_config);
+	kaldi::nnet3::CachingOptimizingCompiler int8_compiler(int8_nnet, opts.optimize_config);
+
+	kaldi::SequentialBaseFloatMatrixReader feature_reader(po.GetArg(2));
+	kaldi::RandomAccessBaseFloatMatrixReader ivector_reader(ivector_rspecifier);
+
+	nanoseconds_t float_ns = 0, int8_ns = 0;
+	double diff_sum = 0, diff_max = 0;
+	kaldi::int64 frames = 0, values = 0, agreed = 0;
+	kaldi::int32 utterances = 0;
+	for (; !feature_reader.Done(); feature_reader.Next()) {
+		const std::string &key = feature_reader.Key();
+		const kaldi::Matrix<kaldi::BaseFloat> &features = feature_reader.Value();
+		const kaldi::Matrix<kaldi::BaseFloat> *ivectors = NULL;
+		if (ivector_rspecifier != "") {
+			if (!ivector_reader.HasKey(key)) {
+				KALDI_WARN << "No iVectors for utterance " << key;
+				continue;
+			}
+			ivectors = &ivector_reader.Value(key);
+		}
+
+		kaldi::Matrix<kaldi::BaseFloat> float_output, int8_output;
+		nanoseconds_t start = getMonotonicNanoseconds();
+		ComputeOutput(opts, float_nnet, &float_compiler, features, ivectors, ivector_period, &float_output);
+		float_ns += getMonotonicNanoseconds() - start;
+
+		start = getMonotonicNanoseconds();
+		ComputeOutput(opts, int8_nnet, &int8_compiler, features, ivectors, ivector_period, &int8_output);
+		int8_ns += getMonotonicNanoseconds() - start;
+
+		for (kaldi::MatrixIndexT t = 0; t < float_output.NumRows(); t++) {
+			kaldi::MatrixIndexT float_best = 0, int8_best = 0;
+			for (kaldi::MatrixIndexT i = 0; i < float_output.NumCols(); i++) {
+				double diff = fabs(float_output(t, i) - int8_output(t, i));
+				diff_sum += diff;
+				diff_max = std::max(diff_max, diff);
+				if (float_output(t, i) > float_output(t, float_best)) float_best = i;
+				if (int8_output(t, i) > int8_output(t, int8_best)) int8_best = i;
+			}
+			agreed += float_best == int8_best;
+		}
+		frames += float_output.NumRows();
+		values += float_output.NumRows() * float_output.NumCols();
+		utterances++;
+	}
+
+	if (frames == 0) {
+		KALDI_WARN << "No frames computed";
+		return 1;
+	}
+
+	std::cout << "Utterances: " << utterances << ", frames: " << frames << std::endl;
+	std::cout << "float: " << (float_ns / 1e6) << " ms, int8: " << (int8_ns / 1e6) << " ms, speedup "
+			<< (double(float_ns) / int8_ns) << std::endl;
+	std::cout << "Output divergence: mean " << (diff_sum / values) << ", max " << diff_max << std::endl;
+	std::cout << "Best output agreement: " << (100.0 * agreed / frames) << "%" << std::endl;
+	return 0;
+}
@@ -0,0 +1,143 @@
+// pcm-conversion-bench.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PcmConversion.h"
+#include "RequestRawReader.h"
+#include "Timing.h"
+#include "util/parse-options.h"
+#include <sstream>
+#include <string.h>
+#include <vector>
+
+using namespace apiai;
+
+/**
+ * Chunk reading as it was done before buffers reuse:
+ * per-chunk allocation, per-sample push_back and extra copy
+ */
+class LegacyChunkReader {
+public:
+	LegacyChunkReader(std::istream *is, kaldi::int32 channels, kaldi::int32 channel_index)
+		: is_(is), channels_(channels), channel_index_(channel_index), current_chunk_(NULL) {}
+	~LegacyChunkReader() { delete current_chunk_; }
+
+	kaldi::SubVector<kaldi::BaseFloat> *NextChunk(kaldi::int32 samples_count) {
+		int frame_size = 2 * channels_;
+		int offset = channel_index_ * 2;
+		std::vector<char> audioData(samples_count * frame_size);
+		is_->read(audioData.data(), audioData.size());
+		int bytes_read = is_->gcount();
+		if (bytes_read == 0) {
+			return NULL;
+		}
+		buffer_.clear();
+		for (int index = 0; index < bytes_read; index += frame_size) {
+			kaldi::int16 value = *reinterpret_cast<kaldi::int16*>(audioData.data() + index + offset);
+			buffer_.push_back(kaldi::BaseFloat(value));
+		}
+		if (current_chunk_ && (current_chunk_->Dim() != kaldi::int32(buffer_.size()))) {
+			delete current_chunk_;
+			current_chunk_ = NULL;
+		}
+		if (!current_chunk_) {
+			current_chunk_ = new kaldi::SubVector<kaldi::BaseFloat>(buffer_.data(), buffer_.size());
+		} else {
+			std::copy(buffer_.begin(), buffer_.end(), current_chunk_->Data());
+		}
+		return current_chunk_;
+	}
+private:
+	std::istream *is_;
+	kaldi::int32 channels_;
+	kaldi::int32 channel_index_;
+	std::vector<kaldi::BaseFloat> buffer_;
+	kaldi::SubVector<kaldi::BaseFloat> *current_chunk_;
+};
+
+static void Report(const std::string &name, size_t bytes, milliseconds_t elapsed_ms, double checksum) {
+	double seconds = std::max<milliseconds_t>(1, elapsed_ms) / 1000.0;
+	std::cout << name << ": " << (bytes / seconds / (1 << 20)) << " MB/s"
+			<< " (" << elapsed_ms << " ms, checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	const char *usage = "Measures PCM input conversion throughput.\n"
+			"Usage: pcm-conversion-bench [options]\n";
+	kaldi::ParseOptions po(usage);
+
+	kaldi::int32 seconds = 600;
+	kaldi::int32 channels = 1;
+	kaldi::int32 chunk_samples = 2880;
+	kaldi::int32 iterations = 5;
+	po.Register("seconds", &seconds, "Length of generated 16 KHz audio in seconds");
+	po.Register("channels", &channels, "Number of interleaved channels, first one is decoded");
+	po.Register("chunk-samples", &chunk_samples, "Samples per chunk, default is 0.18 s at 16 KHz");
+	po.Register("iterations", &iterations, "Number of passes over generated audio");
+	po.Read(argc, argv);
+
+	const size_t frames = size_t(seconds) * 16000;
+	std::string pcm(frames * channels * 2, '\0');
+	for (size_t i = 0; i < frames * channels; i++) {
+		kaldi::int16 value = kaldi::int16((i * 7919) & 0xffff);
+		memcpy(&pcm[i * 2], &value, 2);
+	}
+	const size_t total_bytes = pcm.size() * iterations;
+
+	{
+		double checksum = 0;
+		milliseconds_t start = getMilliseconds();
+		for (kaldi::int32 i = 0; i < iterations; i++) {
+			std::istringstream is(pcm);
+			LegacyChunkReader reader(&is, channels, 0);
+			kaldi::SubVector<kaldi::BaseFloat> *chunk;
+			while ((chunk = reader.NextChunk(chunk_samples)) != NULL) {
+				checksum += (*chunk)(0);
+			}
+		}
+		Report("legacy reader", total_bytes, getMillisecondsSince(start), checksum);
+	}
+
+	{
+		double checksum = 0;
+		milliseconds_t start = getMilliseconds();
+		for (kaldi::int32 i = 0; i < iterations; i++) {
+			std::istringstream is(pcm);
+			RequestRawReader reader(&is);
+			reader.Channels(channels);
+			kaldi::SubVector<kaldi::BaseFloat> *chunk;
+			while ((chunk = reader.NextChunk(chunk_samples)) != NULL) {
+				checksum += (*chunk)(0);
+			}
+		}
+		Report("request reader", total_bytes, getMillisecondsSince(start), checksum);
+	}
+
+	{
+		std::vector<kaldi::BaseFloat> out(frames);
+		milliseconds_t start = getMilliseconds();
+		for (kaldi::int32 i = 0; i < iterations; i++) {
+			ConvertPcm16ToFloatScalar(pcm.data(), frames, channels, 0, out.data());
+		}
+		Report("scalar conversion", total_bytes, getMillisecondsSince(start), out[frames - 1]);
+
+		start = getMilliseconds();
+		for (kaldi::int32 i = 0; i < iterations; i++) {
+			ConvertPcm16ToFloat(pcm.data(), frames, channels, 0, out.data());
+		}
+		Report("vectorized conversion", total_bytes, getMillisecondsSince(start), out[frames - 1]);
+	}
+
+	return 0;
+}
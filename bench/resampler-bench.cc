@@ -0,0 +1,110 @@
+// resampler-bench.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Resampler.h"
+#include "Timing.h"
+#include "util/parse-options.h"
+#include "util/text-utils.h"
+#include <math.h>
+#include <sstream>
+#include <vector>
+
+using namespace apiai;
+
+/**
+ * Runs on a single thread, so the numbers are per core:
+ * a core serves as many real-time streams as the speedup reported
+ */
+static void Report(const std::string &name, double input_seconds, size_t samples, milliseconds_t elapsed_ms, double checksum) {
+	double seconds = std::max<milliseconds_t>(1, elapsed_ms) / 1000.0;
+	std::cout << name << ": " << (samples / seconds / 1e6) << " Msamples/s, "
+			<< (input_seconds / seconds) << "x real time"
+			<< " (" << elapsed_ms << " ms, checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	const char *usage = "Measures resampling to 16 KHz throughput per core.\n"
+			"Usage: resampler-bench [options]\n";
+	kaldi::ParseOptions po(usage);
+
+	kaldi::int32 seconds = 300;
+	kaldi::int32 chunk_samples = 4096;
+	kaldi::int32 iterations = 3;
+	std::string frequencies = "8000,22050,44100,48000";
+	po.Register("seconds", &seconds, "Length of generated audio in seconds");
+	po.Register("chunk-samples", &chunk_samples, "Input samples per chunk");
+	po.Register("iterations", &iterations, "Number of passes over generated audio");
+	po.Register("frequencies", &frequencies, "Comma separated list of input sampling frequencies");
+	po.Read(argc, argv);
+
+	std::vector<kaldi::int32> input_frequencies;
+	if (!kaldi::SplitStringToIntegers(frequencies, ",", true, &input_frequencies)) {
+		KALDI_ERR << "Bad frequencies list: " << frequencies;
+	}
+
+	for (size_t f = 0; f < input_frequencies.size(); f++) {
+		const kaldi::int32 input_frequency = input_frequencies[f];
+		if (!Resampler::Supported(input_frequency, 16000)) {
+			KALDI_WARN << "Skipping unsupported frequency " << input_frequency;
+			continue;
+		}
+		std::vector<kaldi::BaseFloat> input(size_t(seconds) * input_frequency);
+		for (size_t i = 0; i < input.size(); i++) {
+			input[i] = 8000 * sin(2 * M_PI * 440 * i / input_frequency) + (i * 7919) % 200;
+		}
+
+		Resampler resampler(input_frequency, 16000);
+		std::vector<kaldi::BaseFloat> output;
+		output.reserve(size_t(seconds) * 16000 + chunk_samples);
+		double checksum = 0;
+		milliseconds_t start = getMilliseconds();
+		for (kaldi::int32 i = 0; i < iterations; i++) {
+			resampler.Reset();
+			output.clear();
+			for (size_t offset = 0; offset < input.size(); offset += chunk_samples) {
+				resampler.Process(input.data() + offset, std::min<size_t>(chunk_samples, input.size() - offset), &output);
+			}
+			resampler.Finish(&output);
+			checksum += output[output.size() / 2];
+		}
+		std::ostringstream name;
+		name << input_frequency << " Hz, " << resampler.Taps() << " taps";
+		Report(name.str(), double(seconds) * iterations, input.size() * iterations, getMillisecondsSince(start), checksum);
+	}
+
+	{
+		const kaldi::int32 taps = 56;
+		const size_t count = size_t(seconds) * 16000;
+		std::vector<kaldi::BaseFloat> filter(taps, 0.01), input(count + taps);
+		for (size_t i = 0; i < input.size(); i++) {
+			input[i] = kaldi::BaseFloat(i % 1000);
+		}
+		double checksum = 0;
+		milliseconds_t start = getMilliseconds();
+		for (size_t i = 0; i < count; i++) {
+			checksum += ResamplerDotScalar(filter.data(), input.data() + i, taps);
+		}
+		Report("scalar 56 taps dot", seconds, count, getMillisecondsSince(start), checksum);
+
+		checksum = 0;
+		start = getMilliseconds();
+		for (size_t i = 0; i < count; i++) {
+			checksum += ResamplerDot(filter.data(), input.data() + i, taps);
+		}
+		Report("vectorized 56 taps dot", seconds, count, getMillisecondsSince(start), checksum);
+	}
+
+	return 0;
+}
@@ -0,0 +1,88 @@
+// AdaptationCache.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "AdaptationCache.h"
+#include <stdio.h>
+#include <algorithm>
+
+namespace apiai {
+
+AdaptationCache::AdaptationCache(const kaldi::OnlineIvectorExtractionInfo &info, kaldi::int32 capacity,
+		kaldi::int32 ttl_seconds)
+	: info_(info), capacity_(std::max(1, capacity)), ttl_ms_(ttl_seconds > 0 ? ttl_seconds * 1000L : 0),
+	  hits_(0), misses_(0) {
+	pthread_mutex_init(&mutex_, NULL);
+}
+
+AdaptationCache::~AdaptationCache() {
+	pthread_mutex_destroy(&mutex_);
+}
+
+void AdaptationCache::ExpireLocked(milliseconds_t now) {
+	while (ttl_ms_ > 0 && !entries_.empty() && now - entries_.back().last_used > ttl_ms_) {
+		index_.erase(entries_.back().session);
+		entries_.pop_back();
+	}
+}
+
+bool AdaptationCache::Restore(const std::string &session, kaldi::OnlineNnet2FeaturePipeline *pipeline) {
+	milliseconds_t now = getMilliseconds();
+	pthread_mutex_lock(&mutex_);
+	ExpireLocked(now);
+	std::map<std::string, EntryList::iterator>::iterator it = index_.find(session);
+	bool found = it != index_.end();
+	if (found) {
+		hits_++;
+		entries_.splice(entries_.begin(), entries_, it->second);
+		it->second->last_used = now;
+		pipeline->SetAdaptationState(it->second->state);
+	} else {
+		misses_++;
+	}
+	pthread_mutex_unlock(&mutex_);
+	return found;
+}
+
+void AdaptationCache::Store(const std::string &session, const kaldi::OnlineNnet2FeaturePipeline &pipeline) {
+	milliseconds_t now = getMilliseconds();
+	pthread_mutex_lock(&mutex_);
+	std::map<std::string, EntryList::iterator>::iterator it = index_.find(session);
+	if (it == index_.end()) {
+		entries_.push_front(Entry(session, info_));
+		it = index_.insert(std::make_pair(session, entries_.begin())).first;
+	} else {
+		entries_.splice(entries_.begin(), entries_, it->second);
+	}
+	pipeline.GetAdaptationState(&(it->second->state));
+	it->second->last_used = now;
+
+	while (entries_.size() > capacity_) {
+		index_.erase(entries_.back().session);
+		entries_.pop_back();
+	}
+	ExpireLocked(now);
+	pthread_mutex_unlock(&mutex_);
+}
+
+void AdaptationCache::AppendMetrics(std::string *json) {
+	pthread_mutex_lock(&mutex_);
+	char metrics[128];
+	int length = snprintf(metrics, sizeof(metrics), "\"adaptation_sessions\":%d,\"adaptation_hits\":%lld,"
+			"\"adaptation_misses\":%lld", int(entries_.size()), (long long)hits_, (long long)misses_);
+	pthread_mutex_unlock(&mutex_);
+	json->append(metrics, length);
+}
+
+} /* namespace apiai */
@@ -0,0 +1,76 @@
+// AdaptationCache.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_ADAPTATIONCACHE_H_
+#define APIAI_DECODER_ADAPTATIONCACHE_H_
+
+#include "Timing.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include <pthread.h>
+#include <list>
+#include <map>
+#include <string>
+
+namespace apiai {
+
+/**
+ * Speaker adaptation states of recent sessions, so that requests of the
+ * same dialog continue iVector estimation instead of starting from zero.
+ * Least recently used states are dropped when cache is full, states not
+ * used for longer than the time-to-live are dropped on access.
+ */
+class AdaptationCache {
+public:
+	/** Time-to-live is given in seconds, non-positive for no limit */
+	AdaptationCache(const kaldi::OnlineIvectorExtractionInfo &info, kaldi::int32 capacity, kaldi::int32 ttl_seconds);
+	virtual ~AdaptationCache();
+
+	/** Set adaptation state of the session to the pipeline. Returns false if the session is not cached */
+	bool Restore(const std::string &session, kaldi::OnlineNnet2FeaturePipeline *pipeline);
+	/** Store adaptation state of the pipeline for the session */
+	void Store(const std::string &session, const kaldi::OnlineNnet2FeaturePipeline &pipeline);
+	/** Append cache counters as comma separated JSON object members */
+	void AppendMetrics(std::string *json);
+private:
+	struct Entry {
+		std::string session;
+		kaldi::OnlineIvectorExtractorAdaptationState state;
+		milliseconds_t last_used;
+
+		Entry(const std::string &session, const kaldi::OnlineIvectorExtractionInfo &info)
+			: session(session), state(info), last_used(0) {}
+	};
+	typedef std::list<Entry> EntryList;
+
+	/** Drop expired entries from the tail */
+	void ExpireLocked(milliseconds_t now);
+
+	const kaldi::OnlineIvectorExtractionInfo &info_;
+	size_t capacity_;
+	milliseconds_t ttl_ms_;
+
+	/** Most recently used first */
+	EntryList entries_;
+	std::map<std::string, EntryList::iterator> index_;
+
+	kaldi::int64 hits_;
+	kaldi::int64 misses_;
+
+	pthread_mutex_t mutex_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_ADAPTATIONCACHE_H_ */
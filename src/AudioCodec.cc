@@ -0,0 +1,469 @@
+// AudioCodec.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "AudioCodec.h"
+#include "FlacCodec.h"
+#include "PcmConversion.h"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+namespace apiai {
+
+const std::string AudioCodec::PCM = "pcm";
+const std::string AudioCodec::WAV = "wav";
+const std::string AudioCodec::FLAC = "flac";
+const std::string AudioCodec::MULAW = "mulaw";
+const std::string AudioCodec::ALAW = "alaw";
+const std::string AudioCodec::ADPCM = "adpcm";
+
+/** Max size of WAV header chunks before the data chunk */
+static const size_t WAV_HEADER_MAX = 1 << 20;
+
+static kaldi::uint32 ReadLe16(const char *data) {
+	const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+	return p[0] | (p[1] << 8);
+}
+
+static kaldi::uint32 ReadLe32(const char *data) {
+	const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (kaldi::uint32(p[3]) << 24);
+}
+
+/**
+ * Codec of fixed size frames, incomplete frame is kept till the next piece
+ */
+class FrameCodec : public AudioCodec {
+public:
+	virtual bool Decode(const char *data, size_t size, std::vector<kaldi::BaseFloat> *samples) {
+		const size_t frame_size = FrameSize();
+		if (carry_.size() > 0) {
+			size_t length = std::min(frame_size - carry_.size(), size);
+			carry_.append(data, length);
+			data += length;
+			size -= length;
+			if (carry_.size() < frame_size) {
+				return true;
+			}
+			DecodeFrames(carry_.data(), 1, samples);
+			carry_.clear();
+		}
+		size_t frames = size / frame_size;
+		DecodeFrames(data, frames, samples);
+		carry_.assign(data + frames * frame_size, size - frames * frame_size);
+		return true;
+	}
+protected:
+	virtual size_t FrameSize() const = 0;
+	virtual void DecodeFrames(const char *data, size_t frames, std::vector<kaldi::BaseFloat> *samples) = 0;
+private:
+	std::string carry_;
+};
+
+/** Little-endian signed 16 bits PCM */
+class Pcm16Codec : public FrameCodec {
+public:
+	virtual size_t EncodedBytes(kaldi::int32 samples) const { return samples * FrameSize(); }
+protected:
+	virtual size_t FrameSize() const { return 2 * channels_; }
+	virtual void DecodeFrames(const char *data, size_t frames, std::vector<kaldi::BaseFloat> *samples) {
+		size_t offset = samples->size();
+		samples->resize(offset + frames);
+		ConvertPcm16ToFloat(data, frames, channels_, channel_index_, samples->data() + offset);
+	}
+};
+
+/** G.711 mu-law or A-law, decoded by lookup */
+class G711Codec : public FrameCodec {
+public:
+	G711Codec(bool alaw) {
+		for (int i = 0; i < 256; i++) {
+			table_[i] = alaw ? AlawToLinear(i) : MulawToLinear(i);
+		}
+	}
+
+	virtual size_t EncodedBytes(kaldi::int32 samples) const { return samples * FrameSize(); }
+protected:
+	virtual size_t FrameSize() const { return channels_; }
+	virtual void DecodeFrames(const char *data, size_t frames, std::vector<kaldi::BaseFloat> *samples) {
+		const unsigned char *p = reinterpret_cast<const unsigned char*>(data) + channel_index_;
+		for (size_t i = 0; i < frames; i++, p += channels_) {
+			samples->push_back(table_[*p]);
+		}
+	}
+private:
+	static int MulawToLinear(unsigned char value) {
+		value = ~value;
+		int magnitude = (((value & 0x0f) << 3) + 0x84) << ((value & 0x70) >> 4);
+		return (value & 0x80) ? 0x84 - magnitude : magnitude - 0x84;
+	}
+
+	static int AlawToLinear(unsigned char value) {
+		value ^= 0x55;
+		int magnitude = (value & 0x0f) << 4;
+		int segment = (value & 0x70) >> 4;
+		if (segment == 0) {
+			magnitude += 8;
+		} else {
+			magnitude = (magnitude + 0x108) << (segment - 1);
+		}
+		return (value & 0x80) ? magnitude : -magnitude;
+	}
+
+	kaldi::BaseFloat table_[256];
+};
+
+/**
+ * IMA ADPCM. Without block size given the stream is a continuous mono
+ * nibble sequence, low nibble first, starting from zero state. Otherwise
+ * it consists of WAV blocks starting with state of every channel.
+ */
+class ImaAdpcmCodec : public AudioCodec {
+public:
+	ImaAdpcmCodec(size_t block_align) : block_align_(block_align) {
+		state_.predictor = 0;
+		state_.index = 0;
+	}
+
+	virtual bool Decode(const char *data, size_t size, std::vector<kaldi::BaseFloat> *samples) {
+		if (block_align_ == 0) {
+			if (channels_ != 1) {
+				error_ = "IMA ADPCM stream without header must be mono";
+				return false;
+			}
+			const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++) {
+				samples->push_back(DecodeNibble(&state_, p[i] & 0x0f));
+				samples->push_back(DecodeNibble(&state_, p[i] >> 4));
+			}
+			return true;
+		}
+		if (block_align_ < 4 * size_t(channels_)) {
+			error_ = "IMA ADPCM block is shorter than its header";
+			return false;
+		}
+
+		while (size > 0) {
+			if (carry_.size() == 0 && size >= block_align_) {
+				if (!DecodeBlock(data, block_align_, samples)) {
+					return false;
+				}
+				data += block_align_;
+				size -= block_align_;
+				continue;
+			}
+			size_t length = std::min(block_align_ - carry_.size(), size);
+			carry_.append(data, length);
+			data += length;
+			size -= length;
+			if (carry_.size() == block_align_) {
+				if (!DecodeBlock(carry_.data(), carry_.size(), samples)) {
+					return false;
+				}
+				carry_.clear();
+			}
+		}
+		return true;
+	}
+
+	virtual bool Finish(std::vector<kaldi::BaseFloat> *samples) {
+		// The last block may be shorter than others
+		bool result = carry_.size() < 4 * size_t(channels_) || DecodeBlock(carry_.data(), carry_.size(), samples);
+		carry_.clear();
+		return result;
+	}
+
+	virtual size_t EncodedBytes(kaldi::int32 samples) const {
+		if (block_align_ == 0) {
+			return (samples + 1) / 2;
+		}
+		size_t block_samples = 1 + (block_align_ - 4 * channels_) * 2 / channels_;
+		return (samples + block_samples - 1) / block_samples * block_align_;
+	}
+private:
+	struct State {
+		int predictor;
+		int index;
+	};
+
+	static int DecodeNibble(State *state, int nibble) {
+		static const int STEPS[89] = {
+			7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+			50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+			253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+			1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+			3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+			12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+		};
+		static const int INDEX_SHIFTS[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+		int step = STEPS[state->index];
+		int diff = step >> 3;
+		if (nibble & 1) diff += step >> 2;
+		if (nibble & 2) diff += step >> 1;
+		if (nibble & 4) diff += step;
+		state->predictor += (nibble & 8) ? -diff : diff;
+		state->predictor = std::max(-32768, std::min(32767, state->predictor));
+		state->index = std::max(0, std::min(88, state->index + INDEX_SHIFTS[nibble & 7]));
+		return state->predictor;
+	}
+
+	bool DecodeBlock(const char *data, size_t size, std::vector<kaldi::BaseFloat> *samples) {
+		const size_t header_size = 4 * channels_;
+		const unsigned char *header = reinterpret_cast<const unsigned char*>(data) + 4 * channel_index_;
+		State state;
+		state.predictor = kaldi::int16(header[0] | (header[1] << 8));
+		state.index = header[2];
+		if (state.index > 88) {
+			error_ = "Bad IMA ADPCM block header";
+			return false;
+		}
+		samples->push_back(state.predictor);
+		// Every channel has 4 bytes of 8 samples in turn
+		for (size_t group = header_size; group + header_size <= size; group += header_size) {
+			const unsigned char *p = reinterpret_cast<const unsigned char*>(data) + group + 4 * channel_index_;
+			for (int i = 0; i < 4; i++) {
+				samples->push_back(DecodeNibble(&state, p[i] & 0x0f));
+				samples->push_back(DecodeNibble(&state, p[i] >> 4));
+			}
+		}
+		return true;
+	}
+
+	size_t block_align_;
+	/** State of continuous stream */
+	State state_;
+	/** Incomplete block */
+	std::string carry_;
+};
+
+/**
+ * RIFF WAVE container of PCM, G.711 or IMA ADPCM data. Data chunk of zero
+ * or max size, as written by streaming encoders, lasts till the end of stream.
+ * Stream not starting with RIFF is taken for raw PCM of the request format
+ */
+class WavCodec : public AudioCodec {
+public:
+	WavCodec() : data_left_(0), data_limited_(false) {};
+
+	virtual bool Decode(const char *data, size_t size, std::vector<kaldi::BaseFloat> *samples) {
+		if (data_codec_.get() != NULL) {
+			return DecodeData(data, size, samples);
+		}
+
+		header_.append(data, size);
+		size_t data_start = 0;
+		if (!ParseHeader(&data_start)) {
+			return false;
+		}
+		if (data_codec_.get() == NULL) {
+			if (header_.size() > WAV_HEADER_MAX) {
+				error_ = "WAV header is too long";
+				return false;
+			}
+			return true;
+		}
+		std::string rest(header_, data_start);
+		header_.clear();
+		return DecodeData(rest.data(), rest.size(), samples);
+	}
+
+	virtual bool Finish(std::vector<kaldi::BaseFloat> *samples) {
+		if (data_codec_.get() == NULL) {
+			error_ = "Truncated WAV header";
+			return false;
+		}
+		if (!data_codec_->Finish(samples)) {
+			error_ = data_codec_->Error();
+			return false;
+		}
+		return true;
+	}
+
+	virtual size_t EncodedBytes(kaldi::int32 samples) const {
+		// Header of the usual size is expected before data
+		return data_codec_.get() != NULL ? data_codec_->EncodedBytes(samples) : 44 + samples * 2 * channels_;
+	}
+private:
+	bool DecodeData(const char *data, size_t size, std::vector<kaldi::BaseFloat> *samples) {
+		if (data_limited_) {
+			size = std::min<kaldi::uint64>(size, data_left_);
+			data_left_ -= size;
+		}
+		if (!data_codec_->Decode(data, size, samples)) {
+			error_ = data_codec_->Error();
+			return false;
+		}
+		return true;
+	}
+
+	/** Parse header received so far, data codec is created once data chunk is reached */
+	bool ParseHeader(size_t *data_start) {
+		const char *header = header_.data();
+		if (header_.size() >= 4 && memcmp(header, "RIFF", 4) != 0) {
+			// Raw PCM labelled as WAV by some clients is decoded as stream without header
+			data_codec_.reset(new Pcm16Codec());
+			data_codec_->Format(frequency_, channels_, channel_index_);
+			data_limited_ = false;
+			*data_start = 0;
+			return true;
+		}
+		if (header_.size() < 12) {
+			return true;
+		}
+		if (memcmp(header + 8, "WAVE", 4) != 0) {
+			error_ = "Not a WAV stream";
+			return false;
+		}
+
+		bool format_found = false;
+		kaldi::uint32 format = 0, channels = 0, frequency = 0, block_align = 0, bits = 0;
+		for (size_t pos = 12; pos + 8 <= header_.size(); ) {
+			const char *chunk = header + pos;
+			kaldi::uint32 chunk_size = ReadLe32(chunk + 4);
+			if (memcmp(chunk, "data", 4) == 0) {
+				if (!format_found) {
+					error_ = "WAV data chunk before format chunk";
+					return false;
+				}
+				if (!CreateDataCodec(format, channels, frequency, block_align, bits)) {
+					return false;
+				}
+				data_limited_ = chunk_size != 0 && chunk_size != 0xffffffff;
+				data_left_ = chunk_size;
+				*data_start = pos + 8;
+				return true;
+			}
+
+			size_t next = pos + 8 + chunk_size + (chunk_size & 1);
+			if (next > header_.size()) {
+				break;
+			}
+			if (memcmp(chunk, "fmt ", 4) == 0) {
+				if (chunk_size < 16) {
+					error_ = "Bad WAV format chunk";
+					return false;
+				}
+				format = ReadLe16(chunk + 8);
+				channels = ReadLe16(chunk + 10);
+				frequency = ReadLe32(chunk + 12);
+				block_align = ReadLe16(chunk + 20);
+				bits = ReadLe16(chunk + 22);
+				// WAVE_FORMAT_EXTENSIBLE keeps format tag at the start of sub-format GUID
+				if (format == 0xfffe && chunk_size >= 26) {
+					format = ReadLe16(chunk + 32);
+				}
+				format_found = true;
+			}
+			pos = next;
+		}
+		return true;
+	}
+
+	bool CreateDataCodec(kaldi::uint32 format, kaldi::uint32 channels, kaldi::uint32 frequency,
+			kaldi::uint32 block_align, kaldi::uint32 bits) {
+		std::ostringstream error;
+		if (format == 1 && bits == 16) {
+			data_codec_.reset(new Pcm16Codec());
+		} else if (format == 6) {
+			data_codec_.reset(new G711Codec(true));
+		} else if (format == 7) {
+			data_codec_.reset(new G711Codec(false));
+		} else if (format == 0x11 && block_align > 0) {
+			data_codec_.reset(new ImaAdpcmCodec(block_align));
+		} else {
+			error << "Unsupported WAV format " << format << " of " << bits << " bits";
+			error_ = error.str();
+			return false;
+		}
+		if (channels == 0 || frequency == 0) {
+			error_ = "Bad WAV format chunk";
+			return false;
+		}
+		frequency_ = frequency;
+		channels_ = channels;
+		channel_index_ = std::min<kaldi::int32>(channel_index_, channels - 1);
+		data_codec_->Format(frequency_, channels_, channel_index_);
+		return true;
+	}
+
+	std::string header_;
+	std::auto_ptr<AudioCodec> data_codec_;
+	kaldi::uint64 data_left_;
+	bool data_limited_;
+};
+
+AudioCodec *AudioCodec::Create(const std::string &name) {
+	if (name == PCM) {
+		return new Pcm16Codec();
+	} else if (name == WAV) {
+		return new WavCodec();
+	} else if (name == MULAW) {
+		return new G711Codec(false);
+	} else if (name == ALAW) {
+		return new G711Codec(true);
+	} else if (name == ADPCM) {
+		return new ImaAdpcmCodec(0);
+#ifdef HAVE_FLAC
+	} else if (name == FLAC) {
+		return new FlacCodec();
+#endif
+	}
+	return NULL;
+}
+
+bool AudioCodec::Supported(const std::string &name) {
+	if (name == PCM) {
+		return true;
+	}
+	std::auto_ptr<AudioCodec> codec(Create(name));
+	return codec.get() != NULL;
+}
+
+std::string AudioCodec::ForContentType(const std::string &content_type) {
+	std::string type = content_type.substr(0, content_type.find(';'));
+	type.erase(std::remove_if(type.begin(), type.end(), ::isspace), type.end());
+	std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+
+	if (type == "audio/wav" || type == "audio/x-wav" || type == "audio/wave" || type == "audio/vnd.wave") {
+		return WAV;
+	} else if (type == "audio/flac" || type == "audio/x-flac") {
+		return FLAC;
+	} else if (type == "audio/basic" || type == "audio/pcmu" || type == "audio/mulaw" || type == "audio/x-mulaw") {
+		return MULAW;
+	} else if (type == "audio/pcma" || type == "audio/alaw" || type == "audio/x-alaw") {
+		return ALAW;
+	} else if (type == "audio/adpcm" || type == "audio/x-adpcm") {
+		return ADPCM;
+	}
+	return PCM;
+}
+
+kaldi::int32 AudioCodec::RateForContentType(const std::string &content_type) {
+	std::string type = content_type;
+	type.erase(std::remove_if(type.begin(), type.end(), ::isspace), type.end());
+	std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+
+	size_t pos = type.find(";rate=");
+	if (pos == std::string::npos) {
+		return 0;
+	}
+	return atoi(type.c_str() + pos + 6);
+}
+
+} /* namespace apiai */
@@ -0,0 +1,86 @@
+// AudioCodec.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_AUDIOCODEC_H_
+#define APIAI_DECODER_AUDIOCODEC_H_
+
+#include "base/kaldi-types.h"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Incremental decoder of compressed or containerized audio stream.
+ * Stream is passed in pieces as it arrives and samples of the selected
+ * channel are produced as soon as data encoding them is complete, so that
+ * recognition starts on the first received packet. Samples are in signed
+ * 16 bits range, the same as of raw PCM input.
+ */
+class AudioCodec {
+public:
+	AudioCodec() : frequency_(0), channels_(1), channel_index_(0) {};
+	virtual ~AudioCodec() {};
+
+	/** Set format of the stream without header, channel index is used for all streams */
+	void Format(kaldi::int32 frequency, kaldi::int32 channels, kaldi::int32 channel_index) {
+		frequency_ = frequency;
+		channels_ = channels;
+		channel_index_ = channel_index;
+	}
+
+	/** Decode next piece of stream appending samples. Returns false for malformed stream */
+	virtual bool Decode(const char *data, size_t size, std::vector<kaldi::BaseFloat> *samples) = 0;
+	/** Decode data kept till the end of stream. Returns false for truncated stream */
+	virtual bool Finish(std::vector<kaldi::BaseFloat> *samples) { return true; }
+	/** Get approximate number of stream bytes encoding given number of samples */
+	virtual size_t EncodedBytes(kaldi::int32 samples) const = 0;
+	/** Get true if EncodedBytes() is exact, false if it only estimates variable rate stream */
+	virtual bool FixedRate() const { return true; }
+
+	/** Get sampling frequency, zero until stream header is decoded */
+	kaldi::int32 Frequency() const { return frequency_; }
+	/** Get description of the stream error */
+	const std::string &Error() const { return error_; }
+
+	/**
+	 * Create codec of given name, NULL for unsupported names.
+	 * Raw PCM codec is only needed when the stream is resampled
+	 */
+	static AudioCodec *Create(const std::string &name);
+	/** Get true if codec name is supported, including "pcm" for raw PCM which needs no codec */
+	static bool Supported(const std::string &name);
+	/** Get codec name of MIME content type, "pcm" for unknown types */
+	static std::string ForContentType(const std::string &content_type);
+	/** Get sampling frequency of "rate" parameter of MIME content type, zero if it is not given */
+	static kaldi::int32 RateForContentType(const std::string &content_type);
+
+	static const std::string PCM;
+	static const std::string WAV;
+	static const std::string FLAC;
+	static const std::string MULAW;
+	static const std::string ALAW;
+	static const std::string ADPCM;
+protected:
+	kaldi::int32 frequency_;
+	kaldi::int32 channels_;
+	kaldi::int32 channel_index_;
+	std::string error_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_AUDIOCODEC_H_ */
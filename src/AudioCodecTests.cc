@@ -0,0 +1,238 @@
+// AudioCodecTests.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "AudioCodec.h"
+#include "base/kaldi-common.h"
+#include <memory>
+
+namespace apiai {
+
+	static std::vector<kaldi::BaseFloat> DecodeAll(const std::string &name, const std::string &stream, size_t piece_size,
+			kaldi::int32 channel_index = 0) {
+		std::auto_ptr<AudioCodec> codec(AudioCodec::Create(name));
+		KALDI_ASSERT(codec.get() != NULL);
+		codec->Format(16000, 1, channel_index);
+		std::vector<kaldi::BaseFloat> samples;
+		for (size_t i = 0; i < stream.size(); i += piece_size) {
+			KALDI_ASSERT(codec->Decode(stream.data() + i, std::min(piece_size, stream.size() - i), &samples));
+		}
+		KALDI_ASSERT(codec->Finish(&samples));
+		KALDI_ASSERT(codec->Frequency() == 16000);
+		return samples;
+	}
+
+	static void AppendLe(kaldi::uint32 value, int bytes, std::string *out) {
+		for (int i = 0; i < bytes; i++) {
+			*out += char((value >> (8 * i)) & 0xff);
+		}
+	}
+
+	static std::string WavHeader(kaldi::uint32 format, kaldi::uint32 channels, kaldi::uint32 block_align,
+			kaldi::uint32 bits, kaldi::uint32 data_size) {
+		std::string header = "RIFF";
+		AppendLe(0, 4, &header);
+		header += "WAVEfmt ";
+		AppendLe(16, 4, &header);
+		AppendLe(format, 2, &header);
+		AppendLe(channels, 2, &header);
+		AppendLe(16000, 4, &header);
+		AppendLe(16000 * block_align, 4, &header);
+		AppendLe(block_align, 2, &header);
+		AppendLe(bits, 2, &header);
+		// Chunks before data are skipped
+		header += "LIST";
+		AppendLe(3, 4, &header);
+		header += std::string("abc\0", 4);
+		header += "data";
+		AppendLe(data_size, 4, &header);
+		return header;
+	}
+
+	void TestG711() {
+		const char mulaw[] = { char(0xff), char(0x7f), char(0x00), char(0x80) };
+		std::vector<kaldi::BaseFloat> samples = DecodeAll(AudioCodec::MULAW, std::string(mulaw, 4), 3);
+		KALDI_ASSERT(samples.size() == 4);
+		KALDI_ASSERT(samples[0] == 0 && samples[1] == 0 && samples[2] == -32124 && samples[3] == 32124);
+
+		const char alaw[] = { char(0xd5), char(0x55), char(0x2a), char(0xaa) };
+		samples = DecodeAll(AudioCodec::ALAW, std::string(alaw, 4), 1);
+		KALDI_ASSERT(samples.size() == 4);
+		KALDI_ASSERT(samples[0] == 8 && samples[1] == -8 && samples[2] == -32256 && samples[3] == 32256);
+	}
+
+	void TestWavPcm() {
+		std::string stream = WavHeader(1, 2, 4, 16, 0);
+		for (int i = 0; i < 100; i++) {
+			AppendLe(kaldi::uint16(-i), 2, &stream);
+			AppendLe(i * 300, 2, &stream);
+		}
+		// Header and frames are split between pieces
+		std::vector<kaldi::BaseFloat> samples = DecodeAll(AudioCodec::WAV, stream, 3, 1);
+		KALDI_ASSERT(samples.size() == 100);
+		for (int i = 0; i < 100; i++) {
+			KALDI_ASSERT(samples[i] == i * 300);
+		}
+
+		// Data after data chunk of known size is ignored
+		stream = WavHeader(7, 1, 1, 8, 2) + std::string(4, char(0x80));
+		samples = DecodeAll(AudioCodec::WAV, stream, 5);
+		KALDI_ASSERT(samples.size() == 2 && samples[0] == 32124);
+
+		std::auto_ptr<AudioCodec> codec(AudioCodec::Create(AudioCodec::WAV));
+		std::vector<kaldi::BaseFloat> none;
+		KALDI_ASSERT(codec->Decode(stream.data(), 20, &none));
+		KALDI_ASSERT(!codec->Finish(&none));
+		codec.reset(AudioCodec::Create(AudioCodec::WAV));
+		KALDI_ASSERT(!codec->Decode("RIFF\0\0\0\0WAVX", 12, &none));
+		codec.reset(AudioCodec::Create(AudioCodec::WAV));
+		std::string float_header = WavHeader(3, 1, 4, 32, 0);
+		KALDI_ASSERT(!codec->Decode(float_header.data(), float_header.size(), &none));
+	}
+
+	void TestWavRawFallback() {
+		std::string stream;
+		for (int i = 0; i < 100; i++) {
+			AppendLe(kaldi::uint16(i * 300 - 15000), 2, &stream);
+		}
+		// Headerless PCM sent as audio/wav is decoded as raw PCM
+		std::vector<kaldi::BaseFloat> samples = DecodeAll(AudioCodec::WAV, stream, 3);
+		KALDI_ASSERT(samples.size() == 100);
+		for (int i = 0; i < 100; i++) {
+			KALDI_ASSERT(samples[i] == i * 300 - 15000);
+		}
+	}
+
+	void TestImaAdpcm() {
+		std::string nibbles;
+		for (int i = 0; i < 64; i++) {
+			nibbles += char((i * 37) & 0xff);
+		}
+		std::vector<kaldi::BaseFloat> continuous = DecodeAll(AudioCodec::ADPCM, nibbles, 7);
+		KALDI_ASSERT(continuous.size() == 128);
+		// Step 7 at index 0, nibble 4 adds the whole step
+		KALDI_ASSERT(DecodeAll(AudioCodec::ADPCM, std::string(1, char(0x04)), 1)[0] == 7);
+
+		// WAV block starts with its own state, which is the first sample
+		std::string block;
+		AppendLe(0, 4, &block);
+		block += nibbles;
+		std::string stream = WavHeader(0x11, 1, block.size(), 4, 0) + block + block.substr(0, 12);
+		std::vector<kaldi::BaseFloat> samples = DecodeAll(AudioCodec::WAV, stream, 11);
+		// Full block and the shorter last one
+		KALDI_ASSERT(samples.size() == 129 + 17);
+		KALDI_ASSERT(samples[0] == 0 && samples[129] == 0);
+		for (size_t i = 0; i < continuous.size(); i++) {
+			KALDI_ASSERT(samples[i + 1] == continuous[i]);
+		}
+		for (size_t i = 0; i < 16; i++) {
+			KALDI_ASSERT(samples[i + 130] == continuous[i]);
+		}
+	}
+
+	void TestFlac() {
+#ifdef HAVE_FLAC
+		// 16 kHz mono stream of verbatim and constant frames of 16 samples, the last one is shorter
+		static const unsigned char flac[] = {
+			0x66, 0x4c, 0x61, 0x43, 0x80, 0x00, 0x00, 0x22, 0x00, 0x10, 0x00, 0x10,
+			0x00, 0x00, 0x0c, 0x00, 0x00, 0x2a, 0x03, 0xe8, 0x00, 0xf0, 0x00, 0x00,
+			0x00, 0x4a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xf8, 0x65, 0x08, 0x00, 0x0f,
+			0xd8, 0x02, 0xff, 0x01, 0x07, 0x8c, 0x0b, 0x8c, 0x09, 0x1e, 0x03, 0xec,
+			0xfb, 0xe4, 0xf4, 0xcb, 0xf4, 0x7d, 0xf8, 0x9b, 0xff, 0x33, 0x07, 0xb2,
+			0x0b, 0x94, 0x09, 0x04, 0x03, 0xbd, 0xfb, 0xb5, 0xf4, 0xb2, 0x34, 0xb0,
+			0xff, 0xf8, 0x65, 0x08, 0x01, 0x0f, 0xcd, 0x00, 0x00, 0x00, 0xda, 0x80,
+			0xff, 0xf8, 0x65, 0x08, 0x02, 0x0f, 0xf2, 0x02, 0xfa, 0x59, 0xf5, 0x83,
+			0xf4, 0x9d, 0xf8, 0x13, 0x00, 0xc9, 0x08, 0x22, 0x0a, 0xa8, 0x09, 0xb1,
+			0x03, 0x2c, 0xfa, 0x2b, 0xf5, 0x6d, 0xf4, 0xa9, 0xf8, 0x3c, 0x00, 0xfb,
+			0x08, 0x46, 0x0a, 0xad, 0xd5, 0xd6, 0xff, 0xf8, 0x65, 0x08, 0x03, 0x0f,
+			0xe7, 0x00, 0xff, 0xfb, 0xa2, 0x99, 0xff, 0xf8, 0x65, 0x08, 0x04, 0x09,
+			0x9e, 0x02, 0x07, 0x8d, 0x0b, 0xb3, 0x09, 0x59, 0x01, 0x9b, 0xfa, 0xa2,
+			0xf5, 0x2f, 0xf3, 0xd4, 0xf9, 0xb9, 0x01, 0x92, 0x07, 0xaf, 0x17, 0x95,
+		};
+		static const kaldi::int16 pcm[] = {
+			-255, 1932, 2956, 2334, 1004, -1052, -2869, -2947, -1893, -205, 1970, 2964, 2308, 957, -1099, -2894,
+			0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+			-1447, -2685, -2915, -2029, 201, 2082, 2728, 2481, 812, -1493, -2707, -2903, -1988, 251, 2118, 2733,
+			-5, -5, -5, -5, -5, -5, -5, -5, -5, -5, -5, -5, -5, -5, -5, -5,
+			1933, 2995, 2393, 411, -1374, -2769, -3116, -1607, 402, 1967,
+		};
+		std::string stream(reinterpret_cast<const char*>(flac), sizeof(flac));
+		const size_t pcm_size = sizeof(pcm) / sizeof(pcm[0]);
+		for (size_t piece_size = 1; piece_size < 12; piece_size += 3) {
+			std::vector<kaldi::BaseFloat> samples = DecodeAll(AudioCodec::FLAC, stream, piece_size);
+			KALDI_ASSERT(samples.size() == pcm_size);
+			for (size_t i = 0; i < pcm_size; i++) {
+				KALDI_ASSERT(samples[i] == pcm[i]);
+			}
+		}
+
+		// Frame is decoded as soon as the header of the next frame is received,
+		// so the short frame of silence is not held till more data comes
+		std::auto_ptr<AudioCodec> codec(AudioCodec::Create(AudioCodec::FLAC));
+		std::vector<kaldi::BaseFloat> samples;
+		KALDI_ASSERT(codec->Decode(stream.data(), 149, &samples));
+		KALDI_ASSERT(samples.size() == 48);
+		KALDI_ASSERT(codec->Decode(stream.data() + 149, 8, &samples));
+		KALDI_ASSERT(samples.size() == 64 && samples[63] == pcm[63]);
+		KALDI_ASSERT(codec->Decode(stream.data() + 157, stream.size() - 157, &samples));
+		KALDI_ASSERT(codec->Finish(&samples) && samples.size() == pcm_size);
+
+		std::auto_ptr<AudioCodec> truncated(AudioCodec::Create(AudioCodec::FLAC));
+		KALDI_ASSERT(!truncated->Finish(&samples));
+
+		// First frame samples -8, 25864, 1295, -26368 look like a frame header with valid CRC-8,
+		// frame is not decoded till its CRC-16 is checked when the rest of it is received
+		std::string false_sync(stream);
+		static const unsigned char false_sync_frame[] = {
+			0xff, 0xf8, 0x65, 0x08, 0x05, 0x0f, 0x99, 0x00,
+		};
+		false_sync.replace(54, sizeof(false_sync_frame), reinterpret_cast<const char*>(false_sync_frame),
+				sizeof(false_sync_frame));
+		false_sync[82] = char(0xaf);
+		false_sync[83] = char(0x53);
+		std::auto_ptr<AudioCodec> false_sync_codec(AudioCodec::Create(AudioCodec::FLAC));
+		samples.clear();
+		KALDI_ASSERT(false_sync_codec->Decode(false_sync.data(), 64, &samples) && samples.empty());
+		KALDI_ASSERT(false_sync_codec->Decode(false_sync.data() + 64, false_sync.size() - 64, &samples));
+		KALDI_ASSERT(false_sync_codec->Finish(&samples) && samples.size() == pcm_size);
+		KALDI_ASSERT(samples[1] == pcm[1] && samples[2] == -8 && samples[5] == -26368 && samples[6] == pcm[6]);
+#endif
+	}
+
+	void TestContentType() {
+		KALDI_ASSERT(AudioCodec::ForContentType("audio/x-wav") == AudioCodec::WAV);
+		KALDI_ASSERT(AudioCodec::ForContentType("Audio/FLAC; rate=16000") == AudioCodec::FLAC);
+		KALDI_ASSERT(AudioCodec::ForContentType("audio/basic") == AudioCodec::MULAW);
+		KALDI_ASSERT(AudioCodec::ForContentType("application/octet-stream") == AudioCodec::PCM);
+		KALDI_ASSERT(AudioCodec::ForContentType("") == AudioCodec::PCM);
+		KALDI_ASSERT(AudioCodec::Supported(AudioCodec::PCM) && AudioCodec::Supported(AudioCodec::ADPCM));
+		KALDI_ASSERT(!AudioCodec::Supported("mp3"));
+		KALDI_ASSERT(AudioCodec::RateForContentType("audio/L16; Rate=8000") == 8000);
+		KALDI_ASSERT(AudioCodec::RateForContentType("audio/x-wav") == 0);
+	}
+
+} /* namespace apiai */
+
+int main(int argn, char *argv[]) {
+	using namespace apiai;
+
+	TestG711();
+	TestWavPcm();
+	TestWavRawFallback();
+	TestImaAdpcm();
+	TestFlac();
+	TestContentType();
+	return 0;
+}
@@ -0,0 +1,76 @@
+// AudioInput.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_AUDIOINPUT_H_
+#define APIAI_DECODER_AUDIOINPUT_H_
+
+#include "Timing.h"
+#include <stddef.h>
+#include <istream>
+
+namespace apiai {
+
+/**
+ * Source of raw audio bytes with deadline-limited reads
+ */
+class AudioInput {
+public:
+	virtual ~AudioInput() {};
+
+	/**
+	 * Read up to length bytes. Waits until length bytes are read, input is
+	 * finished or deadline is passed. Deadline given as getMilliseconds()
+	 * time, non-positive value means no deadline.
+	 * Returns number of bytes read.
+	 */
+	virtual size_t Read(char *data, size_t length, milliseconds_t deadline_ms) = 0;
+
+	/**
+	 * Get number of bytes which may be read without waiting.
+	 * May be less than actually received, but never more.
+	 */
+	virtual size_t Available(void) = 0;
+
+	/** Get true if the last read stopped because of the deadline */
+	virtual bool TimedOut(void) const = 0;
+
+	/** Get true if input failed */
+	virtual bool Failed(void) const = 0;
+};
+
+/**
+ * Blocking audio input from standard stream, deadlines are not supported
+ */
+class StreamAudioInput : public AudioInput {
+public:
+	StreamAudioInput(std::istream *is) : is_(is) {};
+
+	virtual size_t Read(char *data, size_t length, milliseconds_t deadline_ms) {
+		is_->read(data, length);
+		return is_->gcount();
+	}
+	virtual size_t Available(void) {
+		std::streamsize available = is_->rdbuf()->in_avail();
+		return available > 0 ? size_t(available) : 0;
+	}
+	virtual bool TimedOut(void) const { return false; }
+	virtual bool Failed(void) const { return is_->bad(); }
+private:
+	std::istream *is_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_AUDIOINPUT_H_ */
@@ -0,0 +1,100 @@
+// BestPathDecoder.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "BestPathDecoder.h"
+#include "util/text-utils.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace apiai {
+
+static kaldi::FasterDecoderOptions ToFasterOptions(const kaldi::LatticeFasterDecoderConfig &config) {
+	kaldi::FasterDecoderOptions options;
+	options.beam = config.beam;
+	options.max_active = config.max_active;
+	options.min_active = config.min_active;
+	options.beam_delta = config.beam_delta;
+	options.hash_ratio = config.hash_ratio;
+	return options;
+}
+
+BestPathDecoder::BestPathDecoder(const fst::Fst<fst::StdArc> &fst, const kaldi::LatticeFasterDecoderConfig &config)
+	: kaldi::FasterDecoder(fst, ToFasterOptions(config)) {
+}
+
+void BestPathDecoder::SetOptions(const kaldi::LatticeFasterDecoderConfig &config) {
+	kaldi::FasterDecoder::SetOptions(ToFasterOptions(config));
+}
+
+const BestPathDecoder::Token *BestPathDecoder::BestToken() const {
+	const Token *best = NULL;
+	for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
+		if (best == NULL || e->val->cost_ < best->cost_) {
+			best = e->val;
+		}
+	}
+	return best;
+}
+
+kaldi::BaseFloat BestPathDecoder::FinalRelativeCost() const {
+	const double infinity = std::numeric_limits<double>::infinity();
+	double best_cost = infinity, best_cost_with_final = infinity;
+	for (const Elem *e = toks_.GetList(); e != NULL; e = e->tail) {
+		double cost = e->val->cost_;
+		best_cost = std::min(best_cost, cost);
+		best_cost_with_final = std::min(best_cost_with_final, cost + fst_.Final(e->key).Value());
+	}
+	if (best_cost == infinity || best_cost_with_final == infinity) {
+		return std::numeric_limits<kaldi::BaseFloat>::infinity();
+	}
+	return best_cost_with_final - best_cost;
+}
+
+kaldi::int32 BestPathDecoder::TrailingSilenceFrames(const kaldi::TransitionModel &tmodel,
+		const kaldi::ConstIntegerSet<kaldi::int32> &silence_phones) const {
+	kaldi::int32 frames = 0;
+	// Non-emitting arcs have no phone, they neither count nor end the silence
+	for (const Token *tok = BestToken(); tok != NULL; tok = tok->prev_) {
+		kaldi::int32 tid = tok->arc_.ilabel;
+		if (tid == 0) {
+			continue;
+		}
+		if (!silence_phones.count(tmodel.TransitionIdToPhone(tid))) {
+			break;
+		}
+		frames++;
+	}
+	return frames;
+}
+
+bool BestPathDecoder::EndpointDetected(const kaldi::OnlineEndpointConfig &config,
+		const kaldi::TransitionModel &tmodel, kaldi::BaseFloat frame_shift_in_seconds) {
+	if (NumFramesDecoded() == 0) {
+		return false;
+	}
+	if (silence_phones_str_ != config.silence_phones || silence_phones_.size() == 0) {
+		std::vector<kaldi::int32> phones;
+		if (!kaldi::SplitStringToIntegers(config.silence_phones, ":", false, &phones)) {
+			KALDI_ERR << "Bad --silence-phones option in endpointing config: " << config.silence_phones;
+		}
+		silence_phones_.Init(phones);
+		silence_phones_str_ = config.silence_phones;
+	}
+	return kaldi::EndpointDetected(config, NumFramesDecoded(),
+			TrailingSilenceFrames(tmodel, silence_phones_), frame_shift_in_seconds, FinalRelativeCost());
+}
+
+} /* namespace apiai */
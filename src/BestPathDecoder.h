@@ -0,0 +1,65 @@
+// BestPathDecoder.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_BESTPATHDECODER_H_
+#define APIAI_DECODER_BESTPATHDECODER_H_
+
+#include "decoder/faster-decoder.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "hmm/transition-model.h"
+#include "online2/online-endpoint.h"
+#include "util/const-integer-set.h"
+#include <string>
+
+namespace apiai {
+
+/**
+ * Search keeping only back-pointers of the surviving tokens, for requests
+ * which need the single best result. Tokens are released as soon as no
+ * active token refers to them, so memory does not grow with utterance
+ * length and no lattice is determinized at the end of the utterance.
+ */
+class BestPathDecoder : public kaldi::FasterDecoder {
+public:
+	BestPathDecoder(const fst::Fst<fst::StdArc> &fst, const kaldi::LatticeFasterDecoderConfig &config);
+
+	/** Apply beam and active tokens limits of lattice decoder options */
+	void SetOptions(const kaldi::LatticeFasterDecoderConfig &config);
+
+	/**
+	 * Cost of the best token with final cost relative to the best token,
+	 * infinity if no active state is final. Same as for lattice decoder
+	 */
+	kaldi::BaseFloat FinalRelativeCost() const;
+
+	/** Number of frames of the best path end which are aligned to silence phones */
+	kaldi::int32 TrailingSilenceFrames(const kaldi::TransitionModel &tmodel,
+			const kaldi::ConstIntegerSet<kaldi::int32> &silence_phones) const;
+
+	/** Endpoint rules check, the same as kaldi::EndpointDetected does for lattice decoder */
+	bool EndpointDetected(const kaldi::OnlineEndpointConfig &config,
+			const kaldi::TransitionModel &tmodel, kaldi::BaseFloat frame_shift_in_seconds);
+private:
+	/** Best token of the last decoded frame, NULL if none */
+	const Token *BestToken() const;
+
+	/** Silence phones of the last endpoint config, parsed once */
+	std::string silence_phones_str_;
+	kaldi::ConstIntegerSet<kaldi::int32> silence_phones_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_BESTPATHDECODER_H_ */
@@ -35,6 +35,13 @@ public:
 	virtual void RegisterOptions(kaldi::OptionsItf &po) = 0;
 	/** Initialize decoder */
 	virtual bool Initialize(kaldi::OptionsItf &po) = 0;
+	/**
+	 * Reload models for all clones. Requests already started keep using
+	 * previous models. Returns false if models are not reloaded.
+	 */
+	virtual bool Reload() { return false; }
+	/** Append decoder state metrics as comma separated JSON object members */
+	virtual void AppendMetrics(std::string *json) {}
 	/** Perform decoding routine */
 	virtual void Decode(Request &request, Response &response) = 0;
 };
@@ -0,0 +1,146 @@
+// EnergyVad.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "EnergyVad.h"
+#include <math.h>
+
+namespace apiai {
+
+const kaldi::int32 FRAME_MS = 10;
+/** Full scale of 16 bit samples */
+const double SAMPLE_FULL_SCALE = 32768.0;
+/** Energy margin below threshold at which frames with high zero-crossing rate are still speech */
+const double ZCR_ENERGY_MARGIN_DB = 10.0;
+
+EnergyVad::EnergyVad()
+	: enabled_(false), energy_threshold_db_(-45), zcr_threshold_(0.25), padding_ms_(300), max_silence_ms_(1000),
+	  frame_size_(0), padding_(0), max_silence_(0), endpoint_silence_(0), passed_silence_(0),
+	  dropping_(true), speech_detected_(false)
+{
+}
+
+void EnergyVad::RegisterOptions(kaldi::OptionsItf &po) {
+	po.Register("vad", &enabled_,
+			"Drop leading and long internal silences before feature extraction");
+	po.Register("vad-energy-threshold", &energy_threshold_db_,
+			"Frame energy in dB relative to full scale above which frame is speech");
+	po.Register("vad-zcr-threshold", &zcr_threshold_,
+			"Zero-crossing rate above which frame slightly below energy threshold is speech");
+	po.Register("vad-padding-ms", &padding_ms_,
+			"Silence kept before and after speech, in milliseconds");
+	po.Register("vad-max-silence-ms", &max_silence_ms_,
+			"Silences longer than this are shortened to padding on both sides, in milliseconds");
+}
+
+void EnergyVad::Reset(kaldi::BaseFloat sampling_rate, kaldi::BaseFloat endpoint_silence_secs) {
+	frame_size_ = size_t(sampling_rate * FRAME_MS / 1000);
+	padding_ = size_t(sampling_rate * padding_ms_ / 1000);
+	max_silence_ = std::max(2 * padding_, size_t(sampling_rate * max_silence_ms_ / 1000));
+	// Decoder counts trailing silence from the last speech phone, which may end before VAD speech does
+	endpoint_silence_ = endpoint_silence_secs > 0 ? size_t(sampling_rate * endpoint_silence_secs) + padding_ : 0;
+	passed_silence_ = 0;
+
+	frame_.clear();
+	silence_.clear();
+	dropping_ = true;
+	speech_detected_ = false;
+}
+
+bool EnergyVad::IsSpeech(const kaldi::BaseFloat *frame, size_t length) const {
+	double energy = 0;
+	size_t crossings = 0;
+	for (size_t i = 0; i < length; i++) {
+		energy += frame[i] * frame[i];
+		if (i > 0 && ((frame[i] >= 0) != (frame[i - 1] >= 0))) {
+			crossings++;
+		}
+	}
+	double energy_db = 10 * log10(energy / length / (SAMPLE_FULL_SCALE * SAMPLE_FULL_SCALE) + 1e-10);
+	if (energy_db >= energy_threshold_db_) {
+		return true;
+	}
+	return energy_db >= energy_threshold_db_ - ZCR_ENERGY_MARGIN_DB
+			&& length > 1 && double(crossings) / (length - 1) >= zcr_threshold_;
+}
+
+void EnergyVad::AcceptFrame(const kaldi::BaseFloat *frame, size_t length, std::vector<kaldi::BaseFloat> *output) {
+	if (IsSpeech(frame, length)) {
+		// Short silence is kept whole, long one only by padding before speech
+		size_t kept = dropping_ ? std::min(padding_, silence_.size()) : silence_.size();
+		output->insert(output->end(), silence_.end() - kept, silence_.end());
+		output->insert(output->end(), frame, frame + length);
+		silence_.clear();
+		dropping_ = false;
+		passed_silence_ = 0;
+		speech_detected_ = true;
+		return;
+	}
+
+	if (!dropping_ && endpoint_silence_ > 0) {
+		if (passed_silence_ < endpoint_silence_) {
+			output->insert(output->end(), frame, frame + length);
+			passed_silence_ += length;
+			return;
+		}
+		// Padding after speech is already passed, only one before the next speech is kept
+		dropping_ = true;
+	}
+
+	silence_.insert(silence_.end(), frame, frame + length);
+	if (!dropping_ && silence_.size() > max_silence_) {
+		output->insert(output->end(), silence_.begin(), silence_.begin() + padding_);
+		silence_.erase(silence_.begin(), silence_.begin() + padding_);
+		dropping_ = true;
+	}
+	// Trimmed once per padding length rather than on every frame
+	if (dropping_ && silence_.size() >= 2 * padding_ + length) {
+		silence_.erase(silence_.begin(), silence_.end() - padding_);
+	}
+}
+
+void EnergyVad::Accept(const kaldi::VectorBase<kaldi::BaseFloat> &waveform, std::vector<kaldi::BaseFloat> *output) {
+	output->clear();
+	const kaldi::BaseFloat *data = waveform.Data();
+	size_t length = waveform.Dim();
+	size_t offset = 0;
+
+	if (frame_.size() > 0) {
+		offset = std::min(length, frame_size_ - frame_.size());
+		frame_.insert(frame_.end(), data, data + offset);
+		if (frame_.size() < frame_size_) {
+			return;
+		}
+		AcceptFrame(frame_.data(), frame_.size(), output);
+		frame_.clear();
+	}
+	for (; offset + frame_size_ <= length; offset += frame_size_) {
+		AcceptFrame(data + offset, frame_size_, output);
+	}
+	frame_.insert(frame_.end(), data + offset, data + length);
+}
+
+void EnergyVad::Finish(std::vector<kaldi::BaseFloat> *output) {
+	output->clear();
+	if (frame_.size() > 0) {
+		AcceptFrame(frame_.data(), frame_.size(), output);
+		frame_.clear();
+	}
+	if (!dropping_) {
+		output->insert(output->end(), silence_.begin(), silence_.begin() + std::min(padding_, silence_.size()));
+	}
+	silence_.clear();
+}
+
+} /* namespace apiai */
@@ -0,0 +1,82 @@
+// EnergyVad.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_ENERGYVAD_H_
+#define APIAI_DECODER_ENERGYVAD_H_
+
+#include "matrix/kaldi-vector.h"
+#include "util/parse-options.h"
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Streaming voice activity detector dropping silent audio before feature extraction.
+ * Audio is classified in 10 ms frames by energy, low energy frames with high
+ * zero-crossing rate (unvoiced consonants) are treated as speech as well.
+ * Leading silence is dropped, silences longer than max silence are shortened
+ * to padding on both sides of the speech, so that word edges are kept intact.
+ * With endpointing, silence is shortened only after the longest endpoint rule.
+ */
+class EnergyVad {
+public:
+	EnergyVad();
+
+	void RegisterOptions(kaldi::OptionsItf &po);
+
+	bool Enabled() const { return enabled_; }
+
+	/**
+	 * Prepare for new request. Trailing silence up to endpoint silence length
+	 * is passed as it arrives, so that endpoint rules of the decoder can see it
+	 */
+	void Reset(kaldi::BaseFloat sampling_rate, kaldi::BaseFloat endpoint_silence_secs = 0);
+	/** Classify audio chunk, replaces output with audio to be decoded */
+	void Accept(const kaldi::VectorBase<kaldi::BaseFloat> &waveform, std::vector<kaldi::BaseFloat> *output);
+	/** Finish input, replaces output with the rest of audio to be decoded */
+	void Finish(std::vector<kaldi::BaseFloat> *output);
+
+	/** Whether any speech frame is found since reset */
+	bool SpeechDetected() const { return speech_detected_; }
+private:
+	bool IsSpeech(const kaldi::BaseFloat *frame, size_t length) const;
+	void AcceptFrame(const kaldi::BaseFloat *frame, size_t length, std::vector<kaldi::BaseFloat> *output);
+
+	bool enabled_;
+	kaldi::BaseFloat energy_threshold_db_;
+	kaldi::BaseFloat zcr_threshold_;
+	kaldi::int32 padding_ms_;
+	kaldi::int32 max_silence_ms_;
+
+	size_t frame_size_;
+	size_t padding_;
+	size_t max_silence_;
+	/** Trailing silence passed through for endpointing, zero if disabled */
+	size_t endpoint_silence_;
+	/** Trailing silence already passed through since the last speech frame */
+	size_t passed_silence_;
+
+	/** Incomplete frame left from the previous chunk */
+	std::vector<kaldi::BaseFloat> frame_;
+	/** Silence following the last speech frame, or preceding speech while dropping */
+	std::vector<kaldi::BaseFloat> silence_;
+	/** Whether silence is too long and is dropped except of padding before the next speech */
+	bool dropping_;
+	bool speech_detected_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_ENERGYVAD_H_ */
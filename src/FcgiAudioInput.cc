@@ -0,0 +1,134 @@
+// FcgiAudioInput.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FcgiAudioInput.h"
+#include "FcgxStreamData.h"
+#include "FcgiProtocol.h"
+#include "base/kaldi-error.h"
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+namespace apiai {
+
+bool FcgxAudioInput::HasBufferedData() const {
+	if (stream_->rdNext != stream_->stop) {
+		return true;
+	}
+#ifdef HAVE_FCGX_STREAM_LAYOUT
+	const FcgxStreamDataPrefix *data = static_cast<const FcgxStreamDataPrefix*>(stream_->data);
+	return (data != NULL) && (data->buffStop > stream_->stop);
+#else
+	return false;
+#endif
+}
+
+bool FcgxAudioInput::WaitReadable(milliseconds_t deadline_ms) {
+	while (true) {
+		milliseconds_t timeout = deadline_ms - getMilliseconds();
+		if (timeout <= 0) {
+			return false;
+		}
+		struct pollfd pfd;
+		pfd.fd = fd_;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int result = poll(&pfd, 1, timeout);
+		if (result > 0) {
+			return true;
+		}
+		if (result < 0 && errno != EINTR) {
+			// Let blocking read report the failure
+			KALDI_WARN << "Failed to poll request socket: " << strerror(errno);
+			return true;
+		}
+	}
+}
+
+size_t FcgxAudioInput::Available(void) {
+	if (stream_->isClosed) {
+		return 0;
+	}
+	size_t available = stream_->stop - stream_->rdNext;
+#ifdef HAVE_FCGX_STREAM_LAYOUT
+	const FcgxStreamDataPrefix *data = static_cast<const FcgxStreamDataPrefix*>(stream_->data);
+	if (data == NULL || data->contentLen > 0 || data->skip) {
+		// Rest of the current record is not received yet
+		return available;
+	}
+	// Raw records follow the padding of the current one, only content of STDIN
+	// records is counted, and counting stops at the end of the stream
+	const unsigned char *record = stream_->stop + data->paddingLen;
+	while (record + FcgiProtocol::HEADER_LENGTH <= data->buffStop) {
+		size_t content_length = (size_t(record[4]) << 8) | record[5];
+		if (record[1] != FcgiProtocol::STDIN || content_length == 0) {
+			break;
+		}
+		const unsigned char *content = record + FcgiProtocol::HEADER_LENGTH;
+		if (content + content_length > data->buffStop) {
+			// libfcgi passes received part of a record content as well
+			available += data->buffStop - content;
+			break;
+		}
+		available += content_length;
+		record = content + content_length + record[6];
+	}
+#endif
+	return available;
+}
+
+size_t FcgxAudioInput::Read(char *data, size_t length, milliseconds_t deadline_ms) {
+	timed_out_ = false;
+#ifndef HAVE_FCGX_STREAM_LAYOUT
+	// Without access to records buffered by libfcgi polling the socket may
+	// wait for data already received, so deadlines are not enforced
+	deadline_ms = 0;
+#endif
+	if (deadline_ms <= 0) {
+		int count = FCGX_GetStr(data, length, stream_);
+		if (count < 0 || FCGX_GetError(stream_) != 0) {
+			failed_ = true;
+		}
+		return std::max(count, 0);
+	}
+
+	size_t total = 0;
+	while (total < length && !stream_->isClosed) {
+		if (!HasBufferedData() && !WaitReadable(deadline_ms)) {
+			timed_out_ = true;
+			break;
+		}
+		// Buffered data is consumed without blocking, otherwise at least
+		// one byte is available on socket and the whole record follows it
+		size_t wanted = length - total;
+		if (stream_->rdNext != stream_->stop) {
+			wanted = std::min(wanted, size_t(stream_->stop - stream_->rdNext));
+		} else {
+			wanted = 1;
+		}
+		int count = FCGX_GetStr(data + total, wanted, stream_);
+		if (count <= 0) {
+			if (FCGX_GetError(stream_) != 0) {
+				failed_ = true;
+			}
+			break;
+		}
+		total += count;
+	}
+	return total;
+}
+
+} /* namespace apiai */
@@ -0,0 +1,72 @@
+// FcgiAudioInput.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_FCGIAUDIOINPUT_H_
+#define APIAI_DECODER_FCGIAUDIOINPUT_H_
+
+#include "AudioInput.h"
+#include "FcgiEventServer.h"
+#include <fcgiapp.h>
+
+namespace apiai {
+
+/**
+ * Request body input of libfcgi request.
+ * Deadlines are enforced by polling the request socket
+ * whenever libfcgi stream has no buffered data left.
+ */
+class FcgxAudioInput : public AudioInput {
+public:
+	FcgxAudioInput(FCGX_Stream *stream, int fd) :
+		stream_(stream), fd_(fd), timed_out_(false), failed_(false) {};
+
+	virtual size_t Read(char *data, size_t length, milliseconds_t deadline_ms);
+	virtual size_t Available(void);
+	virtual bool TimedOut(void) const { return timed_out_; }
+	virtual bool Failed(void) const { return failed_; }
+private:
+	/** Check if stream has data which may be read without waiting on socket */
+	bool HasBufferedData() const;
+	/** Wait until socket is readable. Returns false on timeout */
+	bool WaitReadable(milliseconds_t deadline_ms);
+
+	FCGX_Stream *stream_;
+	int fd_;
+	bool timed_out_;
+	bool failed_;
+};
+
+/**
+ * Request body input of event loop request
+ */
+class FcgiEventAudioInput : public AudioInput {
+public:
+	FcgiEventAudioInput(FcgiEventServer::Request &request) :
+		request_(request), timed_out_(false) {};
+
+	virtual size_t Read(char *data, size_t length, milliseconds_t deadline_ms) {
+		return request_.Read(data, length, deadline_ms, &timed_out_);
+	}
+	virtual size_t Available(void) { return request_.Available(); }
+	virtual bool TimedOut(void) const { return timed_out_; }
+	virtual bool Failed(void) const { return false; }
+private:
+	FcgiEventServer::Request &request_;
+	bool timed_out_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_FCGIAUDIOINPUT_H_ */
@@ -17,6 +17,8 @@
 #include "ResponseJsonWriter.h"
 #include "ResponseMultipartJsonWriter.h"
 #include "FcgiDecodingApp.h"
+#include "FcgiEventServer.h"
+#include "FcgiAudioInput.h"
 #include "QueryStringParser.h"
 #include <fcgio.h>
 #include <list>
@@ -24,6 +26,16 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <string.h>
+#include <map>
+#include <math.h>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
@@ -35,16 +47,43 @@ namespace apiai {
 const std::string PARAMETER_NAME_NBEST = "nbest";
 const std::string PARAMETER_NAME_INTERMEDIATE = "intermediate";
 const std::string PARAMETER_NAME_END_OF_SPEECH = "endofspeech";
+const std::string PARAMETER_NAME_BEST_PATH = "bestpath";
+const std::string PARAMETER_NAME_PARTIAL = "partial";
+const std::string PARAMETER_NAME_CODEC = "codec";
+const std::string PARAMETER_NAME_RATE = "rate";
+const std::string PARAMETER_NAME_MODEL = "model";
+const std::string PARAMETER_NAME_SESSION = "session";
 const std::string PARAMETER_MULTIPART = "multipart";
+const std::string PARAMETER_ADMIN = "admin";
+const std::string PARAMETER_TIMING = "timing";
+
+const std::string PARTIAL_FULL = "full";
+const std::string PARTIAL_DELTA = "delta";
+
+const std::string ADMIN_COMMAND_RELOAD = "reload";
+const std::string ADMIN_COMMAND_METRICS = "metrics";
+const std::string ADMIN_COMMAND_READY = "ready";
+
+/** Length of synthetic audio decoded by every worker on warm-up */
+const int WARMUP_AUDIO_MILLISECONDS = 3000;
+/** Sampling frequency of raw request audio */
+const int WARMUP_AUDIO_FREQUENCY = 16000;
+/** Number of synthetic requests decoded by every worker on warm-up */
+const int WARMUP_REQUESTS = 2;
 
 class ResponseParams {
 public:
 	bool multipart;
+	/** Add stage timing summary to the result */
+	bool timing;
+	/** Admin command instead of recognition, empty for recognition requests */
+	std::string admin;
 
 	static bool default_multipart;
 	static bool default_endofspeech;
+	static bool default_bestpath;
 
-	ResponseParams() : multipart(default_multipart) {};
+	ResponseParams() : multipart(default_multipart), timing(false) {};
 };
 
 // Multipart option default value
@@ -53,6 +92,9 @@ bool ResponseParams::default_multipart = false;
 // End-of-speech detection option default value
 bool ResponseParams::default_endofspeech = true;
 
+// Best path only search option default value
+bool ResponseParams::default_bestpath = false;
+
 bool to_bool(std::string &str) {
     std::transform(str.begin(), str.end(), str.begin(), ::tolower);
     std::istringstream is(str);
@@ -66,8 +108,7 @@ bool to_bool(const char *chars) {
     return to_bool(str);
 }
 
-void apply_request_parameters(FCGX_Request &request, RequestRawReader &reader, ResponseParams &params) {
-	char *queryString = FCGX_GetParam("QUERY_STRING", request.envp);
+void apply_request_parameters(const char *queryString, RequestRawReader &reader, ResponseParams &params) {
 	if (queryString) {
 		QueryStringParser queryStringParser(queryString);
 		std::string name, value;
@@ -81,9 +122,41 @@ void apply_request_parameters(FCGX_Request &request, RequestRawReader &reader, R
 			} else if (PARAMETER_NAME_END_OF_SPEECH == name) {
 				reader.DoEndpointing(to_bool(value.data()));
 				KALDI_VLOG(1) << "Setting end-of-speech: " << (reader.DoEndpointing() ? "enabled" : "disabled");
+			} else if (PARAMETER_NAME_BEST_PATH == name) {
+				reader.BestPathOnly(to_bool(value.data()));
+				KALDI_VLOG(1) << "Setting best path only: " << (reader.BestPathOnly() ? "enabled" : "disabled");
+			} else if (PARAMETER_NAME_PARTIAL == name) {
+				if (PARTIAL_DELTA == value || PARTIAL_FULL == value) {
+					reader.PartialDelta(PARTIAL_DELTA == value);
+					KALDI_VLOG(1) << "Setting partial results: " << value;
+				} else {
+					KALDI_VLOG(1) << "Skipping unknown partial results mode \"" << value << "\"";
+				}
+			} else if (PARAMETER_NAME_CODEC == name) {
+				// Parameter overrides codec of the content type
+				if (reader.Codec(value)) {
+					KALDI_VLOG(1) << "Setting codec: " << value;
+				}
+			} else if (PARAMETER_NAME_RATE == name) {
+				if (reader.Rate(atoi(value.data()))) {
+					KALDI_VLOG(1) << "Setting input sampling frequency: " << value;
+				} else {
+					KALDI_VLOG(1) << "Unsupported input sampling frequency: " << value;
+				}
+			} else if (PARAMETER_NAME_MODEL == name) {
+				reader.Model(value);
+				KALDI_VLOG(1) << "Setting model: " << value;
+			} else if (PARAMETER_NAME_SESSION == name) {
+				reader.Session(value);
+				KALDI_VLOG(1) << "Setting session: " << value;
 			} else if (PARAMETER_MULTIPART == name) {
 				params.multipart = to_bool(value.data());
 				KALDI_VLOG(1) << "Setting multipart: " << (params.multipart ? "enabled" : "disabled");
+			} else if (PARAMETER_TIMING == name) {
+				params.timing = to_bool(value.data());
+				KALDI_VLOG(1) << "Setting timing: " << (params.timing ? "enabled" : "disabled");
+			} else if (PARAMETER_ADMIN == name) {
+				params.admin = value;
 			} else {
 				KALDI_VLOG(1) << "Skipping unknown parameter \"" << name << "\"";
 			}
@@ -97,16 +170,147 @@ void FcgiDecodingApp::RegisterOptions(kaldi::OptionsItf &po) {
     po.Register("fcgi-threads-number", &fcgi_threads_number_, "Number of FastCGI working threads");
     po.Register("fcgi-multipart", &ResponseParams::default_multipart, "Enable or disable multipart responses by default");
     po.Register("fcgi-endofspeech", &ResponseParams::default_endofspeech, "Enable or disable end-of-speech detection by default");
+    po.Register("fcgi-bestpath", &ResponseParams::default_bestpath, "Enable or disable best path only search "
+    		"(no lattice) by default for requests of a single result");
+    po.Register("fcgi-event-loop", &fcgi_event_loop_, "Serve connections with single event loop and process requests "
+    		"with --fcgi-threads-number workers, so that slow clients and keep-alive connections do not occupy worker threads");
+    po.Register("fcgi-stack-size", &fcgi_stack_size_kb_, "Request coroutine stack size in kilobytes, event loop mode only");
+    po.Register("fcgi-admin", &fcgi_admin_, "Enable admin requests, e.g. \"?admin=reload\" to reload models");
+    po.Register("fcgi-processes", &fcgi_processes_number_, "Number of worker processes forked after models are loaded. "
+    		"Every process runs --fcgi-threads-number threads, died processes are restarted");
+    po.Register("warmup", &warmup_, "Decode synthetic audio with every worker before it starts accepting "
+    		"requests, so that first requests do not pay for lazy initialization");
+    po.Register("ready-file", &ready_file_, "Create given file once all workers are warmed up and the process "
+    		"is ready to serve, e.g. for readiness probes. \"?admin=ready\" tells the same. With --fcgi-processes "
+    		"the file exists only while all worker processes are ready");
+    po.Register("trace-file", &trace_file_, "Append processing stages timing of every request to given file "
+    		"in Chrome trace event format (chrome://tracing, Perfetto)");
 }
 
+/**
+ * Event loop request handler, runs every request with its own decoder copy
+ */
+class FcgiDecodingApp::EventHandler : public FcgiEventServer::Handler {
+public:
+	EventHandler(FcgiDecodingApp &app) : app_(app) {};
+
+	virtual void HandleRequest(FcgiEventServer::Request &request) {
+		std::auto_ptr<Decoder> decoder(app_.decoder_.Clone());
+		FcgiEventAudioInput input(request);
+		// Coroutines of one worker interleave, so buffer is kept per request
+		std::string json_buffer;
+		app_.ProcessRequest(*decoder, request.GetParam("QUERY_STRING"), request.GetParam("CONTENT_TYPE"),
+				input, request.Out(), &json_buffer);
+	}
+private:
+	FcgiDecodingApp &app_;
+};
+
 void *FcgiDecodingApp::RunChildThread(void *arg) {
 	FcgiDecodingApp *app = (FcgiDecodingApp*)arg;
 	Decoder *decoder = app->decoder_.Clone();
+	if (app->warmup_) {
+		app->WarmUp(*decoder);
+	}
+	app->WorkerReady();
 	app->ProcessingRoutine(*decoder);
 	delete decoder;
 	return NULL;
 }
 
+void *FcgiDecodingApp::RunWarmUpThread(void *arg) {
+	FcgiDecodingApp *app = (FcgiDecodingApp*)arg;
+	std::auto_ptr<Decoder> decoder(app->decoder_.Clone());
+	app->WarmUp(*decoder);
+	app->WorkerReady();
+	return NULL;
+}
+
+/**
+ * Voiced speech-like signal: harmonics of a gliding pitch in syllable-rate
+ * bursts with some noise, so that it passes voice activity detection and
+ * produces real search activity
+ */
+static void GenerateWarmUpAudio(kaldi::int32 frequency, std::string *pcm) {
+	kaldi::int32 samples = WARMUP_AUDIO_MILLISECONDS * (frequency / 1000);
+	pcm->resize(samples * 2);
+	unsigned int seed = 1;
+	double phase = 0;
+	for (kaldi::int32 i = 0; i < samples; i++) {
+		double t = double(i) / frequency;
+		double pitch = 120 + 30 * sin(2 * M_PI * 0.7 * t);
+		phase += 2 * M_PI * pitch / frequency;
+		double voiced = 0;
+		for (int harmonic = 1; harmonic <= 6; harmonic++) {
+			voiced += sin(harmonic * phase) / harmonic;
+		}
+		double envelope = 0.5 - 0.5 * cos(2 * M_PI * 4 * t);
+		double noise = double(rand_r(&seed)) / RAND_MAX - 0.5;
+		kaldi::int16 sample = kaldi::int16(3000 * envelope * voiced + 300 * noise);
+		(*pcm)[2 * i] = char(sample & 0xff);
+		(*pcm)[2 * i + 1] = char((sample >> 8) & 0xff);
+	}
+}
+
+void FcgiDecodingApp::WarmUp(Decoder &decoder) {
+	milliseconds_t start = getMilliseconds();
+	std::string pcm;
+	GenerateWarmUpAudio(WARMUP_AUDIO_FREQUENCY, &pcm);
+	for (int i = 0; i < WARMUP_REQUESTS; i++) {
+		std::istringstream input(pcm);
+		RequestRawReader reader(&input);
+		// Intermediate results and n-best exercise all result paths
+		reader.IntermediateIntervalMillisec(500);
+		reader.BestCount(NBEST_MAX);
+		// Every other request takes the best path only search if requests use it by default
+		if (ResponseParams::default_bestpath && i % 2 == 1) {
+			reader.BestCount(1);
+			reader.BestPathOnly(true);
+		}
+		std::ostringstream output;
+		ResponseJsonWriter writer(&output);
+		decoder.Decode(reader, writer);
+	}
+	KALDI_VLOG(1) << "Worker warmed up in " << getMillisecondsSince(start) << " ms";
+}
+
+void FcgiDecodingApp::WorkerReady() {
+	if (__sync_sub_and_fetch(&workers_warming_up_, 1) > 0) {
+		return;
+	}
+	__sync_lock_test_and_set(&ready_, 1);
+	KALDI_LOG << "Ready to serve requests";
+	if (ready_pipe_[1] >= 0) {
+		// Supervisor retires the worker being replaced and creates ready file once all workers are ready
+		pid_t pid = getpid();
+		if (write(ready_pipe_[1], &pid, sizeof(pid)) != sizeof(pid)) {
+			KALDI_WARN << "Failed to report readiness to supervisor: " << strerror(errno);
+		}
+	} else {
+		// Ready file of worker processes is managed by their supervisor
+		UpdateReadyFile(true);
+	}
+}
+
+void FcgiDecodingApp::UpdateReadyFile(bool ready) {
+	if (ready_file_.size() == 0) {
+		return;
+	}
+	if (!ready) {
+		if (unlink(ready_file_.c_str()) != 0 && errno != ENOENT) {
+			KALDI_WARN << "Failed to remove ready file " << ready_file_ << ": " << strerror(errno);
+		}
+		return;
+	}
+	FILE *file = fopen(ready_file_.c_str(), "w");
+	if (file == NULL) {
+		KALDI_WARN << "Failed to create ready file " << ready_file_ << ": " << strerror(errno);
+	} else {
+		fprintf(file, "%d\n", int(getpid()));
+		fclose(file);
+	}
+}
+
 void FcgiDecodingApp::ProcessingRoutine(Decoder &decoder) {
     if (socket_id_ < 0) {
 	KALDI_WARN << "Socket not opened";
@@ -115,40 +319,238 @@ void FcgiDecodingApp::ProcessingRoutine(Decoder &decoder) {
 
     FCGX_Request request;
     FCGX_InitRequest(&request, socket_id_, 0);
-
-    while (FCGX_Accept_r(&request) == 0) {
-	fcgi_streambuf cin_fcgi_streambuf(request.in);
+    // Responses of all requests of this thread are serialized into the same buffer
+    std::string json_buffer;
+
+    while (EnterAccept()) {
+	int accepted = FCGX_Accept_r(&request);
+	LeaveAccept();
+	if (accepted != 0) {
+		break;
+	}
 	fcgi_streambuf cout_fcgi_streambuf(request.out);
 	fcgi_streambuf cerr_fcgi_streambuf(request.err);
 
-	std::istream fcgiin(&cin_fcgi_streambuf);
+	FcgxAudioInput fcgiin(request.in, request.ipcFd);
 	std::ostream fcgiout(&cout_fcgi_streambuf);
 	std::ostream fcgierr(&cerr_fcgi_streambuf);
 
+	ProcessRequest(decoder, FCGX_GetParam("QUERY_STRING", request.envp), FCGX_GetParam("CONTENT_TYPE", request.envp),
+			fcgiin, fcgiout, &json_buffer);
+
+	FCGX_Finish_r(&request);
+    }
+}
+
+void FcgiDecodingApp::ProcessRequest(Decoder &decoder, const char *query_string, const char *content_type,
+		AudioInput &fcgiin, std::ostream &fcgiout, std::string *json_buffer) {
 	try {
 		RequestRawReader reader(&fcgiin);
 
 		reader.DoEndpointing(ResponseParams::default_endofspeech);
+		reader.BestPathOnly(ResponseParams::default_bestpath);
+		if (content_type != NULL) {
+			reader.Codec(AudioCodec::ForContentType(content_type));
+			// Bad rate of the content type is answered with an error as the parameter one
+			kaldi::int32 rate = AudioCodec::RateForContentType(content_type);
+			if (rate != 0) {
+				reader.Rate(rate);
+			}
+		}
 
 		ResponseParams params;
-		apply_request_parameters(request, reader, params);
+		apply_request_parameters(query_string, reader, params);
+
+		if (params.admin.size() > 0) {
+			ProcessAdminRequest(params.admin, fcgiout);
+			return;
+		}
 
 		std::auto_ptr<ResponseJsonWriter> writer_ptr;
 		if (params.multipart) {
-			writer_ptr.reset(new ResponseMultipartJsonWriter(&fcgiout));
+			writer_ptr.reset(new ResponseMultipartJsonWriter(&fcgiout, json_buffer));
 		} else {
-			writer_ptr.reset(new ResponseJsonWriter(&fcgiout));
+			writer_ptr.reset(new ResponseJsonWriter(&fcgiout, json_buffer));
+		}
+
+		std::auto_ptr<RequestTrace> trace;
+		if (params.timing || trace_writer_.IsOpen()) {
+			trace.reset(new RequestTrace(trace_writer_.IsOpen()));
+			reader.Trace(trace.get());
+			if (params.timing) {
+				writer_ptr->Timing(trace.get());
+			}
 		}
 
 		fcgiout << "Content-type: "<< writer_ptr.get()->GetContentType() <<"\r\n\r\n";
 
+		if (reader.HasErrors()) {
+			writer_ptr->SetError(reader.LastErrorMessage());
+			return;
+		}
+
 		decoder.Decode(reader, *(writer_ptr.get()));
+
+		if (trace.get() != NULL) {
+			trace_writer_.Write(*trace);
+		}
 	} catch (std::exception &e) {
 		KALDI_LOG << "Fatal exception: " << e.what();
 	}
+}
 
-	FCGX_Finish_r(&request);
-    }
+void FcgiDecodingApp::ProcessAdminRequest(const std::string &command, std::ostream &fcgiout) {
+	ResponseJsonWriter writer(&fcgiout);
+	if (ADMIN_COMMAND_READY == command) {
+		// Readiness is reported even when other admin requests are disabled
+		if (ready_) {
+			fcgiout << "Content-type: " << writer.GetContentType() << "\r\n\r\n";
+			fcgiout << "{\"status\":\"ok\",\"data\":[{\"text\":\"ready\"}]}" << std::endl;
+		} else {
+			fcgiout << "Status: 503 Service Unavailable\r\n";
+			fcgiout << "Content-type: " << writer.GetContentType() << "\r\n\r\n";
+			writer.SetError("Warming up");
+		}
+	} else if (!fcgi_admin_) {
+		fcgiout << "Status: 403 Forbidden\r\n";
+		fcgiout << "Content-type: " << writer.GetContentType() << "\r\n\r\n";
+		writer.SetError("Admin requests are disabled");
+	} else if (ADMIN_COMMAND_RELOAD == command) {
+		fcgiout << "Content-type: " << writer.GetContentType() << "\r\n\r\n";
+		if (!RequestReload()) {
+			writer.SetError("Failed to start reloading");
+		} else {
+			fcgiout << "{\"status\":\"ok\",\"data\":[{\"text\":\"reloading\"}]}" << std::endl;
+		}
+	} else if (ADMIN_COMMAND_METRICS == command) {
+		std::string metrics;
+		decoder_.AppendMetrics(&metrics);
+		fcgiout << "Content-type: " << writer.GetContentType() << "\r\n\r\n";
+		fcgiout << "{\"status\":\"ok\",\"metrics\":{" << metrics << "}}" << std::endl;
+	} else {
+		fcgiout << "Status: 400 Bad Request\r\n";
+		fcgiout << "Content-type: " << writer.GetContentType() << "\r\n\r\n";
+		writer.SetError("Unknown admin command");
+	}
+}
+
+bool FcgiDecodingApp::RequestReload() {
+	if (supervisor_pid_ != 0) {
+		// Supervisor reloads models once for all workers and replaces them
+		if (kill(supervisor_pid_, SIGHUP) != 0) {
+			KALDI_WARN << "Failed to request reload from supervisor: " << strerror(errno);
+			return false;
+		}
+		return true;
+	}
+
+	bool result = true;
+	pthread_mutex_lock(&reload_mutex_);
+	if (reloading_) {
+		// Files may have changed after running reload has read them
+		reload_pending_ = true;
+	} else {
+		pthread_t thread;
+		int errnumber;
+		if ((errnumber = pthread_create(&thread, NULL, RunReloadThread, this)) != 0) {
+			KALDI_WARN << "Failed to start reload thread: " << strerror(errnumber);
+			result = false;
+		} else {
+			pthread_detach(thread);
+			reloading_ = true;
+		}
+	}
+	pthread_mutex_unlock(&reload_mutex_);
+	return result;
+}
+
+void *FcgiDecodingApp::RunReloadThread(void *arg) {
+	FcgiDecodingApp *app = (FcgiDecodingApp*)arg;
+	pthread_mutex_lock(&(app->reload_mutex_));
+	do {
+		app->reload_pending_ = false;
+		pthread_mutex_unlock(&(app->reload_mutex_));
+		KALDI_LOG << "Reloading models";
+		app->decoder_.Reload();
+		pthread_mutex_lock(&(app->reload_mutex_));
+	} while (app->reload_pending_);
+	app->reloading_ = false;
+	pthread_mutex_unlock(&(app->reload_mutex_));
+	return NULL;
+}
+
+void *FcgiDecodingApp::RunSignalThread(void *arg) {
+	FcgiDecodingApp *app = (FcgiDecodingApp*)arg;
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGHUP);
+	if (app->supervisor_pid_ != 0) {
+		sigaddset(&signals, SIGTERM);
+	}
+
+	while (true) {
+		int signal_number;
+		if (sigwait(&signals, &signal_number) != 0) {
+			continue;
+		}
+		if (signal_number == SIGHUP) {
+			KALDI_LOG << "Reloading models on SIGHUP";
+			app->RequestReload();
+		} else if (signal_number == SIGTERM) {
+			KALDI_LOG << "Finishing running requests before exit";
+			app->Drain();
+		}
+	}
+	return NULL;
+}
+
+/** Interval of interrupting threads waiting for requests while process is draining */
+const useconds_t DRAIN_WAKE_UP_INTERVAL_US = 100000;
+
+/** Interrupts accept() of draining worker threads */
+static void handle_wake_up_signal(int) {
+}
+
+void FcgiDecodingApp::Drain() {
+	pthread_mutex_lock(&accept_mutex_);
+	draining_ = true;
+	FCGX_ShutdownPending();
+	if (event_server_ != NULL) {
+		event_server_->Stop();
+	}
+	pthread_mutex_unlock(&accept_mutex_);
+
+	// Thread may be signalled just before it enters accept(), so waiting
+	// threads are interrupted until all of them see the shutdown
+	while (true) {
+		pthread_mutex_lock(&accept_mutex_);
+		bool waiting = !accepting_threads_.empty();
+		for (std::set<pthread_t>::iterator i = accepting_threads_.begin(); i != accepting_threads_.end(); ++i) {
+			pthread_kill(*i, SIGUSR1);
+		}
+		pthread_mutex_unlock(&accept_mutex_);
+		if (!waiting) {
+			break;
+		}
+		usleep(DRAIN_WAKE_UP_INTERVAL_US);
+	}
+}
+
+bool FcgiDecodingApp::EnterAccept() {
+	pthread_mutex_lock(&accept_mutex_);
+	bool draining = draining_;
+	if (!draining) {
+		// Only threads waiting for a request are interrupted, so that I/O of running ones is never broken
+		accepting_threads_.insert(pthread_self());
+	}
+	pthread_mutex_unlock(&accept_mutex_);
+	return !draining;
+}
+
+void FcgiDecodingApp::LeaveAccept() {
+	pthread_mutex_lock(&accept_mutex_);
+	accepting_threads_.erase(pthread_self());
+	pthread_mutex_unlock(&accept_mutex_);
 }
 
 int FcgiDecodingApp::Run(int argc, char **argv) {
@@ -208,17 +610,101 @@ int FcgiDecodingApp::Run(int argc, char **argv) {
 	    return 1;
 	}
 
-	if (fcgi_threads_number_ == 1) {
+	if (trace_file_.size() > 0 && !trace_writer_.Open(trace_file_)) {
+		running_ = false;
+		return 1;
+	}
+
+	int result;
+	if (fcgi_processes_number_ > 1) {
+		result = RunProcesses();
+	} else {
+		result = Serve();
+	}
+
+	UpdateReadyFile(false);
+
+	running_ = false;
+	return result;
+}
+
+int FcgiDecodingApp::Serve() {
+	// SIGHUP (and SIGTERM of worker process) is blocked for all serving threads and handled by dedicated one
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGHUP);
+	if (supervisor_pid_ != 0) {
+		sigaddset(&signals, SIGTERM);
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		// No SA_RESTART, so that accept() is interrupted
+		action.sa_handler = handle_wake_up_signal;
+		sigaction(SIGUSR1, &action, NULL);
+	}
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	pthread_t signal_thread;
+	int errnumber;
+	if ((errnumber = pthread_create(&signal_thread, NULL, RunSignalThread, this)) != 0) {
+		KALDI_WARN << "Failed to start signal handling thread: " << strerror(errnumber);
+	} else {
+		pthread_detach(signal_thread);
+	}
+
+	if (fcgi_event_loop_) {
+		// Workers of the event loop have no decoders of their own, so the same
+		// number of temporary clones is warmed up concurrently before serving
+		workers_warming_up_ = warmup_ ? fcgi_threads_number_ : 1;
+		if (warmup_) {
+			std::list<pthread_t> warmup_threads;
+			for (int i = 0; i < fcgi_threads_number_; i++) {
+				pthread_t thread;
+				if ((errnumber = pthread_create(&thread, NULL, RunWarmUpThread, this)) != 0) {
+					KALDI_WARN << "Failed to start warm-up thread: " << strerror(errnumber);
+					WorkerReady();
+				} else {
+					warmup_threads.push_back(thread);
+				}
+			}
+			for (std::list<pthread_t>::iterator i = warmup_threads.begin(); i != warmup_threads.end(); ++i) {
+				pthread_join(*i, NULL);
+			}
+		} else {
+			WorkerReady();
+		}
+		EventHandler handler(*this);
+		FcgiEventServer server(handler, socket_id_, fcgi_threads_number_, fcgi_stack_size_kb_);
+		pthread_mutex_lock(&accept_mutex_);
+		event_server_ = &server;
+		if (draining_) {
+			server.Stop();
+		}
+		pthread_mutex_unlock(&accept_mutex_);
+		int result = server.Run();
+		pthread_mutex_lock(&accept_mutex_);
+		event_server_ = NULL;
+		pthread_mutex_unlock(&accept_mutex_);
+		return result;
+	} else if (fcgi_threads_number_ == 1) {
 		KALDI_VLOG(1) << "Single thread running";
+		workers_warming_up_ = 1;
+		if (warmup_) {
+			WarmUp(decoder_);
+		}
+		WorkerReady();
 		ProcessingRoutine(decoder_);
 	} else {
 		std::list<pthread_t> thread_list;
-		int errnumber;
 
+		workers_warming_up_ = fcgi_threads_number_;
 		for (int i = 0; i < fcgi_threads_number_; i++) {
 			pthread_t thread;
 			if ((errnumber = pthread_create(&thread, NULL, RunChildThread, this)) != 0) {
 				KALDI_WARN << "Failed to start thread: " << strerror(errnumber);
+				// Threads never started should not hold readiness
+				for (; i < fcgi_threads_number_; i++) {
+					WorkerReady();
+				}
 				break;
 			} else {
 				thread_list.push_back(thread);
@@ -234,8 +720,232 @@ int FcgiDecodingApp::Run(int argc, char **argv) {
 		}
 		KALDI_VLOG(1) << "Thread finished, threads left: " << thread_list.size();
 	}
+	return 0;
+}
 
-	running_ = false;
+/** Minimal worker process lifetime in seconds, faster failing workers are restarted with delay */
+const int MIN_PROCESS_LIFETIME_SECONDS = 1;
+/** Time in seconds a stopped worker may finish its running requests before it is killed */
+const int MAX_DRAIN_SECONDS = 300;
+/** Interval of checking draining workers while nothing else happens */
+const int SUPERVISOR_POLL_INTERVAL_MS = 1000;
+
+static volatile sig_atomic_t shutdown_requested = 0;
+static volatile sig_atomic_t reload_requested = 0;
+
+static void handle_shutdown_signal(int) {
+	shutdown_requested = 1;
+}
+
+static void handle_reload_signal(int) {
+	reload_requested = 1;
+}
+
+/** Interrupts supervisor waiting for worker events */
+static void handle_child_signal(int) {
+}
+
+/** Worker process state kept by supervisor */
+struct WorkerProcess {
+	time_t started;
+	/** Models reload count the worker was forked after */
+	int generation;
+	bool ready;
+	/** Time the worker was told to finish, 0 if it is serving */
+	time_t stopped;
+	bool killed;
+};
+
+pid_t FcgiDecodingApp::ForkProcess() {
+	// Worker handles SIGHUP and SIGTERM on its own, keep them pending until its signal thread is started
+	sigset_t signals, old_signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGHUP);
+	sigaddset(&signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &signals, &old_signals);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGHUP, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		// Worker should not outlive its supervisor
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+		if (getppid() == 1) {
+			_exit(0);
+		}
+		supervisor_pid_ = getppid();
+		close(ready_pipe_[0]);
+		ready_pipe_[0] = -1;
+		_exit(Serve());
+	} else if (pid < 0) {
+		KALDI_WARN << "Failed to fork worker process: " << strerror(errno);
+	}
+	sigprocmask(SIG_SETMASK, &old_signals, NULL);
+	return pid;
+}
+
+int FcgiDecodingApp::RunProcesses() {
+	// Models are already loaded, so worker processes share their pages copy-on-write
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_shutdown_signal;
+	sigaction(SIGTERM, &action, NULL);
+	sigaction(SIGINT, &action, NULL);
+	action.sa_handler = handle_reload_signal;
+	sigaction(SIGHUP, &action, NULL);
+	action.sa_handler = handle_child_signal;
+	sigaction(SIGCHLD, &action, NULL);
+
+	if (pipe(ready_pipe_) != 0) {
+		KALDI_WARN << "Failed to create worker readiness pipe: " << strerror(errno);
+		return 1;
+	}
+	fcntl(ready_pipe_[0], F_SETFL, fcntl(ready_pipe_[0], F_GETFL, 0) | O_NONBLOCK);
+
+	std::map<pid_t, WorkerProcess> processes;
+	int generation = 0;
+	bool stopping = false;
+	// File may be left by previous run
+	bool ready = false;
+	UpdateReadyFile(false);
+	while (true) {
+		if (shutdown_requested && !stopping) {
+			stopping = true;
+			KALDI_LOG << "Stopping worker processes";
+			for (std::map<pid_t, WorkerProcess>::iterator i = processes.begin(); i != processes.end(); ++i) {
+				if (i->second.stopped == 0) {
+					kill(i->first, SIGTERM);
+					i->second.stopped = time(NULL);
+				}
+			}
+		}
+		if (stopping && processes.empty()) {
+			break;
+		}
+
+		int serving = 0;
+		int outdated = 0;
+		int starting = 0;
+		for (std::map<pid_t, WorkerProcess>::iterator i = processes.begin(); i != processes.end(); ++i) {
+			if (i->second.stopped == 0) {
+				serving++;
+				if (i->second.generation < generation) {
+					outdated++;
+				} else if (!i->second.ready) {
+					starting++;
+				}
+			}
+		}
+
+		// Ready file tells that all workers serve, it is absent while any of them is
+		// missing or warming up (on start, restart or replacement with new models)
+		bool all_ready = !stopping && serving >= fcgi_processes_number_ && starting == 0;
+		for (std::map<pid_t, WorkerProcess>::iterator i = processes.begin(); all_ready && i != processes.end(); ++i) {
+			all_ready = i->second.stopped != 0 || i->second.ready;
+		}
+		if (all_ready != ready) {
+			ready = all_ready;
+			KALDI_LOG << (ready ? "All worker processes are ready" : "Worker processes are warming up");
+			UpdateReadyFile(ready);
+		}
+
+		if (reload_requested && !stopping && outdated == 0 && starting == 0) {
+			// Reload requested while workers are replaced waits for them
+			reload_requested = 0;
+			KALDI_LOG << "Reloading models on SIGHUP";
+			if (decoder_.Reload()) {
+				generation++;
+				outdated = serving;
+			}
+		}
+
+		if (!stopping) {
+			pid_t pid = 0;
+			if (serving < fcgi_processes_number_ || (outdated > 0 && starting == 0 && serving == fcgi_processes_number_)) {
+				// Worker with the latest models replaces died or outdated one
+				pid = ForkProcess();
+			} else if (outdated > 0 && starting == 0) {
+				// Replacement is ready, one outdated worker finishes its requests and exits
+				for (std::map<pid_t, WorkerProcess>::iterator i = processes.begin(); i != processes.end(); ++i) {
+					if (i->second.stopped == 0 && i->second.generation < generation) {
+						kill(i->first, SIGTERM);
+						i->second.stopped = time(NULL);
+						KALDI_LOG << "Worker process " << i->first << " replaced";
+						break;
+					}
+				}
+				continue;
+			}
+			if (pid > 0) {
+				WorkerProcess &process = processes[pid];
+				process.started = time(NULL);
+				process.generation = generation;
+				process.ready = false;
+				process.stopped = 0;
+				process.killed = false;
+				KALDI_LOG << "Worker process started: " << pid;
+				continue;
+			}
+		}
+
+		struct pollfd ready_poll;
+		ready_poll.fd = ready_pipe_[0];
+		ready_poll.events = POLLIN;
+		if (poll(&ready_poll, 1, SUPERVISOR_POLL_INTERVAL_MS) > 0) {
+			pid_t pid;
+			while (read(ready_pipe_[0], &pid, sizeof(pid)) == sizeof(pid)) {
+				std::map<pid_t, WorkerProcess>::iterator process = processes.find(pid);
+				if (process != processes.end()) {
+					process->second.ready = true;
+				}
+			}
+		}
+
+		time_t now = time(NULL);
+		for (std::map<pid_t, WorkerProcess>::iterator i = processes.begin(); i != processes.end(); ++i) {
+			if (i->second.stopped != 0 && !i->second.killed && now - i->second.stopped > MAX_DRAIN_SECONDS) {
+				KALDI_WARN << "Worker process " << i->first << " did not finish in " << MAX_DRAIN_SECONDS << " s, killed";
+				kill(i->first, SIGKILL);
+				i->second.killed = true;
+			}
+		}
+
+		int status;
+		pid_t pid;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			std::map<pid_t, WorkerProcess>::iterator process = processes.find(pid);
+			if (process == processes.end()) {
+				continue;
+			}
+			WorkerProcess finished = process->second;
+			processes.erase(process);
+
+			if (finished.stopped != 0 && !finished.killed) {
+				KALDI_LOG << "Worker process " << pid << " finished";
+				continue;
+			}
+			if (WIFSIGNALED(status)) {
+				KALDI_WARN << "Worker process " << pid << " killed by signal " << WTERMSIG(status);
+			} else {
+				KALDI_WARN << "Worker process " << pid << " exited with status " << WEXITSTATUS(status);
+			}
+			if (finished.stopped == 0 && !stopping && !shutdown_requested
+					&& now - finished.started < MIN_PROCESS_LIFETIME_SECONDS) {
+				sleep(MIN_PROCESS_LIFETIME_SECONDS);
+			}
+		}
+		if (pid < 0 && errno != ECHILD && errno != EINTR) {
+			KALDI_WARN << "Failed to wait for worker processes: " << strerror(errno);
+			break;
+		}
+	}
+
+	close(ready_pipe_[0]);
+	close(ready_pipe_[1]);
+	ready_pipe_[0] = ready_pipe_[1] = -1;
 	return 0;
 }
+
 } /* namespace apiai */
@@ -17,9 +17,17 @@
 #define APIAI_DECODER_FCGIDECODINGAPP_H_
 
 #include "Decoder.h"
+#include "AudioInput.h"
+#include "RequestTrace.h"
+#include <ostream>
+#include <set>
+#include <pthread.h>
+#include <sys/types.h>
 
 namespace apiai {
 
+class FcgiEventServer;
+
 /**
  * Decoding class with main routine defined.
  * Data IO implemented via FastCGI gate.
@@ -31,7 +39,18 @@ public:
 	/** Initialize with given decoder */
 	FcgiDecodingApp(Decoder &decoder) : decoder_(decoder),
 		fcgi_threads_number_(1), fcgi_socket_backlog_(0), socket_id_(0),
-		running_(false) {};
+		fcgi_event_loop_(false), fcgi_stack_size_kb_(2048), fcgi_processes_number_(1),
+		fcgi_admin_(false), warmup_(false), workers_warming_up_(0), ready_(0),
+		running_(false), supervisor_pid_(0), reloading_(false), reload_pending_(false),
+		draining_(false), event_server_(NULL) {
+		ready_pipe_[0] = ready_pipe_[1] = -1;
+		pthread_mutex_init(&reload_mutex_, NULL);
+		pthread_mutex_init(&accept_mutex_, NULL);
+	};
+	virtual ~FcgiDecodingApp() {
+		pthread_mutex_destroy(&accept_mutex_);
+		pthread_mutex_destroy(&reload_mutex_);
+	};
 
 	/** Get run specifications and allowed arguments list */
 	std::string &Usage() { return usage_; }
@@ -41,9 +60,49 @@ public:
 	/** Run main routine and pass all given arguments */
 	int Run(int argn, char **argv);
 private:
+	class EventHandler;
+
 	void RegisterOptions(kaldi::OptionsItf &po);
+	/** Serve requests within current process. Returns non-zero value on failure */
+	int Serve();
+	/**
+	 * Supervise worker processes serving requests, restart died ones.
+	 * Models are reloaded here only, and workers are replaced one by one
+	 * with ones forked with the new models.
+	 */
+	int RunProcesses();
+	pid_t ForkProcess();
 	void ProcessingRoutine(Decoder &decoder);
+	/**
+	 * Decode single request with given decoder, response is serialized into given reusable buffer.
+	 * Audio codec is chosen by content type unless given by request parameter
+	 */
+	void ProcessRequest(Decoder &decoder, const char *query_string, const char *content_type,
+			AudioInput &in, std::ostream &out, std::string *json_buffer);
+	void ProcessAdminRequest(const std::string &command, std::ostream &out);
+	/**
+	 * Reload models in background. Reloads never overlap: requests coming while
+	 * models are loaded are merged into one more reload. Worker process passes
+	 * the request to its supervisor instead. Returns false if reload is not started.
+	 */
+	bool RequestReload();
+	static void *RunReloadThread(void *app);
+	/** Reload models on SIGHUP, finish running requests and exit on SIGTERM in worker process */
+	static void *RunSignalThread(void *app);
+	/** Stop accepting requests, so that serving returns once running ones are finished */
+	void Drain();
+	/** Register thread going to accept a request, returns false if process is draining */
+	bool EnterAccept();
+	void LeaveAccept();
 	static void *RunChildThread(void *app);
+	/** Decode synthetic audio with given decoder, so that lazily compiled and allocated resources are ready */
+	void WarmUp(Decoder &decoder);
+	/** Warm up a temporary decoder clone */
+	static void *RunWarmUpThread(void *app);
+	/** Count worker which finished warm-up, process is ready when all of them are done */
+	void WorkerReady();
+	/** Create ready file of ready process or remove it */
+	void UpdateReadyFile(bool ready);
 
 	Decoder &decoder_;
 	std::string usage_;
@@ -52,7 +111,35 @@ private:
 	std::string fcgi_socket_path_;
 	int fcgi_socket_backlog_;
 	int socket_id_;
+	bool fcgi_event_loop_;
+	int fcgi_stack_size_kb_;
+	int fcgi_processes_number_;
+	bool fcgi_admin_;
+	/** Warm up every worker before it starts accepting requests */
+	bool warmup_;
+	/** File created once all workers are warmed up */
+	std::string ready_file_;
+	volatile int workers_warming_up_;
+	volatile int ready_;
 	bool running_;
+
+	/** Supervisor of this worker process, 0 if not forked */
+	pid_t supervisor_pid_;
+	/** Pipe worker processes report their pids to once ready, -1 if none */
+	int ready_pipe_[2];
+
+	pthread_mutex_t reload_mutex_;
+	bool reloading_;
+	bool reload_pending_;
+
+	/** Guards draining state and threads waiting in FCGX_Accept_r() */
+	pthread_mutex_t accept_mutex_;
+	bool draining_;
+	std::set<pthread_t> accepting_threads_;
+	FcgiEventServer *event_server_;
+
+	std::string trace_file_;
+	ChromeTraceWriter trace_writer_;
 };
 
 } /* namespace apiai */
@@ -0,0 +1,877 @@
+// FcgiEventServer.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FcgiEventServer.h"
+#include "FcgiProtocol.h"
+#include "Timing.h"
+#include "WaitEvent.h"
+#include "base/kaldi-error.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <streambuf>
+#include <string>
+
+namespace apiai {
+
+/** Reading of connection is paused when request has more unprocessed input data */
+const size_t MAX_INPUT_BUFFER_SIZE = 1 << 20;
+const size_t READ_BUFFER_SIZE = 64 * 1024;
+const int MAX_EVENTS = 256;
+/** Read deadlines of waiting requests are checked with this interval */
+const milliseconds_t DEADLINE_CHECK_INTERVAL_MS = 50;
+
+struct FcgiEventServer::Worker {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	std::deque<Stream*> run_queue;
+	ucontext_t context;
+	FcgiEventServer *server;
+	bool started;
+	bool stopping;
+};
+
+class FcgiEventServer::Connection {
+public:
+	Connection(int fd) : fd(fd), stream(NULL), in_pos(0), out_pos(0),
+		reading(true), writing(false), closing(false), closed(false) {};
+
+	int fd;
+	/** Active request, only one request per connection is served at a time */
+	Stream *stream;
+
+	std::string in;
+	size_t in_pos;
+	std::string out;
+	size_t out_pos;
+
+	bool reading;
+	bool writing;
+	bool closing;
+	bool closed;
+};
+
+/**
+ * Single request state.
+ * Fields without mutex are owned by the event loop thread,
+ * input and output buffers are shared with the worker running the request.
+ */
+class FcgiEventServer::Stream : public FcgiEventServer::Request, public Coroutine {
+public:
+	Stream(FcgiEventServer &server, Connection *connection, int request_id, bool keep_conn)
+		: server(server), connection(connection), request_id(request_id), keep_conn(keep_conn),
+		  started(false), worker(NULL), stack(NULL), coroutine_done(false),
+		  notified(false), done(false),
+		  input_pos_(0), input_closed_(false), aborted_(false), waiting_(false), wanted_(0), deadline_(0),
+		  input_paused_(false), resume_input_(false),
+		  out_buf_(*this), out_(&out_buf_)
+	{
+		pthread_mutex_init(&mutex_, NULL);
+	}
+
+	virtual ~Stream() {
+		pthread_mutex_destroy(&mutex_);
+	}
+
+	virtual const char *GetParam(const char *name) const {
+		for (size_t i = 0; i < params.size(); i++) {
+			if (params[i].first == name) {
+				return params[i].second.c_str();
+			}
+		}
+		return NULL;
+	}
+
+	virtual size_t Read(char *data, size_t length, milliseconds_t deadline_ms, bool *timed_out) {
+		return ReadInput(data, length, length, deadline_ms, timed_out);
+	}
+	virtual size_t Available() {
+		pthread_mutex_lock(&mutex_);
+		size_t available = input_.size() - input_pos_;
+		pthread_mutex_unlock(&mutex_);
+		return available;
+	}
+	virtual std::ostream &Out() { return out_; }
+
+	virtual void Suspend() {
+		swapcontext(&context, &(worker->context));
+	}
+	virtual void Resume() {
+		server.Schedule(this);
+	}
+
+	/** Append received data. Returns true if input buffer is full and connection reading should be paused */
+	bool AppendInput(const char *data, size_t length) {
+		pthread_mutex_lock(&mutex_);
+		if (!aborted_) {
+			input_.append(data, length);
+		}
+		size_t available = input_.size() - input_pos_;
+		bool wake = waiting_ && (available >= wanted_);
+		if (wake) {
+			waiting_ = false;
+		}
+		if ((available >= MAX_INPUT_BUFFER_SIZE) && !waiting_) {
+			input_paused_ = true;
+		}
+		bool paused = input_paused_;
+		pthread_mutex_unlock(&mutex_);
+
+		if (wake) {
+			server.Schedule(this);
+		}
+		return paused;
+	}
+
+	/** Mark input finished, aborted input drops all unread data */
+	void CloseInput(bool aborted) {
+		pthread_mutex_lock(&mutex_);
+		input_closed_ = true;
+		if (aborted) {
+			aborted_ = true;
+			input_.clear();
+			input_pos_ = 0;
+			output_.clear();
+		}
+		bool wake = waiting_;
+		waiting_ = false;
+		pthread_mutex_unlock(&mutex_);
+
+		if (wake) {
+			server.Schedule(this);
+		}
+	}
+
+	/**
+	 * Read up to max_length bytes of input.
+	 * Coroutine yields until at least min_length bytes received, input closed
+	 * or deadline passed. Non-positive deadline means no time limit.
+	 */
+	size_t ReadInput(char *data, size_t min_length, size_t max_length,
+			milliseconds_t deadline_ms, bool *timed_out) {
+		bool resume = false;
+		*timed_out = false;
+		pthread_mutex_lock(&mutex_);
+		while ((input_.size() - input_pos_ < min_length) && !input_closed_) {
+			if (deadline_ms > 0 && getMilliseconds() >= deadline_ms) {
+				*timed_out = true;
+				break;
+			}
+			waiting_ = true;
+			wanted_ = min_length;
+			deadline_ = deadline_ms;
+			if (input_paused_) {
+				input_paused_ = false;
+				resume_input_ = true;
+				resume = true;
+			}
+			pthread_mutex_unlock(&mutex_);
+
+			if (resume) {
+				server.Notify(this, false);
+				resume = false;
+			}
+			swapcontext(&context, &(worker->context));
+
+			pthread_mutex_lock(&mutex_);
+		}
+		waiting_ = false;
+		deadline_ = 0;
+
+		size_t length = std::min(max_length, input_.size() - input_pos_);
+		memcpy(data, input_.data() + input_pos_, length);
+		input_pos_ += length;
+		if (input_pos_ == input_.size()) {
+			input_.clear();
+			input_pos_ = 0;
+		} else if ((input_pos_ > READ_BUFFER_SIZE) && (input_pos_ * 2 > input_.size())) {
+			input_.erase(0, input_pos_);
+			input_pos_ = 0;
+		}
+
+		if (input_paused_ && (input_.size() - input_pos_ < MAX_INPUT_BUFFER_SIZE / 2)) {
+			input_paused_ = false;
+			resume_input_ = true;
+			resume = true;
+		}
+		pthread_mutex_unlock(&mutex_);
+
+		if (resume) {
+			server.Notify(this, false);
+		}
+		return length;
+	}
+
+	/** Resume waiting coroutine if its read deadline passed */
+	void CheckDeadline(milliseconds_t now) {
+		pthread_mutex_lock(&mutex_);
+		bool wake = waiting_ && (deadline_ > 0) && (now >= deadline_);
+		if (wake) {
+			waiting_ = false;
+		}
+		pthread_mutex_unlock(&mutex_);
+
+		if (wake) {
+			server.Schedule(this);
+		}
+	}
+
+	void WriteOutput(const char *data, size_t length) {
+		pthread_mutex_lock(&mutex_);
+		if (!aborted_) {
+			output_.append(data, length);
+		}
+		pthread_mutex_unlock(&mutex_);
+	}
+
+	void FlushOutput() {
+		pthread_mutex_lock(&mutex_);
+		bool pending = !output_.empty();
+		pthread_mutex_unlock(&mutex_);
+
+		if (pending) {
+			server.Notify(this, false);
+		}
+	}
+
+	/** Take pending output data and connection reading resumption flag */
+	void TakeOutput(std::string *output, bool *resume_input) {
+		pthread_mutex_lock(&mutex_);
+		output->swap(output_);
+		output_.clear();
+		*resume_input = resume_input_;
+		resume_input_ = false;
+		pthread_mutex_unlock(&mutex_);
+	}
+
+	FcgiEventServer &server;
+	Connection *connection;
+	int request_id;
+	bool keep_conn;
+
+	std::string params_data;
+	FcgiProtocol::Params params;
+	bool started;
+
+	Worker *worker;
+	ucontext_t context;
+	void *stack;
+	bool coroutine_done;
+
+	/** Both flags are guarded by server notification mutex */
+	bool notified;
+	bool done;
+private:
+	class OutputBuf : public std::streambuf {
+	public:
+		OutputBuf(Stream &stream) : stream_(stream) { setp(buffer_, buffer_ + sizeof(buffer_)); }
+	protected:
+		virtual int_type overflow(int_type c) {
+			Flush();
+			if (!traits_type::eq_int_type(c, traits_type::eof())) {
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+			return traits_type::not_eof(c);
+		}
+
+		virtual int sync() {
+			Flush();
+			stream_.FlushOutput();
+			return 0;
+		}
+	private:
+		void Flush() {
+			if (pptr() > pbase()) {
+				stream_.WriteOutput(pbase(), pptr() - pbase());
+				setp(buffer_, buffer_ + sizeof(buffer_));
+			}
+		}
+
+		Stream &stream_;
+		char buffer_[4096];
+	};
+
+	pthread_mutex_t mutex_;
+	std::string input_;
+	size_t input_pos_;
+	bool input_closed_;
+	bool aborted_;
+	bool waiting_;
+	size_t wanted_;
+	milliseconds_t deadline_;
+	bool input_paused_;
+	bool resume_input_;
+	std::string output_;
+
+	OutputBuf out_buf_;
+	std::ostream out_;
+};
+
+FcgiEventServer::FcgiEventServer(Handler &handler, int listen_socket, int workers_number, int stack_size_kb)
+	: handler_(handler), listen_socket_(listen_socket), stack_size_(std::max(64, stack_size_kb) * 1024),
+	  epoll_fd_(-1), event_fd_(-1), next_worker_(0), stopping_(0)
+{
+	pthread_mutex_init(&notify_mutex_, NULL);
+	for (int i = 0; i < std::max(1, workers_number); i++) {
+		Worker *worker = new Worker();
+		worker->server = this;
+		worker->started = false;
+		worker->stopping = false;
+		pthread_mutex_init(&(worker->mutex), NULL);
+		pthread_cond_init(&(worker->cond), NULL);
+		workers_.push_back(worker);
+	}
+}
+
+FcgiEventServer::~FcgiEventServer() {
+	for (size_t i = 0; i < workers_.size(); i++) {
+		Worker *worker = workers_[i];
+		if (worker->started) {
+			pthread_mutex_lock(&(worker->mutex));
+			worker->stopping = true;
+			pthread_cond_signal(&(worker->cond));
+			pthread_mutex_unlock(&(worker->mutex));
+			pthread_join(worker->thread, NULL);
+		}
+		pthread_cond_destroy(&(worker->cond));
+		pthread_mutex_destroy(&(worker->mutex));
+		delete worker;
+	}
+	pthread_mutex_destroy(&notify_mutex_);
+
+	if (event_fd_ >= 0) {
+		close(event_fd_);
+	}
+	if (epoll_fd_ >= 0) {
+		close(epoll_fd_);
+	}
+}
+
+int FcgiEventServer::Run() {
+	if ((epoll_fd_ = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		KALDI_WARN << "Failed to create epoll instance: " << strerror(errno);
+		return 1;
+	}
+	if ((event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		KALDI_WARN << "Failed to create eventfd: " << strerror(errno);
+		return 1;
+	}
+
+	int flags = fcntl(listen_socket_, F_GETFL, 0);
+	if ((flags < 0) || (fcntl(listen_socket_, F_SETFL, flags | O_NONBLOCK) < 0)) {
+		KALDI_WARN << "Failed to switch listening socket to non-blocking mode: " << strerror(errno);
+		return 1;
+	}
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+	// Socket may be shared by several worker processes, wake up only one of them
+	event.events |= EPOLLEXCLUSIVE;
+#endif
+	event.data.ptr = NULL;
+	if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_socket_, &event) < 0) {
+		KALDI_WARN << "Failed to watch listening socket: " << strerror(errno);
+		return 1;
+	}
+	event.events = EPOLLIN;
+	event.data.ptr = &event_fd_;
+	if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) < 0) {
+		KALDI_WARN << "Failed to watch eventfd: " << strerror(errno);
+		return 1;
+	}
+
+	int errnumber;
+	for (size_t i = 0; i < workers_.size(); i++) {
+		if ((errnumber = pthread_create(&(workers_[i]->thread), NULL, RunWorkerThread, workers_[i])) != 0) {
+			KALDI_WARN << "Failed to start worker thread: " << strerror(errnumber);
+			return 1;
+		}
+		workers_[i]->started = true;
+	}
+
+	KALDI_LOG << "Event loop started, workers: " << workers_.size();
+
+	struct epoll_event events[MAX_EVENTS];
+	milliseconds_t deadline_check_time = getMilliseconds();
+	bool accepting = true;
+	while (true) {
+		int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, DEADLINE_CHECK_INTERVAL_MS);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			KALDI_WARN << "Event loop failed: " << strerror(errno);
+			return 1;
+		}
+
+		for (int i = 0; i < count; i++) {
+			void *ptr = events[i].data.ptr;
+			if (ptr == NULL) {
+				AcceptConnections();
+			} else if (ptr == &event_fd_) {
+				uint64_t value;
+				if (read(event_fd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+					KALDI_WARN << "Failed to read eventfd: " << strerror(errno);
+				}
+				ProcessNotifications();
+			} else {
+				Connection *connection = static_cast<Connection*>(ptr);
+				if (!connection->closed && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+					ReadConnection(connection);
+				}
+				if (!connection->closed && (events[i].events & EPOLLOUT)) {
+					WriteConnection(connection);
+				}
+			}
+		}
+
+		milliseconds_t now = getMilliseconds();
+		if (now - deadline_check_time >= DEADLINE_CHECK_INTERVAL_MS) {
+			deadline_check_time = now;
+			for (std::set<Connection*>::iterator i = connections_.begin(); i != connections_.end(); ++i) {
+				if ((*i)->stream != NULL && (*i)->stream->started) {
+					(*i)->stream->CheckDeadline(now);
+				}
+			}
+		}
+
+		if (stopping_ && accepting) {
+			accepting = false;
+			epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_socket_, NULL);
+			std::vector<Connection*> connections(connections_.begin(), connections_.end());
+			for (size_t i = 0; i < connections.size(); i++) {
+				Connection *connection = connections[i];
+				if (connection->stream == NULL && connection->out_pos == connection->out.size()) {
+					CloseConnection(connection);
+				} else {
+					// Closed once its request is finished and response is sent
+					connection->closing = true;
+				}
+			}
+			KALDI_LOG << "Event loop stopped accepting, requests running: " << connections_.size();
+		}
+
+		// Connections are deleted after the whole batch of events is handled
+		for (size_t i = 0; i < closed_.size(); i++) {
+			delete closed_[i];
+		}
+		closed_.clear();
+
+		if (!accepting && connections_.empty()) {
+			break;
+		}
+	}
+	return 0;
+}
+
+void FcgiEventServer::Stop() {
+	// Picked up by the event loop within the deadline check interval
+	__sync_lock_test_and_set(&stopping_, 1);
+}
+
+void FcgiEventServer::AcceptConnections() {
+	while (true) {
+		int fd = accept4(listen_socket_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				KALDI_WARN << "Failed to accept connection: " << strerror(errno);
+			}
+			return;
+		}
+
+		// Partial results are small and should not wait for delayed ACKs.
+		// Fails harmlessly on Unix domain sockets.
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		Connection *connection = new Connection(fd);
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = connection;
+		if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+			KALDI_WARN << "Failed to watch connection: " << strerror(errno);
+			close(fd);
+			delete connection;
+		} else {
+			connections_.insert(connection);
+		}
+	}
+}
+
+void FcgiEventServer::UpdateEvents(Connection *connection) {
+	struct epoll_event event;
+	event.events = 0;
+	if (connection->reading) {
+		event.events |= EPOLLIN;
+	}
+	if (connection->writing) {
+		event.events |= EPOLLOUT;
+	}
+	event.data.ptr = connection;
+	if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection->fd, &event) < 0) {
+		KALDI_WARN << "Failed to update connection events: " << strerror(errno);
+	}
+}
+
+void FcgiEventServer::ReadConnection(Connection *connection) {
+	char buffer[READ_BUFFER_SIZE];
+	ssize_t length = read(connection->fd, buffer, sizeof(buffer));
+	if (length < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			CloseConnection(connection);
+		}
+		return;
+	}
+	if (length == 0) {
+		CloseConnection(connection);
+		return;
+	}
+
+	connection->in.append(buffer, length);
+
+	while (connection->in.size() - connection->in_pos >= FcgiProtocol::HEADER_LENGTH) {
+		FcgiProtocol::Header header;
+		FcgiProtocol::ParseHeader(connection->in.data() + connection->in_pos, &header);
+		if (header.version != FcgiProtocol::VERSION) {
+			KALDI_WARN << "Unsupported FastCGI protocol version " << header.version;
+			CloseConnection(connection);
+			return;
+		}
+		if (connection->in.size() - connection->in_pos < header.RecordLength()) {
+			break;
+		}
+		const char *content = connection->in.data() + connection->in_pos + FcgiProtocol::HEADER_LENGTH;
+		if (!HandleRecord(connection, header.type, header.request_id, content, header.content_length)) {
+			KALDI_WARN << "Malformed FastCGI record of type " << header.type;
+			CloseConnection(connection);
+			return;
+		}
+		connection->in_pos += header.RecordLength();
+	}
+	connection->in.erase(0, connection->in_pos);
+	connection->in_pos = 0;
+
+	if (connection->out.size() > 0) {
+		WriteConnection(connection);
+	}
+}
+
+bool FcgiEventServer::HandleRecord(Connection *connection, int type, int request_id,
+		const char *content, size_t length) {
+	Stream *stream = connection->stream;
+	bool current = (stream != NULL) && (stream->request_id == request_id);
+
+	switch (type) {
+	case FcgiProtocol::BEGIN_REQUEST: {
+		int role, flags;
+		if (!FcgiProtocol::ParseBeginRequest(content, length, &role, &flags)) {
+			return false;
+		}
+		if (stream != NULL) {
+			FcgiProtocol::AppendEndRequest(&(connection->out), request_id, 0, FcgiProtocol::CANT_MPX_CONN);
+		} else if (role != FcgiProtocol::RESPONDER) {
+			FcgiProtocol::AppendEndRequest(&(connection->out), request_id, 0, FcgiProtocol::UNKNOWN_ROLE);
+		} else {
+			connection->stream = new Stream(*this, connection, request_id, (flags & FcgiProtocol::KEEP_CONN) != 0);
+		}
+		break;
+	}
+	case FcgiProtocol::ABORT_REQUEST:
+		if (current) {
+			if (stream->started) {
+				stream->CloseInput(true);
+			} else {
+				FcgiProtocol::AppendEndRequest(&(connection->out), request_id, 0, FcgiProtocol::REQUEST_COMPLETE);
+				connection->stream = NULL;
+				connection->closing = !stream->keep_conn || stopping_;
+				delete stream;
+			}
+		}
+		break;
+	case FcgiProtocol::PARAMS:
+		if (current && !stream->started) {
+			if (length > 0) {
+				stream->params_data.append(content, length);
+			} else {
+				if (!FcgiProtocol::ParseParams(stream->params_data.data(), stream->params_data.size(), &(stream->params))) {
+					return false;
+				}
+				stream->params_data.clear();
+				StartStream(stream);
+			}
+		}
+		break;
+	case FcgiProtocol::STDIN:
+		if (current) {
+			if (length == 0) {
+				stream->CloseInput(false);
+			} else if (stream->AppendInput(content, length) && connection->reading) {
+				connection->reading = false;
+				UpdateEvents(connection);
+			}
+		}
+		break;
+	case FcgiProtocol::GET_VALUES: {
+		FcgiProtocol::Params query;
+		if (!FcgiProtocol::ParseParams(content, length, &query)) {
+			return false;
+		}
+		std::string values;
+		for (size_t i = 0; i < query.size(); i++) {
+			if (query[i].first == "FCGI_MPXS_CONNS") {
+				FcgiProtocol::AppendParam(&values, query[i].first, "0");
+			} else if (query[i].first == "FCGI_MAX_CONNS" || query[i].first == "FCGI_MAX_REQS") {
+				FcgiProtocol::AppendParam(&values, query[i].first, "65535");
+			}
+		}
+		FcgiProtocol::AppendRecord(&(connection->out), FcgiProtocol::GET_VALUES_RESULT,
+				FcgiProtocol::NULL_REQUEST_ID, values.data(), values.size());
+		break;
+	}
+	default:
+		if (request_id == FcgiProtocol::NULL_REQUEST_ID) {
+			FcgiProtocol::AppendUnknownType(&(connection->out), type);
+		}
+		break;
+	}
+	return true;
+}
+
+void FcgiEventServer::WriteConnection(Connection *connection) {
+	while (connection->out_pos < connection->out.size()) {
+		ssize_t written = send(connection->fd, connection->out.data() + connection->out_pos,
+				connection->out.size() - connection->out_pos, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				if (!connection->writing) {
+					connection->writing = true;
+					UpdateEvents(connection);
+				}
+				return;
+			}
+			CloseConnection(connection);
+			return;
+		}
+		connection->out_pos += written;
+	}
+	connection->out.clear();
+	connection->out_pos = 0;
+
+	if (connection->writing) {
+		connection->writing = false;
+		UpdateEvents(connection);
+	}
+	if (connection->closing && connection->stream == NULL) {
+		CloseConnection(connection);
+	}
+}
+
+void FcgiEventServer::CloseConnection(Connection *connection) {
+	if (connection->closed) {
+		return;
+	}
+	epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection->fd, NULL);
+	close(connection->fd);
+	connection->closed = true;
+	connections_.erase(connection);
+
+	Stream *stream = connection->stream;
+	if (stream != NULL) {
+		connection->stream = NULL;
+		stream->connection = NULL;
+		if (stream->started) {
+			// Request is finished by its worker, stream is deleted afterwards
+			stream->CloseInput(true);
+		} else {
+			delete stream;
+		}
+	}
+	closed_.push_back(connection);
+}
+
+void FcgiEventServer::StartStream(Stream *stream) {
+	Worker *worker = workers_[next_worker_];
+	next_worker_ = (next_worker_ + 1) % workers_.size();
+
+	void *stack = mmap(NULL, stack_size_, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (stack == MAP_FAILED) {
+		KALDI_WARN << "Failed to allocate request stack: " << strerror(errno);
+		Connection *connection = stream->connection;
+		FcgiProtocol::AppendEndRequest(&(connection->out), stream->request_id, 0, FcgiProtocol::OVERLOADED);
+		connection->stream = NULL;
+		connection->closing = !stream->keep_conn || stopping_;
+		delete stream;
+		return;
+	}
+	// Guard page catches stack overflows
+	mprotect(stack, sysconf(_SC_PAGESIZE), PROT_NONE);
+
+	stream->started = true;
+	stream->worker = worker;
+	stream->stack = stack;
+
+	getcontext(&(stream->context));
+	stream->context.uc_stack.ss_sp = stack;
+	stream->context.uc_stack.ss_size = stack_size_;
+	stream->context.uc_link = &(worker->context);
+	uint64_t ptr = reinterpret_cast<uintptr_t>(stream);
+	makecontext(&(stream->context), (void (*)())RunCoroutine, 2,
+			(unsigned int)(ptr >> 32), (unsigned int)(ptr & 0xffffffff));
+
+	Schedule(stream);
+}
+
+void FcgiEventServer::Schedule(Stream *stream) {
+	Worker *worker = stream->worker;
+	pthread_mutex_lock(&(worker->mutex));
+	worker->run_queue.push_back(stream);
+	pthread_cond_signal(&(worker->cond));
+	pthread_mutex_unlock(&(worker->mutex));
+}
+
+void FcgiEventServer::Notify(Stream *stream, bool done) {
+	pthread_mutex_lock(&notify_mutex_);
+	if (done) {
+		stream->done = true;
+	}
+	if (!stream->notified) {
+		stream->notified = true;
+		notified_.push_back(stream);
+	}
+	pthread_mutex_unlock(&notify_mutex_);
+
+	// Stream must not be touched after done notification
+	uint64_t value = 1;
+	if (write(event_fd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+		KALDI_WARN << "Failed to write eventfd: " << strerror(errno);
+	}
+}
+
+void FcgiEventServer::ProcessNotifications() {
+	std::vector<Stream*> streams;
+	std::vector<bool> done;
+
+	pthread_mutex_lock(&notify_mutex_);
+	streams.swap(notified_);
+	for (size_t i = 0; i < streams.size(); i++) {
+		streams[i]->notified = false;
+		done.push_back(streams[i]->done);
+	}
+	pthread_mutex_unlock(&notify_mutex_);
+
+	for (size_t i = 0; i < streams.size(); i++) {
+		Stream *stream = streams[i];
+		std::string output;
+		bool resume_input = false;
+		stream->TakeOutput(&output, &resume_input);
+
+		Connection *connection = stream->connection;
+		if (connection != NULL) {
+			if (output.size() > 0) {
+				FcgiProtocol::AppendRecord(&(connection->out), FcgiProtocol::STDOUT,
+						stream->request_id, output.data(), output.size());
+			}
+			if (done[i]) {
+				FcgiProtocol::AppendRecord(&(connection->out), FcgiProtocol::STDOUT, stream->request_id, NULL, 0);
+				FcgiProtocol::AppendEndRequest(&(connection->out), stream->request_id, 0, FcgiProtocol::REQUEST_COMPLETE);
+				connection->stream = NULL;
+				connection->closing = !stream->keep_conn || stopping_;
+				resume_input = true;
+			}
+			if (resume_input && !connection->reading) {
+				connection->reading = true;
+				UpdateEvents(connection);
+			}
+			WriteConnection(connection);
+		}
+
+		if (done[i]) {
+			delete stream;
+		}
+	}
+}
+
+void *FcgiEventServer::RunWorkerThread(void *arg) {
+	Worker *worker = static_cast<Worker*>(arg);
+	worker->server->WorkerRoutine(*worker);
+	return NULL;
+}
+
+void FcgiEventServer::WorkerRoutine(Worker &worker) {
+	pthread_mutex_lock(&(worker.mutex));
+	while (true) {
+		while (worker.run_queue.empty() && !worker.stopping) {
+			pthread_cond_wait(&(worker.cond), &(worker.mutex));
+		}
+		if (worker.stopping) {
+			break;
+		}
+		Stream *stream = worker.run_queue.front();
+		worker.run_queue.pop_front();
+		pthread_mutex_unlock(&(worker.mutex));
+
+		// Runs until request needs more input data, waits for an event or finishes
+		Coroutine::SetCurrent(stream);
+		swapcontext(&(worker.context), &(stream->context));
+		Coroutine::SetCurrent(NULL);
+
+		if (stream->coroutine_done) {
+			munmap(stream->stack, stack_size_);
+			stream->stack = NULL;
+			Notify(stream, true);
+		}
+
+		pthread_mutex_lock(&(worker.mutex));
+	}
+	pthread_mutex_unlock(&(worker.mutex));
+}
+
+void FcgiEventServer::RunCoroutine(unsigned int ptr_high, unsigned int ptr_low) {
+	uint64_t ptr = (uint64_t(ptr_high) << 32) | ptr_low;
+	Stream *stream = reinterpret_cast<Stream*>(uintptr_t(ptr));
+
+	try {
+		stream->server.handler_.HandleRequest(*stream);
+	} catch (std::exception &e) {
+		KALDI_WARN << "Request processing failed: " << e.what();
+	}
+	stream->Out().flush();
+	stream->coroutine_done = true;
+	// Returning switches back to the worker via uc_link
+}
+
+} /* namespace apiai */
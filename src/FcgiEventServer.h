@@ -0,0 +1,122 @@
+// FcgiEventServer.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_FCGIEVENTSERVER_H_
+#define APIAI_DECODER_FCGIEVENTSERVER_H_
+
+#include "Timing.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <ostream>
+#include <set>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Event-driven FastCGI server.
+ * Single epoll loop owns the listening socket and all connections
+ * (including keep-alive ones), while requests are processed by a fixed
+ * pool of worker threads. Every request runs as a coroutine pinned to one
+ * worker: when it needs more input data than already received it yields,
+ * and it is resumed only when the requested amount of data has arrived
+ * or its read deadline has passed, so idle or slow clients never occupy
+ * a worker thread. Requests waiting for a WaitEvent yield the same way.
+ */
+class FcgiEventServer {
+public:
+	/** Request data available to the handler */
+	class Request {
+	public:
+		virtual ~Request() {};
+
+		/** Get FastCGI parameter value, NULL if parameter is not defined */
+		virtual const char *GetParam(const char *name) const = 0;
+		/**
+		 * Read request body data. Waits until length bytes are received,
+		 * body is finished or deadline (non-positive for none) is passed.
+		 * Returns number of bytes read.
+		 */
+		virtual size_t Read(char *data, size_t length, milliseconds_t deadline_ms, bool *timed_out) = 0;
+		/** Get number of request body bytes received and not read yet */
+		virtual size_t Available() = 0;
+		/** Response stream */
+		virtual std::ostream &Out() = 0;
+	};
+
+	/** Request processing routine */
+	class Handler {
+	public:
+		virtual ~Handler() {};
+
+		/** Process request. Runs inside worker coroutine */
+		virtual void HandleRequest(Request &request) = 0;
+	};
+
+	/**
+	 * Initialize server for already opened listening socket.
+	 * Coroutine stack size given in kilobytes.
+	 */
+	FcgiEventServer(Handler &handler, int listen_socket, int workers_number, int stack_size_kb);
+	virtual ~FcgiEventServer();
+
+	/** Run event loop. Returns non-zero value on failure */
+	int Run();
+	/**
+	 * Stop accepting connections and close idle ones, Run() returns
+	 * once running requests are finished. May be called from any thread.
+	 */
+	void Stop();
+private:
+	class Stream;
+	class Connection;
+	struct Worker;
+
+	static void *RunWorkerThread(void *worker);
+	static void RunCoroutine(unsigned int ptr_high, unsigned int ptr_low);
+	void WorkerRoutine(Worker &worker);
+
+	void AcceptConnections();
+	void ReadConnection(Connection *connection);
+	bool HandleRecord(Connection *connection, int type, int request_id, const char *content, size_t length);
+	void WriteConnection(Connection *connection);
+	void CloseConnection(Connection *connection);
+	void UpdateEvents(Connection *connection);
+	void ProcessNotifications();
+
+	void StartStream(Stream *stream);
+	void Schedule(Stream *stream);
+	/** Pass stream output to event loop, done flag tells that request processing is finished */
+	void Notify(Stream *stream, bool done);
+
+	Handler &handler_;
+	int listen_socket_;
+	int stack_size_;
+	int epoll_fd_;
+	int event_fd_;
+
+	std::vector<Worker*> workers_;
+	size_t next_worker_;
+
+	pthread_mutex_t notify_mutex_;
+	std::vector<Stream*> notified_;
+	std::set<Connection*> connections_;
+	std::vector<Connection*> closed_;
+	volatile int stopping_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_FCGIEVENTSERVER_H_ */
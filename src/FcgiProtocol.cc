@@ -0,0 +1,153 @@
+// FcgiProtocol.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FcgiProtocol.h"
+#include <algorithm>
+
+namespace apiai {
+
+void FcgiProtocol::ParseHeader(const char *data, Header *header) {
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+	header->version = bytes[0];
+	header->type = bytes[1];
+	header->request_id = (bytes[2] << 8) | bytes[3];
+	header->content_length = (bytes[4] << 8) | bytes[5];
+	header->padding_length = bytes[6];
+}
+
+bool FcgiProtocol::ParseBeginRequest(const char *data, size_t length, int *role, int *flags) {
+	if (length < 8) {
+		return false;
+	}
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+	*role = (bytes[0] << 8) | bytes[1];
+	*flags = bytes[2];
+	return true;
+}
+
+bool FcgiProtocol::ParseLength(const unsigned char *&data, const unsigned char *end, size_t *length) {
+	if (data >= end) {
+		return false;
+	}
+	if ((*data & 0x80) == 0) {
+		*length = *data;
+		data++;
+		return true;
+	}
+	if (end - data < 4) {
+		return false;
+	}
+	*length = (size_t(data[0] & 0x7f) << 24) | (size_t(data[1]) << 16) | (size_t(data[2]) << 8) | data[3];
+	data += 4;
+	return true;
+}
+
+bool FcgiProtocol::ParseParams(const char *data, size_t length, Params *params) {
+	const unsigned char *index = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char *end = index + length;
+
+	while (index < end) {
+		size_t name_length, value_length;
+		if (!ParseLength(index, end, &name_length) || !ParseLength(index, end, &value_length)) {
+			return false;
+		}
+		if (size_t(end - index) < name_length + value_length) {
+			return false;
+		}
+		const char *name = reinterpret_cast<const char*>(index);
+		params->push_back(std::make_pair(std::string(name, name_length),
+				std::string(name + name_length, value_length)));
+		index += name_length + value_length;
+	}
+	return true;
+}
+
+void FcgiProtocol::AppendHeader(std::string *out, int type, int request_id,
+		size_t content_length, size_t padding_length) {
+	char header[HEADER_LENGTH];
+	header[0] = VERSION;
+	header[1] = type;
+	header[2] = (request_id >> 8) & 0xff;
+	header[3] = request_id & 0xff;
+	header[4] = (content_length >> 8) & 0xff;
+	header[5] = content_length & 0xff;
+	header[6] = padding_length;
+	header[7] = 0;
+	out->append(header, HEADER_LENGTH);
+}
+
+void FcgiProtocol::AppendRecord(std::string *out, int type, int request_id, const char *data, size_t length) {
+	if (length == 0) {
+		AppendHeader(out, type, request_id, 0, 0);
+		return;
+	}
+	while (length > 0) {
+		size_t content_length = std::min(length, size_t(MAX_CONTENT_LENGTH));
+		// Align records to 8 bytes as recommended by specification
+		size_t padding_length = (8 - (content_length % 8)) % 8;
+		AppendHeader(out, type, request_id, content_length, padding_length);
+		out->append(data, content_length);
+		out->append(padding_length, '\0');
+		data += content_length;
+		length -= content_length;
+	}
+}
+
+void FcgiProtocol::AppendBeginRequest(std::string *out, int request_id, int role, int flags) {
+	char body[8] = { 0 };
+	body[0] = (role >> 8) & 0xff;
+	body[1] = role & 0xff;
+	body[2] = flags;
+	AppendHeader(out, BEGIN_REQUEST, request_id, sizeof(body), 0);
+	out->append(body, sizeof(body));
+}
+
+void FcgiProtocol::AppendEndRequest(std::string *out, int request_id, int app_status, int protocol_status) {
+	char body[8] = { 0 };
+	body[0] = (app_status >> 24) & 0xff;
+	body[1] = (app_status >> 16) & 0xff;
+	body[2] = (app_status >> 8) & 0xff;
+	body[3] = app_status & 0xff;
+	body[4] = protocol_status;
+	AppendHeader(out, END_REQUEST, request_id, sizeof(body), 0);
+	out->append(body, sizeof(body));
+}
+
+void FcgiProtocol::AppendUnknownType(std::string *out, int type) {
+	char body[8] = { 0 };
+	body[0] = type;
+	AppendHeader(out, UNKNOWN_TYPE, NULL_REQUEST_ID, sizeof(body), 0);
+	out->append(body, sizeof(body));
+}
+
+void FcgiProtocol::AppendLength(std::string *out, size_t length) {
+	if (length < 0x80) {
+		out->push_back(char(length));
+	} else {
+		out->push_back(char(((length >> 24) & 0x7f) | 0x80));
+		out->push_back(char((length >> 16) & 0xff));
+		out->push_back(char((length >> 8) & 0xff));
+		out->push_back(char(length & 0xff));
+	}
+}
+
+void FcgiProtocol::AppendParam(std::string *content, const std::string &name, const std::string &value) {
+	AppendLength(content, name.size());
+	AppendLength(content, value.size());
+	content->append(name);
+	content->append(value);
+}
+
+} /* namespace apiai */
@@ -0,0 +1,113 @@
+// FcgiProtocol.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_FCGIPROTOCOL_H_
+#define APIAI_DECODER_FCGIPROTOCOL_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace apiai {
+
+/**
+ * FastCGI record layer encoding and decoding routines.
+ * See https://fast-cgi.github.io/spec for protocol specification.
+ */
+class FcgiProtocol {
+public:
+	enum {
+		VERSION = 1,
+		HEADER_LENGTH = 8,
+		MAX_CONTENT_LENGTH = 65535,
+		NULL_REQUEST_ID = 0,
+	};
+
+	enum RecordType {
+		BEGIN_REQUEST = 1,
+		ABORT_REQUEST = 2,
+		END_REQUEST = 3,
+		PARAMS = 4,
+		STDIN = 5,
+		STDOUT = 6,
+		STDERR = 7,
+		DATA = 8,
+		GET_VALUES = 9,
+		GET_VALUES_RESULT = 10,
+		UNKNOWN_TYPE = 11,
+	};
+
+	enum Role {
+		RESPONDER = 1,
+		AUTHORIZER = 2,
+		FILTER = 3,
+	};
+
+	enum Flags {
+		KEEP_CONN = 1,
+	};
+
+	enum ProtocolStatus {
+		REQUEST_COMPLETE = 0,
+		CANT_MPX_CONN = 1,
+		OVERLOADED = 2,
+		UNKNOWN_ROLE = 3,
+	};
+
+	/** Record header */
+	struct Header {
+		int version;
+		int type;
+		int request_id;
+		int content_length;
+		int padding_length;
+
+		/** Total record length including header, content and padding */
+		size_t RecordLength() const { return HEADER_LENGTH + content_length + padding_length; }
+	};
+
+	typedef std::vector<std::pair<std::string, std::string> > Params;
+
+	/** Decode record header from HEADER_LENGTH bytes */
+	static void ParseHeader(const char *data, Header *header);
+	/** Decode BEGIN_REQUEST record body. Returns false if body is malformed */
+	static bool ParseBeginRequest(const char *data, size_t length, int *role, int *flags);
+	/** Decode name-value pairs from PARAMS or GET_VALUES stream. Returns false if data is malformed */
+	static bool ParseParams(const char *data, size_t length, Params *params);
+
+	/**
+	 * Append stream record(s) of given type to the output buffer.
+	 * Data longer than MAX_CONTENT_LENGTH is split to several records,
+	 * empty data produces stream termination record.
+	 */
+	static void AppendRecord(std::string *out, int type, int request_id, const char *data, size_t length);
+	/** Append BEGIN_REQUEST record */
+	static void AppendBeginRequest(std::string *out, int request_id, int role, int flags);
+	/** Append END_REQUEST record */
+	static void AppendEndRequest(std::string *out, int request_id, int app_status, int protocol_status);
+	/** Append UNKNOWN_TYPE record */
+	static void AppendUnknownType(std::string *out, int type);
+	/** Append encoded name-value pair to the PARAMS stream content */
+	static void AppendParam(std::string *content, const std::string &name, const std::string &value);
+private:
+	static void AppendHeader(std::string *out, int type, int request_id, size_t content_length, size_t padding_length);
+	static void AppendLength(std::string *out, size_t length);
+	static bool ParseLength(const unsigned char *&data, const unsigned char *end, size_t *length);
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_FCGIPROTOCOL_H_ */
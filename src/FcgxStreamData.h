@@ -0,0 +1,47 @@
+// FcgxStreamData.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_FCGXSTREAMDATA_H_
+#define APIAI_DECODER_FCGXSTREAMDATA_H_
+
+namespace apiai {
+
+/**
+ * Leading fields of libfcgi private FCGX_Stream_Data (fcgiapp.c).
+ * Records already received but not yet parsed are kept
+ * between stream stop and buffStop, after the padding of
+ * the current record.
+ *
+ * The layout is not a public API, configure checks it against the
+ * installed libfcgi and defines HAVE_FCGX_STREAM_LAYOUT if it matches.
+ */
+struct FcgxStreamDataPrefix {
+	unsigned char *buff;
+	int bufflen;
+	unsigned char *mBuff;
+	unsigned char *buffStop;
+	int type;
+	int eorStop;
+	/** Content of the current record is dropped, not delivered */
+	int skip;
+	/** Bytes of the current record content not received yet */
+	int contentLen;
+	/** Bytes of the current record padding not skipped yet */
+	int paddingLen;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_FCGXSTREAMDATA_H_ */
@@ -0,0 +1,272 @@
+// FlacCodec.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FlacCodec.h"
+
+#ifdef HAVE_FLAC
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace apiai {
+
+/** Max size of FLAC metadata blocks */
+static const size_t FLAC_METADATA_MAX = 1 << 20;
+/** Max size of FLAC frame header */
+static const size_t FLAC_FRAME_HEADER_MAX = 16;
+/** Min size of FLAC frame header */
+static const size_t FLAC_FRAME_HEADER_MIN = 6;
+
+FlacCodec::FlacCodec() : position_(0), frame_start_(0), metadata_read_(false), finished_(false), max_frame_size_(0), samples_(NULL) {
+	decoder_ = FLAC__stream_decoder_new();
+	if (decoder_ == NULL || FLAC__stream_decoder_init_stream(decoder_, ReadCallback, NULL, NULL, NULL, NULL,
+			WriteCallback, NULL, ErrorCallback, this) != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+		error_ = "Failed to initialize FLAC decoder";
+	}
+}
+
+FlacCodec::~FlacCodec() {
+	if (decoder_ != NULL) {
+		FLAC__stream_decoder_delete(decoder_);
+	}
+}
+
+FLAC__StreamDecoderReadStatus FlacCodec::ReadCallback(const FLAC__StreamDecoder *decoder,
+		FLAC__byte buffer[], size_t *bytes, void *client_data) {
+	FlacCodec *codec = static_cast<FlacCodec*>(client_data);
+	size_t available = codec->buffer_.size() - codec->position_;
+	if (available == 0) {
+		*bytes = 0;
+		// Frames are decoded only when complete, so no data means end of stream
+		return codec->finished_ ? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM : FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+	}
+	*bytes = std::min(*bytes, available);
+	memcpy(buffer, codec->buffer_.data() + codec->position_, *bytes);
+	codec->position_ += *bytes;
+	return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderWriteStatus FlacCodec::WriteCallback(const FLAC__StreamDecoder *decoder,
+		const FLAC__Frame *frame, const FLAC__int32 *const buffer[], void *client_data) {
+	FlacCodec *codec = static_cast<FlacCodec*>(client_data);
+	const FLAC__int32 *channel = buffer[std::min<kaldi::int32>(codec->channel_index_, frame->header.channels - 1)];
+	// Samples are scaled to 16 bits range
+	const kaldi::BaseFloat scale = ldexpf(1.0f, 16 - int(frame->header.bits_per_sample));
+	for (unsigned i = 0; i < frame->header.blocksize; i++) {
+		codec->samples_->push_back(channel[i] * scale);
+	}
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void FlacCodec::ErrorCallback(const FLAC__StreamDecoder *decoder,
+		FLAC__StreamDecoderErrorStatus status, void *client_data) {
+	FlacCodec *codec = static_cast<FlacCodec*>(client_data);
+	codec->error_ = std::string("FLAC stream error: ") + FLAC__StreamDecoderErrorStatusString[status];
+}
+
+bool FlacCodec::ParseMetadata() {
+	const char *data = buffer_.data();
+	if (buffer_.size() < 4) {
+		return true;
+	}
+	if (memcmp(data, "fLaC", 4) != 0) {
+		error_ = "Not a FLAC stream";
+		return false;
+	}
+	for (size_t pos = 4; pos + 4 <= buffer_.size(); ) {
+		const unsigned char *header = reinterpret_cast<const unsigned char*>(data + pos);
+		bool last = header[0] & 0x80;
+		size_t length = (header[1] << 16) | (header[2] << 8) | header[3];
+		if (pos + 4 + length > buffer_.size()) {
+			break;
+		}
+		// STREAMINFO is the first block, libFLAC checks it completely
+		if ((header[0] & 0x7f) == 0 && length >= 18) {
+			const unsigned char *info = header + 4;
+			size_t max_block_size = (info[2] << 8) | info[3];
+			max_frame_size_ = (info[7] << 16) | (info[8] << 8) | info[9];
+			frequency_ = (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+			channels_ = ((info[12] >> 1) & 0x07) + 1;
+			kaldi::int32 bits = (((info[12] & 0x01) << 4) | (info[13] >> 4)) + 1;
+			if (max_frame_size_ == 0) {
+				// Verbatim frame with headers is the largest one
+				max_frame_size_ = max_block_size * channels_ * ((bits + 7) / 8) + 64;
+			}
+		}
+		pos += 4 + length;
+		if (last) {
+			frame_start_ = pos;
+			if (max_frame_size_ == 0) {
+				error_ = "FLAC stream has no STREAMINFO";
+				return false;
+			}
+			if (!FLAC__stream_decoder_process_until_end_of_metadata(decoder_)) {
+				error_ = "Bad FLAC metadata";
+				return false;
+			}
+			metadata_read_ = true;
+			return true;
+		}
+	}
+	if (buffer_.size() > FLAC_METADATA_MAX) {
+		error_ = "FLAC metadata is too long";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Check frame header at the start of data. Returns header length,
+ * 0 for invalid header, or -1 if more data is needed to check it
+ */
+static int FrameHeaderLength(const unsigned char *data, size_t size) {
+	if (size < 5) {
+		return -1;
+	}
+	int block_size_code = data[2] >> 4;
+	int rate_code = data[2] & 0x0f;
+	int channels_code = data[3] >> 4;
+	int bits_code = (data[3] >> 1) & 0x07;
+	if (block_size_code == 0 || rate_code == 15 || channels_code > 10 || bits_code == 3 || (data[3] & 0x01) != 0) {
+		return 0;
+	}
+	// Frame or sample number is coded like UTF-8 character
+	int leading_ones = 0;
+	while (leading_ones < 8 && (data[4] & (0x80 >> leading_ones)) != 0) {
+		leading_ones++;
+	}
+	if (leading_ones == 1 || leading_ones == 8) {
+		return 0;
+	}
+	size_t number_size = leading_ones == 0 ? 1 : leading_ones;
+	size_t length = 4 + number_size;
+	length += block_size_code == 6 ? 1 : block_size_code == 7 ? 2 : 0;
+	length += rate_code == 12 ? 1 : (rate_code == 13 || rate_code == 14) ? 2 : 0;
+	if (size <= length) {
+		return -1;
+	}
+	for (size_t i = 5; i < 4 + number_size; i++) {
+		if ((data[i] & 0xc0) != 0x80) {
+			return 0;
+		}
+	}
+	// CRC-8 with polynomial x^8 + x^2 + x + 1 rejects sync codes found inside of frames
+	unsigned char crc = 0;
+	for (size_t i = 0; i < length; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+	}
+	return crc == data[length] ? int(length + 1) : 0;
+}
+
+/** CRC-16 with polynomial x^16 + x^15 + x^2 + 1 of the whole frame is stored in its last two bytes */
+static unsigned short FrameCrc16(const unsigned char *data, size_t size) {
+	unsigned short crc = 0;
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i] << 8;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+size_t FlacCodec::FindNextFrame() const {
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(buffer_.data());
+	for (size_t pos = frame_start_ + FLAC_FRAME_HEADER_MIN + 2; pos + 1 < buffer_.size(); pos++) {
+		if (data[pos] != 0xff || (data[pos + 1] & 0xfe) != 0xf8) {
+			continue;
+		}
+		int length = FrameHeaderLength(data + pos, buffer_.size() - pos);
+		if (length < 0) {
+			break;
+		}
+		// Header CRC-8 may match inside of a frame by chance, while the current
+		// frame has to be complete before it is decoded
+		if (length > 0 && FrameCrc16(data + frame_start_, pos - 2 - frame_start_) == ((data[pos - 2] << 8) | data[pos - 1])) {
+			return pos;
+		}
+	}
+	return std::string::npos;
+}
+
+bool FlacCodec::DecodeFrames(std::vector<kaldi::BaseFloat> *samples) {
+	samples_ = samples;
+	while (error_.empty()) {
+		size_t next_frame = std::string::npos;
+		if (!finished_) {
+			next_frame = FindNextFrame();
+			if (next_frame == std::string::npos) {
+				if (buffer_.size() - frame_start_ > max_frame_size_ + FLAC_FRAME_HEADER_MAX) {
+					error_ = "Bad FLAC frame";
+				}
+				break;
+			}
+		}
+		if (!FLAC__stream_decoder_process_single(decoder_)) {
+			if (error_.empty()) {
+				error_ = "Bad FLAC frame";
+			}
+			break;
+		}
+		FLAC__StreamDecoderState state = FLAC__stream_decoder_get_state(decoder_);
+		if (state == FLAC__STREAM_DECODER_END_OF_STREAM) {
+			break;
+		}
+		if (!finished_) {
+			frame_start_ = next_frame;
+		}
+	}
+	samples_ = NULL;
+
+	// Passed and decoded data is dropped once it takes most of the buffer
+	size_t passed = std::min(position_, frame_start_);
+	if (passed > buffer_.size() / 2) {
+		buffer_.erase(0, passed);
+		position_ -= passed;
+		frame_start_ -= passed;
+	}
+	return error_.empty();
+}
+
+bool FlacCodec::Decode(const char *data, size_t size, std::vector<kaldi::BaseFloat> *samples) {
+	if (!error_.empty()) {
+		return false;
+	}
+	buffer_.append(data, size);
+	if (!metadata_read_ && !ParseMetadata()) {
+		return false;
+	}
+	return !metadata_read_ || DecodeFrames(samples);
+}
+
+bool FlacCodec::Finish(std::vector<kaldi::BaseFloat> *samples) {
+	finished_ = true;
+	if (!metadata_read_) {
+		if (error_.empty()) {
+			error_ = "Truncated FLAC metadata";
+		}
+		return false;
+	}
+	// Frames kept inside of libFLAC are decoded as well
+	return DecodeFrames(samples) && FLAC__stream_decoder_finish(decoder_);
+}
+
+} /* namespace apiai */
+
+#endif /* HAVE_FLAC */
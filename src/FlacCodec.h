@@ -0,0 +1,74 @@
+// FlacCodec.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_FLACCODEC_H_
+#define APIAI_DECODER_FLACCODEC_H_
+
+#ifdef HAVE_FLAC
+
+#include "AudioCodec.h"
+#include <FLAC/stream_decoder.h>
+
+namespace apiai {
+
+/**
+ * Streaming FLAC decoded with libFLAC. Frame is decoded only when the header
+ * of the next frame is received, so that decoder never waits for data inside
+ * of a frame, and short frames of silence are not delayed
+ */
+class FlacCodec : public AudioCodec {
+public:
+	FlacCodec();
+	virtual ~FlacCodec();
+
+	virtual bool Decode(const char *data, size_t size, std::vector<kaldi::BaseFloat> *samples);
+	virtual bool Finish(std::vector<kaldi::BaseFloat> *samples);
+	/** Compression ratio of speech about 2 is assumed */
+	virtual size_t EncodedBytes(kaldi::int32 samples) const { return samples * channels_; }
+	virtual bool FixedRate() const { return false; }
+private:
+	static FLAC__StreamDecoderReadStatus ReadCallback(const FLAC__StreamDecoder *decoder,
+			FLAC__byte buffer[], size_t *bytes, void *client_data);
+	static FLAC__StreamDecoderWriteStatus WriteCallback(const FLAC__StreamDecoder *decoder,
+			const FLAC__Frame *frame, const FLAC__int32 *const buffer[], void *client_data);
+	static void ErrorCallback(const FLAC__StreamDecoder *decoder,
+			FLAC__StreamDecoderErrorStatus status, void *client_data);
+
+	/** Parse metadata blocks received so far, returns false for malformed stream */
+	bool ParseMetadata();
+	/** Find start of the frame following the complete current one, npos if not received yet */
+	size_t FindNextFrame() const;
+	/** Decode complete frames, all the rest when stream is finished */
+	bool DecodeFrames(std::vector<kaldi::BaseFloat> *samples);
+
+	FLAC__StreamDecoder *decoder_;
+	/** Received data not passed to libFLAC yet, starting at position_ */
+	std::string buffer_;
+	size_t position_;
+	/** Buffer position of the next frame to decode, data before it is passed to libFLAC */
+	size_t frame_start_;
+	bool metadata_read_;
+	bool finished_;
+	/** Max size of a frame of the stream */
+	size_t max_frame_size_;
+	/** Output of the current decoding call */
+	std::vector<kaldi::BaseFloat> *samples_;
+};
+
+} /* namespace apiai */
+
+#endif /* HAVE_FLAC */
+
+#endif /* APIAI_DECODER_FLACCODEC_H_ */
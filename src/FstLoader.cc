@@ -0,0 +1,151 @@
+// FstLoader.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "FstLoader.h"
+#include "Timing.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fstream>
+
+namespace apiai {
+
+void FstLoader::RegisterOptions(kaldi::OptionsItf &po) {
+	po.Register("fst-mmap", &mmap_,
+			"Memory map decoding graph instead of reading it. Graph should be "
+			"converted with \"fstconvert --fst_type=const --fst_align\"");
+	po.Register("fst-mmap-populate", &populate_,
+			"Fault in all pages of mapped graph at startup, only with --fst-mmap");
+	po.Register("fst-mmap-hugepages", &hugepages_,
+			"Advise kernel to back mapped graph with transparent huge pages, only with --fst-mmap");
+	po.Register("fst-mmap-lock", &lock_,
+			"Lock mapped graph in memory, requires sufficient RLIMIT_MEMLOCK, only with --fst-mmap");
+	po.Register("hcl-in", &hcl_rxfilename_,
+			"Output label lookahead HCL graph to be composed with --g-in on the fly instead of "
+			"reading --fst-in, e.g. HCLr.fst built by utils/mkgraph_lookahead.sh");
+	po.Register("g-in", &g_rxfilename_,
+			"Relabeled grammar to be composed with --hcl-in on the fly, e.g. Gr.fst");
+	po.Register("compose-cache-mb", &cache_mb_,
+			"Arc cache size limit in megabytes of every decoding session with --hcl-in and --g-in");
+	po.Register("compose-pooled-cache-mb", &pooled_cache_mb_,
+			"Total arc cache size limit in megabytes of idle pooled decoding sessions of the process "
+			"with --hcl-in and --g-in, sessions above it drop their caches");
+}
+
+LookaheadGraph *FstLoader::ReadLookahead() const {
+	return new LookaheadGraph(hcl_rxfilename_, g_rxfilename_);
+}
+
+fst::Fst<fst::StdArc> *FstLoader::Read(const std::string &rxfilename) const {
+	if (!mmap_) {
+		return fst::ReadFstKaldiGeneric(rxfilename);
+	}
+	return ReadMapped(rxfilename);
+}
+
+fst::Fst<fst::StdArc> *FstLoader::ReadMapped(const std::string &filename) const {
+	milliseconds_t start = getMilliseconds();
+
+	std::ifstream is(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!is.good()) {
+		KALDI_ERR << "Could not open decoding graph " << filename;
+	}
+
+	// Graph loaded before, e.g. the one being reloaded, may be mapped from the same file,
+	// so only regions which appear while reading belong to the new graph
+	std::vector<AddressRange> existing = MappedRegions(filename);
+
+	// OpenFst maps const FST sections by file name when they are properly aligned
+	fst::FstReadOptions opts(filename);
+	opts.mode = fst::FstReadOptions::MAP;
+	fst::Fst<fst::StdArc> *graph = fst::Fst<fst::StdArc>::Read(is, opts);
+	if (graph == NULL) {
+		KALDI_ERR << "Could not read decoding graph " << filename;
+	}
+
+	std::vector<AddressRange> regions;
+	std::vector<AddressRange> mapped = MappedRegions(filename);
+	for (size_t i = 0; i < mapped.size(); i++) {
+		if (std::find(existing.begin(), existing.end(), mapped[i]) == existing.end()) {
+			regions.push_back(mapped[i]);
+		}
+	}
+	size_t mapped_size = AdviseMappedRegions(regions);
+	if (graph->Type() != "const" || mapped_size == 0) {
+		KALDI_WARN << "Decoding graph " << filename << " of type \"" << graph->Type()
+				<< "\" is loaded into memory instead of being mapped, convert it with "
+				<< "\"fstconvert --fst_type=const --fst_align\"";
+	} else {
+		KALDI_LOG << "Decoding graph " << filename << " mapped: " << (mapped_size >> 20)
+				<< " MB in " << getMillisecondsSince(start) << " ms";
+	}
+	return graph;
+}
+
+std::vector<FstLoader::AddressRange> FstLoader::MappedRegions(const std::string &filename) {
+	std::vector<AddressRange> regions;
+	char path[PATH_MAX];
+	if (realpath(filename.c_str(), path) == NULL) {
+		return regions;
+	}
+
+	std::ifstream maps("/proc/self/maps");
+	std::string line;
+	while (std::getline(maps, line)) {
+		// Line format: "start-end perms offset dev inode pathname"
+		size_t path_pos = line.find('/');
+		if (path_pos == std::string::npos || line.compare(path_pos, std::string::npos, path) != 0) {
+			continue;
+		}
+		unsigned long begin, end;
+		if (sscanf(line.c_str(), "%lx-%lx", &begin, &end) == 2) {
+			regions.push_back(AddressRange(begin, end));
+		}
+	}
+	return regions;
+}
+
+size_t FstLoader::AdviseMappedRegions(const std::vector<AddressRange> &regions) const {
+	const long page_size = sysconf(_SC_PAGESIZE);
+	size_t total_size = 0;
+
+	for (size_t i = 0; i < regions.size(); i++) {
+		char *data = reinterpret_cast<char*>(regions[i].first);
+		size_t size = regions[i].second - regions[i].first;
+		total_size += size;
+
+		if (hugepages_ && madvise(data, size, MADV_HUGEPAGE) != 0) {
+			KALDI_WARN << "Huge pages are not available for mapped graph: " << strerror(errno);
+		}
+		if (populate_) {
+			madvise(data, size, MADV_WILLNEED);
+			// Equivalent of MAP_POPULATE for the region mapped by OpenFst
+			volatile char sum = 0;
+			for (size_t offset = 0; offset < size; offset += page_size) {
+				sum += data[offset];
+			}
+		}
+		if (lock_ && mlock(data, size) != 0) {
+			KALDI_WARN << "Failed to lock mapped graph in memory: " << strerror(errno);
+		}
+	}
+	return total_size;
+}
+
+} /* namespace apiai */
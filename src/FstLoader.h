@@ -0,0 +1,77 @@
+// FstLoader.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_FSTLOADER_H_
+#define APIAI_DECODER_FSTLOADER_H_
+
+#include "LookaheadGraph.h"
+#include "fstext/kaldi-fst-io.h"
+#include "util/parse-options.h"
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Decoding graph loader.
+ * Besides regular reading into heap memory graph can be memory mapped,
+ * so that startup doesn't depend on graph size and all processes on
+ * the host share the same page cache copy. Mapping requires const FST
+ * with aligned sections, e.g. converted with:
+ *   fstconvert --fst_type=const --fst_align HCLG.fst HCLG.const.fst
+ */
+class FstLoader {
+public:
+	FstLoader() : mmap_(false), populate_(false), hugepages_(false), lock_(false), cache_mb_(64), pooled_cache_mb_(512) {};
+
+	void RegisterOptions(kaldi::OptionsItf &po);
+
+	/** Read graph, caller takes ownership. Mapped graph is unmapped on deletion */
+	fst::Fst<fst::StdArc> *Read(const std::string &rxfilename) const;
+
+	/** Check if graph is composed on the fly from HCL and G instead of being read */
+	bool Lookahead() const { return hcl_rxfilename_.size() > 0 && g_rxfilename_.size() > 0; }
+	/** Read lookahead graph components, caller takes ownership */
+	LookaheadGraph *ReadLookahead() const;
+	/** Size limit of arc cache of every lazily composed graph instance, in bytes */
+	size_t CacheBytes() const { return size_t(std::max(1, cache_mb_)) << 20; }
+	/** Number of idle decoding sessions which may keep their arc caches within the process budget */
+	kaldi::int32 MaxPooledCaches() const { return std::max(0, pooled_cache_mb_) / std::max(1, cache_mb_); }
+private:
+	/** Start and end address of a memory region */
+	typedef std::pair<unsigned long, unsigned long> AddressRange;
+
+	fst::Fst<fst::StdArc> *ReadMapped(const std::string &filename) const;
+	/** Get memory regions mapped from given file */
+	static std::vector<AddressRange> MappedRegions(const std::string &filename);
+	/** Apply page options to given memory regions. Returns their total size */
+	size_t AdviseMappedRegions(const std::vector<AddressRange> &regions) const;
+
+	bool mmap_;
+	bool populate_;
+	bool hugepages_;
+	bool lock_;
+
+	std::string hcl_rxfilename_;
+	std::string g_rxfilename_;
+	kaldi::int32 cache_mb_;
+	kaldi::int32 pooled_cache_mb_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_FSTLOADER_H_ */
@@ -0,0 +1,79 @@
+// IncrementalBestPath.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "IncrementalBestPath.h"
+
+namespace apiai {
+
+void IncrementalBestPath::Reset() {
+	path_.clear();
+	index_.clear();
+	words_.clear();
+}
+
+kaldi::LatticeWeight IncrementalBestPath::Weight() const {
+	return path_.empty() ? kaldi::LatticeWeight::One() : path_.back().weight;
+}
+
+bool IncrementalBestPath::Update(const kaldi::LatticeFasterOnlineDecoder &decoder) {
+	if (decoder.NumFramesDecoded() == 0) {
+		return false;
+	}
+
+	typedef kaldi::LatticeFasterOnlineDecoder::BestPathIterator BestPathIterator;
+
+	// Trace back until the path joins the known one. Tokens of decoded frames
+	// are never created again, so a known token still has the same backpointers
+	std::vector<TokenKey> tokens;
+	std::vector<kaldi::LatticeArc> arcs;
+	std::map<TokenKey, size_t>::const_iterator join = index_.end();
+	BestPathIterator iter = decoder.BestPathEnd(false);
+	while (!iter.Done()) {
+		TokenKey token(iter.frame, iter.tok);
+		join = index_.find(token);
+		if (join != index_.end()) {
+			break;
+		}
+		kaldi::LatticeArc arc;
+		iter = decoder.TraceBackBestPath(iter, &arc);
+		tokens.push_back(token);
+		arcs.push_back(arc);
+	}
+
+	// Drop the part of the known path not shared with the new one
+	size_t length = (join != index_.end()) ? join->second + 1 : 0;
+	for (size_t i = length; i < path_.size(); i++) {
+		index_.erase(path_[i].token);
+	}
+	path_.resize(length);
+	words_.resize(length > 0 ? path_.back().words : 0);
+
+	kaldi::LatticeWeight weight = Weight();
+	for (size_t i = tokens.size(); i-- > 0; ) {
+		weight = fst::Times(weight, arcs[i].weight);
+		if (arcs[i].olabel != 0) {
+			words_.push_back(arcs[i].olabel);
+		}
+		Entry entry;
+		entry.token = tokens[i];
+		entry.words = words_.size();
+		entry.weight = weight;
+		index_[entry.token] = path_.size();
+		path_.push_back(entry);
+	}
+	return true;
+}
+
+} /* namespace apiai */
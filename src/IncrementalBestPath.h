@@ -0,0 +1,65 @@
+// IncrementalBestPath.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_INCREMENTALBESTPATH_H_
+#define APIAI_DECODER_INCREMENTALBESTPATH_H_
+
+#include "decoder/lattice-faster-online-decoder.h"
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Best path of online decoder traced back from the best token of the
+ * last decoded frame. Path found by the previous update is kept, so
+ * traceback stops as soon as it joins the known path and the cost
+ * of every update depends on how much of the path changed, not on
+ * utterance length.
+ */
+class IncrementalBestPath {
+public:
+	IncrementalBestPath() {};
+
+	/** Forget path, must be called when decoder starts new utterance */
+	void Reset();
+
+	/** Update path with tokens decoded since previous update. Returns false if nothing decoded yet */
+	bool Update(const kaldi::LatticeFasterOnlineDecoder &decoder);
+
+	/** Get words of current best path */
+	const std::vector<kaldi::int32> &Words() const { return words_; }
+	/** Get total graph and acoustic costs of current best path */
+	kaldi::LatticeWeight Weight() const;
+private:
+	/** Token identified by frame number and address, as addresses may be reused for later frames */
+	typedef std::pair<kaldi::int32, void*> TokenKey;
+
+	/** Path state after reaching token */
+	struct Entry {
+		TokenKey token;
+		size_t words;
+		kaldi::LatticeWeight weight;
+	};
+
+	std::vector<Entry> path_;
+	std::map<TokenKey, size_t> index_;
+	std::vector<kaldi::int32> words_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_INCREMENTALBESTPATH_H_ */
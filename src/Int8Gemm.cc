@@ -0,0 +1,211 @@
+// Int8Gemm.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Int8Gemm.h"
+#include "base/kaldi-error.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define APIAI_INT8_X86 1
+#include <immintrin.h>
+#endif
+
+namespace apiai {
+
+void Int8Matrix::Quantize(const kaldi::BaseFloat *data, kaldi::int32 rows, kaldi::int32 cols, kaldi::int32 stride) {
+	rows_ = rows;
+	cols_ = cols;
+	stride_ = (cols + INT8_ROW_ALIGN - 1) / INT8_ROW_ALIGN * INT8_ROW_ALIGN;
+	// Buffers keep their capacity, so that activations are quantized without allocation
+	data_.assign(size_t(rows) * stride_, 0);
+	scales_.resize(rows);
+	sums_.resize(rows);
+
+	for (kaldi::int32 r = 0; r < rows; r++) {
+		const kaldi::BaseFloat *row = data + size_t(r) * stride;
+		kaldi::BaseFloat max_abs = 0;
+		for (kaldi::int32 c = 0; c < cols; c++) {
+			max_abs = std::max(max_abs, kaldi::BaseFloat(fabs(row[c])));
+		}
+		kaldi::BaseFloat scale = max_abs > 0 ? max_abs / 127 : 1;
+		kaldi::BaseFloat inverse = 1 / scale;
+		kaldi::int8 *quantized = data_.data() + size_t(r) * stride_;
+		kaldi::int32 sum = 0;
+		for (kaldi::int32 c = 0; c < cols; c++) {
+			kaldi::int32 value = kaldi::int32(lrintf(row[c] * inverse));
+			quantized[c] = kaldi::int8(std::max(-127, std::min(127, value)));
+			sum += quantized[c];
+		}
+		scales_[r] = scale;
+		sums_[r] = sum;
+	}
+}
+
+static inline void StoreResult(kaldi::int32 dot, kaldi::BaseFloat scale, const kaldi::BaseFloat *bias,
+		kaldi::int32 col, bool add, kaldi::BaseFloat *out) {
+	kaldi::BaseFloat value = dot * scale + (bias != NULL ? bias[col] : 0);
+	out[col] = add ? out[col] + value : value;
+}
+
+void Int8MatMulScalar(const Int8Matrix &x, const Int8Matrix &w, const kaldi::BaseFloat *bias, bool add,
+		kaldi::BaseFloat *out, kaldi::int32 out_stride) {
+	for (kaldi::int32 i = 0; i < x.Rows(); i++) {
+		const kaldi::int8 *x_row = x.Row(i);
+		kaldi::BaseFloat *out_row = out + size_t(i) * out_stride;
+		for (kaldi::int32 j = 0; j < w.Rows(); j++) {
+			const kaldi::int8 *w_row = w.Row(j);
+			kaldi::int32 dot = 0;
+			for (kaldi::int32 k = 0; k < x.Cols(); k++) {
+				dot += kaldi::int32(x_row[k]) * w_row[k];
+			}
+			StoreResult(dot, x.Scale(i) * w.Scale(j), bias, j, add, out_row);
+		}
+	}
+}
+
+#ifdef APIAI_INT8_X86
+
+__attribute__((target("avx2")))
+static inline kaldi::int32 HorizontalSumAvx2(__m256i values) {
+	__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(sum);
+}
+
+/**
+ * Values are sign-extended to 16 bits and multiplied with madd,
+ * which unlike maddubs can't saturate. Four rows of w share loads of x.
+ */
+__attribute__((target("avx2")))
+static void Int8MatMulAvx2(const Int8Matrix &x, const Int8Matrix &w, const kaldi::BaseFloat *bias, bool add,
+		kaldi::BaseFloat *out, kaldi::int32 out_stride) {
+	const kaldi::int32 stride = x.Stride();
+	for (kaldi::int32 i = 0; i < x.Rows(); i++) {
+		const kaldi::int8 *x_row = x.Row(i);
+		kaldi::BaseFloat *out_row = out + size_t(i) * out_stride;
+		kaldi::int32 j = 0;
+		for (; j + 4 <= w.Rows(); j += 4) {
+			const kaldi::int8 *w0 = w.Row(j), *w1 = w.Row(j + 1), *w2 = w.Row(j + 2), *w3 = w.Row(j + 3);
+			__m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+			__m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+			for (kaldi::int32 k = 0; k < stride; k += 16) {
+				__m256i xv = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x_row + k)));
+				acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(xv,
+						_mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w0 + k)))));
+				acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(xv,
+						_mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w1 + k)))));
+				acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(xv,
+						_mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w2 + k)))));
+				acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(xv,
+						_mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w3 + k)))));
+			}
+			StoreResult(HorizontalSumAvx2(acc0), x.Scale(i) * w.Scale(j), bias, j, add, out_row);
+			StoreResult(HorizontalSumAvx2(acc1), x.Scale(i) * w.Scale(j + 1), bias, j + 1, add, out_row);
+			StoreResult(HorizontalSumAvx2(acc2), x.Scale(i) * w.Scale(j + 2), bias, j + 2, add, out_row);
+			StoreResult(HorizontalSumAvx2(acc3), x.Scale(i) * w.Scale(j + 3), bias, j + 3, add, out_row);
+		}
+		for (; j < w.Rows(); j++) {
+			const kaldi::int8 *w_row = w.Row(j);
+			__m256i acc = _mm256_setzero_si256();
+			for (kaldi::int32 k = 0; k < stride; k += 16) {
+				__m256i xv = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x_row + k)));
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(xv,
+						_mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w_row + k)))));
+			}
+			StoreResult(HorizontalSumAvx2(acc), x.Scale(i) * w.Scale(j), bias, j, add, out_row);
+		}
+	}
+}
+
+__attribute__((target("avx512f")))
+static inline kaldi::int32 HorizontalSumAvx512(__m512i values) {
+	return HorizontalSumAvx2(_mm256_add_epi32(_mm512_maskz_extracti64x4_epi64(0xff, values, 0),
+			_mm512_maskz_extracti64x4_epi64(0xff, values, 1)));
+}
+
+/**
+ * VNNI multiplies unsigned by signed bytes, so x is shifted by 128 to be
+ * unsigned and the shift is subtracted back as 128 * sum of w row.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void Int8MatMulVnni(const Int8Matrix &x, const Int8Matrix &w, const kaldi::BaseFloat *bias, bool add,
+		kaldi::BaseFloat *out, kaldi::int32 out_stride) {
+	const kaldi::int32 stride = x.Stride();
+	const __m512i shift = _mm512_set1_epi8(char(0x80));
+	for (kaldi::int32 i = 0; i < x.Rows(); i++) {
+		const kaldi::int8 *x_row = x.Row(i);
+		kaldi::BaseFloat *out_row = out + size_t(i) * out_stride;
+		kaldi::int32 j = 0;
+		for (; j + 4 <= w.Rows(); j += 4) {
+			const kaldi::int8 *w0 = w.Row(j), *w1 = w.Row(j + 1), *w2 = w.Row(j + 2), *w3 = w.Row(j + 3);
+			__m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+			__m512i acc2 = _mm512_setzero_si512(), acc3 = _mm512_setzero_si512();
+			for (kaldi::int32 k = 0; k < stride; k += 64) {
+				__m512i xv = _mm512_xor_si512(_mm512_loadu_si512(x_row + k), shift);
+				acc0 = _mm512_dpbusd_epi32(acc0, xv, _mm512_loadu_si512(w0 + k));
+				acc1 = _mm512_dpbusd_epi32(acc1, xv, _mm512_loadu_si512(w1 + k));
+				acc2 = _mm512_dpbusd_epi32(acc2, xv, _mm512_loadu_si512(w2 + k));
+				acc3 = _mm512_dpbusd_epi32(acc3, xv, _mm512_loadu_si512(w3 + k));
+			}
+			StoreResult(HorizontalSumAvx512(acc0) - 128 * w.Sum(j), x.Scale(i) * w.Scale(j), bias, j, add, out_row);
+			StoreResult(HorizontalSumAvx512(acc1) - 128 * w.Sum(j + 1), x.Scale(i) * w.Scale(j + 1), bias, j + 1, add, out_row);
+			StoreResult(HorizontalSumAvx512(acc2) - 128 * w.Sum(j + 2), x.Scale(i) * w.Scale(j + 2), bias, j + 2, add, out_row);
+			StoreResult(HorizontalSumAvx512(acc3) - 128 * w.Sum(j + 3), x.Scale(i) * w.Scale(j + 3), bias, j + 3, add, out_row);
+		}
+		for (; j < w.Rows(); j++) {
+			const kaldi::int8 *w_row = w.Row(j);
+			__m512i acc = _mm512_setzero_si512();
+			for (kaldi::int32 k = 0; k < stride; k += 64) {
+				__m512i xv = _mm512_xor_si512(_mm512_loadu_si512(x_row + k), shift);
+				acc = _mm512_dpbusd_epi32(acc, xv, _mm512_loadu_si512(w_row + k));
+			}
+			StoreResult(HorizontalSumAvx512(acc) - 128 * w.Sum(j), x.Scale(i) * w.Scale(j), bias, j, add, out_row);
+		}
+	}
+}
+
+static bool HasAvx2() {
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+static bool HasVnni() {
+	static const bool vnni = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+			&& __builtin_cpu_supports("avx512vnni");
+	return vnni;
+}
+
+#endif /* APIAI_INT8_X86 */
+
+void Int8MatMul(const Int8Matrix &x, const Int8Matrix &w, const kaldi::BaseFloat *bias, bool add,
+		kaldi::BaseFloat *out, kaldi::int32 out_stride) {
+	KALDI_ASSERT(x.Cols() == w.Cols());
+#ifdef APIAI_INT8_X86
+	if (HasVnni()) {
+		Int8MatMulVnni(x, w, bias, add, out, out_stride);
+		return;
+	}
+	if (HasAvx2()) {
+		Int8MatMulAvx2(x, w, bias, add, out, out_stride);
+		return;
+	}
+#endif
+	Int8MatMulScalar(x, w, bias, add, out, out_stride);
+}
+
+} /* namespace apiai */
@@ -0,0 +1,72 @@
+// Int8Gemm.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_INT8GEMM_H_
+#define APIAI_DECODER_INT8GEMM_H_
+
+#include "base/kaldi-types.h"
+#include <stddef.h>
+#include <vector>
+
+namespace apiai {
+
+/** Row length of quantized matrices is padded with zeros to a multiple of this value */
+#define INT8_ROW_ALIGN 64
+
+/**
+ * Matrix quantized to 8 bits symmetrically per row:
+ * row values are scale * [-127, 127]
+ */
+class Int8Matrix {
+public:
+	Int8Matrix() : rows_(0), cols_(0), stride_(0) {}
+
+	/** Quantize float matrix, rows are stride values apart */
+	void Quantize(const kaldi::BaseFloat *data, kaldi::int32 rows, kaldi::int32 cols, kaldi::int32 stride);
+
+	kaldi::int32 Rows() const { return rows_; }
+	kaldi::int32 Cols() const { return cols_; }
+	/** Padded row length */
+	kaldi::int32 Stride() const { return stride_; }
+
+	const kaldi::int8 *Row(kaldi::int32 row) const { return data_.data() + size_t(row) * stride_; }
+	kaldi::BaseFloat Scale(kaldi::int32 row) const { return scales_[row]; }
+	/** Sum of quantized row values */
+	kaldi::int32 Sum(kaldi::int32 row) const { return sums_[row]; }
+private:
+	kaldi::int32 rows_;
+	kaldi::int32 cols_;
+	kaldi::int32 stride_;
+	std::vector<kaldi::int8> data_;
+	std::vector<kaldi::BaseFloat> scales_;
+	std::vector<kaldi::int32> sums_;
+};
+
+/**
+ * Compute out = x * w^T (+ bias) with x and w quantized.
+ * Quantized rows of x are multiplied by every row of w in int32 and scaled back.
+ * Output is added to existing values if add is set, bias may be NULL.
+ * Vectorized with AVX-512 VNNI or AVX2 depending on CPU capabilities.
+ */
+void Int8MatMul(const Int8Matrix &x, const Int8Matrix &w, const kaldi::BaseFloat *bias, bool add,
+		kaldi::BaseFloat *out, kaldi::int32 out_stride);
+
+/** Non-vectorized multiplication, reference implementation */
+void Int8MatMulScalar(const Int8Matrix &x, const Int8Matrix &w, const kaldi::BaseFloat *bias, bool add,
+		kaldi::BaseFloat *out, kaldi::int32 out_stride);
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_INT8GEMM_H_ */
@@ -0,0 +1,89 @@
+// Int8GemmTests.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Int8Gemm.h"
+#include "base/kaldi-common.h"
+#include <math.h>
+#include <stdlib.h>
+
+namespace apiai {
+
+	static void RandomMatrix(kaldi::int32 rows, kaldi::int32 cols, std::vector<kaldi::BaseFloat> *data) {
+		data->resize(size_t(rows) * cols);
+		for (size_t i = 0; i < data->size(); i++) {
+			(*data)[i] = kaldi::BaseFloat(rand()) / RAND_MAX * 2 - 1;
+		}
+	}
+
+	void TestQuantize() {
+		kaldi::BaseFloat values[] = { 0.5, -1, 0.25, 0, 0, 0 };
+		Int8Matrix matrix;
+		matrix.Quantize(values, 2, 3, 3);
+		KALDI_ASSERT(matrix.Rows() == 2 && matrix.Cols() == 3);
+		KALDI_ASSERT(matrix.Stride() == INT8_ROW_ALIGN);
+		KALDI_ASSERT(matrix.Row(0)[0] == 64 && matrix.Row(0)[1] == -127 && matrix.Row(0)[2] == 32);
+		KALDI_ASSERT(matrix.Row(0)[3] == 0);
+		KALDI_ASSERT(matrix.Sum(0) == 64 - 127 + 32);
+		KALDI_ASSERT(fabs(matrix.Scale(0) - 1.0 / 127) < 1e-7);
+		KALDI_ASSERT(matrix.Row(1)[0] == 0 && matrix.Sum(1) == 0);
+	}
+
+	void TestMatMul() {
+		// Odd sizes cover padding and rows left after blocks of four
+		const kaldi::int32 rows = 7, cols = 203, out_dim = 31, out_stride = 33;
+		std::vector<kaldi::BaseFloat> x, w, bias;
+		RandomMatrix(rows, cols, &x);
+		RandomMatrix(out_dim, cols, &w);
+		RandomMatrix(1, out_dim, &bias);
+
+		Int8Matrix x_quantized, w_quantized;
+		x_quantized.Quantize(x.data(), rows, cols, cols);
+		w_quantized.Quantize(w.data(), out_dim, cols, cols);
+
+		std::vector<kaldi::BaseFloat> reference(rows * out_stride, 1), out(rows * out_stride, 1);
+		Int8MatMulScalar(x_quantized, w_quantized, bias.data(), false, reference.data(), out_stride);
+		Int8MatMul(x_quantized, w_quantized, bias.data(), false, out.data(), out_stride);
+
+		for (kaldi::int32 i = 0; i < rows; i++) {
+			for (kaldi::int32 j = 0; j < out_dim; j++) {
+				kaldi::BaseFloat exact = bias[j];
+				for (kaldi::int32 k = 0; k < cols; k++) {
+					exact += x[i * cols + k] * w[j * cols + k];
+				}
+				// Integer products are exact, so only summation order may differ
+				KALDI_ASSERT(fabs(out[i * out_stride + j] - reference[i * out_stride + j]) < 1e-4);
+				KALDI_ASSERT(fabs(out[i * out_stride + j] - exact) < 0.1);
+			}
+			KALDI_ASSERT(out[i * out_stride + out_dim] == 1);
+		}
+
+		Int8MatMul(x_quantized, w_quantized, NULL, true, out.data(), out_stride);
+		for (kaldi::int32 i = 0; i < rows; i++) {
+			for (kaldi::int32 j = 0; j < out_dim; j++) {
+				kaldi::BaseFloat expected = 2 * reference[i * out_stride + j] - bias[j];
+				KALDI_ASSERT(fabs(out[i * out_stride + j] - expected) < 1e-4);
+			}
+		}
+	}
+
+} /* namespace apiai */
+
+int main(int argn, char *argv[]) {
+	using namespace apiai;
+
+	TestQuantize();
+	TestMatMul();
+	return 0;
+}
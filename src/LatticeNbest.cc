@@ -0,0 +1,136 @@
+// LatticeNbest.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LatticeNbest.h"
+#include "lat/lattice-functions.h"
+#include <algorithm>
+#include <limits>
+
+namespace apiai {
+
+typedef kaldi::CompactLattice::StateId StateId;
+
+LatticeNbest::LatticeNbest(kaldi::CompactLattice *clat) : clat_(*clat) {
+	kaldi::TopSortCompactLatticeIfNeeded(clat);
+
+	const double infinity = std::numeric_limits<double>::infinity();
+	betas_.resize(clat_.NumStates(), infinity);
+	for (StateId s = clat_.NumStates() - 1; s >= 0; s--) {
+		double beta = infinity;
+		kaldi::CompactLatticeWeight final = clat_.Final(s);
+		if (final != kaldi::CompactLatticeWeight::Zero()) {
+			beta = Cost(final.Weight());
+		}
+		for (fst::ArcIterator<kaldi::CompactLattice> aiter(clat_, s); !aiter.Done(); aiter.Next()) {
+			const kaldi::CompactLatticeArc &arc = aiter.Value();
+			beta = std::min(beta, Cost(arc.weight.Weight()) + betas_[arc.nextstate]);
+		}
+		betas_[s] = beta;
+	}
+
+	StateId start = clat_.Start();
+	if (start != fst::kNoStateId && betas_[start] != infinity) {
+		Node node;
+		node.state = start;
+		node.arc = 0;
+		node.parent = -1;
+		node.cost = 0;
+		Push(node, betas_[start]);
+	}
+}
+
+void LatticeNbest::Push(const Node &node, double estimate) {
+	Candidate candidate;
+	candidate.estimate = estimate;
+	candidate.node = nodes_.size();
+	nodes_.push_back(node);
+	queue_.push(candidate);
+}
+
+bool LatticeNbest::Next(Path *path) {
+	const double infinity = std::numeric_limits<double>::infinity();
+	while (!queue_.empty()) {
+		kaldi::int32 index = queue_.top().node;
+		queue_.pop();
+
+		// Complete path ends with final weight
+		if (nodes_[index].arc < 0) {
+			GetPath(index, path);
+			return true;
+		}
+
+		Node node = nodes_[index];
+		kaldi::CompactLatticeWeight final = clat_.Final(node.state);
+		if (final != kaldi::CompactLatticeWeight::Zero()) {
+			Node next;
+			next.state = node.state;
+			next.arc = -1;
+			next.parent = index;
+			next.cost = node.cost + Cost(final.Weight());
+			Push(next, next.cost);
+		}
+		kaldi::int32 position = 0;
+		for (fst::ArcIterator<kaldi::CompactLattice> aiter(clat_, node.state); !aiter.Done(); aiter.Next(), position++) {
+			const kaldi::CompactLatticeArc &arc = aiter.Value();
+			if (betas_[arc.nextstate] == infinity) {
+				continue;
+			}
+			Node next;
+			next.state = arc.nextstate;
+			next.arc = position;
+			next.parent = index;
+			next.cost = node.cost + Cost(arc.weight.Weight());
+			Push(next, next.cost + betas_[arc.nextstate]);
+		}
+	}
+	return false;
+}
+
+void LatticeNbest::GetPath(kaldi::int32 index, Path *path) {
+	path->words.clear();
+	path->alignment.clear();
+	path->weights.clear();
+	path->weight = kaldi::LatticeWeight::One();
+
+	// Collect nodes from the end, final weight node first
+	std::vector<kaldi::int32> chain;
+	for (kaldi::int32 i = index; nodes_[i].parent >= 0; i = nodes_[i].parent) {
+		chain.push_back(i);
+	}
+
+	for (size_t i = chain.size(); i-- > 0; ) {
+		const Node &node = nodes_[chain[i]];
+		const Node &parent = nodes_[node.parent];
+		kaldi::CompactLatticeWeight weight;
+		if (node.arc < 0) {
+			weight = clat_.Final(node.state);
+		} else {
+			fst::ArcIterator<kaldi::CompactLattice> aiter(clat_, parent.state);
+			aiter.Seek(node.arc);
+			const kaldi::CompactLatticeArc &arc = aiter.Value();
+			if (arc.olabel != 0) {
+				path->words.push_back(arc.olabel);
+			}
+			weight = arc.weight;
+		}
+		path->alignment.insert(path->alignment.end(), weight.String().begin(), weight.String().end());
+		path->weight = fst::Times(path->weight, weight.Weight());
+		if (weight.Weight().Value1() != 0 || weight.Weight().Value2() != 0) {
+			path->weights.push_back(weight.Weight());
+		}
+	}
+}
+
+} /* namespace apiai */
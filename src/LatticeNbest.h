@@ -0,0 +1,77 @@
+// LatticeNbest.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_LATTICENBEST_H_
+#define APIAI_DECODER_LATTICENBEST_H_
+
+#include "lat/kaldi-lattice.h"
+#include <queue>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Lazy n-best paths enumeration of acyclic compact lattice.
+ * Paths are found in the order of cost by A* search guided with
+ * exact cost-to-final of every state, so only states lying on
+ * the returned paths are expanded and the cost of every next path
+ * depends on its length rather than on lattice size.
+ */
+class LatticeNbest {
+public:
+	/** Single lattice path */
+	struct Path {
+		std::vector<kaldi::int32> words;
+		std::vector<kaldi::int32> alignment;
+		kaldi::LatticeWeight weight;
+		/** Non-zero weights of path arcs and final weight */
+		std::vector<kaldi::LatticeWeight> weights;
+	};
+
+	/** Lattice is topologically sorted if needed and has to outlive the object */
+	LatticeNbest(kaldi::CompactLattice *clat);
+
+	/** Get next best path. Returns false if there are no more paths */
+	bool Next(Path *path);
+private:
+	/** Partial path from start state, linked to its prefix */
+	struct Node {
+		kaldi::CompactLattice::StateId state;
+		/** Arc position in previous node state, -1 for final weight */
+		kaldi::int32 arc;
+		kaldi::int32 parent;
+		double cost;
+	};
+	/** Queue item ordered by path cost estimate */
+	struct Candidate {
+		double estimate;
+		kaldi::int32 node;
+		bool operator<(const Candidate &other) const { return estimate > other.estimate; }
+	};
+
+	static double Cost(const kaldi::LatticeWeight &weight) { return weight.Value1() + weight.Value2(); }
+	void Push(const Node &node, double estimate);
+	void GetPath(kaldi::int32 node, Path *path);
+
+	const kaldi::CompactLattice &clat_;
+	/** Min cost from state to final weight */
+	std::vector<double> betas_;
+	std::vector<Node> nodes_;
+	std::priority_queue<Candidate> queue_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_LATTICENBEST_H_ */
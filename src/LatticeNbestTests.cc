@@ -0,0 +1,115 @@
+// LatticeNbestTests.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LatticeNbest.h"
+#include "lat/lattice-functions.h"
+#include "base/kaldi-math.h"
+
+namespace apiai {
+
+	/** Random acyclic lattice with arcs going only forward */
+	void RandomLattice(kaldi::int32 states_number, kaldi::CompactLattice *clat) {
+		clat->DeleteStates();
+		for (kaldi::int32 s = 0; s < states_number; s++) {
+			clat->AddState();
+		}
+		clat->SetStart(0);
+		for (kaldi::int32 s = 0; s < states_number; s++) {
+			if (s == states_number - 1 || kaldi::Rand() % 5 == 0) {
+				clat->SetFinal(s, kaldi::CompactLatticeWeight(kaldi::LatticeWeight(kaldi::Rand() % 3, 0),
+						std::vector<kaldi::int32>()));
+			}
+			for (kaldi::int32 t = s + 1; t < states_number; t++) {
+				if (t == s + 1 || kaldi::Rand() % 3 == 0) {
+					kaldi::int32 word = kaldi::Rand() % 4 == 0 ? 0 : 1 + kaldi::Rand() % 20;
+					std::vector<kaldi::int32> alignment(1 + kaldi::Rand() % 3, 1 + kaldi::Rand() % 100);
+					kaldi::CompactLatticeWeight weight(kaldi::LatticeWeight(kaldi::RandUniform() * 5, kaldi::RandUniform() * 10),
+							alignment);
+					clat->AddArc(s, kaldi::CompactLatticeArc(word, word, weight, t));
+				}
+			}
+		}
+	}
+
+	/** Paths should be the same as found by OpenFst n-shortest paths of converted lattice */
+	void TestSameAsShortestPath() {
+		for (int i = 0; i < 100; i++) {
+			kaldi::CompactLattice clat;
+			RandomLattice(3 + kaldi::Rand() % 12, &clat);
+			kaldi::int32 count = 1 + kaldi::Rand() % 10;
+
+			kaldi::Lattice lat, nbest_lat;
+			fst::ConvertLattice(clat, &lat);
+			fst::ShortestPath(lat, &nbest_lat, count);
+			std::vector<kaldi::Lattice> nbest_lats;
+			fst::ConvertNbestToVector(nbest_lat, &nbest_lats);
+
+			LatticeNbest nbest(&clat);
+			LatticeNbest::Path path;
+			for (size_t k = 0; k < nbest_lats.size(); k++) {
+				KALDI_ASSERT(nbest.Next(&path));
+
+				std::vector<kaldi::int32> alignment, words;
+				kaldi::LatticeWeight weight;
+				fst::GetLinearSymbolSequence(nbest_lats[k], &alignment, &words, &weight);
+				KALDI_ASSERT(kaldi::ApproxEqual(weight.Value1() + weight.Value2(),
+						path.weight.Value1() + path.weight.Value2()));
+			}
+			if (nbest_lats.size() < size_t(count)) {
+				KALDI_ASSERT(!nbest.Next(&path));
+			}
+		}
+	}
+
+	/** Words and alignment of the single path lattice */
+	void TestLinearLattice() {
+		kaldi::CompactLattice clat;
+		clat.AddState();
+		clat.AddState();
+		clat.AddState();
+		clat.SetStart(0);
+		clat.AddArc(0, kaldi::CompactLatticeArc(5, 5, kaldi::CompactLatticeWeight(kaldi::LatticeWeight(1, 2),
+				std::vector<kaldi::int32>(2, 7)), 1));
+		clat.AddArc(1, kaldi::CompactLatticeArc(0, 0, kaldi::CompactLatticeWeight(kaldi::LatticeWeight(0, 0),
+				std::vector<kaldi::int32>(1, 8)), 2));
+		clat.SetFinal(2, kaldi::CompactLatticeWeight(kaldi::LatticeWeight(3, 0), std::vector<kaldi::int32>()));
+
+		LatticeNbest nbest(&clat);
+		LatticeNbest::Path path;
+		KALDI_ASSERT(nbest.Next(&path));
+		KALDI_ASSERT(path.words.size() == 1 && path.words[0] == 5);
+		KALDI_ASSERT(path.alignment.size() == 3 && path.alignment[2] == 8);
+		KALDI_ASSERT(path.weight.Value1() == 4 && path.weight.Value2() == 2);
+		KALDI_ASSERT(path.weights.size() == 2);
+		KALDI_ASSERT(!nbest.Next(&path));
+	}
+
+	void TestEmptyLattice() {
+		kaldi::CompactLattice clat;
+		LatticeNbest nbest(&clat);
+		LatticeNbest::Path path;
+		KALDI_ASSERT(!nbest.Next(&path));
+	}
+
+} /* namespace apiai */
+
+int main(int argn, char *argv[]) {
+	using namespace apiai;
+
+	TestEmptyLattice();
+	TestLinearLattice();
+	TestSameAsShortestPath();
+	return 0;
+}
@@ -0,0 +1,141 @@
+// LoadController.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LoadController.h"
+#include <math.h>
+#include <stdio.h>
+
+namespace apiai {
+
+/** Time constant of real-time factor decay */
+const double RTF_DECAY_SECONDS = 2.0;
+/** Min time between level changes */
+const milliseconds_t LEVEL_HOLD_MS = 1000;
+
+LoadController::LoadController()
+	: enabled_(false), rtf_high_(0.9), rtf_low_(0.6), max_sessions_(0), levels_(3),
+	  beam_scale_(0.8), max_active_scale_(0.6),
+	  level_(0), active_sessions_(0), processing_seconds_(0), audio_seconds_(0),
+	  last_report_ms_(0), last_change_ms_(0)
+{
+	pthread_mutex_init(&mutex_, NULL);
+	level_opts_.resize(1);
+}
+
+LoadController::~LoadController() {
+	pthread_mutex_destroy(&mutex_);
+}
+
+void LoadController::RegisterOptions(kaldi::OptionsItf &po) {
+	po.Register("load-control", &enabled_,
+			"Narrow search beams of running sessions when decoding falls behind real time");
+	po.Register("load-rtf-high", &rtf_high_,
+			"Real-time factor of chunk processing above which search is degraded by one more level");
+	po.Register("load-rtf-low", &rtf_low_,
+			"Real-time factor of chunk processing below which search is restored by one level");
+	po.Register("load-max-sessions", &max_sessions_,
+			"Number of concurrently decoded requests above which search is degraded, 0 for no limit");
+	po.Register("load-levels", &levels_,
+			"Max degradation level");
+	po.Register("load-beam-scale", &beam_scale_,
+			"Factor applied to beam and lattice beam on every degradation level");
+	po.Register("load-max-active-scale", &max_active_scale_,
+			"Factor applied to max-active on every degradation level");
+}
+
+void LoadController::Initialize(const kaldi::LatticeFasterDecoderConfig &base_opts) {
+	kaldi::int32 levels = enabled_ ? std::max(0, levels_) : 0;
+	level_opts_.assign(levels + 1, base_opts);
+	for (kaldi::int32 level = 1; level <= levels; level++) {
+		kaldi::LatticeFasterDecoderConfig &opts = level_opts_[level];
+		const kaldi::LatticeFasterDecoderConfig &prev = level_opts_[level - 1];
+		opts.beam = prev.beam * beam_scale_;
+		opts.lattice_beam = prev.lattice_beam * beam_scale_;
+		opts.max_active = std::max(opts.min_active + 1, kaldi::int32(prev.max_active * max_active_scale_));
+	}
+	if (levels > 0) {
+		KALDI_LOG << "Load control enabled, at level " << levels << " beam is " << level_opts_[levels].beam
+				<< ", lattice beam is " << level_opts_[levels].lattice_beam
+				<< ", max active is " << level_opts_[levels].max_active;
+	}
+}
+
+void LoadController::SessionStarted() {
+	pthread_mutex_lock(&mutex_);
+	active_sessions_++;
+	pthread_mutex_unlock(&mutex_);
+}
+
+void LoadController::SessionFinished() {
+	pthread_mutex_lock(&mutex_);
+	active_sessions_--;
+	pthread_mutex_unlock(&mutex_);
+}
+
+kaldi::int32 LoadController::ChunkProcessed(double audio_seconds, double processing_seconds) {
+	// Load is tracked even with control disabled, to be reported in metrics
+	milliseconds_t now = getMilliseconds();
+
+	pthread_mutex_lock(&mutex_);
+	double decay = last_report_ms_ > 0 ? exp(-(now - last_report_ms_) / 1000.0 / RTF_DECAY_SECONDS) : 0;
+	processing_seconds_ = processing_seconds_ * decay + processing_seconds;
+	audio_seconds_ = audio_seconds_ * decay + audio_seconds;
+	last_report_ms_ = now;
+	UpdateLevel(now);
+	kaldi::int32 level = level_;
+	pthread_mutex_unlock(&mutex_);
+
+	return level;
+}
+
+void LoadController::UpdateLevel(milliseconds_t now) {
+	if (now - last_change_ms_ < LEVEL_HOLD_MS || audio_seconds_ <= 0) {
+		return;
+	}
+	double rtf = processing_seconds_ / audio_seconds_;
+	bool sessions_exceeded = max_sessions_ > 0 && active_sessions_ > max_sessions_;
+
+	kaldi::int32 level = level_;
+	if ((rtf > rtf_high_ || sessions_exceeded) && level_ + 1 < kaldi::int32(level_opts_.size())) {
+		level++;
+	} else if (rtf < rtf_low_ && !sessions_exceeded && level_ > 0) {
+		level--;
+	}
+	if (level != level_) {
+		KALDI_LOG << "Search degradation level changed to " << level << " (real-time factor " << rtf
+				<< ", active sessions " << active_sessions_ << ")";
+		level_ = level;
+		last_change_ms_ = now;
+	}
+}
+
+kaldi::int32 LoadController::Level() {
+	pthread_mutex_lock(&mutex_);
+	kaldi::int32 level = level_;
+	pthread_mutex_unlock(&mutex_);
+	return level;
+}
+
+void LoadController::AppendMetrics(std::string *json) {
+	pthread_mutex_lock(&mutex_);
+	double rtf = audio_seconds_ > 0 ? processing_seconds_ / audio_seconds_ : 0;
+	char metrics[128];
+	int length = snprintf(metrics, sizeof(metrics), "\"load_level\":%d,\"realtime_factor\":%.3f,\"active_sessions\":%d",
+			level_, rtf, active_sessions_);
+	pthread_mutex_unlock(&mutex_);
+	json->append(metrics, length);
+}
+
+} /* namespace apiai */
@@ -0,0 +1,88 @@
+// LoadController.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_LOADCONTROLLER_H_
+#define APIAI_DECODER_LOADCONTROLLER_H_
+
+#include "Timing.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "util/parse-options.h"
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Search degradation under overload, shared by all decoder clones of a process.
+ * Sessions report processing time of every audio chunk; when the decayed
+ * real-time factor of all of them or the number of active sessions exceeds
+ * its limit, degradation level is raised, narrowing beam, lattice beam
+ * and max-active for the next chunks of all running sessions. Level is
+ * lowered back once the load drops. Level is changed by one step at a time
+ * and not more often than once per hold interval, so that search settings
+ * don't oscillate.
+ */
+class LoadController {
+public:
+	LoadController();
+	virtual ~LoadController();
+
+	void RegisterOptions(kaldi::OptionsItf &po);
+	/** Prepare options of every level from the configured ones */
+	void Initialize(const kaldi::LatticeFasterDecoderConfig &base_opts);
+
+	void SessionStarted();
+	void SessionFinished();
+	/**
+	 * Account audio chunk processed by a session and return
+	 * degradation level to be used for the next chunks
+	 */
+	kaldi::int32 ChunkProcessed(double audio_seconds, double processing_seconds);
+
+	/** Current degradation level, 0 if search is not degraded */
+	kaldi::int32 Level();
+	/** Decoder options of the given level */
+	const kaldi::LatticeFasterDecoderConfig &Options(kaldi::int32 level) const { return level_opts_[level]; }
+
+	/** Append current state as comma separated JSON object members */
+	void AppendMetrics(std::string *json);
+private:
+	/** Move level by one step according to current load. Called with mutex locked */
+	void UpdateLevel(milliseconds_t now);
+
+	bool enabled_;
+	kaldi::BaseFloat rtf_high_;
+	kaldi::BaseFloat rtf_low_;
+	kaldi::int32 max_sessions_;
+	kaldi::int32 levels_;
+	kaldi::BaseFloat beam_scale_;
+	kaldi::BaseFloat max_active_scale_;
+
+	std::vector<kaldi::LatticeFasterDecoderConfig> level_opts_;
+
+	pthread_mutex_t mutex_;
+	kaldi::int32 level_;
+	kaldi::int32 active_sessions_;
+	/** Exponentially decayed sums of processing and audio time */
+	double processing_seconds_;
+	double audio_seconds_;
+	milliseconds_t last_report_ms_;
+	milliseconds_t last_change_ms_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_LOADCONTROLLER_H_ */
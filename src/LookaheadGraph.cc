@@ -0,0 +1,66 @@
+// LookaheadGraph.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LookaheadGraph.h"
+#include "Timing.h"
+#include "fst/compose.h"
+#include "fst/lookahead-filter.h"
+
+namespace fst {
+
+// Lookahead FST type is registered by OpenFst lookahead extension library,
+// which is not linked by Kaldi, so it is registered here
+const char olabel_lookahead_fst_type[] = "olabel_lookahead";
+static FstRegisterer<StdOLabelLookAheadFst> OLabelLookAheadFst_StdArc_registerer;
+
+} /* namespace fst */
+
+namespace apiai {
+
+LookaheadGraph::LookaheadGraph(const std::string &hcl_rxfilename, const std::string &g_rxfilename)
+	: hcl_(NULL), g_(NULL)
+{
+	milliseconds_t start = getMilliseconds();
+
+	fst::Fst<fst::StdArc> *hcl = fst::ReadFstKaldiGeneric(hcl_rxfilename);
+	hcl_ = dynamic_cast<fst::StdOLabelLookAheadFst*>(hcl);
+	if (hcl_ == NULL) {
+		std::string type = hcl->Type();
+		delete hcl;
+		KALDI_ERR << "HCL graph " << hcl_rxfilename << " is of type \"" << type << "\" instead of \""
+				<< fst::olabel_lookahead_fst_type << "\", it should be built by utils/mkgraph_lookahead.sh";
+	}
+
+	g_ = fst::ReadFstKaldi(g_rxfilename);
+	if (g_->Properties(fst::kILabelSorted, true) == 0) {
+		fst::ArcSort(g_, fst::ILabelCompare<fst::StdArc>());
+	}
+
+	KALDI_LOG << "Lookahead graph loaded in " << getMillisecondsSince(start) << " ms: HCL "
+			<< hcl_->NumStates() << " states, G " << g_->NumStates() << " states";
+}
+
+LookaheadGraph::~LookaheadGraph() {
+	delete g_;
+	delete hcl_;
+}
+
+fst::Fst<fst::StdArc> *LookaheadGraph::CreateFst(size_t cache_bytes) const {
+	// Default compose filter of lookahead matcher does label and weight pushing
+	fst::CacheOptions cache_opts(true, cache_bytes);
+	return new fst::StdComposeFst(*hcl_, *g_, cache_opts);
+}
+
+} /* namespace apiai */
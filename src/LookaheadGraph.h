@@ -0,0 +1,54 @@
+// LookaheadGraph.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_LOOKAHEADGRAPH_H_
+#define APIAI_DECODER_LOOKAHEADGRAPH_H_
+
+#include "fstext/kaldi-fst-io.h"
+#include "fst/matcher-fst.h"
+#include <string>
+
+namespace apiai {
+
+/**
+ * Decoding graph composed on the fly from HCL and G instead of static HCLG.
+ * HCL is an output label lookahead FST, so that composition filter looks
+ * ahead through HCL to the words reachable from its state and prunes
+ * dead G paths early and pushes G weights towards the start. Components
+ * are built by Kaldi utils/mkgraph_lookahead.sh (HCLr.fst and Gr.fst,
+ * G input labels relabeled to match HCL lookahead).
+ * Composed states are cached by every graph instance, the cache is
+ * garbage collected once it exceeds given size. Instances are not thread
+ * safe and share only the components, so each decoding session gets its own.
+ */
+class LookaheadGraph {
+public:
+	/** Read components. Throws on failure */
+	LookaheadGraph(const std::string &hcl_rxfilename, const std::string &g_rxfilename);
+	virtual ~LookaheadGraph();
+
+	/** Create lazily composed graph with its own cache limited by given number of bytes */
+	fst::Fst<fst::StdArc> *CreateFst(size_t cache_bytes) const;
+private:
+	LookaheadGraph(const LookaheadGraph&);
+	LookaheadGraph &operator=(const LookaheadGraph&);
+
+	fst::StdOLabelLookAheadFst *hcl_;
+	fst::StdVectorFst *g_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_LOOKAHEADGRAPH_H_ */
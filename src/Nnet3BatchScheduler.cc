@@ -0,0 +1,413 @@
+// Nnet3BatchScheduler.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Nnet3BatchScheduler.h"
+#include "nnet3/nnet-utils.h"
+#include "util/kaldi-io.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+#include <string.h>
+#include <errno.h>
+
+namespace apiai {
+
+Nnet3BatchScheduler::Nnet3BatchScheduler(const kaldi::nnet3::AmNnetSimple &am_nnet,
+		const kaldi::nnet3::NnetSimpleLoopedComputationOptions &opts,
+		kaldi::int32 max_batch_size, kaldi::int32 max_wait_ms, kaldi::int32 threads_number)
+	: nnet_(am_nnet.GetNnet()),
+	  compute_config_(opts.compute_config),
+	  compiler_(am_nnet.GetNnet(), opts.optimize_config),
+	  acoustic_scale_(opts.acoustic_scale),
+	  max_batch_size_(std::max(1, max_batch_size)),
+	  max_wait_ms_(std::max(0, max_wait_ms)),
+	  threads_number_(std::max(1, threads_number)),
+	  queued_tasks_(0), started_(false), stopping_(false)
+{
+	frame_subsampling_factor_ = opts.frame_subsampling_factor;
+	frames_per_chunk_ = kaldi::nnet3::GetChunkSize(nnet_, frame_subsampling_factor_, opts.frames_per_chunk);
+
+	kaldi::nnet3::ComputeSimpleNnetContext(nnet_, &frames_left_context_, &frames_right_context_);
+
+	input_dim_ = nnet_.InputDim("input");
+	ivector_dim_ = std::max<kaldi::int32>(0, nnet_.InputDim("ivector"));
+	output_dim_ = nnet_.OutputDim("output");
+
+	// Few sizes keep compilation short, while padding never takes more than half of a batch
+	for (kaldi::int32 size = 1; size < max_batch_size_; size *= 2) {
+		batch_sizes_.push_back(size);
+	}
+	batch_sizes_.push_back(max_batch_size_);
+	requests_.resize(batch_sizes_.size());
+	for (size_t i = 0; i < batch_sizes_.size(); i++) {
+		CreateComputationRequest(batch_sizes_[i], &(requests_[i]));
+	}
+
+	if (am_nnet.Priors().Dim() != 0) {
+		kaldi::Vector<kaldi::BaseFloat> log_priors(am_nnet.Priors());
+		log_priors.ApplyLog();
+		log_priors_.Resize(log_priors.Dim(), kaldi::kUndefined);
+		log_priors_.CopyFromVec(log_priors);
+	}
+
+	pthread_mutex_init(&compile_mutex_, NULL);
+	pthread_mutex_init(&mutex_, NULL);
+	pthread_cond_init(&task_cond_, NULL);
+
+	KALDI_LOG << "Nnet batch scheduler initialized (batch size: " << max_batch_size_
+			<< ", max wait: " << max_wait_ms_ << " ms, threads: " << threads_number_
+			<< ", chunk: " << frames_per_chunk_ << " frames, context: "
+			<< frames_left_context_ << "/" << frames_right_context_ << ")";
+}
+
+Nnet3BatchScheduler::~Nnet3BatchScheduler() {
+	pthread_mutex_lock(&mutex_);
+	stopping_ = true;
+	pthread_cond_broadcast(&task_cond_);
+	pthread_mutex_unlock(&mutex_);
+
+	// Batches being computed are finished by their threads
+	for (size_t i = 0; i < threads_.size(); i++) {
+		pthread_join(threads_[i], NULL);
+	}
+
+	// Chunks left are failed, so that nobody waits for them forever
+	for (size_t i = 0; i < queue_.size(); i++) {
+		Finish(queue_[i], true);
+	}
+
+	pthread_cond_destroy(&task_cond_);
+	pthread_mutex_destroy(&mutex_);
+	pthread_mutex_destroy(&compile_mutex_);
+}
+
+void *Nnet3BatchScheduler::RunComputationThread(void *scheduler) {
+	((Nnet3BatchScheduler*)scheduler)->ComputationRoutine();
+	return NULL;
+}
+
+void Nnet3BatchScheduler::Compute(std::vector<Task*> &tasks) {
+	if (tasks.empty()) {
+		return;
+	}
+
+	Request request;
+	request.tasks = tasks;
+	request.next = 0;
+	request.remaining = tasks.size();
+	request.enqueue_time = getMilliseconds();
+	request.failed = false;
+
+	pthread_mutex_lock(&mutex_);
+	if (stopping_) {
+		pthread_mutex_unlock(&mutex_);
+		throw std::runtime_error("Nnet batch scheduler is stopped");
+	}
+	if (!started_) {
+		// Started on demand, so that scheduler may be created before worker processes are forked
+		for (kaldi::int32 i = 0; i < threads_number_; i++) {
+			pthread_t thread;
+			int errnumber;
+			if ((errnumber = pthread_create(&thread, NULL, RunComputationThread, this)) != 0) {
+				KALDI_WARN << "Failed to start nnet batch computation thread: " << strerror(errnumber);
+				break;
+			}
+			threads_.push_back(thread);
+		}
+		if (threads_.empty()) {
+			pthread_mutex_unlock(&mutex_);
+			throw std::runtime_error("No nnet batch computation threads");
+		}
+		started_ = true;
+	}
+	queue_.push_back(&request);
+	queued_tasks_ += tasks.size();
+	pthread_cond_signal(&task_cond_);
+	pthread_mutex_unlock(&mutex_);
+
+	request.done.Wait();
+
+	if (request.failed) {
+		throw std::runtime_error("Nnet batch computation failed");
+	}
+}
+
+void Nnet3BatchScheduler::Finish(Request *request, bool failed) {
+	request->failed = failed;
+	// Caller returns at once, request must not be touched afterwards
+	request->done.Signal();
+}
+
+void Nnet3BatchScheduler::ComputationRoutine() {
+	std::vector<Task*> batch;
+	std::vector<Request*> batch_requests;
+
+	pthread_mutex_lock(&mutex_);
+	while (!stopping_) {
+		if (queue_.empty()) {
+			pthread_cond_wait(&task_cond_, &mutex_);
+			continue;
+		}
+
+		// Partial batch waits for more chunks, unless the oldest chunk waits too long
+		milliseconds_t deadline = queue_.front()->enqueue_time + max_wait_ms_;
+		if ((queued_tasks_ < max_batch_size_) && (getMilliseconds() < deadline)) {
+			struct timespec ts;
+			ts.tv_sec = deadline / 1000;
+			ts.tv_nsec = (deadline % 1000) * 1000000;
+			pthread_cond_timedwait(&task_cond_, &mutex_, &ts);
+			continue;
+		}
+
+		batch.clear();
+		batch_requests.clear();
+		while (!queue_.empty() && (kaldi::int32(batch.size()) < max_batch_size_)) {
+			Request *request = queue_.front();
+			batch.push_back(request->tasks[request->next]);
+			batch_requests.push_back(request);
+			if (++(request->next) == request->tasks.size()) {
+				queue_.pop_front();
+			}
+		}
+		queued_tasks_ -= batch.size();
+		if (!queue_.empty()) {
+			// Chunks left are taken by another thread
+			pthread_cond_signal(&task_cond_);
+		}
+		pthread_mutex_unlock(&mutex_);
+
+		bool failed = false;
+		try {
+			ComputeBatch(batch);
+		} catch (std::exception &e) {
+			KALDI_WARN << "Nnet batch computation failed: " << e.what();
+			failed = true;
+		}
+
+		pthread_mutex_lock(&mutex_);
+		for (size_t i = 0; i < batch_requests.size(); i++) {
+			Request *request = batch_requests[i];
+			request->failed = request->failed || failed;
+			if (--(request->remaining) == 0) {
+				Finish(request, request->failed);
+			}
+		}
+	}
+	pthread_mutex_unlock(&mutex_);
+}
+
+void Nnet3BatchScheduler::CreateComputationRequest(kaldi::int32 batch_size,
+		kaldi::nnet3::ComputationRequest *request) const {
+	using kaldi::nnet3::Index;
+	using kaldi::nnet3::IoSpecification;
+
+	request->inputs.clear();
+	request->outputs.clear();
+	request->need_model_derivative = false;
+	request->store_component_stats = false;
+
+	// Like in kaldi::nnet3::NnetBatchComputer rows of the same frame of all
+	// chunks are adjacent, so time offsets of layers are contiguous row ranges
+	request->inputs.push_back(IoSpecification());
+	IoSpecification &input = request->inputs.back();
+	input.name = "input";
+	for (kaldi::int32 t = -frames_left_context_; t < frames_per_chunk_ + frames_right_context_; t++) {
+		for (kaldi::int32 n = 0; n < batch_size; n++) {
+			input.indexes.push_back(Index(n, t, 0));
+		}
+	}
+
+	if (ivector_dim_ > 0) {
+		request->inputs.push_back(IoSpecification());
+		IoSpecification &ivector = request->inputs.back();
+		ivector.name = "ivector";
+		for (kaldi::int32 n = 0; n < batch_size; n++) {
+			ivector.indexes.push_back(Index(n, 0, 0));
+		}
+	}
+
+	request->outputs.push_back(IoSpecification());
+	IoSpecification &output = request->outputs.back();
+	output.name = "output";
+	for (kaldi::int32 t = 0; t < frames_per_chunk_; t += frame_subsampling_factor_) {
+		for (kaldi::int32 n = 0; n < batch_size; n++) {
+			output.indexes.push_back(Index(n, t, 0));
+		}
+	}
+}
+
+void Nnet3BatchScheduler::ComputeBatch(const std::vector<Task*> &batch) {
+	const kaldi::int32 num_tasks = batch.size();
+	const kaldi::int32 input_frames = frames_left_context_ + frames_per_chunk_ + frames_right_context_;
+	const kaldi::int32 output_frames = OutputFramesPerChunk();
+
+	size_t size_index = 0;
+	while (batch_sizes_[size_index] < num_tasks) {
+		size_index++;
+	}
+	const kaldi::int32 batch_size = batch_sizes_[size_index];
+
+	pthread_mutex_lock(&compile_mutex_);
+	std::shared_ptr<const kaldi::nnet3::NnetComputation> computation;
+	try {
+		computation = compiler_.Compile(requests_[size_index]);
+	} catch (...) {
+		pthread_mutex_unlock(&compile_mutex_);
+		throw;
+	}
+	pthread_mutex_unlock(&compile_mutex_);
+	kaldi::nnet3::NnetComputer computer(compute_config_, *computation, nnet_, NULL);
+
+	// Padding chunks are left zero
+	kaldi::Matrix<kaldi::BaseFloat> input(input_frames * batch_size, input_dim_);
+	for (kaldi::int32 n = 0; n < num_tasks; n++) {
+		KALDI_ASSERT(batch[n]->input.NumRows() == input_frames);
+		for (kaldi::int32 t = 0; t < input_frames; t++) {
+			input.Row(t * batch_size + n).CopyFromVec(batch[n]->input.Row(t));
+		}
+	}
+	kaldi::CuMatrix<kaldi::BaseFloat> cu_input;
+	cu_input.Swap(&input);
+	computer.AcceptInput("input", &cu_input);
+
+	if (ivector_dim_ > 0) {
+		kaldi::Matrix<kaldi::BaseFloat> ivectors(batch_size, ivector_dim_);
+		for (kaldi::int32 n = 0; n < num_tasks; n++) {
+			KALDI_ASSERT(batch[n]->ivector.Dim() == ivector_dim_);
+			ivectors.Row(n).CopyFromVec(batch[n]->ivector);
+		}
+		kaldi::CuMatrix<kaldi::BaseFloat> cu_ivectors;
+		cu_ivectors.Swap(&ivectors);
+		computer.AcceptInput("ivector", &cu_ivectors);
+	}
+
+	computer.Run();
+
+	kaldi::CuMatrix<kaldi::BaseFloat> cu_output;
+	computer.GetOutputDestructive("output", &cu_output);
+
+	if (log_priors_.Dim() != 0) {
+		cu_output.AddVecToRows(-1.0, log_priors_);
+	}
+	cu_output.Scale(acoustic_scale_);
+
+	kaldi::Matrix<kaldi::BaseFloat> output;
+	cu_output.Swap(&output);
+	for (kaldi::int32 n = 0; n < num_tasks; n++) {
+		batch[n]->output.Resize(output_frames, output_dim_, kaldi::kUndefined);
+		for (kaldi::int32 t = 0; t < output_frames; t++) {
+			batch[n]->output.Row(t).CopyFromVec(output.Row(t * batch_size + n));
+		}
+	}
+}
+
+kaldi::int64 Nnet3BatchScheduler::NnetFingerprint() const {
+	std::ostringstream topology;
+	std::vector<std::string> config_lines;
+	nnet_.GetConfigLines(true, &config_lines);
+	for (size_t i = 0; i < config_lines.size(); i++) {
+		topology << config_lines[i] << "\n";
+	}
+	for (kaldi::int32 c = 0; c < nnet_.NumComponents(); c++) {
+		const kaldi::nnet3::Component *component = nnet_.GetComponent(c);
+		topology << nnet_.GetComponentName(c) << " " << component->Type() << " "
+				<< component->InputDim() << " " << component->OutputDim() << "\n";
+	}
+	topology << "batch";
+	for (size_t i = 0; i < batch_sizes_.size(); i++) {
+		topology << " " << batch_sizes_[i];
+	}
+	topology << " chunk " << frames_per_chunk_ << " context "
+			<< frames_left_context_ << " " << frames_right_context_ << "\n";
+	// FNV-1a, stable between runs unlike std::hash
+	kaldi::uint64 hash = 14695981039346656037ULL;
+	const std::string &text = topology.str();
+	for (size_t i = 0; i < text.size(); i++) {
+		hash = (hash ^ (unsigned char)text[i]) * 1099511628211ULL;
+	}
+	return kaldi::int64(hash);
+}
+
+bool Nnet3BatchScheduler::ReadCache(const std::string &cache_filename) {
+	if (access(cache_filename.c_str(), R_OK) != 0) {
+		return false;
+	}
+	try {
+		bool binary;
+		kaldi::Input ki(cache_filename, &binary);
+		kaldi::int64 fingerprint;
+		kaldi::ExpectToken(ki.Stream(), binary, "<NnetFingerprint>");
+		kaldi::ReadBasicType(ki.Stream(), binary, &fingerprint);
+		if (fingerprint != NnetFingerprint()) {
+			KALDI_LOG << "Compilation cache " << cache_filename << " was written for another nnet, ignored";
+			return false;
+		}
+		compiler_.ReadCache(ki.Stream(), binary);
+		return true;
+	} catch (std::exception &e) {
+		KALDI_WARN << "Failed to read compilation cache " << cache_filename << ": " << e.what();
+		return false;
+	}
+}
+
+void Nnet3BatchScheduler::WriteCache(const std::string &cache_filename) {
+	// Written aside and renamed, so that concurrently starting servers never read a partial file.
+	// Every process writes its own file, the one renamed last wins
+	std::ostringstream temp_filename_stream;
+	temp_filename_stream << cache_filename << ".tmp." << getpid();
+	std::string temp_filename = temp_filename_stream.str();
+	try {
+		{
+			kaldi::Output ko(temp_filename, true);
+			kaldi::WriteToken(ko.Stream(), true, "<NnetFingerprint>");
+			kaldi::WriteBasicType(ko.Stream(), true, NnetFingerprint());
+			compiler_.WriteCache(ko.Stream(), true);
+		}
+		if (rename(temp_filename.c_str(), cache_filename.c_str()) != 0) {
+			KALDI_WARN << "Failed to rename compilation cache to " << cache_filename << ": " << strerror(errno);
+			unlink(temp_filename.c_str());
+		}
+	} catch (std::exception &e) {
+		KALDI_WARN << "Failed to write compilation cache " << cache_filename << ": " << e.what();
+		unlink(temp_filename.c_str());
+	}
+}
+
+void Nnet3BatchScheduler::Precompile(const std::string &cache_filename) {
+	milliseconds_t start = getMilliseconds();
+	bool cached = cache_filename.size() > 0 && ReadCache(cache_filename);
+
+	pthread_mutex_lock(&compile_mutex_);
+	try {
+		for (size_t i = 0; i < requests_.size(); i++) {
+			compiler_.Compile(requests_[i]);
+		}
+	} catch (...) {
+		pthread_mutex_unlock(&compile_mutex_);
+		throw;
+	}
+	pthread_mutex_unlock(&compile_mutex_);
+	KALDI_LOG << "Nnet computations for " << batch_sizes_.size() << " batch sizes up to " << max_batch_size_
+			<< " chunks ready in " << getMillisecondsSince(start) << " ms" << (cached ? " (read from cache)" : "");
+
+	if (cache_filename.size() > 0 && !cached) {
+		WriteCache(cache_filename);
+	}
+}
+
+} /* namespace apiai */
@@ -0,0 +1,151 @@
+// Nnet3BatchScheduler.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_NNET3BATCHSCHEDULER_H_
+#define APIAI_DECODER_NNET3BATCHSCHEDULER_H_
+
+#include "Timing.h"
+#include "WaitEvent.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/decodable-simple-looped.h"
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Shared acoustic model inference stage.
+ * Collects feature chunks from all active sessions and computes them as
+ * a single minibatch, so BLAS kernels work on large matrices instead of
+ * one small chunk per stream. Like kaldi::nnet3::NnetBatchComputer every
+ * chunk carries its own context, so chunks of any sessions may be computed
+ * together in any order: a minibatch holds just the chunks ready, padded to
+ * the nearest compiled batch size (powers of two up to the max one).
+ */
+class Nnet3BatchScheduler {
+public:
+	/** Single chunk of features to be computed */
+	struct Task {
+		/** Input features: FramesLeftContext() + FramesPerChunk() + FramesRightContext() rows */
+		kaldi::Matrix<kaldi::BaseFloat> input;
+		/** iVector of the chunk, empty if model has no iVector input */
+		kaldi::Vector<kaldi::BaseFloat> ivector;
+		/** Scaled log-likelihoods: OutputFramesPerChunk() rows */
+		kaldi::Matrix<kaldi::BaseFloat> output;
+	};
+
+	/**
+	 * Initialize scheduler. Computation threads are started by the first Compute()
+	 * call. Batch is computed as soon as max_batch_size chunks are ready or the
+	 * oldest ready chunk waits for max_wait_ms milliseconds, chunks coming while
+	 * all threads are busy are gathered into the next batch.
+	 */
+	Nnet3BatchScheduler(const kaldi::nnet3::AmNnetSimple &am_nnet,
+			const kaldi::nnet3::NnetSimpleLoopedComputationOptions &opts,
+			kaldi::int32 max_batch_size, kaldi::int32 max_wait_ms, kaldi::int32 threads_number);
+	virtual ~Nnet3BatchScheduler();
+
+	/**
+	 * Compute given chunks. Blocks until all of them are done, a waiting request
+	 * coroutine is suspended instead, so that other requests of its worker may add
+	 * their chunks to the batch. Throws std::runtime_error if computation failed
+	 * or the scheduler is being destroyed.
+	 */
+	void Compute(std::vector<Task*> &tasks);
+	/**
+	 * Compile computations of all batch sizes in advance. If cache file is given,
+	 * computations are read from it when it was written for the same nnet structure
+	 * and batch sizes, otherwise they are written there once compiled. Cache file
+	 * problems are not fatal.
+	 */
+	void Precompile(const std::string &cache_filename);
+
+	kaldi::int32 FramesLeftContext() const { return frames_left_context_; }
+	kaldi::int32 FramesRightContext() const { return frames_right_context_; }
+	/** Number of input frames produced outputs for per chunk */
+	kaldi::int32 FramesPerChunk() const { return frames_per_chunk_; }
+	kaldi::int32 OutputFramesPerChunk() const { return frames_per_chunk_ / frame_subsampling_factor_; }
+	kaldi::int32 FrameSubsamplingFactor() const { return frame_subsampling_factor_; }
+	kaldi::int32 InputDim() const { return input_dim_; }
+	kaldi::int32 IvectorDim() const { return ivector_dim_; }
+	kaldi::int32 OutputDim() const { return output_dim_; }
+private:
+	/** Chunks of a single Compute() call */
+	struct Request {
+		std::vector<Task*> tasks;
+		/** Index of the first task not taken into a batch yet */
+		size_t next;
+		/** Number of tasks not computed yet */
+		size_t remaining;
+		milliseconds_t enqueue_time;
+		bool failed;
+		WaitEvent done;
+	};
+
+	static void *RunComputationThread(void *scheduler);
+	void ComputationRoutine();
+	/** Create computation request for given number of chunks, n index varies fastest */
+	void CreateComputationRequest(kaldi::int32 batch_size, kaldi::nnet3::ComputationRequest *request) const;
+	/** Compute chunks padded to the nearest compiled batch size */
+	void ComputeBatch(const std::vector<Task*> &batch);
+	void Finish(Request *request, bool failed);
+	/** Hash of nnet topology, component types and batch layout, which compiled computations depend on */
+	kaldi::int64 NnetFingerprint() const;
+	bool ReadCache(const std::string &cache_filename);
+	void WriteCache(const std::string &cache_filename);
+
+	const kaldi::nnet3::Nnet &nnet_;
+	kaldi::nnet3::NnetComputeOptions compute_config_;
+	kaldi::nnet3::CachingOptimizingCompiler compiler_;
+	/** Guards compiler cache */
+	pthread_mutex_t compile_mutex_;
+	kaldi::CuVector<kaldi::BaseFloat> log_priors_;
+	kaldi::BaseFloat acoustic_scale_;
+
+	kaldi::int32 frames_left_context_;
+	kaldi::int32 frames_right_context_;
+	kaldi::int32 frames_per_chunk_;
+	kaldi::int32 frame_subsampling_factor_;
+	kaldi::int32 input_dim_;
+	kaldi::int32 ivector_dim_;
+	kaldi::int32 output_dim_;
+
+	kaldi::int32 max_batch_size_;
+	kaldi::int32 max_wait_ms_;
+	kaldi::int32 threads_number_;
+
+	/** Batch sizes computations are compiled for, ascending */
+	std::vector<kaldi::int32> batch_sizes_;
+	/** Computation request of every batch size */
+	std::vector<kaldi::nnet3::ComputationRequest> requests_;
+
+	pthread_mutex_t mutex_;
+	pthread_cond_t task_cond_;
+	/** Requests having tasks not taken into a batch */
+	std::deque<Request*> queue_;
+	/** Number of tasks not taken into a batch */
+	kaldi::int32 queued_tasks_;
+	std::vector<pthread_t> threads_;
+	bool started_;
+	bool stopping_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_NNET3BATCHSCHEDULER_H_ */
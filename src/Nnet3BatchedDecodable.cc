@@ -0,0 +1,130 @@
+// Nnet3BatchedDecodable.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Nnet3BatchedDecodable.h"
+#include <algorithm>
+
+namespace apiai {
+
+Nnet3BatchedDecodable::Nnet3BatchedDecodable(const kaldi::TransitionModel &trans_model,
+		Nnet3BatchScheduler &scheduler,
+		kaldi::OnlineFeatureInterface *input_features,
+		kaldi::OnlineFeatureInterface *ivector_features)
+	: trans_model_(trans_model), scheduler_(scheduler),
+	  input_features_(input_features), ivector_features_(ivector_features),
+	  first_frame_(0)
+{
+	KALDI_ASSERT(input_features_->Dim() == scheduler_.InputDim());
+	if (scheduler_.IvectorDim() > 0) {
+		KALDI_ASSERT(ivector_features_ != NULL && ivector_features_->Dim() == scheduler_.IvectorDim());
+	}
+}
+
+Nnet3BatchedDecodable::~Nnet3BatchedDecodable() {
+}
+
+void Nnet3BatchedDecodable::Reset(kaldi::OnlineFeatureInterface *input_features,
+		kaldi::OnlineFeatureInterface *ivector_features) {
+	input_features_ = input_features;
+	ivector_features_ = ivector_features;
+	first_frame_ = 0;
+	log_likes_.Resize(0, 0);
+}
+
+kaldi::int32 Nnet3BatchedDecodable::NumFramesReady() const {
+	// Follows kaldi::nnet3::DecodableNnetLoopedOnlineBase::NumFramesReady()
+	kaldi::int32 features_ready = input_features_->NumFramesReady();
+	if (features_ready == 0) {
+		return 0;
+	}
+	kaldi::int32 sf = scheduler_.FrameSubsamplingFactor();
+	if (input_features_->IsLastFrame(features_ready - 1)) {
+		// Last chunk is padded with the final frame
+		return (features_ready + sf - 1) / sf;
+	}
+	kaldi::int32 frames_ready = std::max(0, features_ready - scheduler_.FramesRightContext());
+	kaldi::int32 chunks_ready = frames_ready / scheduler_.FramesPerChunk();
+	return chunks_ready * scheduler_.OutputFramesPerChunk();
+}
+
+bool Nnet3BatchedDecodable::IsLastFrame(kaldi::int32 frame) const {
+	kaldi::int32 features_ready = input_features_->NumFramesReady();
+	if (features_ready == 0) {
+		return frame == -1 && input_features_->IsLastFrame(-1);
+	}
+	if (!input_features_->IsLastFrame(features_ready - 1)) {
+		return false;
+	}
+	kaldi::int32 sf = scheduler_.FrameSubsamplingFactor();
+	return frame == (features_ready + sf - 1) / sf - 1;
+}
+
+kaldi::BaseFloat Nnet3BatchedDecodable::LogLikelihood(kaldi::int32 frame, kaldi::int32 index) {
+	if (frame >= first_frame_ + log_likes_.NumRows()) {
+		ComputeReadyChunks(frame);
+	}
+	KALDI_ASSERT(frame >= first_frame_);
+	return log_likes_(frame - first_frame_, trans_model_.TransitionIdToPdf(index));
+}
+
+void Nnet3BatchedDecodable::ComputeReadyChunks(kaldi::int32 frame) {
+	const kaldi::int32 frames_ready = NumFramesReady();
+	KALDI_ASSERT(frame < frames_ready);
+
+	const kaldi::int32 sf = scheduler_.FrameSubsamplingFactor();
+	const kaldi::int32 output_frames = scheduler_.OutputFramesPerChunk();
+	const kaldi::int32 input_frames = scheduler_.FramesLeftContext() + scheduler_.FramesPerChunk()
+			+ scheduler_.FramesRightContext();
+	const kaldi::int32 features_ready = input_features_->NumFramesReady();
+
+	const kaldi::int32 next_frame = first_frame_ + log_likes_.NumRows();
+	const kaldi::int32 num_chunks = (frames_ready - next_frame + output_frames - 1) / output_frames;
+
+	tasks_.resize(num_chunks);
+	std::vector<Nnet3BatchScheduler::Task*> tasks(num_chunks);
+
+	for (kaldi::int32 c = 0; c < num_chunks; c++) {
+		Nnet3BatchScheduler::Task &task = tasks_[c];
+		kaldi::int32 chunk_start = (next_frame + c * output_frames) * sf;
+
+		// Frames beyond utterance boundaries are replaced with the edge ones
+		task.input.Resize(input_frames, scheduler_.InputDim(), kaldi::kUndefined);
+		for (kaldi::int32 i = 0; i < input_frames; i++) {
+			kaldi::int32 t = chunk_start - scheduler_.FramesLeftContext() + i;
+			t = std::max(0, std::min(features_ready - 1, t));
+			kaldi::SubVector<kaldi::BaseFloat> row(task.input, i);
+			input_features_->GetFrame(t, &row);
+		}
+
+		if (scheduler_.IvectorDim() > 0) {
+			kaldi::int32 ivector_frame = std::min(chunk_start + scheduler_.FramesPerChunk() - 1,
+					ivector_features_->NumFramesReady() - 1);
+			task.ivector.Resize(scheduler_.IvectorDim(), kaldi::kUndefined);
+			ivector_features_->GetFrame(ivector_frame, &(task.ivector));
+		}
+
+		tasks[c] = &task;
+	}
+
+	scheduler_.Compute(tasks);
+
+	log_likes_.Resize(num_chunks * output_frames, scheduler_.OutputDim(), kaldi::kUndefined);
+	for (kaldi::int32 c = 0; c < num_chunks; c++) {
+		log_likes_.RowRange(c * output_frames, output_frames).CopyFromMat(tasks_[c].output);
+	}
+	first_frame_ = next_frame;
+}
+
+} /* namespace apiai */
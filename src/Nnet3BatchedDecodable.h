@@ -0,0 +1,66 @@
+// Nnet3BatchedDecodable.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_NNET3BATCHEDDECODABLE_H_
+#define APIAI_DECODER_NNET3BATCHEDDECODABLE_H_
+
+#include "Nnet3BatchScheduler.h"
+#include "itf/decodable-itf.h"
+#include "itf/online-feature-itf.h"
+#include "hmm/transition-model.h"
+
+namespace apiai {
+
+/**
+ * Online decodable object which computes log-likelihoods
+ * via shared batch scheduler instead of own nnet computer.
+ * All chunks ready at the moment are submitted at once.
+ */
+class Nnet3BatchedDecodable : public kaldi::DecodableInterface {
+public:
+	Nnet3BatchedDecodable(const kaldi::TransitionModel &trans_model,
+			Nnet3BatchScheduler &scheduler,
+			kaldi::OnlineFeatureInterface *input_features,
+			kaldi::OnlineFeatureInterface *ivector_features);
+	virtual ~Nnet3BatchedDecodable();
+
+	virtual kaldi::BaseFloat LogLikelihood(kaldi::int32 frame, kaldi::int32 index);
+	virtual bool IsLastFrame(kaldi::int32 frame) const;
+	virtual kaldi::int32 NumFramesReady() const;
+	virtual kaldi::int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+	kaldi::int32 FrameSubsamplingFactor() const { return scheduler_.FrameSubsamplingFactor(); }
+
+	/** Bind decodable to new features keeping allocated chunk buffers */
+	void Reset(kaldi::OnlineFeatureInterface *input_features,
+			kaldi::OnlineFeatureInterface *ivector_features);
+private:
+	void ComputeReadyChunks(kaldi::int32 frame);
+
+	const kaldi::TransitionModel &trans_model_;
+	Nnet3BatchScheduler &scheduler_;
+	kaldi::OnlineFeatureInterface *input_features_;
+	kaldi::OnlineFeatureInterface *ivector_features_;
+
+	std::vector<Nnet3BatchScheduler::Task> tasks_;
+	/** Output frame index of first row of log_likes_ */
+	kaldi::int32 first_frame_;
+	/** Log-likelihoods of last computed chunks */
+	kaldi::Matrix<kaldi::BaseFloat> log_likes_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_NNET3BATCHEDDECODABLE_H_ */
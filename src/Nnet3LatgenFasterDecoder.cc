@@ -14,29 +14,62 @@
 // limitations under the License.
 
 #include "Nnet3LatgenFasterDecoder.h"
+#include "Nnet3BatchedDecodable.h"
+#include "QuantizedAffineComponent.h"
+#include "TimedDecodable.h"
+#include "nnet3/nnet-utils.h"
+#include "Timing.h"
+#include <unistd.h>
+#include <stdexcept>
 
 namespace apiai {
 
+/** Resolve relative path of a file of selected models against their directory */
+static std::string ModelPath(const std::string &model_dir, const std::string &path) {
+	// Absolute paths, standard input and pipes are kept as they are
+	if (path == "" || path[0] == '/' || path == "-" || path[path.size() - 1] == '|') {
+		return path;
+	}
+	return model_dir + "/" + path;
+}
+
 Nnet3LatgenFasterDecoder::Nnet3LatgenFasterDecoder() {
 	online_ = true;
-	decode_fst_ = NULL;
-	trans_model_ = NULL;
-	nnet_ = NULL;
-    decodable_info_ = NULL;    
-	feature_info_ = NULL;
 	nnet3_rxfilename_ = "final.mdl";
+	nnet_batch_size_ = 1;
+	nnet_batch_wait_ms_ = 5;
+	nnet_batch_threads_ = 1;
+	session_pool_size_ = 64;
+	nnet_int8_ = false;
+	nnet_int8_min_dim_ = 128;
+	models_memory_mb_ = 0;
+	adaptation_cache_size_ = 0;
+	adaptation_cache_ttl_ = 600;
+	load_controller_.reset(new LoadController());
+	applied_level_ = 0;
+
+	session_ = NULL;
+	feature_pipeline_ = NULL;
+	decodable_ = NULL;
+	timed_decodable_ = NULL;
+	decoder_ = NULL;
+	best_path_decoder_ = NULL;
 }
 
 Nnet3LatgenFasterDecoder::~Nnet3LatgenFasterDecoder() {
-	delete decode_fst_;
-	delete trans_model_;
-	delete nnet_;
-    delete decodable_info_;   
-	delete feature_info_;
+	CleanUp();
 }
 
 Nnet3LatgenFasterDecoder *Nnet3LatgenFasterDecoder::Clone() const {
-	return new Nnet3LatgenFasterDecoder(*this);
+	Nnet3LatgenFasterDecoder *decoder = new Nnet3LatgenFasterDecoder(*this);
+	decoder->bundle_.reset();
+	decoder->session_ = NULL;
+	decoder->feature_pipeline_ = NULL;
+	decoder->decodable_ = NULL;
+	decoder->timed_decodable_ = NULL;
+	decoder->decoder_ = NULL;
+	decoder->best_path_decoder_ = NULL;
+	return decoder;
 }
 
 void Nnet3LatgenFasterDecoder::RegisterOptions(kaldi::OptionsItf &po) {
@@ -53,11 +86,47 @@ void Nnet3LatgenFasterDecoder::RegisterOptions(kaldi::OptionsItf &po) {
                 "--use-most-recent-ivector=true and --greedy-ivector-extractor=true "
                 "in the file given to --ivector-extraction-config, and "
                 "--chunk-length=-1.");
-
+    po.Register("nnet-batch-size", &nnet_batch_size_,
+                "Max number of running sessions whose nnet chunks are computed "
+                "as a single batch. Values less than 2 disable batching.");
+    po.Register("nnet-batch-wait-ms", &nnet_batch_wait_ms_,
+                "Max time in milliseconds a chunk waits for chunks of other sessions of the batch "
+                "when a computation thread is idle. Chunks coming while all threads are busy "
+                "are gathered into the next batch anyway.");
+    po.Register("nnet-batch-threads", &nnet_batch_threads_,
+                "Number of threads computing nnet batches.");
+    po.Register("session-pool-size", &session_pool_size_,
+                "Max number of idle decoding sessions kept to be reused by next requests.");
+    po.Register("nnet-compile-cache", &nnet_compile_cache_,
+                "File to keep compiled nnet computations of all batch sizes of batched mode between starts. "
+                "If given, computation is compiled (or read from the file) "
+                "on load instead of by first request.");
+    po.Register("models-dir", &models_dir_,
+                "Directory of models selected by \"model\" request parameter. Every subdirectory "
+                "holds final.mdl, HCLG.fst, words.txt and optionally conf/online.conf with "
+                "feature options, whose relative paths are resolved against the subdirectory; "
+                "models are loaded on first request.");
+    po.Register("models-memory-mb", &models_memory_mb_,
+                "Memory budget of models loaded from --models-dir, estimated by file sizes. "
+                "Least recently used models are dropped to fit it. Non-positive for no limit.");
+    po.Register("adaptation-cache-size", &adaptation_cache_size_,
+                "Max number of dialog sessions (\"session\" request parameter) whose iVector "
+                "adaptation state is kept for their next requests. Non-positive to disable.");
+    po.Register("adaptation-cache-ttl", &adaptation_cache_ttl_,
+                "Time in seconds the adaptation state of a session is kept since its last request. "
+                "Non-positive for no limit.");
+    po.Register("nnet-int8", &nnet_int8_,
+                "Quantize weights of affine layers to 8 bits on load and compute "
+                "them with int8 kernels. CPU only, may slightly change results.");
+    po.Register("nnet-int8-min-dim", &nnet_int8_min_dim_,
+                "Layers with smaller input dimension are kept in floating point.");
+
+    fst_loader_.RegisterOptions(po);
     feature_config_.Register(&po);
     decoder_opts_.Register(&po);
     decodable_opts_.Register(&po);
     endpoint_config_.Register(&po);
+    load_controller_->RegisterOptions(po);
 }
 
 bool Nnet3LatgenFasterDecoder::Initialize(kaldi::OptionsItf &po) {
@@ -65,7 +134,7 @@ bool Nnet3LatgenFasterDecoder::Initialize(kaldi::OptionsItf &po) {
 		return false;
 	}
 
-	if (fst_rxfilename_ == "") {
+	if (fst_rxfilename_ == "" && !fst_loader_.Lookahead()) {
 		return false;
 	}
 
@@ -73,97 +142,420 @@ bool Nnet3LatgenFasterDecoder::Initialize(kaldi::OptionsItf &po) {
 		return false;
 	}
 
-    feature_info_ = new kaldi::OnlineNnet2FeaturePipelineInfo(feature_config_);
-
     if (!online_) {
-      feature_info_->ivector_extractor_info.use_most_recent_ivector = true;
-      feature_info_->ivector_extractor_info.greedy_ivector_extractor = true;
       chunk_length_secs_ = -1.0;
     }
 
-    trans_model_ = new kaldi::TransitionModel();
-    nnet_ = new kaldi::nnet3::AmNnetSimple();      
+    acoustic_scale_ = decodable_opts_.acoustic_scale;                          
+    load_controller_->Initialize(decoder_opts_);
+
+    models_.reset(new Nnet3ModelSlot());
+    models_->Set(std::shared_ptr<const Nnet3ModelBundle>(LoadModels("")));
+
+    if (models_dir_ != "") {
+      registry_.reset(new Nnet3ModelRegistry(models_dir_,
+                            models_memory_mb_ > 0 ? size_t(models_memory_mb_) << 20 : 0));
+    }
+
+    return true;
+}
+
+bool Nnet3LatgenFasterDecoder::Reload() {
+	if (!models_) {
+		return false;
+	}
+
+	pthread_mutex_lock(&(models_->reload_mutex));
+	bool result = true;
+	try {
+		milliseconds_t start = getMilliseconds();
+		std::shared_ptr<const Nnet3ModelBundle> bundle(LoadModels(""));
+		models_->Set(bundle);
+		if (registry_) {
+			// Selected models are loaded again on next use
+			registry_->Clear();
+		}
+		KALDI_LOG << "Models reloaded in " << getMillisecondsSince(start) << " ms";
+	} catch (std::exception &e) {
+		KALDI_WARN << "Failed to reload models, previous ones are kept: " << e.what();
+		result = false;
+	}
+	pthread_mutex_unlock(&(models_->reload_mutex));
+	return result;
+}
+
+Nnet3ModelBundle *Nnet3LatgenFasterDecoder::LoadModels(const std::string &model_dir) {
+    std::auto_ptr<Nnet3ModelBundle> bundle(new Nnet3ModelBundle());
+
+    std::string nnet3_rxfilename = nnet3_rxfilename_;
+    std::string fst_rxfilename = fst_rxfilename_;
+    std::string word_syms_rxfilename = word_syms_rxfilename_;
+    kaldi::OnlineNnet2FeaturePipelineConfig feature_config = feature_config_;
+    bool lookahead = fst_loader_.Lookahead();
+    if (model_dir != "") {
+      nnet3_rxfilename = model_dir + "/final.mdl";
+      fst_rxfilename = model_dir + "/HCLG.fst";
+      word_syms_rxfilename = model_dir + "/words.txt";
+      lookahead = false;
+      std::string online_config = model_dir + "/conf/online.conf";
+      if (access(online_config.c_str(), R_OK) == 0) {
+        kaldi::ParseOptions po("");
+        feature_config = kaldi::OnlineNnet2FeaturePipelineConfig();
+        feature_config.Register(&po);
+        po.ReadConfigFile(online_config);
+        // Configs are usually copied along with the models, so their paths are relative to model_dir
+        feature_config.mfcc_config = ModelPath(model_dir, feature_config.mfcc_config);
+        feature_config.plp_config = ModelPath(model_dir, feature_config.plp_config);
+        feature_config.fbank_config = ModelPath(model_dir, feature_config.fbank_config);
+        feature_config.online_pitch_config = ModelPath(model_dir, feature_config.online_pitch_config);
+        feature_config.ivector_extraction_config = ModelPath(model_dir, feature_config.ivector_extraction_config);
+      }
+    }
+
+    // iVector extractor files are named by its own config, which is read here
+    // instead of by the pipeline info, so that they are resolved the same way
+    std::string ivector_extraction_config = feature_config.ivector_extraction_config;
+    if (model_dir != "") {
+      feature_config.ivector_extraction_config = "";
+    }
+    bundle->feature_info = new kaldi::OnlineNnet2FeaturePipelineInfo(feature_config);
+    if (model_dir != "" && ivector_extraction_config != "") {
+      kaldi::OnlineIvectorExtractionConfig ivector_opts;
+      kaldi::ReadConfigFromFile(ivector_extraction_config, &ivector_opts);
+      ivector_opts.lda_mat_rxfilename = ModelPath(model_dir, ivector_opts.lda_mat_rxfilename);
+      ivector_opts.global_cmvn_stats_rxfilename = ModelPath(model_dir, ivector_opts.global_cmvn_stats_rxfilename);
+      ivector_opts.cmvn_config_rxfilename = ModelPath(model_dir, ivector_opts.cmvn_config_rxfilename);
+      ivector_opts.splice_config_rxfilename = ModelPath(model_dir, ivector_opts.splice_config_rxfilename);
+      ivector_opts.diag_ubm_rxfilename = ModelPath(model_dir, ivector_opts.diag_ubm_rxfilename);
+      ivector_opts.ivector_extractor_rxfilename = ModelPath(model_dir, ivector_opts.ivector_extractor_rxfilename);
+      bundle->feature_info->use_ivectors = true;
+      bundle->feature_info->ivector_extractor_info.Init(ivector_opts);
+    }
+
+    if (!online_) {
+      bundle->feature_info->ivector_extractor_info.use_most_recent_ivector = true;
+      bundle->feature_info->ivector_extractor_info.greedy_ivector_extractor = true;
+    }
+
+    bundle->trans_model = new kaldi::TransitionModel();
+    bundle->nnet = new kaldi::nnet3::AmNnetSimple();      
     {
       bool binary;
-      kaldi::Input ki(nnet3_rxfilename_, &binary);
-      trans_model_->Read(ki.Stream(), binary);
-      nnet_->Read(ki.Stream(), binary);
+      kaldi::Input ki(nnet3_rxfilename, &binary);
+      bundle->trans_model->Read(ki.Stream(), binary);
+      bundle->nnet->Read(ki.Stream(), binary);
+    }
+
+    if (nnet_int8_) {
+      // Must be done before computations are compiled for the nnet
+      QuantizeNnet(nnet_int8_min_dim_, &(bundle->nnet->GetNnet()));
     }
 
-    // this object contains precomputed stuff that is used by all decodable
-    // objects.  It takes a pointer to nnet_ because if it has iVectors it has
-    // to modify the nnet to accept iVectors at intervals.
-    decodable_info_ = new kaldi::nnet3::DecodableNnetSimpleLoopedInfo(     
-                            decodable_opts_, nnet_);
+    if (nnet_batch_size_ > 1) {
+      // Batched computation is not looped: every chunk is computed with its
+      // own context, so the nnet is used as it is, with iVectors given per chunk.
+      kaldi::nnet3::SetBatchnormTestMode(true, &(bundle->nnet->GetNnet()));
+      kaldi::nnet3::SetDropoutTestMode(true, &(bundle->nnet->GetNnet()));
+      bundle->batch_scheduler = new Nnet3BatchScheduler(*(bundle->nnet), decodable_opts_,
+                            nnet_batch_size_, nnet_batch_wait_ms_, nnet_batch_threads_);
+      if (nnet_compile_cache_ != "") {
+        // Computations depend on the nnet, so selected models keep their own files
+        bundle->batch_scheduler->Precompile(model_dir == "" ? nnet_compile_cache_ :
+                            nnet_compile_cache_ + "." + model_dir.substr(model_dir.rfind('/') + 1));
+      }
+    } else {
+      // this object contains precomputed stuff that is used by all decodable
+      // objects.  It takes a pointer to nnet because if it has iVectors it has
+      // to modify the nnet to accept iVectors at intervals.
+      bundle->decodable_info = new kaldi::nnet3::DecodableNnetSimpleLoopedInfo(     
+                            decodable_opts_, bundle->nnet);
+    }
 
-    decode_fst_ = fst::ReadFstKaldiGeneric(fst_rxfilename_);
+    if (lookahead) {
+      bundle->lookahead_graph = fst_loader_.ReadLookahead();
+    } else {
+      bundle->decode_fst = fst_loader_.Read(fst_rxfilename);
+    }
 
-    fst::SymbolTable *word_syms = NULL;
-    if (word_syms_rxfilename_ != "")
-      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_rxfilename_)))
-        KALDI_ERR << "Could not read symbol table from file "
-                  << word_syms_rxfilename_;
+    bundle->adaptation_state = new kaldi::OnlineIvectorExtractorAdaptationState(
+                            bundle->feature_info->ivector_extractor_info);
+    if (adaptation_cache_size_ > 0 && bundle->feature_info->use_ivectors) {
+      bundle->adaptation_cache = new AdaptationCache(bundle->feature_info->ivector_extractor_info,
+                            adaptation_cache_size_, adaptation_cache_ttl_);
+    }
+    bundle->session_pool = new Nnet3SessionPool(session_pool_size_, fst_loader_.MaxPooledCaches());
 
-    acoustic_scale_ = decodable_opts_.acoustic_scale;                          
+    if (!(bundle->word_syms = fst::SymbolTable::ReadText(word_syms_rxfilename)))
+      KALDI_ERR << "Could not read symbol table from file "
+                << word_syms_rxfilename;
 
-    return true;
+    bundle->word_strings.resize(bundle->word_syms->AvailableKey());
+    for (size_t i = 0; i < bundle->word_strings.size(); i++) {
+      bundle->word_strings[i] = bundle->word_syms->Find(i);
+    }
+
+    return bundle.release();
+}
+
+void Nnet3LatgenFasterDecoder::AppendMetrics(std::string *json) {
+	load_controller_->AppendMetrics(json);
+	std::shared_ptr<const Nnet3ModelBundle> bundle;
+	if (models_) {
+		bundle = models_->Get();
+	}
+	if (bundle && bundle->adaptation_cache != NULL) {
+		json->append(",");
+		bundle->adaptation_cache->AppendMetrics(json);
+	}
+	if (registry_) {
+		json->append(",");
+		registry_->AppendMetrics(json);
+	}
 }
 
 void Nnet3LatgenFasterDecoder::InputStarted()
 {
-	adaptation_state_ = new kaldi::OnlineIvectorExtractorAdaptationState(feature_info_->ivector_extractor_info);
+	if (model_name_ == "") {
+		bundle_ = models_->Get();
+	} else if (!registry_) {
+		throw std::runtime_error("Models selection is disabled");
+	} else if (!(bundle_ = registry_->Get(model_name_, *this))) {
+		throw std::runtime_error("Models \"" + model_name_ + "\" are not available");
+	}
+	word_strings_ = &(bundle_->word_strings);
+
+	feature_pipeline_ = new kaldi::OnlineNnet2FeaturePipeline (*(bundle_->feature_info));
+	if (bundle_->adaptation_cache == NULL || session_key_ == ""
+			|| !bundle_->adaptation_cache->Restore(session_key_, feature_pipeline_)) {
+		feature_pipeline_->SetAdaptationState(*(bundle_->adaptation_state));
+	}
+
+	session_ = bundle_->session_pool->Acquire();
+	if (session_ == NULL) {
+		session_ = new Nnet3Session();
+	}
+	// Counted as soon as held, CleanUp() finishes every session it releases
+	load_controller_->SessionStarted();
+	if (session_->graph == NULL && bundle_->lookahead_graph != NULL) {
+		session_->graph = bundle_->lookahead_graph->CreateFst(fst_loader_.CacheBytes());
+	}
+	const fst::Fst<fst::StdArc> *graph = session_->graph != NULL ? session_->graph : bundle_->decode_fst;
+	if (best_path_only_ && session_->best_path_decoder == NULL) {
+		session_->best_path_decoder = new BestPathDecoder(*graph, decoder_opts_);
+	} else if (!best_path_only_ && session_->decoder == NULL) {
+		session_->decoder = new kaldi::LatticeFasterOnlineDecoder(*graph, decoder_opts_);
+	}
 
-	feature_pipeline_ = new kaldi::OnlineNnet2FeaturePipeline (*feature_info_);
-	feature_pipeline_->SetAdaptationState(*adaptation_state_);
+	if (bundle_->batch_scheduler != NULL) {
+		if (session_->batched_decodable == NULL) {
+			session_->batched_decodable = new Nnet3BatchedDecodable(*(bundle_->trans_model),
+										*(bundle_->batch_scheduler),
+										feature_pipeline_->InputFeature(),
+										feature_pipeline_->IvectorFeature());
+		} else {
+			session_->batched_decodable->Reset(feature_pipeline_->InputFeature(),
+										feature_pipeline_->IvectorFeature());
+		}
+		decodable_ = session_->batched_decodable;
+	} else {
+		decodable_ = new kaldi::nnet3::DecodableAmNnetLoopedOnline(*(bundle_->trans_model),
+										*(bundle_->decodable_info),
+										feature_pipeline_->InputFeature(),
+										feature_pipeline_->IvectorFeature());
+	}
+
+	if (trace_ != NULL) {
+		timed_decodable_ = new TimedDecodable(decodable_, trace_);
+	}
 
-	decoder_ = new kaldi::SingleUtteranceNnet3Decoder(decoder_opts_,
-										*trans_model_,
-										*decodable_info_,
-										*decode_fst_,
-										feature_pipeline_);
+	// Pooled decoder may keep options of another degradation level
+	applied_level_ = load_controller_->Level();
+	load_level_ = applied_level_;
+	if (best_path_only_) {
+		best_path_decoder_ = session_->best_path_decoder;
+		best_path_decoder_->SetOptions(load_controller_->Options(applied_level_));
+		best_path_decoder_->InitDecoding();
+	} else {
+		decoder_ = session_->decoder;
+		decoder_->SetOptions(load_controller_->Options(applied_level_));
+		decoder_->InitDecoding();
+	}
+	best_path_.Reset();
 }
 
 
 void Nnet3LatgenFasterDecoder::CleanUp()
 {
-	delete decoder_;
-	delete adaptation_state_;
+	delete timed_decodable_;
+	if (session_ == NULL || decodable_ != session_->batched_decodable) {
+		delete decodable_;
+	}
+	if (session_ != NULL) {
+		bundle_->session_pool->Release(session_);
+		load_controller_->SessionFinished();
+	}
 	delete feature_pipeline_;
 
+	session_ = NULL;
 	decoder_ = NULL;
-	adaptation_state_ = NULL;
+	best_path_decoder_ = NULL;
+	decodable_ = NULL;
+	timed_decodable_ = NULL;
 	feature_pipeline_ = NULL;
+
+	best_path_.Reset();
+
+	// Old models are released here once reloaded and not used by any other request
+	word_strings_ = NULL;
+	bundle_.reset();
+}
+
+kaldi::BaseFloat Nnet3LatgenFasterDecoder::EndpointSilenceSeconds() const
+{
+	const kaldi::OnlineEndpointRule *rules[] = { &endpoint_config_.rule1, &endpoint_config_.rule2,
+			&endpoint_config_.rule3, &endpoint_config_.rule4, &endpoint_config_.rule5 };
+	kaldi::BaseFloat silence = 0;
+	for (size_t i = 0; i < sizeof(rules) / sizeof(rules[0]); i++) {
+		silence = std::max(silence, rules[i]->min_trailing_silence);
+	}
+	return silence;
 }
 
 bool Nnet3LatgenFasterDecoder::AcceptWaveform(kaldi::BaseFloat sampling_rate,
 		const kaldi::VectorBase<kaldi::BaseFloat> &waveform,
 		const bool do_endpointing)
 {
-	feature_pipeline_->AcceptWaveform(sampling_rate, waveform);
+	nanoseconds_t start = getMonotonicNanoseconds();
+	{
+		TraceSpan span(trace_, RequestTrace::STAGE_FEATURES);
+		feature_pipeline_->AcceptWaveform(sampling_rate, waveform);
+	}
 
-	if (do_endpointing && decoder_->EndpointDetected(endpoint_config_)) {
-		return false;
+	if (do_endpointing) {
+		TraceSpan span(trace_, RequestTrace::STAGE_ENDPOINT);
+		kaldi::BaseFloat frame_shift = feature_pipeline_->FrameShiftInSeconds() * decodable_opts_.frame_subsampling_factor;
+		if (best_path_decoder_ != NULL
+				? best_path_decoder_->EndpointDetected(endpoint_config_, *(bundle_->trans_model), frame_shift)
+				: kaldi::EndpointDetected(endpoint_config_, *(bundle_->trans_model), frame_shift, *decoder_)) {
+			return false;
+		}
 	}
 
-	decoder_->AdvanceDecoding();
+	AdvanceDecoding();
+
+	kaldi::int32 level = load_controller_->ChunkProcessed(waveform.Dim() / sampling_rate,
+			(getMonotonicNanoseconds() - start) / 1e9);
+	if (level != applied_level_) {
+		if (best_path_decoder_ != NULL) {
+			best_path_decoder_->SetOptions(load_controller_->Options(level));
+		} else {
+			decoder_->SetOptions(load_controller_->Options(level));
+		}
+		applied_level_ = level;
+		load_level_ = std::max(load_level_, level);
+	}
 
 	return true;
 }
 
 void Nnet3LatgenFasterDecoder::InputFinished()
 {
-	feature_pipeline_->InputFinished();
-	decoder_->AdvanceDecoding();
-	decoder_->FinalizeDecoding();
+	{
+		TraceSpan span(trace_, RequestTrace::STAGE_FEATURES);
+		feature_pipeline_->InputFinished();
+	}
+	AdvanceDecoding();
+
+	// Best path only search keeps no links to prune, its path is final as is
+	if (decoder_ != NULL) {
+		TraceSpan span(trace_, RequestTrace::STAGE_SEARCH);
+		decoder_->FinalizeDecoding();
+	}
+
+	// All frames are decoded, so iVector statistics cover the whole request
+	if (bundle_->adaptation_cache != NULL && session_key_ != "") {
+		bundle_->adaptation_cache->Store(session_key_, *feature_pipeline_);
+	}
+}
+
+void Nnet3LatgenFasterDecoder::AdvanceDecoding()
+{
+	if (timed_decodable_ == NULL) {
+		if (best_path_decoder_ != NULL) {
+			best_path_decoder_->AdvanceDecoding(decodable_);
+		} else {
+			decoder_->AdvanceDecoding(decodable_);
+		}
+		return;
+	}
+
+	// Nnet is computed lazily by the search, its time is excluded from search total
+	nanoseconds_t nnet_elapsed = timed_decodable_->Elapsed();
+	nanoseconds_t start = getMonotonicNanoseconds();
+	if (best_path_decoder_ != NULL) {
+		best_path_decoder_->AdvanceDecoding(timed_decodable_);
+	} else {
+		decoder_->AdvanceDecoding(timed_decodable_);
+	}
+	trace_->Add(RequestTrace::STAGE_SEARCH, start, getMonotonicNanoseconds(),
+			timed_decodable_->Elapsed() - nnet_elapsed);
+}
+
+kaldi::int32 Nnet3LatgenFasterDecoder::DecodeIntermediate(int bestCount, std::vector<DecodedData> *result)
+{
+	// Best path only search gives linear lattice, which is its traceback
+	if (bestCount > 1 || best_path_decoder_ != NULL) {
+		return OnlineDecoder::DecodeIntermediate(bestCount, result);
+	}
+
+	// Single best path is traced back through decoder tokens instead of
+	// building the lattice from utterance start
+	TraceSpan span(trace_, RequestTrace::STAGE_LATTICE);
+	if (!best_path_.Update(*decoder_)) {
+		return 0;
+	}
+
+	DecodedData data;
+	data.words = best_path_.Words();
+	// Scaled as lattice costs are for the final result
+	kaldi::LatticeWeight weight = best_path_.Weight();
+	data.weight = kaldi::LatticeWeight(lm_scale_ != 0 ? weight.Value1() * lm_scale_ : weight.Value1(),
+			acoustic_scale_ != 0 ? weight.Value2() / acoustic_scale_ : weight.Value2());
+	result->push_back(data);
+	return 1;
 }
 
 void Nnet3LatgenFasterDecoder::GetLattice(kaldi::CompactLattice *clat, bool end_of_utterance)
 {
-	decoder_->GetLattice(end_of_utterance, clat);
+	if (best_path_decoder_ != NULL) {
+		GetBestPath(clat, end_of_utterance);
+		return;
+	}
+	if (decoder_->NumFramesDecoded() == 0) {
+		clat->DeleteStates();
+		return;
+	}
+
+	kaldi::Lattice raw_lat;
+	decoder_->GetRawLattice(&raw_lat, end_of_utterance);
+	fst::DeterminizeLatticePhonePrunedWrapper(*(bundle_->trans_model), &raw_lat,
+			load_controller_->Options(applied_level_).lattice_beam, clat, decoder_opts_.det_opts);
+
+	if (acoustic_scale_ != 0) {
+		ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_), clat);
+	}
+}
+
+void Nnet3LatgenFasterDecoder::GetBestPath(kaldi::CompactLattice *clat, bool end_of_utterance)
+{
+	kaldi::Lattice path;
+	if (best_path_decoder_->NumFramesDecoded() == 0 || !best_path_decoder_->GetBestPath(&path, end_of_utterance)) {
+		clat->DeleteStates();
+		return;
+	}
 
-	// In an application you might avoid updating the adaptation state if
-	// you felt the utterance had low confidence.  See lat/confidence.h
-	feature_pipeline_->GetAdaptationState(adaptation_state_);
+	// Traceback is linear, so conversion takes place of determinization
+	fst::ConvertLattice(path, clat);
 
 	if (acoustic_scale_ != 0) {
 		ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_), clat);
@@ -17,12 +17,22 @@
 #define APIAI_DECODER_NNET3LATGENFASTERDECODER_H_
 
 #include "OnlineDecoder.h"
+#include "Nnet3ModelBundle.h"
+#include "Nnet3ModelRegistry.h"
+#include "FstLoader.h"
+#include "IncrementalBestPath.h"
+#include "BestPathDecoder.h"
+#include "LoadController.h"
 #include "online2/online-nnet3-decoding.h"          
 #include "online2/online-nnet2-feature-pipeline.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include "nnet3/decodable-online-looped.h"
 
 namespace apiai {
 
-class Nnet3LatgenFasterDecoder: public OnlineDecoder {
+class TimedDecodable;
+
+class Nnet3LatgenFasterDecoder: public OnlineDecoder, private Nnet3ModelRegistry::Loader {
 public:
 	Nnet3LatgenFasterDecoder();
 	virtual ~Nnet3LatgenFasterDecoder();
@@ -30,6 +40,8 @@ public:
 	virtual Nnet3LatgenFasterDecoder *Clone() const;
 	virtual void RegisterOptions(kaldi::OptionsItf &po);
 	virtual bool Initialize(kaldi::OptionsItf &po);
+	virtual bool Reload();
+	virtual void AppendMetrics(std::string *json);
 protected:
 	virtual bool AcceptWaveform(kaldi::BaseFloat sampling_rate,
 			const kaldi::VectorBase<kaldi::BaseFloat> &waveform,
@@ -38,8 +50,44 @@ protected:
 	virtual void InputFinished();
 	virtual void GetLattice(kaldi::CompactLattice *clat, bool end_of_utterance);
 	virtual void CleanUp();
+	virtual kaldi::BaseFloat EndpointSilenceSeconds() const;
+	virtual kaldi::int32 DecodeIntermediate(int bestCount, std::vector<DecodedData> *result);
 private:
+	/**
+	 * Load all models. Files given by options are loaded for empty directory,
+	 * otherwise standard files of the directory. Throws on failure
+	 */
+	virtual Nnet3ModelBundle *LoadModels(const std::string &model_dir);
+	/** Decode all ready frames */
+	void AdvanceDecoding();
+	/** Traceback of best path only search as a linear lattice */
+	void GetBestPath(kaldi::CompactLattice *clat, bool end_of_utterance);
+
 	std::string nnet3_rxfilename_;
+	FstLoader fst_loader_;
+
+	/** Max number of nnet chunks computed at once for all sessions. Batching disabled if less than 2 */
+	kaldi::int32 nnet_batch_size_;
+	/** Max time in milliseconds chunk waits for the batch to be filled */
+	kaldi::int32 nnet_batch_wait_ms_;
+	/** Number of threads computing nnet batches */
+	kaldi::int32 nnet_batch_threads_;
+	/** Max number of idle sessions kept for reuse */
+	kaldi::int32 session_pool_size_;
+	/** File of compiled batched computations kept between starts, computations are compiled lazily if empty */
+	std::string nnet_compile_cache_;
+	/** Replace affine layers with int8 quantized ones on load */
+	bool nnet_int8_;
+	/** Min input dimension of quantized layers */
+	kaldi::int32 nnet_int8_min_dim_;
+	/** Directory of models selected by requests, disabled if empty */
+	std::string models_dir_;
+	/** Memory budget of models selected by requests in megabytes, non-positive for no limit */
+	kaldi::int32 models_memory_mb_;
+	/** Max number of cached adaptation states of dialog sessions, caching disabled if non-positive */
+	kaldi::int32 adaptation_cache_size_;
+	/** Cached adaptation state lifetime in seconds since last use */
+	kaldi::int32 adaptation_cache_ttl_;
 
     bool online_;
     kaldi::OnlineEndpointConfig endpoint_config_;
@@ -50,15 +98,28 @@ private:
     kaldi::nnet3::NnetSimpleLoopedComputationOptions decodable_opts_;  
     kaldi::LatticeFasterDecoderConfig decoder_opts_;                   
 
-    kaldi::OnlineNnet2FeaturePipelineInfo *feature_info_;
-    fst::Fst<fst::StdArc> *decode_fst_;
-    kaldi::TransitionModel *trans_model_;
-    kaldi::nnet3::AmNnetSimple *nnet_;
-    kaldi::nnet3::DecodableNnetSimpleLoopedInfo *decodable_info_;     
+    /** Shared by all clones */
+    std::shared_ptr<Nnet3ModelSlot> models_;
+    /** Models selected by requests, shared by all clones */
+    std::shared_ptr<Nnet3ModelRegistry> registry_;
+    /** Models used by the current request */
+    std::shared_ptr<const Nnet3ModelBundle> bundle_;
+    /** Shared by all clones */
+    std::shared_ptr<LoadController> load_controller_;
+    /** Degradation level which options are set to the current session decoder */
+    kaldi::int32 applied_level_;
 
-    kaldi::OnlineIvectorExtractorAdaptationState *adaptation_state_;
+    Nnet3Session *session_;
     kaldi::OnlineNnet2FeaturePipeline *feature_pipeline_;
-    kaldi::SingleUtteranceNnet3Decoder *decoder_;
+    kaldi::DecodableInterface *decodable_;
+    /** Wraps decodable_ when stage timing is requested */
+    TimedDecodable *timed_decodable_;
+    /** Lattice search of the current request, NULL if it decodes best path only */
+    kaldi::LatticeFasterOnlineDecoder *decoder_;
+    /** Best path only search of the current request, NULL if it decodes lattice */
+    BestPathDecoder *best_path_decoder_;
+    /** Best path for intermediate results, updated incrementally */
+    IncrementalBestPath best_path_;
 };
 
 } /* namespace apiai */
@@ -0,0 +1,66 @@
+// Nnet3ModelBundle.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Nnet3ModelBundle.h"
+
+namespace apiai {
+
+Nnet3ModelBundle::Nnet3ModelBundle()
+	: feature_info(NULL), decode_fst(NULL), lookahead_graph(NULL), trans_model(NULL), nnet(NULL),
+	  decodable_info(NULL), batch_scheduler(NULL), session_pool(NULL),
+	  adaptation_state(NULL), adaptation_cache(NULL), word_syms(NULL)
+{
+}
+
+Nnet3ModelBundle::~Nnet3ModelBundle() {
+	// Pooled sessions refer to the graph and the scheduler
+	delete session_pool;
+	delete batch_scheduler;
+	delete decodable_info;
+	delete adaptation_cache;
+	delete adaptation_state;
+	delete decode_fst;
+	delete lookahead_graph;
+	delete nnet;
+	delete trans_model;
+	delete feature_info;
+	delete word_syms;
+}
+
+Nnet3ModelSlot::Nnet3ModelSlot() {
+	pthread_mutex_init(&reload_mutex, NULL);
+	pthread_mutex_init(&mutex_, NULL);
+}
+
+Nnet3ModelSlot::~Nnet3ModelSlot() {
+	pthread_mutex_destroy(&mutex_);
+	pthread_mutex_destroy(&reload_mutex);
+}
+
+std::shared_ptr<const Nnet3ModelBundle> Nnet3ModelSlot::Get() {
+	pthread_mutex_lock(&mutex_);
+	std::shared_ptr<const Nnet3ModelBundle> bundle = bundle_;
+	pthread_mutex_unlock(&mutex_);
+	return bundle;
+}
+
+void Nnet3ModelSlot::Set(std::shared_ptr<const Nnet3ModelBundle> bundle) {
+	pthread_mutex_lock(&mutex_);
+	bundle_.swap(bundle);
+	pthread_mutex_unlock(&mutex_);
+	// Previous bundle is released outside of the lock, possibly with the last reference
+}
+
+} /* namespace apiai */
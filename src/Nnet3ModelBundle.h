@@ -0,0 +1,90 @@
+// Nnet3ModelBundle.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_NNET3MODELBUNDLE_H_
+#define APIAI_DECODER_NNET3MODELBUNDLE_H_
+
+#include "Nnet3BatchScheduler.h"
+#include "Nnet3SessionPool.h"
+#include "LookaheadGraph.h"
+#include "AdaptationCache.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "nnet3/decodable-online-looped.h"
+#include "fst/symbol-table.h"
+#include <pthread.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * All models required for decoding, loaded together.
+ * Bundle is immutable once loaded and shared by all decoding sessions,
+ * it is released when the last session using it is finished.
+ */
+class Nnet3ModelBundle {
+public:
+	Nnet3ModelBundle();
+	virtual ~Nnet3ModelBundle();
+
+	kaldi::OnlineNnet2FeaturePipelineInfo *feature_info;
+	/** Static decoding graph, NULL if lookahead graph is used */
+	fst::Fst<fst::StdArc> *decode_fst;
+	/** Graph composed on the fly, every session creates its own instance. NULL if static graph is used */
+	LookaheadGraph *lookahead_graph;
+	kaldi::TransitionModel *trans_model;
+	kaldi::nnet3::AmNnetSimple *nnet;
+	/** Looped computation info, NULL if batched computation is used */
+	kaldi::nnet3::DecodableNnetSimpleLoopedInfo *decodable_info;
+	/** Batched computation scheduler, NULL if looped computation is used */
+	Nnet3BatchScheduler *batch_scheduler;
+	/** Idle sessions bound to the decoding graph of this bundle */
+	Nnet3SessionPool *session_pool;
+	/** Initial speaker adaptation state, copied to every new feature pipeline */
+	kaldi::OnlineIvectorExtractorAdaptationState *adaptation_state;
+	/** Adaptation states of recent dialog sessions, NULL if disabled or iVectors are not used */
+	AdaptationCache *adaptation_cache;
+	fst::SymbolTable *word_syms;
+	/** Word symbols indexed by word id, empty for ids missing from the table */
+	std::vector<std::string> word_strings;
+private:
+	Nnet3ModelBundle(const Nnet3ModelBundle&);
+	Nnet3ModelBundle &operator=(const Nnet3ModelBundle&);
+};
+
+/**
+ * Current model bundle holder shared by decoder clones.
+ * Bundle replacement is atomic: new sessions get the new bundle
+ * while running ones keep their reference to the old one.
+ */
+class Nnet3ModelSlot {
+public:
+	Nnet3ModelSlot();
+	virtual ~Nnet3ModelSlot();
+
+	std::shared_ptr<const Nnet3ModelBundle> Get();
+	void Set(std::shared_ptr<const Nnet3ModelBundle> bundle);
+
+	/** Serializes reloads, so that only one bundle is being loaded at a time */
+	pthread_mutex_t reload_mutex;
+private:
+	pthread_mutex_t mutex_;
+	std::shared_ptr<const Nnet3ModelBundle> bundle_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_NNET3MODELBUNDLE_H_ */
@@ -0,0 +1,238 @@
+// Nnet3ModelRegistry.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Nnet3ModelRegistry.h"
+#include "Timing.h"
+#include "base/kaldi-common.h"
+#include <sys/stat.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <exception>
+
+namespace apiai {
+
+/** Files which make up most of models memory */
+static const char *MODEL_FILES[] = { "final.mdl", "HCLG.fst", "words.txt" };
+
+Nnet3ModelRegistry::Nnet3ModelRegistry(const std::string &models_dir, size_t memory_budget)
+	: models_dir_(models_dir), memory_budget_(memory_budget), memory_used_(0), use_counter_(0),
+	  hits_(0), misses_(0), cold_loads_(0), cold_load_ms_(0), load_failures_(0), evictions_(0),
+	  loads_running_(0) {
+	pthread_mutex_init(&mutex_, NULL);
+	pthread_cond_init(&loaded_, NULL);
+}
+
+Nnet3ModelRegistry::~Nnet3ModelRegistry() {
+	// Loading threads are detached, they use registry till the end
+	pthread_mutex_lock(&mutex_);
+	while (loads_running_ > 0) {
+		pthread_cond_wait(&loaded_, &mutex_);
+	}
+	pthread_mutex_unlock(&mutex_);
+	pthread_cond_destroy(&loaded_);
+	pthread_mutex_destroy(&mutex_);
+}
+
+bool Nnet3ModelRegistry::ValidName(const std::string &name) {
+	if (name.empty() || name[0] == '.') {
+		return false;
+	}
+	for (size_t i = 0; i < name.size(); i++) {
+		char c = name[i];
+		if (!(isalnum(c) || c == '_' || c == '-' || c == '.')) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t Nnet3ModelRegistry::EstimateBytes(const std::string &model_dir) {
+	size_t bytes = 0;
+	for (size_t i = 0; i < sizeof(MODEL_FILES) / sizeof(MODEL_FILES[0]); i++) {
+		struct stat file_stat;
+		if (stat((model_dir + "/" + MODEL_FILES[i]).c_str(), &file_stat) == 0) {
+			bytes += file_stat.st_size;
+		}
+	}
+	return bytes;
+}
+
+std::shared_ptr<const Nnet3ModelBundle> Nnet3ModelRegistry::Get(const std::string &name, Loader &loader) {
+	std::shared_ptr<const Nnet3ModelBundle> bundle;
+	if (!ValidName(name)) {
+		return bundle;
+	}
+	const std::string model_dir = models_dir_ + "/" + name;
+
+	pthread_mutex_lock(&mutex_);
+	std::map<std::string, Entry>::iterator it = entries_.find(name);
+	if (it != entries_.end() && !it->second.loading) {
+		hits_++;
+		it->second.last_used = ++use_counter_;
+		bundle = it->second.bundle;
+		pthread_mutex_unlock(&mutex_);
+		return bundle;
+	}
+
+	std::shared_ptr<LoadJob> job;
+	if (it != entries_.end()) {
+		hits_++;
+		job = it->second.job;
+	} else {
+		struct stat dir_stat;
+		if (stat(model_dir.c_str(), &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)) {
+			pthread_mutex_unlock(&mutex_);
+			KALDI_WARN << "Requested models \"" << name << "\" not found in " << models_dir_;
+			return bundle;
+		}
+
+		job.reset(new LoadJob());
+		job->registry = this;
+		job->name = name;
+		job->model_dir = model_dir;
+		job->loader = &loader;
+
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		pthread_t thread;
+		std::shared_ptr<LoadJob> *thread_job = new std::shared_ptr<LoadJob>(job);
+		int errnumber = pthread_create(&thread, &attr, RunLoadThread, thread_job);
+		pthread_attr_destroy(&attr);
+		if (errnumber != 0) {
+			delete thread_job;
+			load_failures_++;
+			pthread_mutex_unlock(&mutex_);
+			KALDI_WARN << "Failed to start loading of models \"" << name << "\": " << strerror(errnumber);
+			return bundle;
+		}
+
+		misses_++;
+		loads_running_++;
+		Entry &entry = entries_[name];
+		entry.loading = true;
+		entry.job = job;
+	}
+
+	if (!job->done) {
+		WaitEvent loaded;
+		job->waiters.push_back(&loaded);
+		pthread_mutex_unlock(&mutex_);
+		loaded.Wait();
+		pthread_mutex_lock(&mutex_);
+	}
+	bundle = job->bundle;
+	pthread_mutex_unlock(&mutex_);
+	return bundle;
+}
+
+void *Nnet3ModelRegistry::RunLoadThread(void *arg) {
+	std::shared_ptr<LoadJob> *job = static_cast<std::shared_ptr<LoadJob>*>(arg);
+	(*job)->registry->Load(*job);
+	delete job;
+	return NULL;
+}
+
+void Nnet3ModelRegistry::Load(const std::shared_ptr<LoadJob> &job) {
+	KALDI_LOG << "Loading models \"" << job->name << "\" from " << job->model_dir;
+	milliseconds_t start = getMilliseconds();
+	std::shared_ptr<const Nnet3ModelBundle> bundle;
+	try {
+		bundle.reset(job->loader->LoadModels(job->model_dir));
+	} catch (std::exception &e) {
+		KALDI_WARN << "Failed to load models \"" << job->name << "\": " << e.what();
+	}
+	milliseconds_t load_ms = getMillisecondsSince(start);
+
+	pthread_mutex_lock(&mutex_);
+	// Loading entries are never dropped, so the entry is still there
+	std::map<std::string, Entry>::iterator it = entries_.find(job->name);
+	if (!bundle) {
+		load_failures_++;
+		entries_.erase(it);
+	} else {
+		Entry &entry = it->second;
+		entry.bundle = bundle;
+		entry.bytes = EstimateBytes(job->model_dir);
+		entry.last_used = ++use_counter_;
+		entry.loading = false;
+		entry.job.reset();
+		memory_used_ += entry.bytes;
+		cold_loads_++;
+		cold_load_ms_ += load_ms;
+		KALDI_LOG << "Models \"" << job->name << "\" loaded in " << load_ms << " ms, "
+				<< (entry.bytes >> 20) << " MB";
+		EvictLocked(job->name);
+	}
+	job->bundle = bundle;
+	job->done = true;
+	std::vector<WaitEvent*> waiters;
+	waiters.swap(job->waiters);
+	loads_running_--;
+	pthread_cond_broadcast(&loaded_);
+	pthread_mutex_unlock(&mutex_);
+
+	// Waiters are still waiting, so their events are alive
+	for (size_t i = 0; i < waiters.size(); i++) {
+		waiters[i]->Signal();
+	}
+}
+
+void Nnet3ModelRegistry::EvictLocked(const std::string &keep) {
+	while (memory_budget_ > 0 && memory_used_ > memory_budget_) {
+		std::map<std::string, Entry>::iterator oldest = entries_.end();
+		for (std::map<std::string, Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+			if (!it->second.loading && it->first != keep
+					&& (oldest == entries_.end() || it->second.last_used < oldest->second.last_used)) {
+				oldest = it;
+			}
+		}
+		if (oldest == entries_.end()) {
+			break;
+		}
+		KALDI_LOG << "Dropping models \"" << oldest->first << "\" to fit memory budget";
+		memory_used_ -= oldest->second.bytes;
+		entries_.erase(oldest);
+		evictions_++;
+	}
+}
+
+void Nnet3ModelRegistry::Clear() {
+	pthread_mutex_lock(&mutex_);
+	for (std::map<std::string, Entry>::iterator it = entries_.begin(); it != entries_.end();) {
+		if (it->second.loading) {
+			++it;
+		} else {
+			memory_used_ -= it->second.bytes;
+			entries_.erase(it++);
+		}
+	}
+	pthread_mutex_unlock(&mutex_);
+}
+
+void Nnet3ModelRegistry::AppendMetrics(std::string *json) {
+	pthread_mutex_lock(&mutex_);
+	char metrics[320];
+	int length = snprintf(metrics, sizeof(metrics), "\"models_loaded\":%d,\"models_memory_mb\":%d,"
+			"\"model_hits\":%lld,\"model_misses\":%lld,\"model_cold_loads\":%lld,\"model_cold_load_ms\":%lld,"
+			"\"model_load_failures\":%lld,\"model_evictions\":%lld",
+			int(entries_.size()), int(memory_used_ >> 20), (long long)hits_, (long long)misses_,
+			(long long)cold_loads_, (long long)cold_load_ms_, (long long)load_failures_, (long long)evictions_);
+	pthread_mutex_unlock(&mutex_);
+	json->append(metrics, length);
+}
+
+} /* namespace apiai */
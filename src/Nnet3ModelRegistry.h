@@ -0,0 +1,128 @@
+// Nnet3ModelRegistry.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_NNET3MODELREGISTRY_H_
+#define APIAI_DECODER_NNET3MODELREGISTRY_H_
+
+#include "Nnet3ModelBundle.h"
+#include "WaitEvent.h"
+#include "base/kaldi-types.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Named models selected by requests. Models are looked up in subdirectories
+ * of the models directory, loaded on first use and shared by all threads.
+ * Loading runs on its own thread, so that requests waiting for it in event
+ * loop mode don't stall other requests of their worker.
+ * When estimated memory of loaded models exceeds the budget, least recently
+ * used ones are dropped; requests still running keep their models until finished.
+ */
+class Nnet3ModelRegistry {
+public:
+	/** Models loading routine, provided by the decoder */
+	class Loader {
+	public:
+		virtual ~Loader() {};
+
+		/** Load models from given directory. Throws on failure */
+		virtual Nnet3ModelBundle *LoadModels(const std::string &model_dir) = 0;
+	};
+
+	/** Memory budget in bytes, zero for no limit */
+	Nnet3ModelRegistry(const std::string &models_dir, size_t memory_budget);
+	virtual ~Nnet3ModelRegistry();
+
+	/**
+	 * Get models with given name, loading them with loader if not loaded yet.
+	 * Concurrent requests of the same models wait for a single load, loader
+	 * of the first one is used. Returns empty pointer for unknown name or if
+	 * loading failed.
+	 */
+	std::shared_ptr<const Nnet3ModelBundle> Get(const std::string &name, Loader &loader);
+	/** Drop all loaded models, so that they are loaded again on next use. Loads in progress are kept */
+	void Clear();
+	/** Append loading counters as comma separated JSON object members */
+	void AppendMetrics(std::string *json);
+private:
+	/** Loading of models, shared by all requests waiting for it */
+	struct LoadJob {
+		Nnet3ModelRegistry *registry;
+		std::string name;
+		std::string model_dir;
+		Loader *loader;
+		/** Loaded models, empty if loading failed */
+		std::shared_ptr<const Nnet3ModelBundle> bundle;
+		bool done;
+		std::vector<WaitEvent*> waiters;
+
+		LoadJob() : registry(NULL), loader(NULL), done(false) {}
+	};
+
+	struct Entry {
+		std::shared_ptr<const Nnet3ModelBundle> bundle;
+		/** Estimated memory size */
+		size_t bytes;
+		/** Value of use counter on last use */
+		kaldi::int64 last_used;
+		bool loading;
+		/** Loading in progress */
+		std::shared_ptr<LoadJob> job;
+
+		Entry() : bytes(0), last_used(0), loading(false) {}
+	};
+
+	static void *RunLoadThread(void *job);
+	/** Load models of the job and wake its waiters */
+	void Load(const std::shared_ptr<LoadJob> &job);
+
+	/** Name is a plain directory name, so that requests can't address other paths */
+	static bool ValidName(const std::string &name);
+	/** Estimate memory size of models by size of their files */
+	static size_t EstimateBytes(const std::string &model_dir);
+	/** Drop least recently used models except the given ones until memory fits the budget */
+	void EvictLocked(const std::string &keep);
+
+	std::string models_dir_;
+	size_t memory_budget_;
+	size_t memory_used_;
+
+	std::map<std::string, Entry> entries_;
+	kaldi::int64 use_counter_;
+
+	kaldi::int64 hits_;
+	kaldi::int64 misses_;
+	kaldi::int64 cold_loads_;
+	kaldi::int64 cold_load_ms_;
+	kaldi::int64 load_failures_;
+	kaldi::int64 evictions_;
+
+	/** Number of loading threads running */
+	kaldi::int32 loads_running_;
+
+	pthread_mutex_t mutex_;
+	/** Signaled when loading of any models is finished */
+	pthread_cond_t loaded_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_NNET3MODELREGISTRY_H_ */
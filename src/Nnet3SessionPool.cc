@@ -0,0 +1,95 @@
+// Nnet3SessionPool.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Nnet3SessionPool.h"
+
+namespace apiai {
+
+/** Pool statistics are logged once per given number of requests */
+const long POOL_STATS_LOG_INTERVAL = 1000;
+
+volatile int Nnet3SessionPool::pooled_graph_caches_ = 0;
+
+Nnet3SessionPool::Nnet3SessionPool(kaldi::int32 max_size, kaldi::int32 max_graph_caches)
+	: max_size_(max_size), max_graph_caches_(max_graph_caches), hits_(0), misses_(0)
+{
+	pthread_mutex_init(&mutex_, NULL);
+}
+
+Nnet3SessionPool::~Nnet3SessionPool() {
+	for (size_t i = 0; i < sessions_.size(); i++) {
+		if (sessions_[i]->graph != NULL) {
+			__sync_sub_and_fetch(&pooled_graph_caches_, 1);
+		}
+		delete sessions_[i];
+	}
+	pthread_mutex_destroy(&mutex_);
+}
+
+Nnet3Session *Nnet3SessionPool::Acquire() {
+	Nnet3Session *session = NULL;
+
+	pthread_mutex_lock(&mutex_);
+	if (sessions_.size() > 0) {
+		session = sessions_.back();
+		sessions_.pop_back();
+		hits_++;
+	} else {
+		misses_++;
+	}
+	long hits = hits_, misses = misses_;
+	size_t idle = sessions_.size();
+	pthread_mutex_unlock(&mutex_);
+
+	if (session != NULL && session->graph != NULL) {
+		__sync_sub_and_fetch(&pooled_graph_caches_, 1);
+	}
+
+	if ((hits + misses) % POOL_STATS_LOG_INTERVAL == 0) {
+		KALDI_LOG << "Session pool hits: " << hits << ", misses: " << misses << ", idle: " << idle;
+	} else {
+		KALDI_VLOG(1) << "Session pool " << (session != NULL ? "hit" : "miss")
+				<< ", hits: " << hits << ", misses: " << misses;
+	}
+	return session;
+}
+
+void Nnet3SessionPool::Release(Nnet3Session *session) {
+	if (session == NULL) {
+		return;
+	}
+	// Arc cache of every graph may grow up to its limit, so idle ones above
+	// the budget are dropped instead of being kept for the next request
+	if (session->graph != NULL && __sync_add_and_fetch(&pooled_graph_caches_, 1) > max_graph_caches_) {
+		__sync_sub_and_fetch(&pooled_graph_caches_, 1);
+		session->DropGraph();
+	}
+
+	pthread_mutex_lock(&mutex_);
+	bool keep = sessions_.size() < size_t(max_size_);
+	if (keep) {
+		sessions_.push_back(session);
+	}
+	pthread_mutex_unlock(&mutex_);
+
+	if (!keep) {
+		if (session->graph != NULL) {
+			__sync_sub_and_fetch(&pooled_graph_caches_, 1);
+		}
+		delete session;
+	}
+}
+
+} /* namespace apiai */
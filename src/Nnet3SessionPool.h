@@ -0,0 +1,92 @@
+// Nnet3SessionPool.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_NNET3SESSIONPOOL_H_
+#define APIAI_DECODER_NNET3SESSIONPOOL_H_
+
+#include "Nnet3BatchedDecodable.h"
+#include "BestPathDecoder.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include <pthread.h>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Heavy per-request decoding objects which may be reset and reused
+ * by the next request instead of being reallocated
+ */
+struct Nnet3Session {
+	/** Reset with InitDecoding(), keeps its token storage between requests. Created on first lattice request */
+	kaldi::LatticeFasterOnlineDecoder *decoder;
+	/** Search of best path only requests, created on first such request */
+	BestPathDecoder *best_path_decoder;
+	/** Lazily composed graph of the decoder, keeps its arc cache between requests. NULL for static graph */
+	fst::Fst<fst::StdArc> *graph;
+	/** Batched decodable, rebound to the new feature pipeline. NULL if batching is disabled */
+	Nnet3BatchedDecodable *batched_decodable;
+
+	Nnet3Session() : decoder(NULL), best_path_decoder(NULL), graph(NULL), batched_decodable(NULL) {};
+	~Nnet3Session() {
+		delete decoder;
+		delete best_path_decoder;
+		delete graph;
+		delete batched_decodable;
+	}
+
+	/** Delete composed graph with its arc cache, decoders refer to the graph and are deleted as well */
+	void DropGraph() {
+		delete decoder;
+		delete best_path_decoder;
+		delete graph;
+		decoder = NULL;
+		best_path_decoder = NULL;
+		graph = NULL;
+	}
+};
+
+/**
+ * Thread safe pool of idle sessions shared by all decoder clones.
+ * Number of idle sessions keeping arc caches of composed graphs is
+ * limited over all pools of the process, others drop their graphs.
+ */
+class Nnet3SessionPool {
+public:
+	/**
+	 * Initialize pool holding up to max_size idle sessions,
+	 * and up to max_graph_caches idle composed graphs in the process
+	 */
+	Nnet3SessionPool(kaldi::int32 max_size, kaldi::int32 max_graph_caches);
+	virtual ~Nnet3SessionPool();
+
+	/** Take idle session. Returns NULL if pool is empty, then caller creates a new one */
+	Nnet3Session *Acquire();
+	/** Return session to the pool, deletes it if pool is full */
+	void Release(Nnet3Session *session);
+private:
+	kaldi::int32 max_size_;
+	kaldi::int32 max_graph_caches_;
+	std::vector<Nnet3Session*> sessions_;
+	/** Idle sessions keeping composed graph in all pools */
+	static volatile int pooled_graph_caches_;
+
+	pthread_mutex_t mutex_;
+	long hits_;
+	long misses_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_NNET3SESSIONPOOL_H_ */
@@ -14,6 +14,7 @@
 // limitations under the License.
 
 #include "OnlineDecoder.h"
+#include "LatticeNbest.h"
 #include "Timing.h"
 
 namespace apiai {
@@ -22,13 +23,6 @@ namespace apiai {
 #define AUDIO_DATA_FREQUENCY 16000
 kaldi::BaseFloat padVector[PAD_SIZE];
 
-struct OnlineDecoder::DecodedData {
-	kaldi::LatticeWeight weight;
-	std::vector<int32> words;
-	std::vector<int32> alignment;
-	std::vector<kaldi::LatticeWeight> weights;
-};
-
 bool wordsEquals(std::vector<int32> &a, std::vector<int32> &b) {
 	return (a.size() == b.size()) && (std::equal(a.begin(), a.end(), b.begin()));
 }
@@ -70,46 +64,62 @@ bool getWeightMeasures(const kaldi::Lattice &fst,
 }
 
 
-OnlineDecoder::OnlineDecoder() {
+OnlineDecoder::OnlineDecoder() : partial_tracker_(0) {
 	lm_scale_ = 10;
 	chunk_length_secs_ = 0.18;
 	max_record_size_seconds_ = 0;
 	max_lattice_unchanged_interval_seconds_ = 0;
 	decoding_timeout_seconds_ = 0;
+	chunk_read_timeout_seconds_ = 0;
+	nbest_beam_ = 0;
+	partial_stable_count_ = 3;
+	min_chunk_length_secs_ = 0.05;
+	max_chunk_length_secs_ = 1.0;
 
 	word_syms_rxfilename_ = "words.txt";
 	fst_rxfilename_ = "HCLG.fst";
+	word_strings_ = NULL;
+	trace_ = NULL;
+	load_level_ = 0;
+	accepted_samples_ = 0;
+	best_path_only_ = false;
 }
 
 OnlineDecoder::~OnlineDecoder() {
 }
 
 
-void OnlineDecoder::GetRecognitionResult(DecodedData &input, RecognitionResult *output) {
+float OnlineDecoder::GetConfidence(DecodedData &input) {
 	  // TODO move parameters to external file
-	  output->confidence = std::max(0.0, std::min(1.0, -0.0001466488 * (2.388449*float(input.weight.Value1()) + float(input.weight.Value2())) / (input.words.size() + 1) + 0.956));
-
-	  std::ostringstream outss;
+	  return std::max(0.0, std::min(1.0, -0.0001466488 * (2.388449*float(input.weight.Value1()) + float(input.weight.Value2())) / (input.words.size() + 1) + 0.956));
+}
 
-	  for (size_t i = 0; i < input.words.size(); i++) {
-		if (i) {
-		  outss << " ";
+void OnlineDecoder::AppendWordsText(const std::vector<int32> &words, size_t first, std::string *text) {
+	  for (size_t i = first; i < words.size(); i++) {
+		if (i > first) {
+		  *text += ' ';
 		}
-		std::string s = word_syms_->Find(input.words[i]);
-		if (s == "") {
-		  KALDI_WARN << "Word-id " << input.words[i] <<" not in symbol table.";
+		kaldi::int32 word = words[i];
+		if (word < 0 || size_t(word) >= word_strings_->size() || (*word_strings_)[word].empty()) {
+		  KALDI_WARN << "Word-id " << word <<" not in symbol table.";
 		} else {
-			outss << s;
+		  *text += (*word_strings_)[word];
 		}
 	  }
-	  output->text = outss.str();
+}
+
+void OnlineDecoder::GetRecognitionResult(DecodedData &input, RecognitionResult *output) {
+	  output->confidence = GetConfidence(input);
+
+	  // Text is rebuilt in place, so reused results keep their capacity
+	  output->text.clear();
+	  AppendWordsText(input.words, 0, &output->text);
 }
 
 void OnlineDecoder::GetRecognitionResult(std::vector<DecodedData> &input, std::vector<RecognitionResult> *output) {
+	output->resize(input.size());
 	for (int i = 0; i < input.size(); i++) {
-		RecognitionResult result;
-		GetRecognitionResult(input.at(i), &result);
-		output->push_back(result);
+		GetRecognitionResult(input.at(i), &(output->at(i)));
 	}
 }
 
@@ -131,17 +141,33 @@ void OnlineDecoder::RegisterOptions(kaldi::OptionsItf &po) {
 
     po.Register("decoding-timeout", &decoding_timeout_seconds_,
     		"Decoding process timeout given in seconds. Timeout disabled if value is non-positive.");
+
+    po.Register("nbest-beam", &nbest_beam_,
+    		"Lattice is pruned with given beam before n-best paths are searched, "
+    		"fewer variants may be returned if it is small. Note: Non-positive value to deactivate.");
+
+    po.Register("chunk-read-timeout", &chunk_read_timeout_seconds_,
+    		"Max time in seconds to wait for the next audio chunk. Request is finished with the audio "
+    		"received so far when expired. Timeout disabled if value is non-positive.");
+
+    po.Register("partial-stable-count", &partial_stable_count_,
+    		"Number of consecutive intermediate result checks a word should stay unchanged to be marked final "
+    		"in delta intermediate results (partial=delta). Note: Non-positive value to never mark words final.");
+
+    po.Register("min-chunk-length", &min_chunk_length_secs_,
+    		"Min chunk length in seconds, used for live streams with intermediate results requested. "
+    		"Note: Non-positive value to always use --chunk-length.");
+    po.Register("max-chunk-length", &max_chunk_length_secs_,
+    		"Max chunk length in seconds, used when more audio is already received than --chunk-length. "
+    		"Note: Non-positive value to always use --chunk-length.");
+
+    vad_.RegisterOptions(po);
 }
 
 bool OnlineDecoder::Initialize(kaldi::OptionsItf &po) {
-	word_syms_ = NULL;
 	if (word_syms_rxfilename_ == "") {
 		return false;
 	}
-	if (!(word_syms_ = fst::SymbolTable::ReadText(word_syms_rxfilename_))) {
-		KALDI_ERR << "Could not read symbol table from file "
-			  << word_syms_rxfilename_;
-	}
 	return true;
 }
 
@@ -152,6 +178,15 @@ void OnlineDecoder::Decode(Request &request, Response &response) {
 		milliseconds_t progress_time = 0;
 
 		KALDI_VLOG(1) << "Started @ " << start_time << " ms";
+		trace_ = request.Trace();
+		model_name_ = request.Model();
+		session_key_ = request.Session();
+		best_path_only_ = request.BestPathOnly() && request.BestCount() == 1;
+		load_level_ = 0;
+		accepted_samples_ = 0;
+		if (vad_.Enabled()) {
+			vad_.Reset(request.Frequency(), request.DoEndpointing() ? EndpointSilenceSeconds() : 0);
+		}
 		InputStarted();
 
 		int intermediate_counter = 1;
@@ -166,41 +201,66 @@ void OnlineDecoder::Decode(Request &request, Response &response) {
 		kaldi::SubVector<kaldi::BaseFloat> *wave_part;
 
 		bool do_endpointing = request.DoEndpointing();
+		const bool partial_delta = request.PartialDelta();
+		partial_tracker_.StableCount(partial_stable_count_);
+		partial_tracker_.Reset();
 		std::string requestInterrupted = Response::NOT_INTERRUPTED;
-		int samples_left = (max_samples_limit > 0) ? std::min(max_samples_limit, samples_per_chunk) : samples_per_chunk;
+		const bool intermediate = intermediate_samples_interval > 0;
+		int samples_left = ChunkSamples(request, samples_per_chunk, intermediate, intermediate_samples_interval);
+		if (max_samples_limit > 0) {
+			samples_left = std::min(max_samples_limit, samples_left);
+		}
 		const bool decoding_timeout_enabled = decoding_timeout_seconds_ > 0;
 		const int decoding_timeout_ms = decoding_timeout_enabled ? decoding_timeout_seconds_ * 1000 : 0;
+		const int chunk_timeout_ms = chunk_read_timeout_seconds_ > 0 ? chunk_read_timeout_seconds_ * 1000 : 0;
 
 		int time_left_ms = decoding_timeout_ms;
-		while ((wave_part = request.NextChunk(samples_left, time_left_ms)) != NULL) {
+		// Read waits for the chunk until the closest of both deadlines
+		int read_timeout_ms = (chunk_timeout_ms > 0 && (time_left_ms <= 0 || chunk_timeout_ms < time_left_ms)) ?
+				chunk_timeout_ms : time_left_ms;
+		while ((wave_part = request.NextChunk(samples_left, read_timeout_ms)) != NULL) {
 
 			samp_counter += wave_part->Dim();
 
-			if (AcceptWaveform(request.Frequency(), *wave_part, do_endpointing) == false && do_endpointing) {
+			if (AcceptAudio(request.Frequency(), *wave_part, do_endpointing) == false && do_endpointing) {
 				requestInterrupted = Response::INTERRUPTED_END_OF_SPEECH;
 				KALDI_VLOG(1) << "End Point Detected @ " << (getMillisecondsSince(start_time)) << " ms";
 				break;
 			}
 			progress_time = getMillisecondsSince(start_time);
 
-			if (max_samples_limit > 0) {
-				if (samp_counter > max_samples_limit) {
-					requestInterrupted = Response::INTERRUPTED_DATA_SIZE_LIMIT;
-					KALDI_VLOG(1) << "Interrupted by record length @ " << progress_time << " ms";
-					break;
-				}
-				samples_left = std::min(max_samples_limit - samp_counter, samples_per_chunk);
+			if (max_samples_limit > 0 && samp_counter > max_samples_limit) {
+				requestInterrupted = Response::INTERRUPTED_DATA_SIZE_LIMIT;
+				KALDI_VLOG(1) << "Interrupted by record length @ " << progress_time << " ms";
+				break;
 			}
 
 			if ((intermediate_samples_interval > 0) && (samp_counter > (intermediate_samples_interval * intermediate_counter))) {
-				intermediate_counter++;
+				// Interval may be shorter than chunk, at most one result per chunk
+				intermediate_counter = samp_counter / intermediate_samples_interval + 1;
 				std::vector<DecodedData> decodeData;
 				if (DecodeIntermediate(1, &decodeData) > 0) {
 					DecodedData &data = decodeData.at(0);
-					if (!wordsEquals(prev_words, data.words)) {
-						RecognitionResult recognitionResult;
-						GetRecognitionResult(data, &recognitionResult);
-						response.SetIntermediateResult(recognitionResult, (samp_counter / (request.Frequency() / 1000)));
+					if (partial_delta) {
+						// Checked on every interval, as unchanged words become final over time
+						if (partial_tracker_.Update(data.words)) {
+							{
+								TraceSpan span(trace_, RequestTrace::STAGE_SYMBOLS);
+								intermediate_result_.confidence = GetConfidence(data);
+								intermediate_result_.text.clear();
+								AppendWordsText(partial_tracker_.Words(), partial_tracker_.Keep(), &intermediate_result_.text);
+							}
+							TraceSpan span(trace_, RequestTrace::STAGE_JSON);
+							response.SetIntermediateDelta(intermediate_result_, partial_tracker_.Keep(),
+									partial_tracker_.Final(), (samp_counter / (request.Frequency() / 1000)));
+						}
+					} else if (!wordsEquals(prev_words, data.words)) {
+						{
+							TraceSpan span(trace_, RequestTrace::STAGE_SYMBOLS);
+							GetRecognitionResult(data, &intermediate_result_);
+						}
+						TraceSpan span(trace_, RequestTrace::STAGE_JSON);
+						response.SetIntermediateResult(intermediate_result_, (samp_counter / (request.Frequency() / 1000)));
 						prev_words = data.words;
 					}
 				} else {
@@ -213,8 +273,18 @@ void OnlineDecoder::Decode(Request &request, Response &response) {
 					break;
 				}
 			}
+			// Sized after intermediate decoding to account audio received meanwhile
+			samples_left = ChunkSamples(request, samples_per_chunk, intermediate, intermediate_samples_interval);
+			if (max_samples_limit > 0) {
+				samples_left = std::min(max_samples_limit - samp_counter, samples_left);
+			}
+			read_timeout_ms = (chunk_timeout_ms > 0 && (time_left_ms <= 0 || chunk_timeout_ms < time_left_ms)) ?
+					chunk_timeout_ms : time_left_ms;
 		}
-		if (wave_part != NULL && requestInterrupted.size() == 0) {
+		if (wave_part == NULL && request.TimedOut()) {
+			KALDI_VLOG(1) << "Audio read timed out @ " << (getMillisecondsSince(start_time)) << " ms";
+			requestInterrupted = Response::INTERRUPTED_TIMEOUT;
+		} else if (wave_part != NULL && requestInterrupted.size() == 0) {
 			if (decoding_timeout_enabled && (decoding_timeout_ms - getMillisecondsSince(start_time) <= 0)) {
 				KALDI_VLOG(1) << "Timeout reached @ " << (getMillisecondsSince(start_time)) << " ms";
 				requestInterrupted = Response::INTERRUPTED_TIMEOUT;
@@ -227,49 +297,139 @@ void OnlineDecoder::Decode(Request &request, Response &response) {
 			throw std::runtime_error("Got no data");
 		}
 
-		if (samp_counter < PAD_SIZE) {
-			KALDI_VLOG(1) << "Input too short, padding with " << (PAD_SIZE - samp_counter) << " zero samples";
-			kaldi::SubVector<kaldi::BaseFloat> padding(padVector, PAD_SIZE - samp_counter);
-			AcceptWaveform(request.Frequency(), padding, false);
+		if (vad_.Enabled()) {
+			{
+				TraceSpan span(trace_, RequestTrace::STAGE_FEATURES);
+				vad_.Finish(&vad_output_);
+			}
+			if (vad_output_.size() > 0) {
+				kaldi::SubVector<kaldi::BaseFloat> speech(vad_output_.data(), vad_output_.size());
+				accepted_samples_ += speech.Dim();
+				AcceptWaveform(request.Frequency(), speech, false);
+			}
+			KALDI_VLOG(1) << "Voice activity detection kept " << accepted_samples_ << " of " << samp_counter << " samples";
 		}
 
-		KALDI_VLOG(1) << "Input finished @ " << getMillisecondsSince(start_time) << " ms (audio length: " << (samp_counter / (request.Frequency() / 1000)) << " ms)";
-		InputFinished();
-
 		std::vector<DecodedData> result;
+		int32 decoded;
+
+		const bool no_speech = vad_.Enabled() && !vad_.SpeechDetected();
+		if (no_speech) {
+			// Silent request is not decoded at all, result is an empty hypothesis
+			KALDI_VLOG(1) << "No speech detected @ " << getMillisecondsSince(start_time) << " ms";
+			result.resize(1);
+			result[0].weight = kaldi::LatticeWeight::One();
+			decoded = 1;
+		} else {
+			if (accepted_samples_ < PAD_SIZE) {
+				KALDI_VLOG(1) << "Input too short, padding with " << (PAD_SIZE - accepted_samples_) << " zero samples";
+				kaldi::SubVector<kaldi::BaseFloat> padding(padVector, PAD_SIZE - accepted_samples_);
+				AcceptWaveform(request.Frequency(), padding, false);
+			}
 
-		int32 decoded = Decode(true, request.BestCount(), &result);
+			KALDI_VLOG(1) << "Input finished @ " << getMillisecondsSince(start_time) << " ms (audio length: " << (samp_counter / (request.Frequency() / 1000)) << " ms)";
+			InputFinished();
+
+			decoded = Decode(true, request.BestCount(), &result);
+		}
 
 		if (decoded == 0) {
 			response.SetError("Best-path failed");
 			KALDI_WARN << "Best-path failed";
 		} else {
 			std::vector<RecognitionResult> recognitionResults;
-			GetRecognitionResult(result, &recognitionResults);
+			{
+				TraceSpan span(trace_, RequestTrace::STAGE_SYMBOLS);
+				GetRecognitionResult(result, &recognitionResults);
+			}
+			if (no_speech) {
+				// Empty hypothesis of silence is not a confident recognition
+				recognitionResults[0].confidence = 0;
+			}
+			TraceSpan span(trace_, RequestTrace::STAGE_JSON);
+			response.SetLoadLevel(load_level_);
 			response.SetResult(recognitionResults, requestInterrupted, (samp_counter / (request.Frequency() / 1000)));
 			KALDI_VLOG(1) << "Recognized @ " << getMillisecondsSince(start_time) << " ms";
 		}
 
 		CleanUp();
+		trace_ = NULL;
 
 		KALDI_VLOG(1) << "Decode subroutine done";
-	} catch (std::runtime_error &e) {
+	} catch (std::exception &e) {
+		// Failed request still releases its session and models, whatever stage it failed at
+		try {
+			CleanUp();
+		} catch (std::exception &cleanup_error) {
+			KALDI_WARN << "Failed to clean up: " << cleanup_error.what();
+		}
+		trace_ = NULL;
 		response.SetError(e.what());
 	}
 };
 
+int32 OnlineDecoder::ChunkSamples(Request &request, int32 samples_per_chunk,
+		bool intermediate, int32 intermediate_samples_interval) {
+	if (samples_per_chunk <= 0) {
+		return samples_per_chunk;
+	}
+	int32 min_samples = min_chunk_length_secs_ > 0 ?
+			std::min(samples_per_chunk, int32(min_chunk_length_secs_ * request.Frequency())) : samples_per_chunk;
+	int32 max_samples = max_chunk_length_secs_ > 0 ?
+			std::max(samples_per_chunk, int32(max_chunk_length_secs_ * request.Frequency())) : samples_per_chunk;
+	if (intermediate) {
+		// Intermediate results are computed at most once per chunk
+		max_samples = std::max(samples_per_chunk, std::min(max_samples, intermediate_samples_interval));
+	}
+	if (min_samples == max_samples) {
+		return samples_per_chunk;
+	}
+
+	int32 available = request.SamplesAvailable();
+	if (available >= samples_per_chunk) {
+		// Already received data, e.g. uploaded file, is decoded with less per-chunk overhead
+		return std::min(available, max_samples);
+	}
+	// Live stream. Without intermediate results there is no one to wait for smaller chunks
+	return intermediate ? std::max(available, min_samples) : samples_per_chunk;
+}
+
+bool OnlineDecoder::AcceptAudio(kaldi::BaseFloat sampling_rate,
+		const kaldi::VectorBase<kaldi::BaseFloat> &waveform, const bool do_endpointing) {
+	if (!vad_.Enabled()) {
+		accepted_samples_ += waveform.Dim();
+		return AcceptWaveform(sampling_rate, waveform, do_endpointing);
+	}
+
+	{
+		TraceSpan span(trace_, RequestTrace::STAGE_FEATURES);
+		vad_.Accept(waveform, &vad_output_);
+	}
+	if (vad_output_.size() == 0) {
+		return true;
+	}
+	kaldi::SubVector<kaldi::BaseFloat> speech(vad_output_.data(), vad_output_.size());
+	accepted_samples_ += speech.Dim();
+	return AcceptWaveform(sampling_rate, speech, do_endpointing);
+}
+
 int32 OnlineDecoder::DecodeIntermediate(int bestCount, std::vector<DecodedData> *result) {
 	return Decode(false, bestCount, result);
 }
 
 int32 OnlineDecoder::Decode(bool end_of_utterance, int bestCount, std::vector<DecodedData> *result) {
 	kaldi::CompactLattice clat;
-	GetLattice(&clat, end_of_utterance);
+	{
+		TraceSpan span(trace_, RequestTrace::STAGE_LATTICE);
+		GetLattice(&clat, end_of_utterance);
+	}
 
 	if (clat.NumStates() == 0) {
 		return 0;
 	}
 
+	TraceSpan span(trace_, RequestTrace::STAGE_NBEST);
+
 	if (lm_scale_ != 0) {
 		fst::ScaleLattice(fst::LatticeScale(lm_scale_, 1.0), &clat);
 	}
@@ -277,22 +437,19 @@ int32 OnlineDecoder::Decode(bool end_of_utterance, int bestCount, std::vector<De
 	int32 resultsNumber = 0;
 
 	if (bestCount > 1) {
-		kaldi::Lattice _lat;
-		fst::ConvertLattice(clat, &_lat);
-		kaldi::Lattice nbest_lat;
-		fst::ShortestPath(_lat, &nbest_lat, bestCount);
-		std::vector<kaldi::Lattice> nbest_lats;
-		fst::ConvertNbestToVector(nbest_lat, &nbest_lats);
-		if (!nbest_lats.empty()) {
-		  resultsNumber = static_cast<int32>(nbest_lats.size());
-		  for (int32 k = 0; k < resultsNumber; k++) {
-			kaldi::Lattice &nbest_lat = nbest_lats[k];
-
+		if (nbest_beam_ > 0) {
+			kaldi::PruneLattice(nbest_beam_, &clat);
+		}
+		LatticeNbest nbest(&clat);
+		LatticeNbest::Path path;
+		while (resultsNumber < bestCount && nbest.Next(&path)) {
 			DecodedData decodeData;
-			GetLinearSymbolSequence(nbest_lat, &(decodeData.alignment), &(decodeData.words), &(decodeData.weight));
-			getWeightMeasures(nbest_lat, &(decodeData.weights));
+			decodeData.words.swap(path.words);
+			decodeData.alignment.swap(path.alignment);
+			decodeData.weight = path.weight;
+			decodeData.weights.swap(path.weights);
 			result->push_back(decodeData);
-		  }
+			resultsNumber++;
 		}
 	} else {
 		kaldi::CompactLattice best_path_clat;
@@ -17,6 +17,9 @@
 #define APIAI_DECODER_ONLINEDECODER_H_
 
 #include "Decoder.h"
+#include "RequestTrace.h"
+#include "EnergyVad.h"
+#include "PartialResultTracker.h"
 #include "online2/online-feature-pipeline.h"
 #include "online2/onlinebin-util.h"
 #include "online2/online-timing.h"
@@ -39,7 +42,13 @@ public:
 	virtual bool Initialize(kaldi::OptionsItf &po);
 	virtual void Decode(Request &request, Response &response);
 protected:
-	struct DecodedData;
+	/** Single recognition variant */
+	struct DecodedData {
+		kaldi::LatticeWeight weight;
+		std::vector<int32> words;
+		std::vector<int32> alignment;
+		std::vector<kaldi::LatticeWeight> weights;
+	};
 
 	/**
 	 * Process next data chunk
@@ -61,13 +70,19 @@ protected:
 	 */
 	virtual void GetLattice(kaldi::CompactLattice *clat, bool end_of_utterance) = 0;
 	/**
-	 * Clean all data
+	 * Clean all data. Called when request fails at any stage as well,
+	 * so it handles input not started or started partially
 	 */
 	virtual void CleanUp() = 0;
 	/**
 	 * Calculate intermediate results
 	 */
 	virtual kaldi::int32 DecodeIntermediate(int bestCount, std::vector<DecodedData> *result);
+	/**
+	 * Get trailing silence length in seconds of the longest endpoint rule,
+	 * zero if endpointing is not supported
+	 */
+	virtual kaldi::BaseFloat EndpointSilenceSeconds() const { return 0; }
 
 	std::string word_syms_rxfilename_;
 	kaldi::BaseFloat chunk_length_secs_;
@@ -90,14 +105,64 @@ protected:
 	 */
 	kaldi::BaseFloat decoding_timeout_seconds_;
 
+	/** Number of intermediate checks word stays unchanged to be sent as final with delta results */
+	kaldi::int32 partial_stable_count_;
+
+	/** Max time in seconds to wait for the next audio chunk.
+	 * Timeout disabled if value is non-positive
+	 */
+	kaldi::BaseFloat chunk_read_timeout_seconds_;
+
+	/** Chunk length limits in seconds, chunks are sized within them by the amount of already received audio */
+	kaldi::BaseFloat min_chunk_length_secs_;
+	kaldi::BaseFloat max_chunk_length_secs_;
+
+	/** Beam of lattice pruning before n-best search, disabled if non-positive */
+	kaldi::BaseFloat nbest_beam_;
+
 	bool do_endpointing_;
 
 	std::string fst_rxfilename_;
+
+	/** Word symbols indexed by word id of the models used by current request, set by implementation */
+	const std::vector<std::string> *word_strings_;
+	/** Stage timing collector of current request, NULL if timing is disabled */
+	RequestTrace *trace_;
+	/** Name of the models requested by current request, empty for default models */
+	std::string model_name_;
+	/** Dialog session key of current request, empty if not given */
+	std::string session_key_;
+	/** Current request decodes single best path only, without lattice */
+	bool best_path_only_;
+	/** Max search degradation level applied to current request, set by implementation */
+	kaldi::int32 load_level_;
 private:
-	fst::SymbolTable *word_syms_;
 
 	kaldi::int32 Decode(bool end_of_utterance, int bestCount, std::vector<DecodedData> *result);
-
+	/**
+	 * Get number of samples to be read as the next chunk: large when audio is already
+	 * received, small for live streams with intermediate results requested
+	 */
+	kaldi::int32 ChunkSamples(Request &request, kaldi::int32 samples_per_chunk,
+			bool intermediate, kaldi::int32 intermediate_samples_interval);
+	/** Pass audio through voice activity detection to AcceptWaveform */
+	bool AcceptAudio(kaldi::BaseFloat sampling_rate, const kaldi::VectorBase<kaldi::BaseFloat> &waveform,
+			const bool do_endpointing);
+
+	EnergyVad vad_;
+	/** Audio kept by voice activity detection, reused between chunks */
+	std::vector<kaldi::BaseFloat> vad_output_;
+	/** Number of samples passed to AcceptWaveform, original audio length is counted separately */
+	kaldi::int32 accepted_samples_;
+
+	/** Intermediate result reused between chunks, so that its text keeps allocated capacity */
+	RecognitionResult intermediate_result_;
+	/** Words sent with delta intermediate results */
+	PartialResultTracker partial_tracker_;
+
+	float GetConfidence(DecodedData &input);
+	/** Append text of words starting from given position */
+	void AppendWordsText(const std::vector<int32> &words, size_t first, std::string *text);
 	void GetRecognitionResult(DecodedData &input, RecognitionResult *output);
 	void GetRecognitionResult(std::vector<DecodedData> &input, std::vector<RecognitionResult> *output);
 };
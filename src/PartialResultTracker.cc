@@ -0,0 +1,68 @@
+// PartialResultTracker.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PartialResultTracker.h"
+#include <stddef.h>
+
+namespace apiai {
+
+static size_t CommonPrefix(const std::vector<kaldi::int32> &a, const std::vector<kaldi::int32> &b) {
+	size_t i = 0;
+	while (i < a.size() && i < b.size() && a[i] == b[i]) {
+		i++;
+	}
+	return i;
+}
+
+void PartialResultTracker::Reset() {
+	final_ = 0;
+	keep_ = 0;
+	sent_.clear();
+	previous_.clear();
+	stable_.clear();
+}
+
+bool PartialResultTracker::Update(const std::vector<kaldi::int32> &words) {
+	size_t unchanged = CommonPrefix(previous_, words);
+	stable_.resize(words.size());
+	for (size_t i = 0; i < words.size(); i++) {
+		stable_[i] = i < unchanged ? stable_[i] + 1 : 1;
+	}
+	previous_ = words;
+
+	// Final words are kept even if hypothesis has changed them meanwhile
+	size_t extendable = CommonPrefix(sent_, words) >= size_t(final_) ? words.size() : 0;
+	std::vector<kaldi::int32> view(sent_.begin(), sent_.begin() + final_);
+	if (size_t(final_) < words.size()) {
+		view.insert(view.end(), words.begin() + final_, words.end());
+	}
+
+	kaldi::int32 final = final_;
+	if (stable_count_ > 0) {
+		while (size_t(final) < extendable && stable_[final] >= stable_count_) {
+			final++;
+		}
+	}
+
+	if (view == sent_ && final == final_) {
+		return false;
+	}
+	keep_ = CommonPrefix(sent_, view);
+	final_ = final;
+	sent_.swap(view);
+	return true;
+}
+
+} /* namespace apiai */
@@ -0,0 +1,67 @@
+// PartialResultTracker.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_PARTIALRESULTTRACKER_H_
+#define APIAI_DECODER_PARTIALRESULTTRACKER_H_
+
+#include "base/kaldi-types.h"
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Tracks partial results sent to the client as deltas: words kept from
+ * the previous partial result and words which replace the rest of it.
+ * Leading words unchanged for given number of consecutive checks are
+ * marked final and are never replaced by later partial results.
+ */
+class PartialResultTracker {
+public:
+	/** Initialize tracker, words unchanged for stable_count checks become final */
+	PartialResultTracker(kaldi::int32 stable_count) : stable_count_(stable_count), final_(0), keep_(0) {};
+
+	/** Forget sent words, must be called when decoder starts new utterance */
+	void Reset();
+
+	/** Set number of checks which makes word final */
+	void StableCount(kaldi::int32 value) { stable_count_ = value; }
+
+	/**
+	 * Check hypothesis of the next intermediate result check.
+	 * Returns true if client view has changed and delta must be sent
+	 */
+	bool Update(const std::vector<kaldi::int32> &words);
+
+	/** Get number of words of the previous partial result kept by the last delta */
+	kaldi::int32 Keep() const { return keep_; }
+	/** Get number of leading final words */
+	kaldi::int32 Final() const { return final_; }
+	/** Get all words of the client view, delta words start at Keep() position */
+	const std::vector<kaldi::int32> &Words() const { return sent_; }
+private:
+	kaldi::int32 stable_count_;
+	kaldi::int32 final_;
+	kaldi::int32 keep_;
+	/** Words seen by the client */
+	std::vector<kaldi::int32> sent_;
+	/** Hypothesis of the previous check */
+	std::vector<kaldi::int32> previous_;
+	/** Number of consecutive checks every word of previous hypothesis stayed unchanged */
+	std::vector<kaldi::int32> stable_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_PARTIALRESULTTRACKER_H_ */
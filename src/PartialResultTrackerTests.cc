@@ -0,0 +1,80 @@
+// PartialResultTrackerTests.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PartialResultTracker.h"
+#include "base/kaldi-common.h"
+
+namespace apiai {
+
+	static std::vector<kaldi::int32> Words(const char *digits) {
+		std::vector<kaldi::int32> words;
+		for (const char *c = digits; *c; c++) {
+			words.push_back(*c - '0');
+		}
+		return words;
+	}
+
+	void TestDelta() {
+		PartialResultTracker tracker(0);
+
+		KALDI_ASSERT(tracker.Update(Words("12")));
+		KALDI_ASSERT(tracker.Keep() == 0 && tracker.Words() == Words("12"));
+		KALDI_ASSERT(!tracker.Update(Words("12")));
+
+		KALDI_ASSERT(tracker.Update(Words("1345")));
+		KALDI_ASSERT(tracker.Keep() == 1 && tracker.Words() == Words("1345"));
+
+		KALDI_ASSERT(tracker.Update(Words("13")));
+		KALDI_ASSERT(tracker.Keep() == 2 && tracker.Words() == Words("13"));
+		KALDI_ASSERT(tracker.Final() == 0);
+	}
+
+	void TestFinalWords() {
+		PartialResultTracker tracker(2);
+
+		KALDI_ASSERT(tracker.Update(Words("12")));
+		KALDI_ASSERT(tracker.Final() == 0);
+		// Both words unchanged for two checks, only final count is sent
+		KALDI_ASSERT(tracker.Update(Words("12")));
+		KALDI_ASSERT(tracker.Final() == 2 && tracker.Keep() == 2);
+		KALDI_ASSERT(!tracker.Update(Words("12")));
+
+		// Changed words after final ones become final once stable
+		KALDI_ASSERT(tracker.Update(Words("1234")));
+		KALDI_ASSERT(tracker.Final() == 2 && tracker.Keep() == 2);
+		KALDI_ASSERT(tracker.Update(Words("1235")));
+		KALDI_ASSERT(tracker.Final() == 3 && tracker.Keep() == 3);
+
+		// Final words are never replaced
+		KALDI_ASSERT(tracker.Update(Words("7")));
+		KALDI_ASSERT(tracker.Final() == 3 && tracker.Keep() == 3 && tracker.Words() == Words("123"));
+		KALDI_ASSERT(tracker.Update(Words("1239")));
+		KALDI_ASSERT(tracker.Keep() == 3 && tracker.Words() == Words("1239"));
+		KALDI_ASSERT(tracker.Final() == 3);
+
+		tracker.Reset();
+		KALDI_ASSERT(tracker.Update(Words("7")));
+		KALDI_ASSERT(tracker.Final() == 0 && tracker.Keep() == 0);
+	}
+
+} /* namespace apiai */
+
+int main(int argn, char *argv[]) {
+	using namespace apiai;
+
+	TestDelta();
+	TestFinalWords();
+	return 0;
+}
@@ -0,0 +1,127 @@
+// PcmConversion.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PcmConversion.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define APIAI_PCM_X86 1
+#include <immintrin.h>
+#endif
+
+namespace apiai {
+
+static inline kaldi::int16 ReadSample(const char *data) {
+	kaldi::int16 value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+void ConvertPcm16ToFloatScalar(const char *data, kaldi::int32 frames_count,
+		kaldi::int32 channels, kaldi::int32 channel_index, kaldi::BaseFloat *out) {
+	const char *sample = data + channel_index * sizeof(kaldi::int16);
+	const kaldi::int32 frame_size = channels * sizeof(kaldi::int16);
+	for (kaldi::int32 i = 0; i < frames_count; i++, sample += frame_size) {
+		out[i] = kaldi::BaseFloat(ReadSample(sample));
+	}
+}
+
+#ifdef APIAI_PCM_X86
+
+/** Mono conversion, 8 samples per step */
+static void ConvertMonoSse2(const char *data, kaldi::int32 frames_count, kaldi::BaseFloat *out) {
+	kaldi::int32 i = 0;
+	for (; i + 8 <= frames_count; i += 8) {
+		__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 2));
+		// Sign-extend by placing samples in the upper halves and shifting back
+		__m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+		__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+		_mm_storeu_ps(out + i, _mm_cvtepi32_ps(low));
+		_mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(high));
+	}
+	ConvertPcm16ToFloatScalar(data + i * 2, frames_count - i, 1, 0, out + i);
+}
+
+/** Stereo deinterleaving conversion, 4 frames per step */
+static void ConvertStereoSse2(const char *data, kaldi::int32 frames_count,
+		kaldi::int32 channel_index, kaldi::BaseFloat *out) {
+	kaldi::int32 i = 0;
+	for (; i + 4 <= frames_count; i += 4) {
+		__m128i frames = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 4));
+		if (channel_index == 0) {
+			frames = _mm_slli_epi32(frames, 16);
+		}
+		_mm_storeu_ps(out + i, _mm_cvtepi32_ps(_mm_srai_epi32(frames, 16)));
+	}
+	ConvertPcm16ToFloatScalar(data + i * 4, frames_count - i, 2, channel_index, out + i);
+}
+
+__attribute__((target("avx2")))
+static void ConvertMonoAvx2(const char *data, kaldi::int32 frames_count, kaldi::BaseFloat *out) {
+	kaldi::int32 i = 0;
+	for (; i + 16 <= frames_count; i += 16) {
+		__m256i low = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 2)));
+		__m256i high = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 2 + 16)));
+		_mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(low));
+		_mm256_storeu_ps(out + i + 8, _mm256_cvtepi32_ps(high));
+	}
+	ConvertPcm16ToFloatScalar(data + i * 2, frames_count - i, 1, 0, out + i);
+}
+
+__attribute__((target("avx2")))
+static void ConvertStereoAvx2(const char *data, kaldi::int32 frames_count,
+		kaldi::int32 channel_index, kaldi::BaseFloat *out) {
+	kaldi::int32 i = 0;
+	for (; i + 8 <= frames_count; i += 8) {
+		__m256i frames = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i * 4));
+		if (channel_index == 0) {
+			frames = _mm256_slli_epi32(frames, 16);
+		}
+		_mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(_mm256_srai_epi32(frames, 16)));
+	}
+	ConvertPcm16ToFloatScalar(data + i * 4, frames_count - i, 2, channel_index, out + i);
+}
+
+static bool HasAvx2() {
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+#endif /* APIAI_PCM_X86 */
+
+void ConvertPcm16ToFloat(const char *data, kaldi::int32 frames_count,
+		kaldi::int32 channels, kaldi::int32 channel_index, kaldi::BaseFloat *out) {
+#ifdef APIAI_PCM_X86
+	if (channels == 1) {
+		if (HasAvx2()) {
+			ConvertMonoAvx2(data, frames_count, out);
+		} else {
+			ConvertMonoSse2(data, frames_count, out);
+		}
+		return;
+	}
+	if (channels == 2) {
+		if (HasAvx2()) {
+			ConvertStereoAvx2(data, frames_count, channel_index, out);
+		} else {
+			ConvertStereoSse2(data, frames_count, channel_index, out);
+		}
+		return;
+	}
+#endif
+	ConvertPcm16ToFloatScalar(data, frames_count, channels, channel_index, out);
+}
+
+} /* namespace apiai */
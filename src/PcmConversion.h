@@ -0,0 +1,37 @@
+// PcmConversion.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_PCMCONVERSION_H_
+#define APIAI_DECODER_PCMCONVERSION_H_
+
+#include "base/kaldi-types.h"
+
+namespace apiai {
+
+/**
+ * Convert little-endian signed 16 bits PCM frames to float samples
+ * taking single channel out of interleaved ones.
+ * Vectorized with AVX2 or SSE2 depending on CPU capabilities.
+ */
+void ConvertPcm16ToFloat(const char *data, kaldi::int32 frames_count,
+		kaldi::int32 channels, kaldi::int32 channel_index, kaldi::BaseFloat *out);
+
+/** Non-vectorized conversion, reference implementation */
+void ConvertPcm16ToFloatScalar(const char *data, kaldi::int32 frames_count,
+		kaldi::int32 channels, kaldi::int32 channel_index, kaldi::BaseFloat *out);
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_PCMCONVERSION_H_ */
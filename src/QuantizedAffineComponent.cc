@@ -0,0 +1,187 @@
+// QuantizedAffineComponent.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "QuantizedAffineComponent.h"
+#include "nnet3/nnet-simple-component.h"
+#include <sstream>
+
+#if HAVE_CUDA == 1
+#include "cudamatrix/cu-device.h"
+#endif
+
+namespace apiai {
+
+QuantizedAffineComponent::QuantizedAffineComponent(const kaldi::MatrixBase<kaldi::BaseFloat> &linear,
+		const kaldi::VectorBase<kaldi::BaseFloat> *bias, int properties)
+	// Parameters are frozen, so the component must not be seen as updatable
+	: properties_(properties & ~(kaldi::nnet3::kUpdatableComponent | kaldi::nnet3::kStoresStats)) {
+	weights_.Quantize(linear.Data(), linear.NumRows(), linear.NumCols(), linear.Stride());
+	if (bias != NULL) {
+		bias_.assign(bias->Data(), bias->Data() + bias->Dim());
+	}
+}
+
+void QuantizedAffineComponent::InitFromConfig(kaldi::nnet3::ConfigLine *cfl) {
+	KALDI_ERR << "QuantizedAffineComponent is created from trained component only";
+}
+
+std::string QuantizedAffineComponent::Info() const {
+	std::ostringstream stream;
+	stream << Type() << ", input-dim=" << InputDim() << ", output-dim=" << OutputDim()
+			<< ", bias=" << (bias_.empty() ? "false" : "true");
+	return stream.str();
+}
+
+void *QuantizedAffineComponent::Propagate(const kaldi::nnet3::ComponentPrecomputedIndexes *indexes,
+		const kaldi::CuMatrixBase<kaldi::BaseFloat> &in,
+		kaldi::CuMatrixBase<kaldi::BaseFloat> *out) const {
+	// Propagation of shared nnet runs in many threads, every thread keeps its own buffer
+	static thread_local Int8Matrix input;
+	input.Quantize(in.Data(), in.NumRows(), in.NumCols(), in.Stride());
+
+	Int8MatMul(input, weights_, bias_.empty() ? NULL : bias_.data(),
+			(properties_ & kaldi::nnet3::kPropagateAdds) != 0, out->Data(), out->Stride());
+	return NULL;
+}
+
+void QuantizedAffineComponent::Backprop(const std::string &debug_info,
+		const kaldi::nnet3::ComponentPrecomputedIndexes *indexes,
+		const kaldi::CuMatrixBase<kaldi::BaseFloat> &in_value,
+		const kaldi::CuMatrixBase<kaldi::BaseFloat> &out_value,
+		const kaldi::CuMatrixBase<kaldi::BaseFloat> &out_deriv,
+		void *memo,
+		kaldi::nnet3::Component *to_update,
+		kaldi::CuMatrixBase<kaldi::BaseFloat> *in_deriv) const {
+	KALDI_ERR << "QuantizedAffineComponent can't be trained";
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+	KALDI_ERR << "QuantizedAffineComponent can't be read, quantize nnet after loading";
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+	KALDI_ERR << "QuantizedAffineComponent can't be written";
+}
+
+kaldi::nnet3::Component *QuantizedAffineComponent::Copy() const {
+	return new QuantizedAffineComponent(*this);
+}
+
+QuantizedTdnnComponent::QuantizedTdnnComponent(const kaldi::nnet3::TdnnComponent &tdnn)
+	: kaldi::nnet3::TdnnComponent(tdnn) {
+	// Parameters of all time offsets are spliced column-wise
+	kaldi::Matrix<kaldi::BaseFloat> linear(LinearParams());
+	kaldi::int32 input_dim = InputDim();
+	weights_.resize(linear.NumCols() / input_dim);
+	for (size_t i = 0; i < weights_.size(); i++) {
+		weights_[i].Quantize(linear.Data() + i * input_dim, linear.NumRows(), input_dim, linear.Stride());
+	}
+	kaldi::Vector<kaldi::BaseFloat> bias(BiasParams());
+	bias_.assign(bias.Data(), bias.Data() + bias.Dim());
+}
+
+int QuantizedTdnnComponent::Properties() const {
+	return kaldi::nnet3::TdnnComponent::Properties() & ~(kaldi::nnet3::kUpdatableComponent | kaldi::nnet3::kStoresStats);
+}
+
+std::string QuantizedTdnnComponent::Info() const {
+	std::ostringstream stream;
+	stream << Type() << ", input-dim=" << InputDim() << ", output-dim=" << OutputDim()
+			<< ", time-offsets=" << weights_.size() << ", bias=" << (bias_.empty() ? "false" : "true");
+	return stream.str();
+}
+
+void *QuantizedTdnnComponent::Propagate(const kaldi::nnet3::ComponentPrecomputedIndexes *indexes_in,
+		const kaldi::CuMatrixBase<kaldi::BaseFloat> &in,
+		kaldi::CuMatrixBase<kaldi::BaseFloat> *out) const {
+	const kaldi::nnet3::TdnnComponent::PrecomputedIndexes *indexes =
+			dynamic_cast<const kaldi::nnet3::TdnnComponent::PrecomputedIndexes*>(indexes_in);
+	KALDI_ASSERT(indexes != NULL && indexes->row_offsets.size() == weights_.size());
+
+	static thread_local Int8Matrix input;
+	const bool add = (Properties() & kaldi::nnet3::kPropagateAdds) != 0;
+	for (size_t i = 0; i < weights_.size(); i++) {
+		// Input of the time offset is every row_stride-th row starting at its row offset
+		input.Quantize(in.Data() + indexes->row_offsets[i] * in.Stride(), out->NumRows(), in.NumCols(),
+				in.Stride() * indexes->row_stride);
+		Int8MatMul(input, weights_[i], i == 0 && !bias_.empty() ? bias_.data() : NULL, i > 0 || add,
+				out->Data(), out->Stride());
+	}
+	return NULL;
+}
+
+void QuantizedTdnnComponent::Backprop(const std::string &debug_info,
+		const kaldi::nnet3::ComponentPrecomputedIndexes *indexes,
+		const kaldi::CuMatrixBase<kaldi::BaseFloat> &in_value,
+		const kaldi::CuMatrixBase<kaldi::BaseFloat> &out_value,
+		const kaldi::CuMatrixBase<kaldi::BaseFloat> &out_deriv,
+		void *memo,
+		kaldi::nnet3::Component *to_update,
+		kaldi::CuMatrixBase<kaldi::BaseFloat> *in_deriv) const {
+	KALDI_ERR << "QuantizedTdnnComponent can't be trained";
+}
+
+void QuantizedTdnnComponent::Read(std::istream &is, bool binary) {
+	KALDI_ERR << "QuantizedTdnnComponent can't be read, quantize nnet after loading";
+}
+
+void QuantizedTdnnComponent::Write(std::ostream &os, bool binary) const {
+	KALDI_ERR << "QuantizedTdnnComponent can't be written";
+}
+
+kaldi::nnet3::Component *QuantizedTdnnComponent::Copy() const {
+	return new QuantizedTdnnComponent(*this);
+}
+
+kaldi::int32 QuantizeNnet(kaldi::int32 min_input_dim, kaldi::nnet3::Nnet *nnet) {
+#if HAVE_CUDA == 1
+	if (kaldi::CuDevice::Instantiate().Enabled()) {
+		KALDI_WARN << "Quantized components are computed on CPU only, nnet is not quantized";
+		return 0;
+	}
+#endif
+	kaldi::int32 replaced = 0;
+	for (kaldi::int32 c = 0; c < nnet->NumComponents(); c++) {
+		const kaldi::nnet3::Component *component = nnet->GetComponent(c);
+		if (component->InputDim() < min_input_dim) {
+			continue;
+		}
+
+		kaldi::nnet3::Component *quantized = NULL;
+		if (const kaldi::nnet3::AffineComponent *affine =
+				dynamic_cast<const kaldi::nnet3::AffineComponent*>(component)) {
+			kaldi::Matrix<kaldi::BaseFloat> linear(affine->LinearParams());
+			kaldi::Vector<kaldi::BaseFloat> bias(affine->BiasParams());
+			quantized = new QuantizedAffineComponent(linear, &bias, affine->Properties());
+		} else if (const kaldi::nnet3::LinearComponent *linear_component =
+				dynamic_cast<const kaldi::nnet3::LinearComponent*>(component)) {
+			kaldi::Matrix<kaldi::BaseFloat> linear(linear_component->Params());
+			quantized = new QuantizedAffineComponent(linear, NULL, linear_component->Properties());
+		} else if (const kaldi::nnet3::TdnnComponent *tdnn =
+				dynamic_cast<const kaldi::nnet3::TdnnComponent*>(component)) {
+			quantized = new QuantizedTdnnComponent(*tdnn);
+		}
+
+		if (quantized != NULL) {
+			KALDI_VLOG(1) << "Quantized component " << nnet->GetComponentName(c) << ": " << quantized->Info();
+			nnet->SetComponent(c, quantized);
+			replaced++;
+		}
+	}
+	KALDI_LOG << "Quantized " << replaced << " of " << nnet->NumComponents() << " nnet components to int8";
+	return replaced;
+}
+
+} /* namespace apiai */
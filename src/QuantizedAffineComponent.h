@@ -0,0 +1,114 @@
+// QuantizedAffineComponent.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_QUANTIZEDAFFINECOMPONENT_H_
+#define APIAI_DECODER_QUANTIZEDAFFINECOMPONENT_H_
+
+#include "Int8Gemm.h"
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-component-itf.h"
+#include "nnet3/nnet-convolutional-component.h"
+#include <string>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Inference-only replacement of affine and linear nnet3 components.
+ * Weights are quantized to 8 bits once on load, input rows are quantized
+ * on every propagation, and the product is computed with int8 kernels.
+ * Computed on CPU only, can't be trained, written or read.
+ */
+class QuantizedAffineComponent : public kaldi::nnet3::Component {
+public:
+	/**
+	 * Quantize component with given weights (output-dim by input-dim) and
+	 * bias (NULL if none). Properties are kept from the replaced component.
+	 */
+	QuantizedAffineComponent(const kaldi::MatrixBase<kaldi::BaseFloat> &linear,
+			const kaldi::VectorBase<kaldi::BaseFloat> *bias, int properties);
+
+	virtual std::string Type() const { return "QuantizedAffineComponent"; }
+	virtual void InitFromConfig(kaldi::nnet3::ConfigLine *cfl);
+	virtual kaldi::int32 InputDim() const { return weights_.Cols(); }
+	virtual kaldi::int32 OutputDim() const { return weights_.Rows(); }
+	virtual int Properties() const { return properties_; }
+	virtual std::string Info() const;
+
+	virtual void *Propagate(const kaldi::nnet3::ComponentPrecomputedIndexes *indexes,
+			const kaldi::CuMatrixBase<kaldi::BaseFloat> &in,
+			kaldi::CuMatrixBase<kaldi::BaseFloat> *out) const;
+	virtual void Backprop(const std::string &debug_info,
+			const kaldi::nnet3::ComponentPrecomputedIndexes *indexes,
+			const kaldi::CuMatrixBase<kaldi::BaseFloat> &in_value,
+			const kaldi::CuMatrixBase<kaldi::BaseFloat> &out_value,
+			const kaldi::CuMatrixBase<kaldi::BaseFloat> &out_deriv,
+			void *memo,
+			kaldi::nnet3::Component *to_update,
+			kaldi::CuMatrixBase<kaldi::BaseFloat> *in_deriv) const;
+
+	virtual void Read(std::istream &is, bool binary);
+	virtual void Write(std::ostream &os, bool binary) const;
+	virtual kaldi::nnet3::Component *Copy() const;
+private:
+	Int8Matrix weights_;
+	std::vector<kaldi::BaseFloat> bias_;
+	int properties_;
+};
+
+/**
+ * Inference-only replacement of nnet3 TDNN component. Index computation is
+ * inherited from the replaced component, while the product for every time
+ * offset is computed with int8 kernels the same way as affine one.
+ */
+class QuantizedTdnnComponent : public kaldi::nnet3::TdnnComponent {
+public:
+	explicit QuantizedTdnnComponent(const kaldi::nnet3::TdnnComponent &tdnn);
+
+	virtual std::string Type() const { return "QuantizedTdnnComponent"; }
+	virtual int Properties() const;
+	virtual std::string Info() const;
+
+	virtual void *Propagate(const kaldi::nnet3::ComponentPrecomputedIndexes *indexes,
+			const kaldi::CuMatrixBase<kaldi::BaseFloat> &in,
+			kaldi::CuMatrixBase<kaldi::BaseFloat> *out) const;
+	virtual void Backprop(const std::string &debug_info,
+			const kaldi::nnet3::ComponentPrecomputedIndexes *indexes,
+			const kaldi::CuMatrixBase<kaldi::BaseFloat> &in_value,
+			const kaldi::CuMatrixBase<kaldi::BaseFloat> &out_value,
+			const kaldi::CuMatrixBase<kaldi::BaseFloat> &out_deriv,
+			void *memo,
+			kaldi::nnet3::Component *to_update,
+			kaldi::CuMatrixBase<kaldi::BaseFloat> *in_deriv) const;
+
+	virtual void Read(std::istream &is, bool binary);
+	virtual void Write(std::ostream &os, bool binary) const;
+	virtual kaldi::nnet3::Component *Copy() const;
+private:
+	/** Weights applied to input of every time offset, output-dim by input-dim each */
+	std::vector<Int8Matrix> weights_;
+	std::vector<kaldi::BaseFloat> bias_;
+};
+
+/**
+ * Replace affine (including natural gradient affine), linear and TDNN
+ * components with input dimension not less than min_input_dim by quantized ones.
+ * Returns number of replaced components.
+ */
+kaldi::int32 QuantizeNnet(kaldi::int32 min_input_dim, kaldi::nnet3::Nnet *nnet);
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_QUANTIZEDAFFINECOMPONENT_H_ */
@@ -18,6 +18,8 @@
 
 #include "base/kaldi-types.h"
 #include "matrix/kaldi-vector.h"
+#include "RequestTrace.h"
+#include <string>
 
 namespace apiai {
 
@@ -40,6 +42,20 @@ public:
 	/** Get end-of-speech points detection flag. */
 	virtual bool DoEndpointing(void) const = 0;
 
+	/**
+	 * Get flag of search keeping the single best path only, without lattice.
+	 * Applied only when a single result is expected
+	 */
+	virtual bool BestPathOnly(void) const = 0;
+
+	/** Get flag of intermediate results sent as deltas of the previous ones */
+	virtual bool PartialDelta(void) const = 0;
+
+	/** Get name of the models to decode with, empty for default models */
+	virtual const std::string &Model(void) const = 0;
+	/** Get key of the dialog session the request belongs to, empty if not given */
+	virtual const std::string &Session(void) const = 0;
+
 	/**
 	 * Get next chunk of audio data samples.
 	 * Max number of samples specified by samples_count value
@@ -48,9 +64,20 @@ public:
 	/**
 	 * Get next chunk of audio data samples.
 	 * Max number of samples specified by samples_count value.
-	 * Read timeout specified by timeout_ms.
+	 * Read timeout specified by timeout_ms, non-positive value to wait without limit.
+	 * Samples received before the timeout are returned as a shorter chunk,
+	 * NULL returned when the timeout passed with no samples received.
 	 */
 	virtual kaldi::SubVector<kaldi::BaseFloat> *NextChunk(kaldi::int32 samples_count, kaldi::int32 timeout_ms) = 0;
+
+	/** Get number of samples already received, which may be read without waiting */
+	virtual kaldi::int32 SamplesAvailable(void) = 0;
+
+	/** Get true if audio data reading was stopped by timeout */
+	virtual bool TimedOut(void) const = 0;
+
+	/** Get stage timing collector, NULL if timing is not requested */
+	virtual RequestTrace *Trace(void) const = 0;
 };
 
 } /* namespace apiai */
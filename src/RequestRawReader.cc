@@ -16,66 +16,224 @@
 #include "RequestRawReader.h"
 
 #include "Timing.h"
+#include "PcmConversion.h"
+#include "base/kaldi-error.h"
 #include <algorithm>
+#include <sstream>
+#include <string.h>
 
 namespace apiai {
 
-const milliseconds_t data_wait_interval_ms = 500;
-
 kaldi::SubVector<kaldi::BaseFloat> *RequestRawReader::NextChunk(kaldi::int32 samples_count)
 {
 	return NextChunk(samples_count, 0);
 }
 
+bool RequestRawReader::Codec(const std::string &name) {
+	// Raw PCM of other frequency is decoded and resampled the same way as encoded input
+	bool raw = name == AudioCodec::PCM && input_frequency_ == frequency_;
+	codec_.reset(raw ? NULL : AudioCodec::Create(name));
+	if (!raw && codec_.get() == NULL) {
+		fail_ = true;
+		last_error_message_ = "Unsupported codec \"" + name + "\"";
+		return false;
+	}
+	// Supported codec replaces unsupported one set before reading
+	fail_ = !rate_error_.empty();
+	last_error_message_ = rate_error_;
+	return true;
+}
+
+bool RequestRawReader::Rate(kaldi::int32 value) {
+	// Frequency is checked before the codec is set up, so that bad one is never used for reading
+	if (value <= 0 || (value != frequency_ && !Resampler::Supported(value, frequency_))) {
+		std::ostringstream message;
+		message << "Sampling frequency " << value << " is not supported";
+		rate_error_ = message.str();
+		fail_ = true;
+		last_error_message_ = rate_error_;
+		return false;
+	}
+	input_frequency_ = value;
+	if (codec_.get() == NULL && input_frequency_ != frequency_) {
+		codec_.reset(AudioCodec::Create(AudioCodec::PCM));
+	}
+	return true;
+}
+
+kaldi::int32 RequestRawReader::SamplesAvailable(void) {
+	if (codec_.get() != NULL) {
+		if (fail_) {
+			return 0;
+		}
+		// Encoded size of a second of input tells samples per byte ratio
+		size_t second_bytes = std::max<size_t>(1, codec_->EncodedBytes(InputFrequency()));
+		return decoded_.size() + (timed_out_ ? 0 : input_->Available() * frequency_ / second_bytes);
+	}
+	if (fail_ || timed_out_) {
+		return 0;
+	}
+	return (raw_carry_ + input_->Available()) / (bytes_per_sample_ * channels_);
+}
+
 kaldi::SubVector<kaldi::BaseFloat> *RequestRawReader::NextChunk(kaldi::int32 samples_count, kaldi::int32 timeout_ms) {
-	// TODO: timeout_ms is not supported because libfcgi do not provides "readsome" functionality
 	if (samples_count <= 0) {
 		return NULL;
 	}
 
-	if (fail_) {
+	const milliseconds_t deadline = timeout_ms > 0 ? getMilliseconds() + timeout_ms : 0;
+
+	if (codec_.get() != NULL) {
+		return NextDecodedChunk(samples_count, deadline);
+	}
+
+	if (fail_ || timed_out_) {
 		return NULL;
 	}
 
-	int frame_size = bytes_per_sample_ * channels_;
-	kaldi::int32 chunk_size = samples_count * frame_size;
+	const size_t frame_size = bytes_per_sample_ * channels_;
+	const size_t chunk_size = samples_count * frame_size;
 
-	int offset = channel_index_ * bytes_per_sample_;
+	// Buffers grow to the largest chunk size once and are reused afterwards
+	if (raw_.size() < chunk_size) {
+		raw_.resize(chunk_size);
+	}
+	if (samples_.size() < size_t(samples_count)) {
+		samples_.resize(samples_count);
+	}
 
-	std::vector<char> audioData(chunk_size);
+	size_t bytes_read = raw_carry_;
+	{
+		TraceSpan span(trace_, RequestTrace::STAGE_READ);
+		bytes_read += input_->Read(raw_.data() + raw_carry_, chunk_size - raw_carry_, deadline);
+	}
+	kaldi::int32 frames_read = bytes_read / frame_size;
+
+	// Data received before the timeout is still returned,
+	// the next call returns no data without waiting
+	timed_out_ = input_->TimedOut();
+
+	if (frames_read == 0) {
+		if (timed_out_) {
+			last_error_message_ = "Read timed out";
+		} else {
+			fail_ = true;
+			last_error_message_ = "Failed to read any data";
+		}
+		return NULL;
+	}
 
-	int bytes_read = 0;
+	{
+		TraceSpan span(trace_, RequestTrace::STAGE_CONVERSION);
+		ConvertPcm16ToFloat(raw_.data(), frames_read, channels_, channel_index_, samples_.data());
+	}
 
-	is_->read(audioData.data(), chunk_size);
+	// Incomplete frame is completed by the next read
+	raw_carry_ = bytes_read - frames_read * frame_size;
+	if (raw_carry_ > 0) {
+		memmove(raw_.data(), raw_.data() + frames_read * frame_size, raw_carry_);
+	}
 
-	bytes_read = is_->gcount();
+	current_chunk_.Bind(samples_.data(), frames_read);
+	return &current_chunk_;
+}
 
-	if (is_->gcount() == 0) {
-		fail_ = true;
-		last_error_message_ == "Failed to read any data";
+kaldi::SubVector<kaldi::BaseFloat> *RequestRawReader::NextDecodedChunk(kaldi::int32 samples_count, milliseconds_t deadline) {
+	// Samples decoded before the timeout are still returned
+	if (fail_ || (timed_out_ && decoded_.empty())) {
 		return NULL;
 	}
+	if (!codec_format_set_) {
+		codec_->Format(input_frequency_, channels_, channel_index_);
+		codec_format_set_ = true;
+	}
+
+	// Encoded data is read in amounts of the requested samples, so that
+	// live streams are decoded as soon as the chunk is received
+	while (decoded_.size() < size_t(samples_count) && !input_finished_ && !timed_out_) {
+		// Resampler may give a sample more or less, the rest is kept for the next chunk
+		kaldi::int64 needed = samples_count - decoded_.size();
+		needed = (needed * InputFrequency() + frequency_ - 1) / frequency_;
+		size_t length = std::max<size_t>(1, codec_->EncodedBytes(needed));
+		if (!codec_->FixedRate()) {
+			// Size of variable rate data is only estimated, so received data is decoded
+			// as is and reading waits only when nothing is received
+			size_t available = input_->Available();
+			length = available > 0 ? std::min(length, available) : 1;
+		}
+		if (raw_.size() < length) {
+			raw_.resize(length);
+		}
+		size_t bytes_read;
+		{
+			TraceSpan span(trace_, RequestTrace::STAGE_READ);
+			bytes_read = input_->Read(raw_.data(), length, deadline);
+		}
+		timed_out_ = input_->TimedOut();
+		input_finished_ = bytes_read < length && !timed_out_;
+
+		bool decoded;
+		{
+			TraceSpan span(trace_, RequestTrace::STAGE_CONVERSION);
+			codec_samples_.clear();
+			decoded = codec_->Decode(raw_.data(), bytes_read, &codec_samples_)
+					&& (!input_finished_ || codec_->Finish(&codec_samples_));
+		}
+		if (!decoded) {
+			KALDI_WARN << "Failed to decode audio: " << codec_->Error();
+			fail_ = true;
+			last_error_message_ = codec_->Error();
+			break;
+		}
+		if (!ResampleDecoded()) {
+			return NULL;
+		}
+	}
 
-	buffer_.clear();
-	for (int index = 0; index < bytes_read; index += frame_size) {
-		kaldi::int16 value = *reinterpret_cast<kaldi::int16*>(audioData.data() + index + offset);
-		kaldi::BaseFloat fvalue = kaldi::BaseFloat(value);
-		buffer_.push_back(fvalue);
+	kaldi::int32 samples_read = std::min(size_t(samples_count), decoded_.size());
+	if (samples_read == 0) {
+		if (timed_out_) {
+			last_error_message_ = "Read timed out";
+		} else if (!fail_) {
+			fail_ = true;
+			last_error_message_ = "Failed to read any data";
+		}
+		return NULL;
 	}
 
-	if (current_chunk_ && (current_chunk_->Dim() != buffer_.size())) {
-		delete current_chunk_;
-		current_chunk_ = NULL;
+	if (samples_.size() < size_t(samples_read)) {
+		samples_.resize(samples_read);
 	}
+	std::copy(decoded_.begin(), decoded_.begin() + samples_read, samples_.begin());
+	decoded_.erase(decoded_.begin(), decoded_.begin() + samples_read);
 
-	if (!current_chunk_) {
-		current_chunk_ = new kaldi::SubVector<kaldi::BaseFloat>(buffer_.data(), buffer_.size());
-	} else {
-		KALDI_ASSERT(buffer_.size() == current_chunk_->Dim());
-		std::copy(buffer_.begin(), buffer_.end(), current_chunk_->Data());
+	current_chunk_.Bind(samples_.data(), samples_read);
+	return &current_chunk_;
+}
+
+bool RequestRawReader::ResampleDecoded(void) {
+	const kaldi::int32 input_frequency = InputFrequency();
+	if (input_frequency == frequency_) {
+		decoded_.insert(decoded_.end(), codec_samples_.begin(), codec_samples_.end());
+		return true;
+	}
+	if (resampler_.get() == NULL || resampler_->InputFrequency() != input_frequency) {
+		if (!Resampler::Supported(input_frequency, frequency_)) {
+			std::ostringstream message;
+			message << "Sampling frequency " << input_frequency << " is not supported";
+			fail_ = true;
+			last_error_message_ = message.str();
+			return false;
+		}
+		resampler_.reset(new Resampler(input_frequency, frequency_));
 	}
 
-	return current_chunk_;
+	TraceSpan span(trace_, RequestTrace::STAGE_CONVERSION);
+	resampler_->Process(codec_samples_.data(), codec_samples_.size(), &decoded_);
+	if (input_finished_) {
+		resampler_->Finish(&decoded_);
+	}
+	return true;
 }
 
 } /* namespace apiai */
@@ -17,52 +17,71 @@
 #define APIAI_DECODER_STIREQUESTREADER_H_
 
 #include "Request.h"
+#include "AudioInput.h"
+#include "AudioCodec.h"
+#include "Resampler.h"
 #include <stdio.h>
 #include <istream>
+#include <memory>
+#include <vector>
 
 #define NBEST_MIN 1
 #define NBEST_MAX 10
 
-#define INTERMEDIATE_MIN 500
+#define INTERMEDIATE_MIN 1
 
 namespace apiai {
 
+/**
+ * Samples vector view which may be rebound to another data
+ * without reallocation of the view object
+ */
+class ChunkView : public kaldi::SubVector<kaldi::BaseFloat> {
+public:
+	ChunkView() : kaldi::SubVector<kaldi::BaseFloat>(NULL, 0) {};
+
+	void Bind(kaldi::BaseFloat *data, kaldi::int32 dim) {
+		data_ = data;
+		dim_ = dim;
+	}
+};
+
 /**
  * Provides access to PCM data from input stream.
  * Assumed that PCM is signed mono, 16 bits, 16 KHz
+ * unless the stream is decoded with a codec.
+ * Input of other sampling frequency is resampled to 16 KHz
  */
 class RequestRawReader : public Request {
 public:
-	RequestRawReader(std::istream *is)
+	RequestRawReader(std::istream *is) : stream_input_(new StreamAudioInput(is))
 	{
-		fail_ = false;
-		current_chunk_ = NULL;
-
-		is_ = is;
-		frequency_ = 16000;
-		bytes_per_sample_ = 16 / 8;
-		channels_ = 1;
-		channel_index_ = 0;
-
-		bestCount_ = 1;
-		intermediateMillisecondsInterval_ = 0;
-		doEndpointing_ = false;
+		Init(stream_input_.get());
 	}
 
-	virtual ~RequestRawReader() {
-		delete current_chunk_;
+	RequestRawReader(AudioInput *input)
+	{
+		Init(input);
 	}
 
+	virtual ~RequestRawReader() {}
+
 	virtual kaldi::int32 Frequency(void) const { return frequency_; }
 
 	/** Get errors flag */
-	bool HasErrors(void) { return fail_ || is_->fail(); }
+	bool HasErrors(void) { return fail_ || input_->Failed(); }
 	/** Get last error message */
 	const std::string &LastErrorMessage(void) const { return last_error_message_; }
 
 	virtual kaldi::int32 BestCount(void) const { return bestCount_; }
 	virtual kaldi::int32 IntermediateIntervalMillisec(void) const { return intermediateMillisecondsInterval_; }
 	virtual bool DoEndpointing(void) const { return doEndpointing_; }
+	virtual bool BestPathOnly(void) const { return bestPathOnly_; }
+	virtual bool PartialDelta(void) const { return partialDelta_; }
+	virtual const std::string &Model(void) const { return model_; }
+	virtual const std::string &Session(void) const { return session_; }
+	virtual bool TimedOut(void) const { return timed_out_; }
+	virtual RequestTrace *Trace(void) const { return trace_; }
 
 	/** Set number of suggested recognition result variants */
 	void BestCount(kaldi::int32 value) { bestCount_ = std::max(NBEST_MIN, std::min(NBEST_MAX, value)); }
@@ -72,12 +91,74 @@ public:
 	}
 	/** Set end-of-speech points detection flag. */
 	void DoEndpointing(bool value) { doEndpointing_ = value; }
+	/** Set best path only search flag */
+	void BestPathOnly(bool value) { bestPathOnly_ = value; }
+	/** Set delta intermediate results flag */
+	void PartialDelta(bool value) { partialDelta_ = value; }
+	/** Set name of the models to decode with */
+	void Model(const std::string &value) { model_ = value; }
+	/** Set key of the dialog session */
+	void Session(const std::string &value) { session_ = value; }
+	/**
+	 * Set codec of the input stream, "pcm" for raw PCM.
+	 * Returns false and sets error for unsupported codec
+	 */
+	bool Codec(const std::string &name);
+	/**
+	 * Set sampling frequency of the input stream, stream header of the
+	 * codec overrides it. Returns false and sets error for unsupported
+	 * frequency, which is kept whatever is set afterwards
+	 */
+	bool Rate(kaldi::int32 value);
+	/** Set number of interleaved channels */
+	void Channels(kaldi::int32 value) {
+		channels_ = std::max(1, value);
+		channel_index_ = std::min(channel_index_, channels_ - 1);
+	}
+	/** Set index of channel to be decoded */
+	void ChannelIndex(kaldi::int32 value) { channel_index_ = std::max(0, std::min(channels_ - 1, value)); }
+	/** Set stage timing collector, NULL to disable timing */
+	void Trace(RequestTrace *trace) { trace_ = trace; }
 
 	virtual kaldi::SubVector<kaldi::BaseFloat> *NextChunk(kaldi::int32 samples_count);
 	virtual kaldi::SubVector<kaldi::BaseFloat> *NextChunk(kaldi::int32 samples_count, kaldi::int32 timeout_ms);
+	virtual kaldi::int32 SamplesAvailable(void);
 private:
+	/** Read and decode samples with codec */
+	kaldi::SubVector<kaldi::BaseFloat> *NextDecodedChunk(kaldi::int32 samples_count, milliseconds_t deadline);
+	/** Move samples of the codec to decoded ones, resampling if needed */
+	bool ResampleDecoded(void);
+	/** Get sampling frequency of the input stream */
+	kaldi::int32 InputFrequency(void) const {
+		return codec_.get() != NULL && codec_->Frequency() != 0 ? codec_->Frequency() : input_frequency_;
+	}
+
+	void Init(AudioInput *input) {
+		fail_ = false;
+		timed_out_ = false;
+		raw_carry_ = 0;
+
+		input_ = input;
+		frequency_ = 16000;
+		input_frequency_ = frequency_;
+		bytes_per_sample_ = 16 / 8;
+		channels_ = 1;
+		channel_index_ = 0;
+
+		bestCount_ = 1;
+		intermediateMillisecondsInterval_ = 0;
+		doEndpointing_ = false;
+		bestPathOnly_ = false;
+		partialDelta_ = false;
+		trace_ = NULL;
+		input_finished_ = false;
+		codec_format_set_ = false;
+	}
+
 	bool fail_;
+	bool timed_out_;
 	kaldi::int32 frequency_;
+	kaldi::int32 input_frequency_;
 	kaldi::int32 bytes_per_sample_;
 	kaldi::int32 channels_;
 	kaldi::int32 channel_index_;
@@ -85,11 +166,39 @@ private:
 	kaldi::int32 bestCount_;
 	kaldi::int32 intermediateMillisecondsInterval_;
 	bool doEndpointing_;
-
-	std::istream *is_;
-	std::vector<kaldi::BaseFloat> buffer_;
+	bool bestPathOnly_;
+	bool partialDelta_;
+	std::string model_;
+	std::string session_;
+	RequestTrace *trace_;
+
+	/** Owned input when reader created for standard stream */
+	std::auto_ptr<StreamAudioInput> stream_input_;
+	AudioInput *input_;
 	std::string last_error_message_;
-	kaldi::SubVector<kaldi::BaseFloat> *current_chunk_;
+	/** Error of unsupported sampling frequency, not cleared by setting codec */
+	std::string rate_error_;
+
+	/** Raw input buffer, allocated once for the largest chunk requested */
+	std::vector<char> raw_;
+	/** Number of bytes of incomplete frame kept at the beginning of raw_ */
+	size_t raw_carry_;
+	/** Converted samples buffer, chunks returned are views of it */
+	std::vector<kaldi::BaseFloat> samples_;
+
+	/** Decoder of the input stream, NULL for raw PCM of frequency_ */
+	std::auto_ptr<AudioCodec> codec_;
+	/** Codec got stream format of the request */
+	bool codec_format_set_;
+	/** Samples of the last decoded piece before resampling */
+	std::vector<kaldi::BaseFloat> codec_samples_;
+	/** Resampler of the input stream, created for its frequency */
+	std::auto_ptr<Resampler> resampler_;
+	/** Samples decoded and not returned yet */
+	std::vector<kaldi::BaseFloat> decoded_;
+	/** Codec input is read till the end */
+	bool input_finished_;
+	ChunkView current_chunk_;
 };
 
 } /* namespace apiai */
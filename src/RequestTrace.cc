@@ -0,0 +1,102 @@
+// RequestTrace.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "RequestTrace.h"
+#include "base/kaldi-error.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sstream>
+
+namespace apiai {
+
+static const char *STAGE_NAMES[RequestTrace::STAGES_NUMBER] = {
+	"read", "conversion", "features", "nnet", "search", "endpoint", "lattice", "nbest", "symbols", "json"
+};
+
+RequestTrace::RequestTrace(bool keep_spans) : keep_spans_(keep_spans) {
+	started_ = getMonotonicNanoseconds();
+	for (int i = 0; i < STAGES_NUMBER; i++) {
+		totals_[i] = 0;
+	}
+}
+
+void RequestTrace::Add(Stage stage, nanoseconds_t start, nanoseconds_t end, nanoseconds_t excluded) {
+	totals_[stage] += end - start - excluded;
+	if (keep_spans_) {
+		Span span;
+		span.stage = stage;
+		span.start = start;
+		span.end = end;
+		spans_.push_back(span);
+	}
+}
+
+const char *RequestTrace::StageName(Stage stage) {
+	return STAGE_NAMES[stage];
+}
+
+ChromeTraceWriter::~ChromeTraceWriter() {
+	if (fd_ >= 0) {
+		close(fd_);
+	}
+}
+
+bool ChromeTraceWriter::Open(const std::string &path) {
+	fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd_ < 0) {
+		KALDI_WARN << "Failed to open trace file " << path << ": " << strerror(errno);
+		return false;
+	}
+	// Closing bracket of events array is optional, so the file stays valid
+	// while events are appended
+	struct stat st;
+	if (fstat(fd_, &st) == 0 && st.st_size == 0) {
+		if (write(fd_, "[\n", 2) != 2) {
+			KALDI_WARN << "Failed to write trace file " << path << ": " << strerror(errno);
+		}
+	}
+	return true;
+}
+
+void ChromeTraceWriter::Write(const RequestTrace &trace) {
+	if (fd_ < 0 || trace.Spans().empty()) {
+		return;
+	}
+	// Every request gets its own row, as coroutines of event loop mode
+	// interleave requests within one thread
+	long request = __sync_add_and_fetch(&requests_, 1);
+	pid_t pid = getpid();
+
+	std::ostringstream events;
+	events << "{\"name\":\"request\",\"cat\":\"asr\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << request
+			<< ",\"ts\":" << trace.Started() / 1000 << ",\"dur\":" << trace.Elapsed() / 1000 << "},\n";
+	const std::vector<RequestTrace::Span> &spans = trace.Spans();
+	for (size_t i = 0; i < spans.size(); i++) {
+		events << "{\"name\":\"" << RequestTrace::StageName(spans[i].stage) << "\",\"cat\":\"asr\",\"ph\":\"X\""
+				<< ",\"pid\":" << pid << ",\"tid\":" << request
+				<< ",\"ts\":" << spans[i].start / 1000 << ",\"dur\":" << (spans[i].end - spans[i].start) / 1000 << "},\n";
+	}
+
+	// Single append keeps events of concurrent writers apart
+	std::string data = events.str();
+	if (write(fd_, data.data(), data.size()) != ssize_t(data.size())) {
+		KALDI_WARN << "Failed to write trace events: " << strerror(errno);
+	}
+}
+
+} /* namespace apiai */
@@ -0,0 +1,117 @@
+// RequestTrace.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_REQUESTTRACE_H_
+#define APIAI_DECODER_REQUESTTRACE_H_
+
+#include "Timing.h"
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Time spent by single request in every processing stage
+ */
+class RequestTrace {
+public:
+	enum Stage {
+		STAGE_READ = 0,
+		STAGE_CONVERSION,
+		STAGE_FEATURES,
+		STAGE_NNET,
+		STAGE_SEARCH,
+		STAGE_ENDPOINT,
+		STAGE_LATTICE,
+		STAGE_NBEST,
+		STAGE_SYMBOLS,
+		STAGE_JSON,
+		STAGES_NUMBER
+	};
+
+	/** Single stage time interval */
+	struct Span {
+		Stage stage;
+		nanoseconds_t start;
+		nanoseconds_t end;
+	};
+
+	/** Individual spans are kept only if keep_spans set, otherwise just totals */
+	RequestTrace(bool keep_spans);
+
+	/**
+	 * Add stage span. Time of nested spans of other stages given
+	 * as excluded is not counted in stage total
+	 */
+	void Add(Stage stage, nanoseconds_t start, nanoseconds_t end, nanoseconds_t excluded = 0);
+
+	/** Get total time of stage in nanoseconds */
+	nanoseconds_t Total(Stage stage) const { return totals_[stage]; }
+	/** Get time passed since trace creation in nanoseconds */
+	nanoseconds_t Elapsed() const { return getMonotonicNanoseconds() - started_; }
+	nanoseconds_t Started() const { return started_; }
+	const std::vector<Span> &Spans() const { return spans_; }
+
+	static const char *StageName(Stage stage);
+private:
+	bool keep_spans_;
+	nanoseconds_t started_;
+	nanoseconds_t totals_[STAGES_NUMBER];
+	std::vector<Span> spans_;
+};
+
+/**
+ * Measures time from construction to destruction as a stage span.
+ * Does nothing if no trace given
+ */
+class TraceSpan {
+public:
+	TraceSpan(RequestTrace *trace, RequestTrace::Stage stage)
+		: trace_(trace), stage_(stage), start_(trace != NULL ? getMonotonicNanoseconds() : 0) {};
+	~TraceSpan() {
+		if (trace_ != NULL) {
+			trace_->Add(stage_, start_, getMonotonicNanoseconds());
+		}
+	}
+private:
+	RequestTrace *trace_;
+	RequestTrace::Stage stage_;
+	nanoseconds_t start_;
+};
+
+/**
+ * Appends request spans to file in Chrome trace event format,
+ * which may be opened by chrome://tracing or Perfetto UI.
+ * Safe to be shared by threads and forked processes.
+ */
+class ChromeTraceWriter {
+public:
+	ChromeTraceWriter() : fd_(-1), requests_(0) {};
+	~ChromeTraceWriter();
+
+	bool Open(const std::string &path);
+	bool IsOpen() const { return fd_ >= 0; }
+
+	/** Write all spans of the finished request */
+	void Write(const RequestTrace &trace);
+private:
+	int fd_;
+	long requests_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_REQUESTTRACE_H_ */
@@ -0,0 +1,210 @@
+// Resampler.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Resampler.h"
+#include <math.h>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define APIAI_RESAMPLER_X86 1
+#include <immintrin.h>
+#endif
+
+/** Filter zero crossings on each side of its center */
+#define RESAMPLER_ZERO_CROSSINGS 8
+/** Cutoff frequency relative to the lower of Nyquist frequencies */
+#define RESAMPLER_ROLLOFF 0.9
+#define RESAMPLER_KAISER_BETA 8.0
+/** Filter taps are padded to the widest vector size */
+#define RESAMPLER_TAPS_ALIGN 8
+/** Bounds on number of filter phases and on input frequency */
+#define RESAMPLER_MAX_PHASES 640
+#define RESAMPLER_MIN_FREQUENCY 4000
+#define RESAMPLER_MAX_FREQUENCY 192000
+
+namespace apiai {
+
+static kaldi::int32 Gcd(kaldi::int32 a, kaldi::int32 b) {
+	while (b != 0) {
+		kaldi::int32 t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/** Modified Bessel function of the first kind of order zero */
+static double BesselI0(double x) {
+	double sum = 1, term = 1;
+	for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+bool Resampler::Supported(kaldi::int32 input_frequency, kaldi::int32 output_frequency) {
+	if (input_frequency < RESAMPLER_MIN_FREQUENCY || input_frequency > RESAMPLER_MAX_FREQUENCY
+			|| output_frequency < RESAMPLER_MIN_FREQUENCY || output_frequency > RESAMPLER_MAX_FREQUENCY) {
+		return false;
+	}
+	return output_frequency / Gcd(input_frequency, output_frequency) <= RESAMPLER_MAX_PHASES;
+}
+
+Resampler::Resampler(kaldi::int32 input_frequency, kaldi::int32 output_frequency) :
+		input_frequency_(input_frequency), output_frequency_(output_frequency) {
+	kaldi::int32 gcd = Gcd(input_frequency, output_frequency);
+	up_ = output_frequency / gcd;
+	down_ = input_frequency / gcd;
+
+	// Prototype filter runs at the upsampled rate, its cutoff is
+	// below Nyquist frequency of both input and output
+	const kaldi::int32 factor = std::max(up_, down_);
+	const double cutoff = 0.5 * RESAMPLER_ROLLOFF / factor;
+	taps_ = kaldi::int32(ceil(2.0 * RESAMPLER_ZERO_CROSSINGS * factor / (up_ * RESAMPLER_ROLLOFF)));
+	taps_ = (taps_ + RESAMPLER_TAPS_ALIGN - 1) / RESAMPLER_TAPS_ALIGN * RESAMPLER_TAPS_ALIGN;
+
+	const kaldi::int32 length = up_ * taps_;
+	// Center at a whole sample makes filter delay exact, the first
+	// coefficient is left out of the window
+	const kaldi::int32 center = length / 2;
+	const double window_norm = BesselI0(RESAMPLER_KAISER_BETA);
+	std::vector<double> prototype(length);
+	for (kaldi::int32 j = 0; j < length; j++) {
+		double x = j - center;
+		double arg = 2 * cutoff * x;
+		double sinc = fabs(arg) < 1e-9 ? 1 : sin(M_PI * arg) / (M_PI * arg);
+		double r = x / center;
+		double window = BesselI0(RESAMPLER_KAISER_BETA * sqrt(std::max(0.0, 1 - r * r))) / window_norm;
+		// Upsampling by zero stuffing loses gain of the factor
+		prototype[j] = 2 * cutoff * sinc * window * up_;
+	}
+
+	// Phase p applies to input samples at every up_-th prototype
+	// coefficient, stored oldest sample first for a forward dot product
+	filters_.resize(size_t(up_) * taps_);
+	for (kaldi::int32 p = 0; p < up_; p++) {
+		for (kaldi::int32 q = 0; q < taps_; q++) {
+			filters_[size_t(p) * taps_ + q] = prototype[p + (taps_ - 1 - q) * up_];
+		}
+	}
+
+	Reset();
+}
+
+void Resampler::Reset(void) {
+	history_.assign(taps_ - 1, 0);
+	input_count_ = 0;
+	output_count_ = 0;
+	// Output is shifted by the filter delay, so that it is aligned with input
+	kaldi::int32 delay = up_ * taps_ / 2;
+	position_ = taps_ - 1 + delay / up_;
+	phase_ = delay % up_;
+}
+
+void Resampler::Run(kaldi::int64 limit, std::vector<kaldi::BaseFloat> *output) {
+	while (position_ < history_.size() && output_count_ < limit) {
+		output->push_back(ResamplerDot(&filters_[size_t(phase_) * taps_],
+				&history_[position_ + 1 - taps_], taps_));
+		output_count_++;
+		phase_ += down_;
+		position_ += phase_ / up_;
+		phase_ %= up_;
+	}
+	// Only the history needed by the next output sample is kept
+	size_t consumed = std::min(position_ + 1 - taps_, history_.size());
+	history_.erase(history_.begin(), history_.begin() + consumed);
+	position_ -= consumed;
+}
+
+void Resampler::Process(const kaldi::BaseFloat *input, kaldi::int32 count, std::vector<kaldi::BaseFloat> *output) {
+	history_.insert(history_.end(), input, input + count);
+	input_count_ += count;
+	Run(OutputCount(input_count_), output);
+}
+
+void Resampler::Finish(std::vector<kaldi::BaseFloat> *output) {
+	// Samples delayed by the filter are pushed out with silence
+	const kaldi::int64 expected = OutputCount(input_count_);
+	while (output_count_ < expected) {
+		history_.resize(history_.size() + taps_, 0);
+		Run(expected, output);
+	}
+}
+
+kaldi::int64 Resampler::OutputCount(kaldi::int64 input_count) const {
+	return (input_count * up_ + down_ - 1) / down_;
+}
+
+kaldi::BaseFloat ResamplerDotScalar(const kaldi::BaseFloat *filter, const kaldi::BaseFloat *input, kaldi::int32 count) {
+	kaldi::BaseFloat sum = 0;
+	for (kaldi::int32 i = 0; i < count; i++) {
+		sum += filter[i] * input[i];
+	}
+	return sum;
+}
+
+#ifdef APIAI_RESAMPLER_X86
+
+static kaldi::BaseFloat DotSse(const kaldi::BaseFloat *filter, const kaldi::BaseFloat *input, kaldi::int32 count) {
+	__m128 sum = _mm_setzero_ps();
+	kaldi::int32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(filter + i), _mm_loadu_ps(input + i)));
+	}
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum) + ResamplerDotScalar(filter + i, input + i, count - i);
+}
+
+__attribute__((target("avx2,fma")))
+static kaldi::BaseFloat DotAvx2(const kaldi::BaseFloat *filter, const kaldi::BaseFloat *input, kaldi::int32 count) {
+	// Two accumulators hide latency of the fused multiply-add
+	__m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+	kaldi::int32 i = 0;
+	for (; i + 16 <= count; i += 16) {
+		sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(filter + i), _mm256_loadu_ps(input + i), sum0);
+		sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(filter + i + 8), _mm256_loadu_ps(input + i + 8), sum1);
+	}
+	if (i + 8 <= count) {
+		sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(filter + i), _mm256_loadu_ps(input + i), sum0);
+		i += 8;
+	}
+	sum0 = _mm256_add_ps(sum0, sum1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum) + ResamplerDotScalar(filter + i, input + i, count - i);
+}
+
+static bool HasAvx2Fma() {
+	static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return avx2;
+}
+
+#endif /* APIAI_RESAMPLER_X86 */
+
+kaldi::BaseFloat ResamplerDot(const kaldi::BaseFloat *filter, const kaldi::BaseFloat *input, kaldi::int32 count) {
+#ifdef APIAI_RESAMPLER_X86
+	if (HasAvx2Fma()) {
+		return DotAvx2(filter, input, count);
+	}
+	return DotSse(filter, input, count);
+#else
+	return ResamplerDotScalar(filter, input, count);
+#endif
+}
+
+} /* namespace apiai */
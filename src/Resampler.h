@@ -0,0 +1,87 @@
+// Resampler.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_RESAMPLER_H_
+#define APIAI_DECODER_RESAMPLER_H_
+
+#include "base/kaldi-types.h"
+#include <stddef.h>
+#include <vector>
+
+namespace apiai {
+
+/**
+ * Streaming polyphase resampler by rational factor.
+ * Windowed sinc low-pass filter is split into one phase per output
+ * position between input samples, so every output sample costs a single
+ * dot product of the filter phase with the last input samples.
+ * Input history is kept between calls, so audio may be fed in chunks
+ * of any size and the output does not depend on chunking.
+ */
+class Resampler {
+public:
+	Resampler(kaldi::int32 input_frequency, kaldi::int32 output_frequency);
+
+	/** Get true if resampling between given frequencies is supported */
+	static bool Supported(kaldi::int32 input_frequency, kaldi::int32 output_frequency);
+
+	kaldi::int32 InputFrequency(void) const { return input_frequency_; }
+	kaldi::int32 OutputFrequency(void) const { return output_frequency_; }
+	/** Get number of filter taps applied per output sample */
+	kaldi::int32 Taps(void) const { return taps_; }
+
+	/** Resample input samples, appending the result to output */
+	void Process(const kaldi::BaseFloat *input, kaldi::int32 count, std::vector<kaldi::BaseFloat> *output);
+	/** Flush samples delayed by the filter at the end of the stream */
+	void Finish(std::vector<kaldi::BaseFloat> *output);
+	/** Forget stream history to start a new stream */
+	void Reset(void);
+private:
+	/** Produce output samples for the input received, up to limit of total output samples */
+	void Run(kaldi::int64 limit, std::vector<kaldi::BaseFloat> *output);
+	/** Get total number of output samples for total number of input ones */
+	kaldi::int64 OutputCount(kaldi::int64 input_count) const;
+
+	kaldi::int32 input_frequency_;
+	kaldi::int32 output_frequency_;
+	/** Upsampling and downsampling factors */
+	kaldi::int32 up_;
+	kaldi::int32 down_;
+	kaldi::int32 taps_;
+	/** Filter phases of taps_ coefficients each, in order of input samples */
+	std::vector<kaldi::BaseFloat> filters_;
+	/** Input history followed by samples not consumed yet */
+	std::vector<kaldi::BaseFloat> history_;
+	/** Index of the newest input sample of the next output one */
+	size_t position_;
+	/** Filter phase of the next output sample */
+	kaldi::int32 phase_;
+	/** Total numbers of samples received and produced */
+	kaldi::int64 input_count_;
+	kaldi::int64 output_count_;
+};
+
+/**
+ * Dot product of filter phase and input samples.
+ * Vectorized with AVX2 and FMA depending on CPU capabilities.
+ */
+kaldi::BaseFloat ResamplerDot(const kaldi::BaseFloat *filter, const kaldi::BaseFloat *input, kaldi::int32 count);
+
+/** Non-vectorized dot product, reference implementation */
+kaldi::BaseFloat ResamplerDotScalar(const kaldi::BaseFloat *filter, const kaldi::BaseFloat *input, kaldi::int32 count);
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_RESAMPLER_H_ */
@@ -0,0 +1,117 @@
+// ResamplerTests.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Resampler.h"
+#include "base/kaldi-common.h"
+#include <math.h>
+#include <stdlib.h>
+
+namespace apiai {
+
+	static std::vector<kaldi::BaseFloat> Sine(kaldi::BaseFloat tone, kaldi::int32 frequency, kaldi::int32 count) {
+		std::vector<kaldi::BaseFloat> samples(count);
+		for (kaldi::int32 i = 0; i < count; i++) {
+			samples[i] = 10000 * sin(2 * M_PI * tone * i / frequency);
+		}
+		return samples;
+	}
+
+	static std::vector<kaldi::BaseFloat> ResampleAll(const std::vector<kaldi::BaseFloat> &input, kaldi::int32 input_frequency,
+			size_t piece_size) {
+		Resampler resampler(input_frequency, 16000);
+		std::vector<kaldi::BaseFloat> output;
+		for (size_t i = 0; i < input.size(); i += piece_size) {
+			resampler.Process(input.data() + i, std::min(piece_size, input.size() - i), &output);
+		}
+		resampler.Finish(&output);
+		return output;
+	}
+
+	void TestSupported() {
+		KALDI_ASSERT(Resampler::Supported(8000, 16000));
+		KALDI_ASSERT(Resampler::Supported(22050, 16000));
+		KALDI_ASSERT(Resampler::Supported(44100, 16000));
+		KALDI_ASSERT(Resampler::Supported(48000, 16000));
+		KALDI_ASSERT(!Resampler::Supported(0, 16000));
+		KALDI_ASSERT(!Resampler::Supported(1000000, 16000));
+		// 16000 / gcd(16001, 16000) phases would be needed
+		KALDI_ASSERT(!Resampler::Supported(16001, 16000));
+	}
+
+	void TestSineTone() {
+		const kaldi::int32 frequencies[] = { 8000, 22050, 44100, 48000 };
+		for (size_t f = 0; f < sizeof(frequencies) / sizeof(frequencies[0]); f++) {
+			kaldi::int32 input_frequency = frequencies[f];
+			std::vector<kaldi::BaseFloat> output = ResampleAll(Sine(1000, input_frequency, input_frequency), input_frequency, 4096);
+			// A second of input gives a second of output, aligned with the input
+			KALDI_ASSERT(output.size() == 16000);
+			std::vector<kaldi::BaseFloat> expected = Sine(1000, 16000, 16000);
+			for (size_t i = 200; i < output.size() - 200; i++) {
+				KALDI_ASSERT(fabs(output[i] - expected[i]) < 30);
+			}
+		}
+	}
+
+	void TestAliasing() {
+		// Tone above output Nyquist frequency is filtered out
+		std::vector<kaldi::BaseFloat> output = ResampleAll(Sine(10000, 48000, 48000), 48000, 48000);
+		double energy = 0;
+		for (size_t i = 200; i < output.size() - 200; i++) {
+			energy += output[i] * output[i];
+		}
+		KALDI_ASSERT(sqrt(energy / (output.size() - 400)) < 10);
+	}
+
+	void TestChunking() {
+		std::vector<kaldi::BaseFloat> input(44100);
+		for (size_t i = 0; i < input.size(); i++) {
+			input[i] = rand() % 20000 - 10000;
+		}
+		std::vector<kaldi::BaseFloat> whole = ResampleAll(input, 44100, input.size());
+		const size_t pieces[] = { 1, 7, 441, 1000 };
+		for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+			std::vector<kaldi::BaseFloat> chunked = ResampleAll(input, 44100, pieces[p]);
+			KALDI_ASSERT(chunked.size() == whole.size());
+			for (size_t i = 0; i < whole.size(); i++) {
+				KALDI_ASSERT(chunked[i] == whole[i]);
+			}
+		}
+	}
+
+	void TestDot() {
+		std::vector<kaldi::BaseFloat> filter(45), input(45);
+		for (size_t i = 0; i < filter.size(); i++) {
+			filter[i] = kaldi::BaseFloat(rand()) / RAND_MAX - 0.5;
+			input[i] = rand() % 20000 - 10000;
+		}
+		// Sizes cover vector blocks and the scalar tail
+		for (kaldi::int32 count = 0; count <= 45; count++) {
+			kaldi::BaseFloat reference = ResamplerDotScalar(filter.data(), input.data(), count);
+			KALDI_ASSERT(fabs(ResamplerDot(filter.data(), input.data(), count) - reference) < 1e-2);
+		}
+	}
+
+} /* namespace apiai */
+
+int main(int argn, char *argv[]) {
+	using namespace apiai;
+
+	TestSupported();
+	TestSineTone();
+	TestAliasing();
+	TestChunking();
+	TestDot();
+	return 0;
+}
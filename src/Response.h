@@ -54,8 +54,16 @@ public:
 	virtual void SetResult(std::vector<RecognitionResult> &data, const std::string &interrupted, int timeMarkMs) = 0;
 	/** Set intermediate result */
 	virtual void SetIntermediateResult(RecognitionResult &decodedData, int timeMarkMs) = 0;
+	/**
+	 * Set intermediate result as a delta of the previous one: first keepWords words
+	 * of the previous result are kept and the rest is replaced by words of decodedData text.
+	 * First finalWords words of the result are never replaced again
+	 */
+	virtual void SetIntermediateDelta(RecognitionResult &decodedData, int keepWords, int finalWords, int timeMarkMs) = 0;
 	/** Set error value */
 	virtual void SetError(const std::string &message) = 0;
+	/** Set max search degradation level used for the request, reported with final result if non-zero */
+	virtual void SetLoadLevel(int level) = 0;
 
 	static const std::string NOT_INTERRUPTED;
 	static const std::string INTERRUPTED_UNEXPECTED;
@@ -14,21 +14,70 @@
 // limitations under the License.
 
 #include "ResponseJsonWriter.h"
+#include <stdio.h>
 
 namespace apiai {
 
 const std::string ResponseJsonWriter::MIME_APPLICATION_JAVA = "application/json";
 
-void ResponseJsonWriter::SendJson(std::string json, bool final) {
-	*out_ << json << std::endl;
+void ResponseJsonWriter::SendJson(const std::string &json, bool final) {
+	out_->write(json.data(), json.size());
+	out_->put('\n');
 	out_->flush();
 }
 
-void ResponseJsonWriter::Write(std::ostringstream &outss, RecognitionResult &data) {
-  outss << "{"
-  	<< "\"confidence\":" << data.confidence << ","
-  	<< "\"text\":\"" << data.text << "\""
-  	<< "}";
+void ResponseJsonWriter::AppendEscaped(const std::string &value, std::string *out) {
+	static const char HEX[] = "0123456789abcdef";
+	size_t plain_start = 0;
+	for (size_t i = 0; i < value.size(); i++) {
+		unsigned char c = value[i];
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+		out->append(value, plain_start, i - plain_start);
+		plain_start = i + 1;
+		switch (c) {
+		case '"': out->append("\\\""); break;
+		case '\\': out->append("\\\\"); break;
+		case '\n': out->append("\\n"); break;
+		case '\r': out->append("\\r"); break;
+		case '\t': out->append("\\t"); break;
+		case '\b': out->append("\\b"); break;
+		case '\f': out->append("\\f"); break;
+		default:
+			out->append("\\u00");
+			*out += HEX[c >> 4];
+			*out += HEX[c & 0xf];
+		}
+	}
+	out->append(value, plain_start, value.size() - plain_start);
+}
+
+void ResponseJsonWriter::AppendNumber(const char *format, double value) {
+	char number[32];
+	int length = snprintf(number, sizeof(number), format, value);
+	buffer_->append(number, length);
+}
+
+void ResponseJsonWriter::Write(RecognitionResult &data) {
+	buffer_->append("{\"confidence\":");
+	AppendNumber("%g", data.confidence);
+	buffer_->append(",\"text\":\"");
+	AppendEscaped(data.text, buffer_);
+	buffer_->append("\"}");
+}
+
+void ResponseJsonWriter::WriteTiming() {
+	buffer_->append("{\"total_ms\":");
+	AppendNumber("%.3f", trace_->Elapsed() / 1e6);
+	for (int i = 0; i < RequestTrace::STAGES_NUMBER; i++) {
+		RequestTrace::Stage stage = RequestTrace::Stage(i);
+		buffer_->append(",\"");
+		buffer_->append(RequestTrace::StageName(stage));
+		buffer_->append("_ms\":");
+		AppendNumber("%.3f", trace_->Total(stage) / 1e6);
+	}
+	buffer_->append("}");
 }
 
 void ResponseJsonWriter::SetResult(std::vector<RecognitionResult> &data, int timeMarkMs) {
@@ -36,45 +85,64 @@ void ResponseJsonWriter::SetResult(std::vector<RecognitionResult> &data, int tim
 }
 
 void ResponseJsonWriter::SetResult(std::vector<RecognitionResult> &data, const std::string &interrupted, int timeMarkMs) {
-
-	std::ostringstream msg;
-	msg << "{";
-	msg << "\"status\":\"ok\"";
-	msg << ",\"data\":[";
+	buffer_->clear();
+	buffer_->append("{\"status\":\"ok\",\"data\":[");
 	for (int i = 0; i < data.size(); i++) {
 		if (i) {
-			msg << ",";
+			buffer_->append(",");
 		}
-		Write(msg, data.at(i));
+		Write(data.at(i));
 	}
-	msg << "]";
+	buffer_->append("]");
 	if (interrupted.size() > 0) {
-		msg << ",\"interrupted\":\"" << interrupted << "\"";
+		buffer_->append(",\"interrupted\":\"");
+		AppendEscaped(interrupted, buffer_);
+		buffer_->append("\"");
 		if (timeMarkMs > 0) {
-		    msg << ",\"time\":" << timeMarkMs;
+			buffer_->append(",\"time\":");
+			AppendNumber("%.0f", timeMarkMs);
 		}
 	}
-	msg << "}";
-	SendJson(msg.str(), true);
+	if (load_level_ > 0) {
+		buffer_->append(",\"load_level\":");
+		AppendNumber("%.0f", load_level_);
+	}
+	if (trace_ != NULL) {
+		buffer_->append(",\"timing\":");
+		WriteTiming();
+	}
+	buffer_->append("}");
+	SendJson(*buffer_, true);
 }
 
 void ResponseJsonWriter::SetIntermediateResult(RecognitionResult &decodedData, int timeMarkMs) {
-	std::ostringstream msg;
-	msg << "{";
-	msg << "\"status\":\"intermediate\"";
-	msg << ",\"data\":[";
-	Write(msg, decodedData);
-	msg << "]}";
-	SendJson(msg.str(), false);
+	buffer_->clear();
+	buffer_->append("{\"status\":\"intermediate\",\"data\":[");
+	Write(decodedData);
+	buffer_->append("]}");
+	SendJson(*buffer_, false);
+}
+
+void ResponseJsonWriter::SetIntermediateDelta(RecognitionResult &decodedData, int keepWords, int finalWords, int timeMarkMs) {
+	buffer_->clear();
+	buffer_->append("{\"status\":\"intermediate\",\"data\":[{\"confidence\":");
+	AppendNumber("%g", decodedData.confidence);
+	buffer_->append(",\"keep\":");
+	AppendNumber("%.0f", keepWords);
+	buffer_->append(",\"text\":\"");
+	AppendEscaped(decodedData.text, buffer_);
+	buffer_->append("\",\"final\":");
+	AppendNumber("%.0f", finalWords);
+	buffer_->append("}]}");
+	SendJson(*buffer_, false);
 }
 
 void ResponseJsonWriter::SetError(const std::string &message) {
-	std::ostringstream msg;
-    msg << "{";
-    msg << "\"status\":\"error\"";
-    msg << ",\"data\":[{\"text\":\""<< message << "\"}]";
-    msg << "}";
-    SendJson(msg.str(), true);
+	buffer_->clear();
+	buffer_->append("{\"status\":\"error\",\"data\":[{\"text\":\"");
+	AppendEscaped(message, buffer_);
+	buffer_->append("\"}]}");
+	SendJson(*buffer_, true);
 }
 
 } /* namespace apiai */
@@ -17,16 +17,23 @@
 #define RESPONSEJSONWRITER_H_
 
 #include "Response.h"
-#include <sstream>
+#include "RequestTrace.h"
+#include <ostream>
+#include <string>
 
 namespace apiai {
 
 /**
- * Writes recognition data to output stream as JSON serialized objects
+ * Writes recognition data to output stream as JSON serialized objects.
+ * Messages are serialized into a single reusable buffer, which may be
+ * shared by subsequent writers of the same worker, so that no heap
+ * allocation is made once the buffer has grown to the usual message size.
  */
 class ResponseJsonWriter : public Response {
 public:
-	ResponseJsonWriter(std::ostream *osb) : out_(osb) {}
+	/** Buffer is used for serialization if given, otherwise writer has its own one */
+	ResponseJsonWriter(std::ostream *osb, std::string *buffer = NULL)
+		: out_(osb), trace_(NULL), load_level_(0), buffer_(buffer != NULL ? buffer : &own_buffer_) {}
 	virtual ~ResponseJsonWriter() {};
 
 	virtual const std::string &GetContentType() { return MIME_APPLICATION_JAVA; }
@@ -34,14 +41,30 @@ public:
 	virtual void SetResult(std::vector<RecognitionResult> &data, int timeMarkMs);
 	virtual void SetResult(std::vector<RecognitionResult> &data, const std::string &interrupted, int timeMarkMs);
 	virtual void SetIntermediateResult(RecognitionResult &decodedData, int timeMarkMs);
+	virtual void SetIntermediateDelta(RecognitionResult &decodedData, int keepWords, int finalWords, int timeMarkMs);
 	virtual void SetError(const std::string &message);
+	virtual void SetLoadLevel(int level) { load_level_ = level; }
+
+	/** Add stage timing summary of given trace to final result, NULL to disable */
+	void Timing(const RequestTrace *trace) { trace_ = trace; }
+
+	/** Append string as JSON string literal contents */
+	static void AppendEscaped(const std::string &value, std::string *out);
 protected:
 	std::ostream *out() { return out_; }
 
-	virtual void SendJson(std::string json, bool final);
+	/** Write serialized message to output stream and flush it */
+	virtual void SendJson(const std::string &json, bool final);
 private:
-	void Write(std::ostringstream &outss, RecognitionResult &data);
+	void Write(RecognitionResult &data);
+	void WriteTiming();
+	void AppendNumber(const char *format, double value);
+
 	std::ostream *out_;
+	const RequestTrace *trace_;
+	int load_level_;
+	std::string own_buffer_;
+	std::string *buffer_;
 
 	static const std::string MIME_APPLICATION_JAVA;
 };
@@ -0,0 +1,103 @@
+// ResponseJsonWriterTests.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ResponseJsonWriter.h"
+#include "ResponseMultipartJsonWriter.h"
+#include "base/kaldi-common.h"
+#include <sstream>
+
+namespace apiai {
+
+	static std::string Escape(const std::string &value) {
+		std::string out;
+		ResponseJsonWriter::AppendEscaped(value, &out);
+		return out;
+	}
+
+	void TestEscaping() {
+		KALDI_ASSERT(Escape("") == "");
+		KALDI_ASSERT(Escape("hello world") == "hello world");
+		KALDI_ASSERT(Escape("say \"hi\"") == "say \\\"hi\\\"");
+		KALDI_ASSERT(Escape("a\\b") == "a\\\\b");
+		KALDI_ASSERT(Escape("\n\r\t") == "\\n\\r\\t");
+		KALDI_ASSERT(Escape(std::string("\x01z\x1f", 3)) == "\\u0001z\\u001f");
+		KALDI_ASSERT(Escape("\xd0\xbf\xd1\x80\xd0\xb8") == "\xd0\xbf\xd1\x80\xd0\xb8");
+	}
+
+	void TestResult() {
+		std::ostringstream out;
+		ResponseJsonWriter writer(&out);
+
+		std::vector<RecognitionResult> results(2);
+		results[0].confidence = 0.5;
+		results[0].text = "it's \"quoted\"";
+		results[1].confidence = 1;
+		results[1].text = "";
+		writer.SetResult(results, Response::INTERRUPTED_END_OF_SPEECH, 1200);
+
+		KALDI_ASSERT(out.str() == "{\"status\":\"ok\",\"data\":["
+				"{\"confidence\":0.5,\"text\":\"it's \\\"quoted\\\"\"},"
+				"{\"confidence\":1,\"text\":\"\"}],"
+				"\"interrupted\":\"" + Response::INTERRUPTED_END_OF_SPEECH + "\",\"time\":1200}\n");
+	}
+
+	void TestSharedBuffer() {
+		std::string buffer;
+		std::ostringstream out;
+		{
+			ResponseJsonWriter writer(&out, &buffer);
+			RecognitionResult result;
+			result.confidence = 0.25;
+			result.text = "a long intermediate result text";
+			writer.SetIntermediateResult(result, 100);
+		}
+		const size_t capacity = buffer.capacity();
+		{
+			ResponseJsonWriter writer(&out, &buffer);
+			writer.SetError("Bad \\ request");
+		}
+		KALDI_ASSERT(buffer.capacity() == capacity);
+		KALDI_ASSERT(out.str() == "{\"status\":\"intermediate\",\"data\":["
+				"{\"confidence\":0.25,\"text\":\"a long intermediate result text\"}]}\n"
+				"{\"status\":\"error\",\"data\":[{\"text\":\"Bad \\\\ request\"}]}\n");
+	}
+
+	void TestIntermediateDelta() {
+		std::ostringstream out;
+		ResponseMultipartJsonWriter writer(&out);
+		RecognitionResult result;
+		result.confidence = 0.75;
+		result.text = "WORLD";
+		writer.SetIntermediateDelta(result, 1, 1, 100);
+
+		KALDI_ASSERT(out.str() == "\r\n--ResponseBoundary\r\n"
+				"Content-Disposition: form-data; name=\"partial\"\r\n"
+				"Content-type: application/json\r\n\r\n"
+				"{\"status\":\"intermediate\",\"data\":["
+				"{\"confidence\":0.75,\"keep\":1,\"text\":\"WORLD\",\"final\":1}]}\n"
+				"\r\n--ResponseBoundary\r\n");
+	}
+
+} /* namespace apiai */
+
+int main(int argn, char *argv[]) {
+	using namespace apiai;
+
+	TestEscaping();
+	TestResult();
+	TestSharedBuffer();
+	TestIntermediateDelta();
+	return 0;
+}
@@ -23,15 +23,15 @@ ResponseMultipartJsonWriter::~ResponseMultipartJsonWriter() {
 
 }
 
-ResponseMultipartJsonWriter::ResponseMultipartJsonWriter(std::ostream *osb)
-	: ResponseJsonWriter(osb)
+ResponseMultipartJsonWriter::ResponseMultipartJsonWriter(std::ostream *osb, std::string *buffer)
+	: ResponseJsonWriter(osb, buffer)
 {
 	boundary_token_ = "ResponseBoundary";
 	content_type_ = MIME_MULTIPART + ";boundary=" + boundary_token_;
 	data_sent_ = false;
 }
 
-void ResponseMultipartJsonWriter::SendJson(std::string json, bool final) {
+void ResponseMultipartJsonWriter::SendJson(const std::string &json, bool final) {
 	if (! data_sent_) {
 		*out() << "\r\n--" << boundary_token_ << "\r\n";
 		data_sent_ = true;
@@ -43,7 +43,8 @@ void ResponseMultipartJsonWriter::SendJson(std::string json, bool final) {
 		<< "Content-type: " << ResponseJsonWriter::GetContentType() << "\r\n"
 		<< "\r\n";
 
-	ResponseJsonWriter::SendJson(json, final);
+	out()->write(json.data(), json.size());
+	out()->put('\n');
 
 	*out() << "\r\n"
 		<< "--" << boundary_token_
@@ -22,12 +22,12 @@ namespace apiai {
 
 class ResponseMultipartJsonWriter: public ResponseJsonWriter {
 public:
-	ResponseMultipartJsonWriter(std::ostream *osb);
+	ResponseMultipartJsonWriter(std::ostream *osb, std::string *buffer = NULL);
 	virtual ~ResponseMultipartJsonWriter();
 
 	virtual const std::string &GetContentType() { return content_type_; }
 protected:
-	virtual void SendJson(std::string json, bool final);
+	virtual void SendJson(const std::string &json, bool final);
 private:
 	std::string boundary_token_;
 	std::string content_type_;
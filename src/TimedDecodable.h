@@ -0,0 +1,66 @@
+// TimedDecodable.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_TIMEDDECODABLE_H_
+#define APIAI_DECODER_TIMEDDECODABLE_H_
+
+#include "RequestTrace.h"
+#include "itf/decodable-itf.h"
+
+namespace apiai {
+
+/**
+ * Measures nnet computation time of wrapped decodable.
+ * Nnet output is computed lazily on the first access to a frame,
+ * so only the first likelihood request of every frame is timed.
+ */
+class TimedDecodable : public kaldi::DecodableInterface {
+public:
+	TimedDecodable(kaldi::DecodableInterface *decodable, RequestTrace *trace)
+		: decodable_(decodable), trace_(trace), last_frame_(-1), elapsed_(0) {};
+
+	virtual kaldi::BaseFloat LogLikelihood(kaldi::int32 frame, kaldi::int32 index) {
+		if (frame == last_frame_) {
+			return decodable_->LogLikelihood(frame, index);
+		}
+		last_frame_ = frame;
+		nanoseconds_t start = getMonotonicNanoseconds();
+		kaldi::BaseFloat result = decodable_->LogLikelihood(frame, index);
+		nanoseconds_t end = getMonotonicNanoseconds();
+		elapsed_ += end - start;
+		// Frames served from already computed chunk are not worth a span
+		if (end - start >= MIN_SPAN_NS) {
+			trace_->Add(RequestTrace::STAGE_NNET, start, end);
+		}
+		return result;
+	}
+	virtual bool IsLastFrame(kaldi::int32 frame) const { return decodable_->IsLastFrame(frame); }
+	virtual kaldi::int32 NumFramesReady() const { return decodable_->NumFramesReady(); }
+	virtual kaldi::int32 NumIndices() const { return decodable_->NumIndices(); }
+
+	/** Get total time of nnet computation in nanoseconds */
+	nanoseconds_t Elapsed() const { return elapsed_; }
+private:
+	static const nanoseconds_t MIN_SPAN_NS = 20000;
+
+	kaldi::DecodableInterface *decodable_;
+	RequestTrace *trace_;
+	kaldi::int32 last_frame_;
+	nanoseconds_t elapsed_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_TIMEDDECODABLE_H_ */
@@ -14,6 +14,7 @@
 // limitations under the License.
 
 #include "Timing.h"
+#include <time.h>
 
 namespace apiai {
 
@@ -38,5 +39,14 @@ milliseconds_t getMillisecondsSince(milliseconds_t since) {
 	return getMillisecondsSince(since, 0);
 }
 
+nanoseconds_t getMonotonicNanoseconds() {
+	struct timespec ts;
+	if (!clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		return nanoseconds_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+	} else {
+		return 0;
+	}
+}
+
 
 } /* namespace apiai */
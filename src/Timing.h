@@ -21,6 +21,7 @@
 namespace apiai {
 
 typedef long int milliseconds_t;
+typedef long long int nanoseconds_t;
 
 /**
  * Get current time of specified time zone in milliseconds
@@ -42,6 +43,11 @@ milliseconds_t getMilliseconds();
  */
 milliseconds_t getMillisecondsSince(milliseconds_t since);
 
+/**
+ * Get monotonic clock time in nanoseconds, suitable for intervals measurement only
+ */
+nanoseconds_t getMonotonicNanoseconds();
+
 } /* namespace apiai */
 
 
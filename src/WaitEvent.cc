@@ -0,0 +1,74 @@
+// WaitEvent.cc
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "WaitEvent.h"
+
+namespace apiai {
+
+static thread_local Coroutine *current_coroutine = NULL;
+
+Coroutine *Coroutine::Current() {
+	return current_coroutine;
+}
+
+void Coroutine::SetCurrent(Coroutine *coroutine) {
+	current_coroutine = coroutine;
+}
+
+WaitEvent::WaitEvent() : signaled_(false), suspended_(NULL) {
+	pthread_mutex_init(&mutex_, NULL);
+	pthread_cond_init(&cond_, NULL);
+}
+
+WaitEvent::~WaitEvent() {
+	pthread_cond_destroy(&cond_);
+	pthread_mutex_destroy(&mutex_);
+}
+
+void WaitEvent::Wait() {
+	Coroutine *coroutine = Coroutine::Current();
+	pthread_mutex_lock(&mutex_);
+	if (coroutine == NULL) {
+		while (!signaled_) {
+			pthread_cond_wait(&cond_, &mutex_);
+		}
+		pthread_mutex_unlock(&mutex_);
+		return;
+	}
+	if (signaled_) {
+		pthread_mutex_unlock(&mutex_);
+		return;
+	}
+	suspended_ = coroutine;
+	pthread_mutex_unlock(&mutex_);
+	// Coroutine is resumed by its own worker thread, which is released only
+	// by this call, so resumption scheduled before the switch is not lost
+	coroutine->Suspend();
+}
+
+void WaitEvent::Signal() {
+	pthread_mutex_lock(&mutex_);
+	signaled_ = true;
+	Coroutine *suspended = suspended_;
+	suspended_ = NULL;
+	pthread_cond_broadcast(&cond_);
+	pthread_mutex_unlock(&mutex_);
+
+	if (suspended != NULL) {
+		suspended->Resume();
+	}
+}
+
+} /* namespace apiai */
@@ -0,0 +1,65 @@
+// WaitEvent.h
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef APIAI_DECODER_WAITEVENT_H_
+#define APIAI_DECODER_WAITEVENT_H_
+
+#include <pthread.h>
+
+namespace apiai {
+
+/**
+ * Request coroutine which may give its thread to other coroutines while waiting
+ */
+class Coroutine {
+public:
+	virtual ~Coroutine() {};
+
+	/** Switch to the scheduler, returns once Resume() is called */
+	virtual void Suspend() = 0;
+	/** Schedule suspended coroutine to run, may be called from any thread */
+	virtual void Resume() = 0;
+
+	/** Get coroutine running on the calling thread, NULL outside of coroutines */
+	static Coroutine *Current();
+	/** Set coroutine running on the calling thread, called by the scheduler */
+	static void SetCurrent(Coroutine *coroutine);
+};
+
+/**
+ * One-shot event a request waits for. Waiting request coroutine is
+ * suspended, so that other requests of its worker thread keep running,
+ * while waiting outside of coroutines blocks the thread.
+ */
+class WaitEvent {
+public:
+	WaitEvent();
+	virtual ~WaitEvent();
+
+	/** Wait until Signal() is called, returns at once if it has been called already */
+	void Wait();
+	/** Wake the waiter, may be called from any thread */
+	void Signal();
+private:
+	pthread_mutex_t mutex_;
+	pthread_cond_t cond_;
+	bool signaled_;
+	/** Suspended waiter, NULL if waiter blocks its thread or doesn't wait yet */
+	Coroutine *suspended_;
+};
+
+} /* namespace apiai */
+
+#endif /* APIAI_DECODER_WAITEVENT_H_ */